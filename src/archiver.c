@@ -29,6 +29,7 @@
 #include <fcntl.h>
 #include <libgen.h>
 #include <limits.h>
+#include <poll.h>
 #include <spawn.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
@@ -40,9 +41,11 @@
 #include "data_structures/hash_map.h"
 #include "data_structures/linked_list.h"
 #include "data_structures/string_list.h"
+#include "data_structures/btree.h"
 #include "data_structures/priority_heap.h"
 #include "helpers.h"
 #include "parser.h"
+#include "platforms.h"
 #include "users.h"
 
 #define FILE_COUNTS_OUTPUT_FORMAT_STR_0 \
@@ -51,14 +54,31 @@
   "[%%%" PRIu64 "zu/%%%" PRIu64 PRIu64 "]\n"
 
 #define SD_SA_32KiB (32 * 1024)
-#define SD_SA_V7_HOLD_SIZE (SD_SA_32KiB * 4)
-#define SD_SA_V7_2ND_OFFSET (SD_SA_32KiB * 2)
+// Space before the data of a chunked-encoding frame (file format 7) for its
+// base10 size and newline ("32768\n" for a full frame).
+#define SD_SA_V7_HEADER_SPACE 6
 
 // Must not be smaller than 32KiB.
 #define SIMPLE_ARCHIVER_BUFFER_SIZE SD_SA_32KiB
 
 #define SIMPLE_ARCHIVER_PROGRESS_INTERVAL 5
 
+// Bloom filter of a chunk's paths (file format 10).
+#define SD_SA_BLOOM_BITS_PER_PATH 10
+#define SD_SA_BLOOM_HASHES 7
+#define SD_SA_BLOOM_MAX_SIZE (1024 * 1024)
+
+// Content-defined slices of "--rsyncable" are at least a quarter of this,
+// average about this plus that minimum, and are at most 8 times this. Small
+// slices keep a change from rewriting much compressed data around it.
+#define SD_SA_RSYNCABLE_AVERAGE (512 * 1024)
+
+// Size of the blocks compared by "--extract-in-place-delta".
+#define SD_SA_IN_PLACE_BLOCK_SIZE (SD_SA_32KiB * 2)
+
+// How often "--pressure-limit" reads the pressure stall information.
+#define SD_SA_PRESSURE_INTERVAL_NS 2000000000
+
 volatile int is_sig_pipe_occurred = 0;
 volatile int is_sig_int_occurred = 0;
 
@@ -91,9 +111,12 @@ typedef struct SDArchiverInternalFileInfo {
   uint32_t gid;
   uint8_t bit_flags[4];
   /// xxxx xxx1 - is invalid.
-  /// xxxx xx1x - white/black-list allowed.
+  /// xxxx xx1x - white/black-list (and size/owner filter) allowed.
   /// xxxx x1xx - arg allowed.
   int_fast8_t other_flags;
+  /// The file's data read during the walk ("file_size" bytes), otherwise
+  /// NULL. Not owned.
+  const char *data;
 } SDArchiverInternalFileInfo;
 
 typedef struct SDArchiverInternalDirInfo {
@@ -101,6 +124,14 @@ typedef struct SDArchiverInternalDirInfo {
   mode_t permissions;
 } SDArchiverInternalDirInfo;
 
+/// Totals of the regular files within a dir and its subdirs (file format 11).
+typedef struct SDArchiverInternalDirSummary {
+  char *path;
+  uint64_t file_count;
+  uint64_t total_size;
+  uint64_t max_size;
+} SDArchiverInternalDirSummary;
+
 typedef struct SDArchiverDecompInfo {
   char *out_filename;
   char *read_buf;
@@ -108,7 +139,7 @@ typedef struct SDArchiverDecompInfo {
   uint64_t file_size;
   int *to_dec_pipe;
   uint64_t *chunk_remaining;
-  FILE *in_f;
+  SDArchiverIOStream *in_f;
   char *hold_buf;
   ssize_t *has_hold;
   int_fast8_t *v5_to_skip;
@@ -116,8 +147,209 @@ typedef struct SDArchiverDecompInfo {
   int in_pipe;
   uint32_t write_version;
   uint32_t size_from_base10;
+  /// If non-NULL, time spent opening "out_filename" is added to it.
+  uint64_t *open_ns;
+  /// If non-NULL, time spent waiting on the decompressor is added to it.
+  uint64_t *wait_ns;
+  /// If non-NULL, written to instead of opening "out_filename".
+  FILE *out_f;
+  /// Offset in "hold_buf" of the "*has_hold" bytes (file format 7).
+  size_t hold_offset;
+  /// If not -1, "out_filename" is opened beneath this dir fd (see
+  /// "simple_archiver_helper_open_beneath").
+  int out_dir_fd;
 } SDArchiverDecompInfo;
 
+/// A file being rewritten in place by "--extract-in-place-delta".
+typedef struct SDArchiverInternalInPlace {
+  int fd;
+  SDArchiverIO *io;
+  FILE *f;
+  int_fast8_t needs_fclose;
+} SDArchiverInternalInPlace;
+
+typedef struct SDArchiverInternalSlowFile {
+  char *filename;
+  uint64_t size;
+  uint64_t open_ns;
+  uint64_t io_ns;
+  uint64_t wait_ns;
+} SDArchiverInternalSlowFile;
+
+typedef struct SDArchiverInternalDirTimes {
+  /// Not owned, points to the key in "dirs".
+  const char *dir;
+  uint64_t files;
+  uint64_t size;
+  uint64_t open_ns;
+  uint64_t io_ns;
+  uint64_t wait_ns;
+} SDArchiverInternalDirTimes;
+
+/// Per-file timings of creating/extracting, stored in the write/parse state
+/// under SDA_PSTATE_FILE_TIMES_KEY.
+typedef struct SDArchiverInternalFileTimes {
+  /// Holds the "max" slowest SDArchiverInternalSlowFile, fastest on top.
+  SDArchiverPHeap *slowest;
+  /// Key is a top-level directory, value is a SDArchiverInternalDirTimes.
+  SDArchiverHashMap *dirs;
+  uint32_t max;
+} SDArchiverInternalFileTimes;
+
+/// Timings of the file currently being archived/extracted.
+typedef struct SDArchiverInternalFileTimer {
+  uint64_t start;
+  uint64_t open_ns;
+  uint64_t wait_ns;
+} SDArchiverInternalFileTimer;
+
+/// A change of how many slice compressors may run ("--pressure-limit").
+typedef struct SDArchiverInternalPressureChange {
+  /// Milliseconds since the start of archiving.
+  uint64_t ms;
+  /// Highest "some avg10" stall of cpu, io, and memory in hundredths of a
+  /// percent.
+  uint32_t stall;
+  uint32_t from_jobs;
+  uint32_t to_jobs;
+  /// Is "cpu quota", "pressure", or "idle".
+  const char *reason;
+} SDArchiverInternalPressureChange;
+
+/// How many slice compressors may run, adapted to the Linux pressure stall
+/// information and the cgroup CPU quota, stored in the write state under
+/// SDA_PSTATE_PRESSURE_KEY.
+typedef struct SDArchiverInternalPressure {
+  uint64_t start_ns;
+  uint64_t next_check_ns;
+  /// Is "compress_jobs", or less if the cgroup CPU quota allows fewer.
+  uint32_t max_jobs;
+  uint32_t jobs;
+  /// Holds SDArchiverInternalPressureChange in order.
+  SDArchiverLinkedList *changes;
+} SDArchiverInternalPressure;
+
+typedef struct SDArchiverInternalWriterEntry {
+  char *path;
+  char *username;
+  char *groupname;
+  /// Is NULL if not a symbolic link.
+  char *link_target;
+  /// Is NULL if not a file added from a buffer.
+  const char *buf;
+  /// Is NULL if not a file added with a read fn.
+  SDArchiverWriterReadFn read_fn;
+  void *read_ud;
+  uint64_t size;
+  uint32_t uid;
+  uint32_t gid;
+  uint_fast16_t permissions;
+} SDArchiverInternalWriterEntry;
+
+struct SDArchiverWriter {
+  SDArchiverIOStream *out_f;
+  const SDArchiverState *state;
+  /// Each value is a SDArchiverInternalWriterEntry.
+  SDArchiverLinkedList *dirs;
+  SDArchiverLinkedList *symlinks;
+  SDArchiverLinkedList *files;
+  /// Every added path, used to reject duplicates.
+  SDArchiverHashMap *paths;
+  /// Parent dir of every added path, used to mark non-empty dirs.
+  SDArchiverHashMap *parent_dirs;
+  int_fast8_t is_finished;
+};
+
+typedef struct SDArchiverInternalDeltaRefChunk {
+  /// Keys are the chunk's stored filenames (including the NULL), values are
+  /// unused.
+  SDArchiverHashMap *filenames;
+  /// Offset of the chunk's data in the reference archive.
+  long data_pos;
+  int_fast8_t is_compressed;
+  /// A chunk that is delta compressed itself cannot be used as a reference.
+  int_fast8_t is_delta;
+} SDArchiverInternalDeltaRefChunk;
+
+/// Index of the chunks of an archive given with "--delta-from".
+typedef struct SDArchiverInternalDeltaRef {
+  /// Read through "in_f".
+  FILE *f;
+  SDArchiverIOStream *in_f;
+  uint16_t version;
+  char *decompressor;
+  SDArchiverInternalDeltaRefChunk *chunks;
+  uint64_t chunk_count;
+} SDArchiverInternalDeltaRef;
+
+/// A compressor working on one slice of a chunk ("--compress-jobs").
+typedef struct SDArchiverInternalSliceJob {
+  FILE *in_f;
+  FILE *out_f;
+  pid_t pid;
+} SDArchiverInternalSliceJob;
+
+/// Client of a GNU make jobserver ("--make-jobserver").
+typedef struct SDArchiverInternalJobserver {
+  /// Is -1 if not connected to a jobserver.
+  int read_fd;
+  int write_fd;
+  /// Is non-zero if "read_fd" is a non-blocking open file description of our
+  /// own, which must be closed ("write_fd" may be the same fd).
+  int_fast8_t owns_read_fd;
+  /// Tokens read from the jobserver, written back as-is when released.
+  char *tokens;
+  uint32_t held;
+} SDArchiverInternalJobserver;
+
+/// Ring buffer of slice compressors in order of the slices.
+typedef struct SDArchiverInternalSliceJobs {
+  SDArchiverInternalSliceJob *jobs;
+  uint32_t size;
+  /// Index of the oldest running job.
+  uint32_t head;
+  uint32_t running;
+  /// Every running job after the first holds one of its tokens.
+  SDArchiverInternalJobserver jobserver;
+} SDArchiverInternalSliceJobs;
+
+/// Uncompressed data of one reference chunk in a temporary file.
+typedef struct SDArchiverInternalDeltaRefData {
+  char *path;
+  int fd;
+  uint64_t size;
+  uint64_t hash;
+} SDArchiverInternalDeltaRefData;
+
+/// Owner of files in the owner table of a chunk in file format 9.
+typedef struct SDArchiverInternalColumnOwner {
+  uint32_t uid;
+  uint32_t gid;
+  /// May be NULL. Points into "data" of SDArchiverInternalColumns.
+  const char *username;
+  /// May be NULL. Points into "data" of SDArchiverInternalColumns.
+  const char *groupname;
+} SDArchiverInternalColumnOwner;
+
+/// The files' metadata of a chunk in file format 9, which is stored as
+/// columns. The integer columns are in host byte order.
+typedef struct SDArchiverInternalColumns {
+  /// Holds the columns as read from the archive.
+  uint8_t *data;
+  uint64_t count;
+  uint64_t *sizes;
+  /// 4 bytes of bit-flags per file.
+  const uint8_t *bit_flags;
+  uint32_t *owner_idxs;
+  uint32_t *name_offsets;
+  SDArchiverInternalColumnOwner *owners;
+  uint32_t owner_count;
+  /// NULL-terminated filenames.
+  const char *names;
+  /// Non-zero for each file passing the size/owner filters.
+  uint8_t *matches;
+} SDArchiverInternalColumns;
+
 void internal_cleanup_dirinfo_fn(void *data) {
   SDArchiverInternalDirInfo *dinfo = data;
   if (dinfo) {
@@ -146,7 +378,7 @@ void free_internal_to_write(void *data) {
 
 int write_list_datas_fn(void *data, void *ud) {
   SDArchiverInternalToWrite *to_write = data;
-  FILE *out_f = ud;
+  SDArchiverIOStream *out_f = ud;
 
   // Handling in case of 32-bit system, but this function probably will never
   // have to write more than 0x7FFFFFFF bytes (2^31 - 1).
@@ -156,11 +388,11 @@ int write_list_datas_fn(void *data, void *ud) {
   char *buf_ptr = to_write->buf;
   while (temp > 0) {
     if (sizeof(uintptr_t) == 4 && temp > 0x7FFFFFFF) {
-      fwrite(buf_ptr, 1, 0x7FFFFFFF, out_f);
+      simple_archiver_io_write(buf_ptr, 1, 0x7FFFFFFF, out_f);
       temp -= 0x7FFFFFFF;
       buf_ptr += 0x7FFFFFFF;
     } else {
-      fwrite(buf_ptr, 1, (size_t)temp, out_f);
+      simple_archiver_io_write(buf_ptr, 1, (size_t)temp, out_f);
       temp = 0;
     }
   }
@@ -589,9 +821,12 @@ int write_files_fn_file_v0(void *data, void *ud) {
       do {
         write_count = fread(write_buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE, tmp_fd);
         if (write_count == SIMPLE_ARCHIVER_BUFFER_SIZE) {
-          fwrite(write_buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE, state->out_f);
+          simple_archiver_io_write(write_buf,
+                                   1,
+                                   SIMPLE_ARCHIVER_BUFFER_SIZE,
+                                   state->out_f);
         } else if (write_count > 0) {
-          fwrite(write_buf, 1, write_count, state->out_f);
+          simple_archiver_io_write(write_buf, 1, write_count, state->out_f);
         }
         if (feof(tmp_fd)) {
           break;
@@ -757,9 +992,12 @@ int write_files_fn_file_v0(void *data, void *ud) {
       do {
         ret = fread(buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE, fd);
         if (ret == SIMPLE_ARCHIVER_BUFFER_SIZE) {
-          fwrite(buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE, state->out_f);
+          simple_archiver_io_write(buf,
+                                   1,
+                                   SIMPLE_ARCHIVER_BUFFER_SIZE,
+                                   state->out_f);
         } else if (ret > 0) {
-          fwrite(buf, 1, ret, state->out_f);
+          simple_archiver_io_write(buf, 1, ret, state->out_f);
         }
         if (feof(fd)) {
           break;
@@ -1202,7 +1440,7 @@ int working_files_to_abs_map_fn(
   return filenames_to_abs_map_fn((void*)val, ud);
 }
 
-SDArchiverStateReturns read_buf_full_from_fd(FILE *fd,
+SDArchiverStateReturns read_buf_full_from_fd(SDArchiverIOStream *fd,
                                              char *read_buf,
                                              const size_t read_buf_size,
                                              const uint64_t amount_total,
@@ -1210,7 +1448,7 @@ SDArchiverStateReturns read_buf_full_from_fd(FILE *fd,
                                              int_fast8_t *v5_to_skip) {
   if (v5_to_skip && *v5_to_skip) {
     char buf[2];
-    if (fread(buf, 1, 2, fd) != 2) {
+    if (simple_archiver_io_read(buf, 1, 2, fd) != 2) {
       return SDAS_INVALID_FILE;
     }
     *v5_to_skip = 0;
@@ -1218,7 +1456,8 @@ SDArchiverStateReturns read_buf_full_from_fd(FILE *fd,
   uint64_t amount = amount_total;
   while (amount != 0) {
     if (amount >= (uint64_t)read_buf_size) {
-      if (fread(read_buf, 1, read_buf_size, fd) != read_buf_size) {
+      if (simple_archiver_io_read(read_buf, 1, read_buf_size, fd)
+          != read_buf_size) {
         return SDAS_INVALID_FILE;
       }
       if (dst_buf) {
@@ -1227,7 +1466,8 @@ SDArchiverStateReturns read_buf_full_from_fd(FILE *fd,
       }
       amount -= (uint64_t)read_buf_size;
     } else {
-      if (fread(read_buf, 1, (size_t)amount, fd) != (size_t)amount) {
+      if (simple_archiver_io_read(read_buf, 1, (size_t)amount, fd)
+          != (size_t)amount) {
         return SDAS_INVALID_FILE;
       }
       if (dst_buf) {
@@ -1241,7 +1481,274 @@ SDArchiverStateReturns read_buf_full_from_fd(FILE *fd,
   return SDAS_SUCCESS;
 }
 
-SDArchiverStateReturns read_fd_to_out_fd(FILE *in_fd,
+/// Sleeps for "nonblock_sleep", adding the time slept to "wait_ns" if it is
+/// non-NULL.
+void simple_archiver_internal_nonblock_sleep(uint64_t *wait_ns) {
+  if (wait_ns) {
+    const uint64_t start = simple_archiver_helper_monotonic_ns();
+    nanosleep(&nonblock_sleep, NULL);
+    *wait_ns += simple_archiver_helper_monotonic_ns() - start;
+  } else {
+    nanosleep(&nonblock_sleep, NULL);
+  }
+}
+
+void simple_archiver_internal_free_slow_file(void *data) {
+  SDArchiverInternalSlowFile *slow_file = data;
+  if (slow_file) {
+    free(slow_file->filename);
+    free(slow_file);
+  }
+}
+
+void simple_archiver_internal_free_file_times(void *data) {
+  SDArchiverInternalFileTimes *times = data;
+  if (times) {
+    simple_archiver_priority_heap_free(&times->slowest);
+    simple_archiver_hash_map_free(&times->dirs);
+    free(times);
+  }
+}
+
+void simple_archiver_internal_free_pressure(void *data) {
+  SDArchiverInternalPressure *pressure = data;
+  if (pressure) {
+    simple_archiver_list_free(&pressure->changes);
+    free(pressure);
+  }
+}
+
+void simple_archiver_internal_pressure_add_change(
+    SDArchiverInternalPressure *pressure,
+    uint32_t stall,
+    uint32_t to_jobs,
+    const char *reason) {
+  SDArchiverInternalPressureChange *change =
+    malloc(sizeof(SDArchiverInternalPressureChange));
+  change->ms =
+    (simple_archiver_helper_monotonic_ns() - pressure->start_ns) / 1000000;
+  change->stall = stall;
+  change->from_jobs = pressure->jobs;
+  change->to_jobs = to_jobs;
+  change->reason = reason;
+  simple_archiver_list_add(pressure->changes, change, NULL);
+  pressure->jobs = to_jobs;
+}
+
+/// Returns NULL if "--pressure-limit" is not used. Returned pointer is owned
+/// by "state_map".
+SDArchiverInternalPressure *simple_archiver_internal_pressure_get(
+    SDArchiverHashMap *state_map,
+    const SDArchiverParsed *parsed) {
+  if (!state_map || !parsed || parsed->pressure_limit == 0) {
+    return NULL;
+  }
+  SDArchiverInternalPressure *pressure =
+    simple_archiver_hash_map_get(state_map,
+                                 SDA_PSTATE_PRESSURE_KEY,
+                                 SDA_PSTATE_PRESSURE_KEY_SIZE);
+  if (pressure) {
+    return pressure;
+  }
+
+  pressure = malloc(sizeof(SDArchiverInternalPressure));
+  pressure->start_ns = simple_archiver_helper_monotonic_ns();
+  pressure->next_check_ns = 0;
+  pressure->max_jobs = parsed->compress_jobs;
+  pressure->jobs = parsed->compress_jobs;
+  pressure->changes = simple_archiver_list_init();
+  simple_archiver_hash_map_insert(
+    state_map,
+    pressure,
+    SDA_PSTATE_PRESSURE_KEY,
+    SDA_PSTATE_PRESSURE_KEY_SIZE,
+    simple_archiver_internal_free_pressure,
+    simple_archiver_helper_datastructure_cleanup_nop);
+
+  const uint32_t cpus =
+    simple_archiver_helper_cgroup_cpu_limit("/sys/fs/cgroup",
+                                            "/proc/self/cgroup");
+  if (cpus != 0 && cpus < pressure->max_jobs) {
+    simple_archiver_internal_pressure_add_change(pressure, 0, cpus,
+                                                 "cpu quota");
+    pressure->max_jobs = cpus;
+  }
+
+  uint32_t stall;
+  if (simple_archiver_helper_read_pressure("/proc/pressure/cpu", &stall)) {
+    fprintf(stderr,
+            "WARNING: No pressure stall information in /proc/pressure, "
+            "\"--pressure-limit\" only applies the cgroup CPU quota!\n");
+  }
+  return pressure;
+}
+
+/// Returns how many slice compressors may run, after reading the pressure
+/// stall information if SD_SA_PRESSURE_INTERVAL_NS passed since the last read.
+/// Halves them while the stall is above "--pressure-limit", and adds one while
+/// it is below half of it.
+uint32_t simple_archiver_internal_pressure_jobs(
+    SDArchiverInternalPressure *pressure,
+    const SDArchiverParsed *parsed) {
+  const uint64_t now = simple_archiver_helper_monotonic_ns();
+  if (now < pressure->next_check_ns) {
+    return pressure->jobs;
+  }
+  pressure->next_check_ns = now + SD_SA_PRESSURE_INTERVAL_NS;
+
+  const char *paths[3] = {"/proc/pressure/cpu",
+                          "/proc/pressure/io",
+                          "/proc/pressure/memory"};
+  uint32_t stall = 0;
+  int_fast8_t is_read = 0;
+  for (uint32_t idx = 0; idx < 3; ++idx) {
+    uint32_t path_stall;
+    if (simple_archiver_helper_read_pressure(paths[idx], &path_stall) == 0) {
+      is_read = 1;
+      if (path_stall > stall) {
+        stall = path_stall;
+      }
+    }
+  }
+  if (!is_read) {
+    return pressure->jobs;
+  }
+
+  const uint32_t limit = parsed->pressure_limit * 100;
+  if (stall > limit && pressure->jobs > 1) {
+    simple_archiver_internal_pressure_add_change(
+      pressure, stall, pressure->jobs / 2, "pressure");
+  } else if (stall < limit / 2 && pressure->jobs < pressure->max_jobs) {
+    simple_archiver_internal_pressure_add_change(
+      pressure, stall, pressure->jobs + 1, "idle");
+  }
+  return pressure->jobs;
+}
+
+/// Returns NULL if the slow-file report is disabled. Returned pointer is owned
+/// by "state_map".
+SDArchiverInternalFileTimes *simple_archiver_internal_file_times_get(
+    SDArchiverHashMap *state_map,
+    const SDArchiverParsed *parsed) {
+  if (!state_map || !parsed || parsed->slow_files == 0) {
+    return NULL;
+  }
+  SDArchiverInternalFileTimes *times =
+    simple_archiver_hash_map_get(state_map,
+                                 SDA_PSTATE_FILE_TIMES_KEY,
+                                 SDA_PSTATE_FILE_TIMES_KEY_SIZE);
+  if (times) {
+    return times;
+  }
+
+  times = malloc(sizeof(SDArchiverInternalFileTimes));
+  times->slowest = simple_archiver_priority_heap_init();
+  times->dirs = simple_archiver_hash_map_init();
+  times->max = parsed->slow_files;
+  simple_archiver_hash_map_insert(
+    state_map,
+    times,
+    SDA_PSTATE_FILE_TIMES_KEY,
+    SDA_PSTATE_FILE_TIMES_KEY_SIZE,
+    simple_archiver_internal_free_file_times,
+    simple_archiver_helper_datastructure_cleanup_nop);
+  return times;
+}
+
+void simple_archiver_internal_file_timer_start(
+    const SDArchiverInternalFileTimes *times,
+    SDArchiverInternalFileTimer *timer) {
+  if (times) {
+    timer->start = simple_archiver_helper_monotonic_ns();
+    timer->open_ns = 0;
+    timer->wait_ns = 0;
+  }
+}
+
+/// Call right after the file was opened.
+void simple_archiver_internal_file_timer_opened(
+    const SDArchiverInternalFileTimes *times,
+    SDArchiverInternalFileTimer *timer) {
+  if (times) {
+    timer->open_ns = simple_archiver_helper_monotonic_ns() - timer->start;
+  }
+}
+
+/// Records the file, all time since "start" not spent opening or waiting is
+/// counted as read/write time.
+void simple_archiver_internal_file_timer_done(
+    SDArchiverInternalFileTimes *times,
+    const SDArchiverInternalFileTimer *timer,
+    const char *filename,
+    uint64_t size) {
+  if (!times) {
+    return;
+  }
+  const uint64_t total_ns =
+    simple_archiver_helper_monotonic_ns() - timer->start;
+  const uint64_t other_ns = timer->open_ns + timer->wait_ns;
+  const uint64_t io_ns = total_ns > other_ns ? total_ns - other_ns : 0;
+
+  // Top-level directory is the first path component, or "." for files
+  // directly in the current directory.
+  const char *dir_start = filename;
+  while (dir_start[0] == '.' && dir_start[1] == '/') {
+    dir_start += 2;
+  }
+  const char *dir_end = strchr(dir_start + (dir_start[0] == '/' ? 1 : 0), '/');
+  const char *dir = dir_end ? dir_start : ".";
+  const size_t dir_size = dir_end ? (size_t)(dir_end - dir_start) : 1;
+  SDArchiverInternalDirTimes *dir_times =
+    simple_archiver_hash_map_get(times->dirs, dir, dir_size);
+  if (!dir_times) {
+    dir_times = malloc(sizeof(SDArchiverInternalDirTimes));
+    dir_times->files = 0;
+    dir_times->size = 0;
+    dir_times->open_ns = 0;
+    dir_times->io_ns = 0;
+    dir_times->wait_ns = 0;
+    char *dir_key = malloc(dir_size + 1);
+    memcpy(dir_key, dir, dir_size);
+    dir_key[dir_size] = 0;
+    dir_times->dir = dir_key;
+    simple_archiver_hash_map_insert(times->dirs,
+                                    dir_times,
+                                    dir_key,
+                                    dir_size,
+                                    NULL,
+                                    NULL);
+  }
+  ++dir_times->files;
+  dir_times->size += size;
+  dir_times->open_ns += timer->open_ns;
+  dir_times->io_ns += io_ns;
+  dir_times->wait_ns += timer->wait_ns;
+
+  const uint64_t file_total_ns = timer->open_ns + io_ns + timer->wait_ns;
+  if (simple_archiver_priority_heap_size(times->slowest) >= times->max) {
+    const SDArchiverInternalSlowFile *fastest =
+      simple_archiver_priority_heap_top(times->slowest);
+    if (fastest->open_ns + fastest->io_ns + fastest->wait_ns
+        >= file_total_ns) {
+      return;
+    }
+    simple_archiver_internal_free_slow_file(
+      simple_archiver_priority_heap_pop(times->slowest));
+  }
+  SDArchiverInternalSlowFile *slow_file =
+    malloc(sizeof(SDArchiverInternalSlowFile));
+  slow_file->filename = strdup(filename);
+  slow_file->size = size;
+  slow_file->open_ns = timer->open_ns;
+  slow_file->io_ns = io_ns;
+  slow_file->wait_ns = timer->wait_ns;
+  simple_archiver_priority_heap_insert(times->slowest,
+                                       (int64_t)file_total_ns,
+                                       slow_file,
+                                       simple_archiver_internal_free_slow_file);
+}
+
+SDArchiverStateReturns read_fd_to_out_fd(SDArchiverIOStream *in_fd,
                                          FILE *out_fd,
                                          char *read_buf,
                                          const size_t read_buf_size,
@@ -1249,7 +1756,7 @@ SDArchiverStateReturns read_fd_to_out_fd(FILE *in_fd,
                                          int_fast8_t *v5_to_skip) {
   if (v5_to_skip && *v5_to_skip) {
     char buf[2];
-    if (fread(buf, 1, 2, in_fd) != 2) {
+    if (simple_archiver_io_read(buf, 1, 2, in_fd) != 2) {
       return SDAS_INVALID_FILE;
     }
     *v5_to_skip = 0;
@@ -1257,14 +1764,16 @@ SDArchiverStateReturns read_fd_to_out_fd(FILE *in_fd,
   uint64_t amount = amount_total;
   while (amount != 0) {
     if (amount >= (uint64_t)read_buf_size) {
-      if (fread(read_buf, 1, read_buf_size, in_fd) != read_buf_size) {
+      if (simple_archiver_io_read(read_buf, 1, read_buf_size, in_fd)
+          != read_buf_size) {
         return SDAS_INVALID_FILE;
       } else if (fwrite(read_buf, 1, read_buf_size, out_fd) != read_buf_size) {
         return SDAS_FAILED_TO_WRITE;
       }
       amount -= (uint64_t)read_buf_size;
     } else {
-      if (fread(read_buf, 1, (size_t)amount, in_fd) != (size_t)amount) {
+      if (simple_archiver_io_read(read_buf, 1, (size_t)amount, in_fd)
+          != (size_t)amount) {
         return SDAS_INVALID_FILE;
       } else if (fwrite(read_buf,
                         1,
@@ -1279,16 +1788,85 @@ SDArchiverStateReturns read_fd_to_out_fd(FILE *in_fd,
   return SDAS_SUCCESS;
 }
 
+/// Reads the base10 size and newline that begin a chunked-encoding frame
+/// (file format 7), scanning the chars in the buffer of "in_f".
+/// Returns zero on success, 1 on EOF or a read error, 2 on an invalid char, or
+/// 3 on a size larger than 32KiB.
+int simple_archiver_internal_v7_read_frame_size(SDArchiverIOStream *in_f,
+                                                uint32_t *size) {
+  uint32_t value = 0;
+  while (1) {
+    size_t buf_size;
+    const char *buf = simple_archiver_io_peek(in_f, &buf_size);
+    if (buf_size == 0) {
+      *size = value;
+      return 1;
+    }
+    for (size_t idx = 0; idx < buf_size; ++idx) {
+      int ret = -1;
+      if (buf[idx] == '\n') {
+        ret = 0;
+      } else if (buf[idx] < '0' || buf[idx] > '9') {
+        ret = 2;
+      } else {
+        value = value * 10 + (uint32_t)(buf[idx] - '0');
+        if (value > SD_SA_32KiB) {
+          ret = 3;
+        }
+      }
+      if (ret != -1) {
+        simple_archiver_io_consume(in_f, idx + 1);
+        *size = value;
+        return ret;
+      }
+    }
+    // The size continues past the buffer.
+    simple_archiver_io_consume(in_f, buf_size);
+  }
+}
+
+/// Reserves room for a chunked-encoding frame (file format 7) in the buffer of
+/// "out_f", whose data goes at "frame + SD_SA_V7_HEADER_SPACE".
+/// Returns NULL on error.
+char *simple_archiver_internal_v7_reserve_frame(SDArchiverIOStream *out_f) {
+  return simple_archiver_io_reserve(out_f,
+                                    SD_SA_V7_HEADER_SPACE + SD_SA_32KiB);
+}
+
+/// Puts the base10 size and newline before the "size" bytes of data of a
+/// frame given by "simple_archiver_internal_v7_reserve_frame", and commits
+/// it. The data of a frame that is not full is moved up to its shorter size.
+/// "size" must not be larger than 32KiB.
+void simple_archiver_internal_v7_commit_frame(SDArchiverIOStream *out_f,
+                                              char *frame,
+                                              size_t size) {
+  char header[SD_SA_V7_HEADER_SPACE];
+  size_t header_idx = SD_SA_V7_HEADER_SPACE - 1;
+  header[header_idx] = '\n';
+  size_t value = size;
+  do {
+    header[--header_idx] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  const size_t header_size = SD_SA_V7_HEADER_SPACE - header_idx;
+  if (header_size != SD_SA_V7_HEADER_SPACE) {
+    memmove(frame + header_size, frame + SD_SA_V7_HEADER_SPACE, size);
+  }
+  memcpy(frame, header + header_idx, header_size);
+  simple_archiver_io_commit(out_f, header_size + size);
+}
+
 SDArchiverStateReturns try_write_to_decomp(SDArchiverDecompInfo *info) {
   if (*info->to_dec_pipe >= 0) {
     if (info->write_version < 7) {
       if (*info->chunk_remaining > 0) {
         if (*info->chunk_remaining > info->read_buf_size) {
           if (*info->has_hold < 0) {
-            size_t fread_ret = fread(info->read_buf,
-                                     1,
-                                     SIMPLE_ARCHIVER_BUFFER_SIZE,
-                                     info->in_f);
+            size_t fread_ret =
+              simple_archiver_io_read(info->read_buf,
+                                      1,
+                                      SIMPLE_ARCHIVER_BUFFER_SIZE,
+                                      info->in_f);
             if (fread_ret == 0) {
               goto TRY_WRITE_TO_DECOMP_END;
             } else {
@@ -1351,11 +1929,13 @@ SDArchiverStateReturns try_write_to_decomp(SDArchiverDecompInfo *info) {
             // compiling for 32-bit systems.
             size_t fread_ret;
             if (sizeof(uintptr_t) == 4 && *info->chunk_remaining > 0x7FFFFFFF) {
-              fread_ret = fread(info->read_buf, 1, 0x7FFFFFFF, info->in_f);
+              fread_ret = simple_archiver_io_read(info->read_buf,
+                                                  1,
+                                                  0x7FFFFFFF,
+                                                  info->in_f);
             } else {
-              fread_ret = fread(info->read_buf,
-                                1,
-                                (size_t)*info->chunk_remaining, info->in_f);
+              fread_ret = simple_archiver_io_read(
+                info->read_buf, 1, (size_t)*info->chunk_remaining, info->in_f);
             }
             if (fread_ret == 0) {
               goto TRY_WRITE_TO_DECOMP_END;
@@ -1415,150 +1995,82 @@ SDArchiverStateReturns try_write_to_decomp(SDArchiverDecompInfo *info) {
         }
       }
     } else {
-      if (*info->has_hold < 0 && info->size_from_base10 == 0) {
-        // chunked-encoding: get the base10 size
-        uint64_t size_from_base10 = 0;
-        char c = 0;
-
-        size_t fread_amt = fread(&c, 1, 1, info->in_f);
-
-        while (c != '\n') {
-          if (fread_amt != 1 || c < '0' || c > '9') {
-            fprintf(stderr, "ERROR: Invalid char for chunked-encoding size!\n");
+      // chunked-encoding: the data of a frame is read into "hold_buf" and
+      // written to the decompressor from there, so a partial write only
+      // moves "hold_offset". Frames are written until the pipe is full.
+      while (1) {
+        if (*info->has_hold > 0) {
+          ssize_t write_ret = write(*info->to_dec_pipe,
+                                    info->hold_buf + info->hold_offset,
+                                    (size_t)*info->has_hold);
+          if (write_ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+              return SDAS_SUCCESS;
+            } else {
+              fprintf(stderr, "ERROR: Failed to write to decomp "
+                              "(has-hold; chunked-encoding; write_ret < 0)\n");
+              return SDAS_CHUNKED_DECOMPRESSION_ERROR;
+            }
+          } else if (write_ret == 0) {
+            fprintf(stderr, "ERROR: Failed to write to decomp "
+                            "(has-hold; chunked-encoding; write_ret == 0)\n");
             return SDAS_CHUNKED_DECOMPRESSION_ERROR;
+          } else if (write_ret < *info->has_hold) {
+            info->hold_offset += (size_t)write_ret;
+            *info->has_hold -= write_ret;
+            return SDAS_SUCCESS;
           }
-          size_from_base10 = size_from_base10 * 10 + (uint64_t)(c - '0');
-          fread_amt = fread(&c, 1, 1, info->in_f);
-        }
-
-        if (size_from_base10 == 0) {
-          // end of chunk
-          *info->chunk_remaining = 0;
           *info->has_hold = -1;
-          goto TRY_WRITE_TO_DECOMP_END;
-        } else if (size_from_base10 > SD_SA_32KiB) {
-          // Invalid chunk size: larger than 32KiB
-          fprintf(stderr,
-                  "ERROR: \"mini-chunk\" (chunked-encoding) size is larger "
-                  "than 32KiB!\n");
-          return SDAS_INVALID_FILE;
-        }
-
-        // Sum to "compressed_size"
-        *info->compressed_size += size_from_base10;
-
-        // get chunked-encoding mini-chunk
-        fread_amt = fread(info->read_buf, 1, size_from_base10, info->in_f);
-
-        if (fread_amt == 0) {
-          // TODO: check if it is better to return error here.
-          return SDAS_SUCCESS;
-        } else if (fread_amt < size_from_base10) {
-          info->size_from_base10 = (uint32_t)(size_from_base10 - fread_amt);
         }
 
-        ssize_t write_ret = write(*info->to_dec_pipe,
-                                  info->read_buf,
-                                  fread_amt);
-        if (write_ret < 0) {
-          if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            *info->has_hold = (ssize_t)fread_amt;
-            memcpy(info->hold_buf, info->read_buf, fread_amt);
-            return SDAS_SUCCESS;
-          } else {
-            fprintf(stderr, "ERROR: Failed to write to decomp "
-                            "(chunked-encoding; write_ret < 0)\n");
-            return SDAS_CHUNKED_DECOMPRESSION_ERROR;
-          }
-        } else if (write_ret == 0) {
-          fprintf(stderr, "ERROR: Failed to write to decomp "
-                          "(chunked-encoding; write_ret == 0)\n");
-          return SDAS_CHUNKED_DECOMPRESSION_ERROR;
-        } else if ((size_t)write_ret < fread_amt) {
-          *info->has_hold = (ssize_t)fread_amt - write_ret;
-          memcpy(info->hold_buf,
-                 info->read_buf + write_ret,
-                 (size_t)*info->has_hold);
-          return SDAS_SUCCESS;
+        size_t fread_amt;
+        if (info->size_from_base10 != 0) {
+          // The rest of a frame that was cut short.
+          fread_amt = simple_archiver_io_read(info->hold_buf,
+                                              1,
+                                              info->size_from_base10,
+                                              info->in_f);
         } else {
-          // Fully written successfully, nothing to do here.
-          return SDAS_SUCCESS;
-        }
-      } else if (*info->has_hold > 0) {
-        ssize_t write_ret = write(*info->to_dec_pipe,
-                                  info->hold_buf,
-                                  (size_t)*info->has_hold);
-        if (write_ret < 0) {
-          if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            return SDAS_SUCCESS;
-          } else {
-            fprintf(stderr, "ERROR: Failed to write to decomp "
-                            "(has-hold; chunked-encoding; write_ret < 0)\n");
+          uint32_t size_from_base10;
+          const int size_ret = simple_archiver_internal_v7_read_frame_size(
+            info->in_f, &size_from_base10);
+          if (size_ret == 3) {
+            fprintf(stderr,
+                    "ERROR: \"mini-chunk\" (chunked-encoding) size is larger "
+                    "than 32KiB!\n");
+            return SDAS_INVALID_FILE;
+          } else if (size_ret != 0) {
+            fprintf(stderr, "ERROR: Invalid char for chunked-encoding size!\n");
             return SDAS_CHUNKED_DECOMPRESSION_ERROR;
+          } else if (size_from_base10 == 0) {
+            // end of chunk
+            *info->chunk_remaining = 0;
+            *info->has_hold = -1;
+            goto TRY_WRITE_TO_DECOMP_END;
           }
-        } else if (write_ret == 0) {
-          fprintf(stderr, "ERROR: Failed to write to decomp "
-                          "(has-hold; chunked-encoding; write_ret == 0)\n");
-          return SDAS_CHUNKED_DECOMPRESSION_ERROR;
-        } else if (write_ret < *info->has_hold) {
-          memcpy(info->read_buf,
-                 info->hold_buf + write_ret,
-                 (size_t)(*info->has_hold - write_ret));
-          memcpy(info->hold_buf,
-                 info->read_buf,
-                 (size_t)(*info->has_hold - write_ret));
-          *info->has_hold -= write_ret;
-          return SDAS_SUCCESS;
-        } else {
-          *info->has_hold = -1;
-        }
-      } else if (info->size_from_base10 != 0) {
-        size_t fread_amt = fread(info->read_buf,
-                                 1,
-                                 info->size_from_base10,
-                                 info->in_f);
 
-        if (fread_amt == 0) {
-          // TODO: check if it is better to return error here.
-          return SDAS_SUCCESS;
-        } else if (fread_amt < info->size_from_base10) {
-          info->size_from_base10 =
-            (uint32_t)(info->size_from_base10 - fread_amt);
-        } else {
-          info->size_from_base10 = 0;
+          // Sum to "compressed_size"
+          *info->compressed_size += size_from_base10;
+          info->size_from_base10 = size_from_base10;
+
+          // get chunked-encoding mini-chunk
+          fread_amt = simple_archiver_io_read(info->hold_buf,
+                                              1,
+                                              size_from_base10,
+                                              info->in_f);
         }
 
-        ssize_t write_ret = write(*info->to_dec_pipe,
-                                  info->read_buf,
-                                  fread_amt);
-        if (write_ret < 0) {
-          if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            *info->has_hold = (ssize_t)fread_amt;
-            memcpy(info->hold_buf, info->read_buf, fread_amt);
-            return SDAS_SUCCESS;
-          } else {
-            fprintf(stderr, "ERROR: Failed to write to decomp "
-                            "(chunked-encoding; write_ret < 0)\n");
-            return SDAS_CHUNKED_DECOMPRESSION_ERROR;
-          }
-        } else if (write_ret == 0) {
-          fprintf(stderr, "ERROR: Failed to write to decomp "
-                          "(chunked-encoding; write_ret == 0)\n");
-          return SDAS_CHUNKED_DECOMPRESSION_ERROR;
-        } else if ((size_t)write_ret < fread_amt) {
-          *info->has_hold = (ssize_t)fread_amt - write_ret;
-          memcpy(info->hold_buf,
-                 info->read_buf + write_ret,
-                 (size_t)*info->has_hold);
-          return SDAS_SUCCESS;
-        } else {
-          // Fully written successfully, nothing to do here.
-          return SDAS_SUCCESS;
+        if (fread_amt == 0) {
+          // "in_f" is blocking, so the archive ended within a "mini-chunk".
+          fprintf(stderr,
+                  "ERROR: Archive ends within a \"mini-chunk\" "
+                  "(chunked-encoding)!\n");
+          return SDAS_INVALID_FILE;
         }
+        info->size_from_base10 -= (uint32_t)fread_amt;
+        *info->has_hold = (ssize_t)fread_amt;
+        info->hold_offset = 0;
       }
-
-      // Wait for "0\n" to go to end.
-      return SDAS_SUCCESS;
     }
   }
 
@@ -1574,18 +2086,148 @@ TRY_WRITE_TO_DECOMP_END:
 
 }
 
-/// Returns SDAS_SUCCESS on success.
+/// Returns non-zero if "filename" would be rewritten in place by
+/// "--extract-in-place-delta", so it must not be removed beforehand.
+/// Files with other hard links are replaced instead, as rewriting them would
+/// change the other links too.
+int_fast8_t simple_archiver_internal_in_place_candidate(
+    const SDArchiverParsed *parsed,
+    const char *filename,
+    uint64_t file_size) {
+  struct stat st;
+  return (parsed->flags & 0x40000000) != 0
+         && lstat(filename, &st) == 0
+         && S_ISREG(st.st_mode)
+         && st.st_nlink == 1
+         && (uint64_t)st.st_size == file_size
+         && access(filename, W_OK) == 0;
+}
+
+/// Opens "filename" to be rewritten in place if "--extract-in-place-delta" is
+/// set and it is an existing regular file of "file_size" bytes without other
+/// hard links.
+/// Returns non-zero if opened, with "in_place->f" to write the file's data to.
+int_fast8_t simple_archiver_internal_in_place_open(
+    SDArchiverInternalInPlace *in_place,
+    const SDArchiverParsed *parsed,
+    int dir_fd,
+    const char *filename,
+    uint64_t file_size) {
+  if ((parsed->flags & 0x40000000) == 0) {
+    return 0;
+  }
+  int fd = simple_archiver_helper_open_beneath(dir_fd,
+                                               filename,
+                                               O_RDWR | O_NOFOLLOW,
+                                               0);
+  if (fd < 0) {
+    return 0;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0
+      || !S_ISREG(st.st_mode)
+      || st.st_nlink != 1
+      || (uint64_t)st.st_size != file_size) {
+    close(fd);
+    return 0;
+  }
+  SDArchiverIO *io = simple_archiver_io_init_delta_fd(fd,
+                                                      SD_SA_IN_PLACE_BLOCK_SIZE);
+  int_fast8_t needs_fclose = 0;
+  FILE *f = io ? simple_archiver_io_open_FILE(io, "wb", &needs_fclose) : NULL;
+  if (!f) {
+    simple_archiver_io_free(&io);
+    close(fd);
+    return 0;
+  }
+  in_place->fd = fd;
+  in_place->io = io;
+  in_place->f = f;
+  in_place->needs_fclose = needs_fclose;
+  return 1;
+}
+
+void simple_archiver_internal_in_place_cleanup(
+    SDArchiverInternalInPlace *in_place) {
+  if (in_place->f) {
+    simple_archiver_io_close_FILE(&in_place->f, in_place->needs_fclose);
+  }
+  simple_archiver_io_free(&in_place->io);
+  if (in_place->fd >= 0) {
+    close(in_place->fd);
+    in_place->fd = -1;
+  }
+}
+
+/// Writes what is left of a file opened by
+/// "simple_archiver_internal_in_place_open" and closes it.
+/// Returns zero on success.
+int simple_archiver_internal_in_place_finish(
+    SDArchiverInternalInPlace *in_place) {
+  int ret = simple_archiver_io_close_FILE(&in_place->f,
+                                          in_place->needs_fclose);
+  if (ret == 0) {
+    ret = simple_archiver_io_delta_finish(in_place->io, NULL, NULL);
+  }
+  simple_archiver_internal_in_place_cleanup(in_place);
+  if (ret != 0) {
+    fprintf(stderr, "ERROR: Failed to rewrite file in place!\n");
+  }
+  return ret;
+}
+
+/// Sets the UID/GID (if permitted) and permissions of an extracted file
+/// through "fd", or by "path" beneath "dir_fd" if "fd" is -1.
+SDArchiverStateReturns simple_archiver_internal_set_owner_perms(
+    int dir_fd,
+    int fd,
+    const char *path,
+    uint32_t uid,
+    uint32_t gid,
+    mode_t permissions) {
+  if (simple_archiver_helper_can_chown()
+      && (fd >= 0
+          ? fchown(fd, uid, gid)
+          : simple_archiver_helper_fchownat_beneath(dir_fd, path, uid, gid, 0))
+         != 0) {
+    return SDAS_UID_GID_SET_FAIL;
+  } else if ((fd >= 0
+              ? fchmod(fd, permissions)
+              : simple_archiver_helper_fchmodat_beneath(dir_fd,
+                                                        path,
+                                                        permissions,
+                                                        0))
+             != 0) {
+    return SDAS_PERMISSION_SET_FAIL;
+  }
+  return SDAS_SUCCESS;
+}
+
 SDArchiverStateReturns read_decomp_to_out_file(SDArchiverDecompInfo *info) {
   __attribute__((cleanup(simple_archiver_helper_cleanup_FILE))) FILE *out_fd =
       NULL;
   if (info->out_filename) {
-    out_fd = fopen(info->out_filename, "wb");
-    if (!out_fd) {
+    const uint64_t open_start =
+      info->open_ns ? simple_archiver_helper_monotonic_ns() : 0;
+    out_fd = simple_archiver_helper_fopen_beneath(info->out_dir_fd,
+                                                  info->out_filename,
+                                                  "wb");
+    const int open_errno = errno;
+    if (info->open_ns) {
+      *info->open_ns += simple_archiver_helper_monotonic_ns() - open_start;
+    }
+    if (!out_fd && open_errno == EXDEV) {
+      fprintf(stderr,
+              "ERROR \"%s\" resolves outside of the extraction dir!\n",
+              info->out_filename);
+      return SDAS_FILE_CREATE_FAIL;
+    } else if (!out_fd) {
       fprintf(stderr, "ERROR Failed to open \"%s\" for writing!\n",
               info->out_filename);
       return SDAS_FILE_CREATE_FAIL;
     }
   }
+  FILE *out_f = info->out_f ? info->out_f : out_fd;
 
   uint64_t written_amt = 0;
   ssize_t read_ret;
@@ -1606,7 +2248,7 @@ SDArchiverStateReturns read_decomp_to_out_file(SDArchiverDecompInfo *info) {
         read_ret = read(info->in_pipe, info->read_buf, 2);
         if (read_ret == -1) {
           if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            nanosleep(&nonblock_sleep, NULL);
+            simple_archiver_internal_nonblock_sleep(info->wait_ns);
             SDArchiverStateReturns ret = try_write_to_decomp(info);
             if (ret != SDAS_SUCCESS) {
               return ret;
@@ -1623,11 +2265,11 @@ SDArchiverStateReturns read_decomp_to_out_file(SDArchiverDecompInfo *info) {
       }
       read_ret = read(info->in_pipe, info->read_buf, info->read_buf_size);
       if (read_ret > 0) {
-        if (out_fd) {
-          fwrite_ret = fwrite(info->read_buf, 1, (size_t)read_ret, out_fd);
+        if (out_f) {
+          fwrite_ret = fwrite(info->read_buf, 1, (size_t)read_ret, out_f);
           if (fwrite_ret == (size_t)read_ret) {
             written_amt += fwrite_ret;
-          } else if (ferror(out_fd)) {
+          } else if (ferror(out_f)) {
             fprintf(stderr, "ERROR Failed to write decompressed data!\n");
             return SDAS_DECOMPRESSION_ERROR;
           } else {
@@ -1651,7 +2293,7 @@ SDArchiverStateReturns read_decomp_to_out_file(SDArchiverDecompInfo *info) {
       } else {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
           // Non-blocking read from pipe.
-          nanosleep(&nonblock_sleep, NULL);
+          simple_archiver_internal_nonblock_sleep(info->wait_ns);
           continue;
         } else {
           // Error.
@@ -1665,7 +2307,7 @@ SDArchiverStateReturns read_decomp_to_out_file(SDArchiverDecompInfo *info) {
         read_ret = read(info->in_pipe, info->read_buf, 2);
         if (read_ret == -1) {
           if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            nanosleep(&nonblock_sleep, NULL);
+            simple_archiver_internal_nonblock_sleep(info->wait_ns);
             SDArchiverStateReturns ret = try_write_to_decomp(info);
             if (ret != SDAS_SUCCESS) {
               return ret;
@@ -1691,11 +2333,11 @@ SDArchiverStateReturns read_decomp_to_out_file(SDArchiverDecompInfo *info) {
         read_ret = read(info->in_pipe, info->read_buf, (size_t)read_amount);
       }
       if (read_ret > 0) {
-        if (out_fd) {
-          fwrite_ret = fwrite(info->read_buf, 1, (size_t)read_ret, out_fd);
+        if (out_f) {
+          fwrite_ret = fwrite(info->read_buf, 1, (size_t)read_ret, out_f);
           if (fwrite_ret == (size_t)read_ret) {
             written_amt += fwrite_ret;
-          } else if (ferror(out_fd)) {
+          } else if (ferror(out_f)) {
             fprintf(stderr, "ERROR Failed to write decompressed data!\n");
             return SDAS_DECOMPRESSION_ERROR;
           } else {
@@ -1719,7 +2361,7 @@ SDArchiverStateReturns read_decomp_to_out_file(SDArchiverDecompInfo *info) {
       } else {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
           // Non-blocking read from pipe.
-          nanosleep(&nonblock_sleep, NULL);
+          simple_archiver_internal_nonblock_sleep(info->wait_ns);
           continue;
         } else {
           // Error.
@@ -1736,6 +2378,16 @@ SDArchiverStateReturns read_decomp_to_out_file(SDArchiverDecompInfo *info) {
          : SDAS_DECOMPRESSION_ERROR;
 }
 
+/// Opens the file's data read during the walk if there is any, otherwise
+/// opens the file.
+FILE *simple_archiver_internal_open_file_info(
+    const SDArchiverInternalFileInfo *file_info) {
+  if (file_info->data) {
+    return fmemopen((void *)file_info->data, file_info->file_size, "rb");
+  }
+  return fopen(file_info->filename, "rb");
+}
+
 void free_internal_file_info(void *data) {
   SDArchiverInternalFileInfo *file_info = data;
   if (file_info) {
@@ -1755,6 +2407,25 @@ void free_internal_file_info(void *data) {
   }
 }
 
+/// Copies "str" followed by "suffix" (if not NULL) into "arena".
+/// Returns NULL on error.
+char *simple_archiver_internal_arena_strcat(SDArchiverArena *arena,
+                                            const char *str,
+                                            const char *suffix) {
+  const size_t str_size = strlen(str);
+  const size_t suffix_size = suffix ? strlen(suffix) : 0;
+  char *out = simple_archiver_arena_alloc(arena, str_size + suffix_size + 1);
+  if (!out) {
+    return NULL;
+  }
+  memcpy(out, str, str_size);
+  if (suffix) {
+    memcpy(out + str_size, suffix, suffix_size);
+  }
+  out[str_size + suffix_size] = 0;
+  return out;
+}
+
 void cleanup_internal_file_info(SDArchiverInternalFileInfo **file_info) {
   if (file_info && *file_info) {
     if ((*file_info)->filename) {
@@ -2062,7 +2733,7 @@ int symlinks_and_files_from_files(
   SDArchiverStringList *symlinks_list = ptr_array[0];
   SDArchiverLinkedList *files_list = ptr_array[1];
   const char *user_cwd = ptr_array[2];
-  SDArchiverPHeap *pheap = ptr_array[3];
+  SDArchiverBTree *files_btree = ptr_array[3];
   SDArchiverStringList *dirs_list = ptr_array[4];
   const SDArchiverState *state = ptr_array[5];
   uint64_t *from_files_count = ptr_array[6];
@@ -2084,7 +2755,7 @@ int symlinks_and_files_from_files(
   }
 
   if (is_sig_int_occurred) {
-    fprintf(stderr, "Interrupt, stopping populating priority heap...\n");
+    fprintf(stderr, "Interrupt, stopping populating file order...\n");
     return 1;
   }
 
@@ -2118,6 +2789,7 @@ int symlinks_and_files_from_files(
       file_info_struct->username = NULL;
       file_info_struct->groupname = NULL;
       file_info_struct->file_size = 0;
+      file_info_struct->data = NULL;
       __attribute__((cleanup(
           simple_archiver_helper_cleanup_chdir_back))) char *original_cwd =
           NULL;
@@ -2192,27 +2864,32 @@ int symlinks_and_files_from_files(
       if (state->parsed->flags & 0x800) {
         file_info_struct->gid = state->parsed->gid;
       }
-      __attribute__((cleanup(simple_archiver_helper_cleanup_FILE))) FILE *fd =
-          fopen(file_info_struct->filename, "rb");
-      if (!fd) {
-        free(file_info_struct);
-        return 1;
-      }
-      if (fseek(fd, 0, SEEK_END) < 0) {
-        free(file_info_struct);
-        return 1;
-      }
-      long ftell_ret = ftell(fd);
-      if (ftell_ret < 0) {
-        free(file_info_struct);
-        return 1;
+      if (file_info->data) {
+        // Was read during the walk, so the size is already known.
+        file_info_struct->data = file_info->data;
+        file_info_struct->file_size = file_info->data_size;
+      } else {
+        __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
+        FILE *fd = fopen(file_info_struct->filename, "rb");
+        if (!fd) {
+          free(file_info_struct);
+          return 1;
+        }
+        if (fseek(fd, 0, SEEK_END) < 0) {
+          free(file_info_struct);
+          return 1;
+        }
+        long ftell_ret = ftell(fd);
+        if (ftell_ret < 0) {
+          free(file_info_struct);
+          return 1;
+        }
+        file_info_struct->file_size = (uint64_t)ftell_ret;
       }
-      file_info_struct->file_size = (uint64_t)ftell_ret;
       *files_actual_size += file_info_struct->file_size;
-      if (pheap) {
-        simple_archiver_priority_heap_insert(
-            pheap, (int64_t)file_info_struct->file_size, file_info_struct,
-            free_internal_file_info);
+      if (files_btree) {
+        simple_archiver_btree_insert(files_btree, file_info_struct,
+                                     free_internal_file_info);
       } else {
         simple_archiver_list_add(files_list, file_info_struct,
                                  free_internal_file_info);
@@ -2258,6 +2935,13 @@ int internal_strcmp_less_fn(void *a, void *b) {
   return strcmp(a_finfo->filename, b_finfo->filename) < 0;
 }
 
+int internal_size_greater_fn(void *a, void *b) {
+  SDArchiverInternalFileInfo *a_finfo = a;
+  SDArchiverInternalFileInfo *b_finfo = b;
+
+  return a_finfo->file_size > b_finfo->file_size;
+}
+
 void simple_archiver_internal_paths_to_files_map(SDArchiverHashMap *files_map,
                                                  const char *filename) {
   simple_archiver_hash_map_insert(
@@ -2283,7 +2967,7 @@ void simple_archiver_internal_paths_to_files_map(SDArchiverHashMap *files_map,
 
 int internal_write_dir_entries_v2_v3_v4_v5_v6(const char *dir, void *ud) {
   void **ptrs = ud;
-  FILE *out_f = ptrs[0];
+  SDArchiverIOStream *out_f = ptrs[0];
   const SDArchiverState *state = ptrs[1];
 
   fprintf(stderr, "  %s\n", dir);
@@ -2302,26 +2986,26 @@ int internal_write_dir_entries_v2_v3_v4_v5_v6(const char *dir, void *ud) {
   uint16_t u16 = (uint16_t)total_name_length;
 
   simple_archiver_helper_16_bit_be(&u16);
-  if (fwrite(&u16, 2, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
     fprintf(stderr, "ERROR: Failed to write dirname length for \"%s\"!\n", dir);
     return 1;
   }
 
   if (state->parsed->prefix) {
-    if (fwrite(state->parsed->prefix, 1, prefix_length, out_f)
+    if (simple_archiver_io_write(state->parsed->prefix, 1, prefix_length, out_f)
         != prefix_length) {
       fprintf(stderr,
               "ERROR: Failed to write prefix part of dirname \"%s\"!\n",
               dir);
       return 1;
-    } else if (fwrite(dir, 1, dir_name_length + 1, out_f)
+    } else if (simple_archiver_io_write(dir, 1, dir_name_length + 1, out_f)
                != dir_name_length + 1) {
       fprintf(stderr,
               "ERROR: Failed to write (after prefix) dirname for \"%s\"!\n",
               dir);
       return 1;
     }
-  } else if (fwrite(dir, 1, dir_name_length + 1, out_f)
+  } else if (simple_archiver_io_write(dir, 1, dir_name_length + 1, out_f)
              != dir_name_length + 1) {
     fprintf(stderr, "ERROR: Failed to write dirname for \"%s\"!\n", dir);
     return 1;
@@ -2372,7 +3056,7 @@ int internal_write_dir_entries_v2_v3_v4_v5_v6(const char *dir, void *ud) {
     }
   }
 
-  if(fwrite(&u8, 1, 1, out_f) != 1) {
+  if(simple_archiver_io_write(&u8, 1, 1, out_f) != 1) {
     fprintf(
       stderr,
       "ERROR: Failed to write permission bits (byte 0) for \"%s\"!\n", dir);
@@ -2398,7 +3082,7 @@ int internal_write_dir_entries_v2_v3_v4_v5_v6(const char *dir, void *ud) {
     u8 |= 0x10;
   }
 
-  if (fwrite(&u8, 1, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u8, 1, 1, out_f) != 1) {
     fprintf(
       stderr,
       "ERROR: Failed to write permission bits (byte 1) for \"%s\"!\n", dir);
@@ -2424,7 +3108,7 @@ int internal_write_dir_entries_v2_v3_v4_v5_v6(const char *dir, void *ud) {
   }
 
   simple_archiver_helper_32_bit_be(&u32);
-  if (fwrite(&u32, 4, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
     fprintf(stderr, "ERROR: Failed to write UID for \"%s\"!\n", dir);
     return 1;
   }
@@ -2447,7 +3131,7 @@ int internal_write_dir_entries_v2_v3_v4_v5_v6(const char *dir, void *ud) {
     }
   }
   simple_archiver_helper_32_bit_be(&u32);
-  if (fwrite(&u32, 4, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
     fprintf(stderr, "ERROR: Failed to write GID for \"%s\"!\n", dir);
     return 1;
   }
@@ -2486,19 +3170,20 @@ int internal_write_dir_entries_v2_v3_v4_v5_v6(const char *dir, void *ud) {
       }
       u16 = (uint16_t)length;
       simple_archiver_helper_16_bit_be(&u16);
-      if (fwrite(&u16, 2, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
         fprintf(
           stderr,
           "ERROR: Failed to write username length for dir \"%s\"!\n", dir);
         return 1;
-      } else if (fwrite(username, 1, length + 1, out_f) != length + 1) {
+      } else if (simple_archiver_io_write(username, 1, length + 1, out_f)
+                 != length + 1) {
         fprintf(
           stderr, "ERROR: Failed to write username for dir \"%s\"!\n", dir);
         return 1;
       }
     } else {
       u16 = 0;
-      if (fwrite(&u16, 2, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
         fprintf(stderr,
                 "ERROR: Failed to write 0 bytes for username for dir \"%s\"\n!",
                 dir);
@@ -2539,19 +3224,20 @@ int internal_write_dir_entries_v2_v3_v4_v5_v6(const char *dir, void *ud) {
       }
       u16 = (uint16_t)length;
       simple_archiver_helper_16_bit_be(&u16);
-      if (fwrite(&u16, 2, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
         fprintf(
           stderr,
           "ERROR: Failed to write Groupname length for dir \"%s\"!\n", dir);
         return 1;
-      } else if (fwrite(groupname, 1, length + 1, out_f) != length + 1) {
+      } else if (simple_archiver_io_write(groupname, 1, length + 1, out_f)
+                 != length + 1) {
         fprintf(
           stderr, "ERROR: Failed to write Groupname for dir \"%s\"!\n", dir);
         return 1;
       }
     } else {
       u16 = 0;
-      if (fwrite(&u16, 2, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
         fprintf(
           stderr,
           "ERROR: Failed to write 0 bytes for Groupname for dir \"%s\"\n!",
@@ -2618,7 +3304,235 @@ int simple_archiver_internal_prune_filenames_v0(
   return 0;
 }
 
-void internal_simple_archiver_parse_stats(SDArchiverHashMap *parse_state) {
+void simple_archiver_internal_json_print_str(FILE *out, const char *str) {
+  fputc('"', out);
+  for (; *str; ++str) {
+    const unsigned char c = (unsigned char)*str;
+    if (c == '"' || c == '\\') {
+      fprintf(out, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(out, "\\u%04x", c);
+    } else {
+      fputc(c, out);
+    }
+  }
+  fputc('"', out);
+}
+
+int internal_dir_times_to_heap(const void *key,
+                               size_t key_size,
+                               const void *value,
+                               void *ud) {
+  (void)key;
+  (void)key_size;
+  const SDArchiverInternalDirTimes *dir_times = value;
+  simple_archiver_priority_heap_insert(
+    ud,
+    (int64_t)(dir_times->open_ns + dir_times->io_ns + dir_times->wait_ns),
+    (void *)dir_times,
+    simple_archiver_helper_datastructure_cleanup_nop);
+  return 0;
+}
+
+/// Returns the throughput in MiB/s of "size" bytes taking "ns" nanoseconds.
+double simple_archiver_internal_mib_per_s(uint64_t size, uint64_t ns) {
+  return ns != 0
+    ? (double)size / (1024.0 * 1024.0) / ((double)ns / 1000000000.0)
+    : 0.0;
+}
+
+/// Prints the slowest files and the time spent per top-level directory as
+/// text to stderr, or as JSON array members to "json_out" if non-NULL.
+/// Empties "times->slowest".
+void internal_simple_archiver_print_file_times(
+    SDArchiverInternalFileTimes *times,
+    FILE *json_out) {
+  const uint64_t count = times
+                         ? simple_archiver_priority_heap_size(times->slowest)
+                         : 0;
+  __attribute__((cleanup(simple_archiver_helper_cleanup_malloced)))
+  void *slowest_ptr = malloc(sizeof(void *) * (count ? count : 1));
+  SDArchiverInternalSlowFile **slowest = slowest_ptr;
+  // Heap gives the fastest first.
+  for (uint64_t idx = count; idx-- > 0;) {
+    slowest[idx] = simple_archiver_priority_heap_pop(times->slowest);
+  }
+
+  __attribute__((cleanup(simple_archiver_priority_heap_free)))
+  SDArchiverPHeap *dirs_heap =
+    simple_archiver_priority_heap_init_less_fn(greater_fn);
+  if (times) {
+    simple_archiver_hash_map_iter(times->dirs,
+                                  internal_dir_times_to_heap,
+                                  dirs_heap);
+  }
+
+  if (json_out) {
+    fprintf(json_out, ",\"slowest_files\":[");
+  } else if (count != 0) {
+    fprintf(stderr,
+            "Slowest %" PRIu64 " file(s) (open / read+write / de/compressor "
+            "wait):\n",
+            count);
+  }
+  for (uint64_t idx = 0; idx < count; ++idx) {
+    const SDArchiverInternalSlowFile *slow_file = slowest[idx];
+    const uint64_t total_ns =
+      slow_file->open_ns + slow_file->io_ns + slow_file->wait_ns;
+    if (json_out) {
+      fprintf(json_out, "%s{\"path\":", idx == 0 ? "" : ",");
+      simple_archiver_internal_json_print_str(json_out, slow_file->filename);
+      fprintf(json_out,
+              ",\"size\":%" PRIu64 ",\"total_ns\":%" PRIu64 ",\"open_ns\":%"
+              PRIu64 ",\"io_ns\":%" PRIu64 ",\"wait_ns\":%" PRIu64
+              ",\"mib_per_s\":%.2f}",
+              slow_file->size,
+              total_ns,
+              slow_file->open_ns,
+              slow_file->io_ns,
+              slow_file->wait_ns,
+              simple_archiver_internal_mib_per_s(slow_file->size, total_ns));
+    } else {
+      fprintf(stderr,
+              "  %9.3f ms (%.3f / %.3f / %.3f), %" PRIu64 " bytes, %.2f MiB/s: "
+              "%s\n",
+              (double)total_ns / 1000000.0,
+              (double)slow_file->open_ns / 1000000.0,
+              (double)slow_file->io_ns / 1000000.0,
+              (double)slow_file->wait_ns / 1000000.0,
+              slow_file->size,
+              simple_archiver_internal_mib_per_s(slow_file->size, total_ns),
+              slow_file->filename);
+    }
+    simple_archiver_internal_free_slow_file(slowest[idx]);
+  }
+
+  if (json_out) {
+    fprintf(json_out, "],\"top_level_dirs\":[");
+  } else if (simple_archiver_priority_heap_size(dirs_heap) != 0) {
+    fprintf(stderr, "Time per top-level directory:\n");
+  }
+  int_fast8_t is_first = 1;
+  while (simple_archiver_priority_heap_size(dirs_heap) != 0) {
+    const SDArchiverInternalDirTimes *dir_times =
+      simple_archiver_priority_heap_pop(dirs_heap);
+    const uint64_t total_ns =
+      dir_times->open_ns + dir_times->io_ns + dir_times->wait_ns;
+    if (json_out) {
+      fprintf(json_out, "%s{\"path\":", is_first ? "" : ",");
+      simple_archiver_internal_json_print_str(json_out, dir_times->dir);
+      fprintf(json_out,
+              ",\"files\":%" PRIu64 ",\"size\":%" PRIu64 ",\"total_ns\":%"
+              PRIu64 ",\"open_ns\":%" PRIu64 ",\"io_ns\":%" PRIu64
+              ",\"wait_ns\":%" PRIu64 ",\"mib_per_s\":%.2f}",
+              dir_times->files,
+              dir_times->size,
+              total_ns,
+              dir_times->open_ns,
+              dir_times->io_ns,
+              dir_times->wait_ns,
+              simple_archiver_internal_mib_per_s(dir_times->size, total_ns));
+    } else {
+      fprintf(stderr,
+              "  %9.3f ms (%.3f / %.3f / %.3f), %" PRIu64 " file(s), %" PRIu64
+              " bytes, %.2f MiB/s: %s\n",
+              (double)total_ns / 1000000.0,
+              (double)dir_times->open_ns / 1000000.0,
+              (double)dir_times->io_ns / 1000000.0,
+              (double)dir_times->wait_ns / 1000000.0,
+              dir_times->files,
+              dir_times->size,
+              simple_archiver_internal_mib_per_s(dir_times->size, total_ns),
+              dir_times->dir);
+    }
+    is_first = 0;
+  }
+  if (json_out) {
+    fprintf(json_out, "]");
+  }
+}
+
+/// Prints the changes of how many slice compressors may run as text to
+/// stderr, or as a JSON member to "json_out" if non-NULL.
+void internal_simple_archiver_print_pressure_changes(
+    const SDArchiverInternalPressure *pressure,
+    FILE *json_out) {
+  if (json_out) {
+    if (!pressure) {
+      return;
+    }
+    fprintf(json_out, ",\"compressor_limit_changes\":[");
+  } else if (pressure->changes->count != 0) {
+    fprintf(stderr, "Compressor limit changes (--pressure-limit):\n");
+  }
+  for (const SDArchiverLLNode *node = pressure->changes->head->next;
+       node != pressure->changes->tail;
+       node = node->next) {
+    const SDArchiverInternalPressureChange *change = node->data;
+    if (json_out) {
+      fprintf(json_out,
+              "%s{\"ms\":%" PRIu64 ",\"reason\":\"%s\",\"stall\":%" PRIu32
+              ".%02" PRIu32 ",\"from\":%" PRIu32 ",\"to\":%" PRIu32 "}",
+              node == pressure->changes->head->next ? "" : ",",
+              change->ms,
+              change->reason,
+              change->stall / 100,
+              change->stall % 100,
+              change->from_jobs,
+              change->to_jobs);
+    } else {
+      fprintf(stderr,
+              "  %9.3f s: %" PRIu32 " -> %" PRIu32 " compressor(s), %" PRIu32
+              ".%02" PRIu32 "%% stall (%s)\n",
+              (double)change->ms / 1000.0,
+              change->from_jobs,
+              change->to_jobs,
+              change->stall / 100,
+              change->stall % 100,
+              change->reason);
+    }
+  }
+  if (json_out) {
+    fprintf(json_out, "]");
+  }
+}
+
+void internal_simple_archiver_parse_stats(SDArchiverHashMap *parse_state,
+                                         const SDArchiverParsed *parsed) {
+  SDArchiverInternalFileTimes *file_times =
+    simple_archiver_hash_map_get(parse_state,
+                                 SDA_PSTATE_FILE_TIMES_KEY,
+                                 SDA_PSTATE_FILE_TIMES_KEY_SIZE);
+  const SDArchiverInternalPressure *pressure =
+    simple_archiver_hash_map_get(parse_state,
+                                 SDA_PSTATE_PRESSURE_KEY,
+                                 SDA_PSTATE_PRESSURE_KEY_SIZE);
+  if (parsed->flags & 0x10000000) {
+    // Keep stdout free if the archive is being written to it.
+    FILE *json_out = (parsed->flags & 0x13) == 0x10 ? stderr : stdout;
+    const uint64_t *sizes[3] = {
+      simple_archiver_hash_map_get(parse_state,
+                                   SDA_PSTATE_CMP_SIZE_KEY,
+                                   SDA_PSTATE_CMP_SIZE_KEY_SIZE),
+      simple_archiver_hash_map_get(parse_state,
+                                   SDA_PSTATE_ACT_SIZE_KEY,
+                                   SDA_PSTATE_ACT_SIZE_KEY_SIZE),
+      simple_archiver_hash_map_get(parse_state,
+                                   SDA_PSTATE_NOT_CMP_SIZE_KEY,
+                                   SDA_PSTATE_NOT_CMP_SIZE_KEY_SIZE)};
+    fprintf(json_out,
+            "{\"compressed_size\":%" PRIu64 ",\"actual_size\":%" PRIu64
+            ",\"not_compressed_size\":%" PRIu64,
+            sizes[0] ? *sizes[0] : 0,
+            sizes[1] ? *sizes[1] : 0,
+            sizes[2] ? *sizes[2] : 0);
+    internal_simple_archiver_print_pressure_changes(pressure, json_out);
+    internal_simple_archiver_print_file_times(file_times, json_out);
+    fprintf(json_out, "}\n");
+    fflush(json_out);
+    return;
+  }
+
   uint64_t *cmp_size =
     simple_archiver_hash_map_get(parse_state,
                                  SDA_PSTATE_CMP_SIZE_KEY,
@@ -2745,9 +3659,16 @@ void internal_simple_archiver_parse_stats(SDArchiverHashMap *parse_state) {
     }
     fprintf(stderr, "\n");
   }
+
+  if (pressure) {
+    internal_simple_archiver_print_pressure_changes(pressure, NULL);
+  }
+  if (file_times) {
+    internal_simple_archiver_print_file_times(file_times, NULL);
+  }
 }
 
-int internal_pheap_file_ext_less_fn(void *a, void *b, void *ud) {
+int internal_file_ext_less_fn(void *a, void *b, void *ud) {
   SDArchiverHashMap *exts = ud;
   SDArchiverInternalFileInfo *file_a = a;
   SDArchiverInternalFileInfo *file_b = b;
@@ -2799,20 +3720,190 @@ int internal_pheap_file_ext_less_fn(void *a, void *b, void *ud) {
   }
 }
 
-int internal_add_list_items_to_list(void *data, void *ud) {
-  SDArchiverLinkedList *other_list = ud;
-  SDArchiverInternalFileInfo *file = data;
-
-  SDArchiverInternalFileInfo *copy = malloc(sizeof(SDArchiverInternalFileInfo));
-  if (file->filename) {
-    copy->filename = strdup(file->filename);
-  } else {
-    copy->filename = NULL;
+/// Number of MinHash bins of a file's similarity signature.
+#define SDA_SIMILARITY_BINS 16
+/// Number of samples read from a file for its similarity signature.
+#define SDA_SIMILARITY_SAMPLES 3
+#define SDA_SIMILARITY_SAMPLE_SIZE 4096
+/// Size in bytes of a shingle hashed into the signature.
+#define SDA_SIMILARITY_SHINGLE_SIZE 8
+
+typedef struct SDArchiverInternalSimilarityEntry {
+  SDArchiverInternalFileInfo *file_info;
+  /// Lowercase extension of the filename including the '.', or NULL.
+  char *ext;
+  /// One-permutation MinHash of the sampled shingles. Empty bins are
+  /// UINT64_MAX.
+  uint64_t signature[SDA_SIMILARITY_BINS];
+} SDArchiverInternalSimilarityEntry;
+
+void simple_archiver_internal_free_similarity_entry(void *data) {
+  SDArchiverInternalSimilarityEntry *entry = data;
+  if (entry) {
+    if (entry->file_info) {
+      free_internal_file_info(entry->file_info);
+    }
+    if (entry->ext) {
+      free(entry->ext);
+    }
+    free(entry);
   }
-  if (file->prefixed_filename) {
-    copy->prefixed_filename = strdup(file->prefixed_filename);
-  } else {
-    copy->prefixed_filename = NULL;
+}
+
+/// Orders by extension, then by signature, then by filename.
+int simple_archiver_internal_similarity_less_fn(void *a, void *b) {
+  const SDArchiverInternalSimilarityEntry *entry_a = a;
+  const SDArchiverInternalSimilarityEntry *entry_b = b;
+
+  if (!entry_a->ext && entry_b->ext) {
+    return 1;
+  } else if (entry_a->ext && !entry_b->ext) {
+    return 0;
+  } else if (entry_a->ext && entry_b->ext) {
+    const int ext_cmp = strcmp(entry_a->ext, entry_b->ext);
+    if (ext_cmp != 0) {
+      return ext_cmp < 0;
+    }
+  }
+
+  for (size_t idx = 0; idx < SDA_SIMILARITY_BINS; ++idx) {
+    if (entry_a->signature[idx] != entry_b->signature[idx]) {
+      return entry_a->signature[idx] < entry_b->signature[idx];
+    }
+  }
+
+  return strcmp(entry_a->file_info->filename,
+                entry_b->file_info->filename) < 0;
+}
+
+/// Puts a MinHash of up to SDA_SIMILARITY_SAMPLES samples of the file's data
+/// into "entry->signature". A file that cannot be read gets an empty
+/// signature.
+void simple_archiver_internal_similarity_signature(
+    SDArchiverInternalSimilarityEntry *entry) {
+  for (size_t idx = 0; idx < SDA_SIMILARITY_BINS; ++idx) {
+    entry->signature[idx] = UINT64_MAX;
+  }
+
+  __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
+  FILE *fd = simple_archiver_internal_open_file_info(entry->file_info);
+  if (!fd) {
+    return;
+  }
+
+  const uint64_t file_size = entry->file_info->file_size;
+  const uint64_t all_samples_size =
+    SDA_SIMILARITY_SAMPLES * SDA_SIMILARITY_SAMPLE_SIZE;
+  char buf[SDA_SIMILARITY_SAMPLE_SIZE];
+
+  for (uint64_t sample = 0; sample < SDA_SIMILARITY_SAMPLES; ++sample) {
+    if (file_size > all_samples_size) {
+      // Evenly spaced samples from the start to the end of the file.
+      const uint64_t offset = (file_size - SDA_SIMILARITY_SAMPLE_SIZE)
+                              * sample / (SDA_SIMILARITY_SAMPLES - 1);
+      if (fseek(fd, (long)offset, SEEK_SET) != 0) {
+        return;
+      }
+    }
+    const size_t read_amt = fread(buf, 1, SDA_SIMILARITY_SAMPLE_SIZE, fd);
+    for (size_t idx = 0;
+         idx + SDA_SIMILARITY_SHINGLE_SIZE <= read_amt;
+         ++idx) {
+      uint64_t hash;
+      memcpy(&hash, buf + idx, SDA_SIMILARITY_SHINGLE_SIZE);
+      // splitmix64 finalizer.
+      hash ^= hash >> 30;
+      hash *= 0xBF58476D1CE4E5B9;
+      hash ^= hash >> 27;
+      hash *= 0x94D049BB133111EB;
+      hash ^= hash >> 31;
+      const size_t bin = (size_t)(hash >> 60);
+      if (hash < entry->signature[bin]) {
+        entry->signature[bin] = hash;
+      }
+    }
+    if (read_amt < SDA_SIMILARITY_SAMPLE_SIZE) {
+      break;
+    }
+  }
+}
+
+/// Pops every file of "files_btree" and appends them to "files_list" grouped
+/// by extension and then by content similarity ("--sort-files-by-similarity").
+SDArchiverStateReturns simple_archiver_internal_sort_files_by_similarity(
+    SDArchiverBTree *files_btree,
+    SDArchiverLinkedList *files_list,
+    const SDArchiverState *state) {
+  // File names are relative to "-C <dir>".
+  __attribute__((cleanup(simple_archiver_helper_cleanup_chdir_back)))
+  char *original_cwd = NULL;
+  if (state->parsed->user_cwd) {
+    original_cwd = realpath(".", NULL);
+    if (chdir(state->parsed->user_cwd)) {
+      return SDAS_FAILED_TO_CHANGE_CWD;
+    }
+  }
+
+  __attribute__((cleanup(simple_archiver_btree_free)))
+  SDArchiverBTree *similarity_btree =
+    simple_archiver_btree_init(simple_archiver_internal_similarity_less_fn);
+
+  while (simple_archiver_btree_size(files_btree) != 0) {
+    if (is_sig_int_occurred) {
+      fprintf(stderr, "Interrupt, stop ordering files...\n");
+      return SDAS_SIGINT;
+    }
+    SDArchiverInternalSimilarityEntry *entry =
+      malloc(sizeof(SDArchiverInternalSimilarityEntry));
+    entry->file_info = simple_archiver_btree_pop_first(files_btree);
+    entry->ext = NULL;
+    for (size_t idx = strlen(entry->file_info->filename); idx-- > 0;) {
+      if (entry->file_info->filename[idx] == '.') {
+        entry->ext =
+          simple_archiver_helper_to_lower(entry->file_info->filename + idx);
+        break;
+      } else if (entry->file_info->filename[idx] == '/') {
+        break;
+      }
+    }
+    simple_archiver_internal_similarity_signature(entry);
+    simple_archiver_btree_insert(
+      similarity_btree,
+      entry,
+      simple_archiver_internal_free_similarity_entry);
+  }
+
+  while (simple_archiver_btree_size(similarity_btree) != 0) {
+    if (is_sig_int_occurred) {
+      fprintf(stderr, "Interrupt, stop ordering files...\n");
+      return SDAS_SIGINT;
+    }
+    SDArchiverInternalSimilarityEntry *entry =
+      simple_archiver_btree_pop_first(similarity_btree);
+    simple_archiver_list_add(files_list,
+                             entry->file_info,
+                             free_internal_file_info);
+    entry->file_info = NULL;
+    simple_archiver_internal_free_similarity_entry(entry);
+  }
+
+  return SDAS_SUCCESS;
+}
+
+int internal_add_list_items_to_list(void *data, void *ud) {
+  SDArchiverLinkedList *other_list = ud;
+  SDArchiverInternalFileInfo *file = data;
+
+  SDArchiverInternalFileInfo *copy = malloc(sizeof(SDArchiverInternalFileInfo));
+  if (file->filename) {
+    copy->filename = strdup(file->filename);
+  } else {
+    copy->filename = NULL;
+  }
+  if (file->prefixed_filename) {
+    copy->prefixed_filename = strdup(file->prefixed_filename);
+  } else {
+    copy->prefixed_filename = NULL;
   }
   memcpy(copy->bit_flags, file->bit_flags, 4);
   copy->uid = file->uid;
@@ -2827,185 +3918,1724 @@ int internal_add_list_items_to_list(void *data, void *ud) {
   } else {
     copy->groupname = NULL;
   }
-  copy->file_size = file->file_size;
-  copy->other_flags = file->other_flags;
-
-  simple_archiver_list_add(other_list, copy, free_internal_file_info);
+  copy->file_size = file->file_size;
+  copy->other_flags = file->other_flags;
+  copy->data = file->data;
+
+  simple_archiver_list_add(other_list, copy, free_internal_file_info);
+
+  return 0;
+}
+
+/// Orders paths in reverse, which puts every dir before its parent dirs.
+int greater_strcmp_fn(void *a, void *b) {
+  return strcmp(a, b) > 0;
+}
+
+/// Orders dirs in reverse, which puts every dir before its parent dirs.
+int greater_dirname_strcmp_fn(void *a, void *b) {
+  const SDArchiverInternalDirInfo *ad = a;
+  const SDArchiverInternalDirInfo *bd = b;
+  return strcmp(ad->dirname, bd->dirname) > 0;
+}
+
+SDArchiverStateRetStruct prefix_dirs_to_forced_permissions(
+    const SDArchiverState *state) {
+  // Assumes cwd is already changed to specified with "-C" (if "-C" is used").
+  if ((state->parsed->flags & 0x800000) == 0) {
+    // Flag is not set. Do not return error.
+    return SDA_RET_STRUCT(SDAS_SUCCESS);
+  } else if (!state->parsed->prefix) {
+    // Prefix is not set. Do not return error.
+    return SDA_RET_STRUCT(SDAS_SUCCESS);
+  }
+
+  __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+  char *buf = strdup(state->parsed->prefix);
+
+  const mode_t prefix_perms = simple_archiver_internal_permissions_to_mode_t(
+    state->parsed->prefix_dir_permissions);
+
+  for (size_t idx = strlen(buf); idx-- > 0;) {
+    if (buf[idx] == '/') {
+      buf[idx] = 0;
+
+      int chmod_ret = chmod(buf, prefix_perms);
+      if (chmod_ret != 0) {
+        fprintf(stderr,
+                "ERROR: Failed to set perfix-dir permissions, errno %d\n",
+                errno);
+        return SDA_RET_STRUCT(SDAS_PERMISSION_SET_FAIL);
+      }
+
+      buf[idx] = '/';
+    }
+  }
+
+  return SDA_RET_STRUCT(SDAS_SUCCESS);
+}
+
+SDArchiverStateRetStruct prefix_dirs_to_forced_ownership(
+    const SDArchiverState *state) {
+  if (state->parsed->prefix && simple_archiver_helper_can_chown()) {
+    // Only set uid/gid if has CAP_CHOWN and args to set them were used.
+    uint32_t uid = getuid();
+    uint32_t gid = getgid();
+    int_fast8_t will_use_chown = 0;
+
+    if (state->parsed->flags & 0x1000000) {
+      uid = state->parsed->prefix_user.uid;
+      will_use_chown = 1;
+    } else if (state->parsed->flags & 0x2000000) {
+      uint32_t *uid_mapped = NULL;
+      uid_mapped = simple_archiver_hash_map_get(
+          state->parsed->users_infos.UnameToUid,
+          state->parsed->prefix_user.username,
+          strlen(state->parsed->prefix_user.username) + 1);
+      if (uid_mapped) {
+        uid = *uid_mapped;
+        will_use_chown = 1;
+      } else {
+        fprintf(stderr,
+                "WARNING: No mapping for username \"%s\" for setting prefix "
+                "dir user!\n",
+                state->parsed->prefix_user.username);
+      }
+    }
+
+    if (state->parsed->flags & 0x4000000) {
+      gid = state->parsed->prefix_group.gid;
+      will_use_chown = 1;
+    } else if (state->parsed->flags & 0x8000000) {
+      uint32_t *gid_mapped = NULL;
+      gid_mapped = simple_archiver_hash_map_get(
+          state->parsed->users_infos.GnameToGid,
+          state->parsed->prefix_group.groupname,
+          strlen(state->parsed->prefix_group.groupname) + 1);
+      if (gid_mapped) {
+        gid = *gid_mapped;
+        will_use_chown = 1;
+      } else {
+        fprintf(stderr,
+                "WARNING: No mapping found for groupname \"%s\" for setting "
+                "prefix dir group!\n",
+                state->parsed->prefix_group.groupname);
+      }
+    }
+
+    if (will_use_chown) {
+      __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+      char *buf = strdup(state->parsed->prefix);
+      for (size_t idx = strlen(buf); idx-- > 0;) {
+        if (buf[idx] == '/') {
+          buf[idx] = 0;
+
+          int chown_ret =
+            fchownat(AT_FDCWD, buf, uid, gid, AT_SYMLINK_NOFOLLOW);
+          if (chown_ret != 0) {
+            fprintf(stderr,
+                    "ERROR: Failed to set prefix-dir ownership, errno %d\n",
+                    errno);
+            return SDA_RET_STRUCT(SDAS_PERMISSION_SET_FAIL);
+          }
+
+          buf[idx] = '/';
+        }
+      }
+    }
+  }
+
+  return SDA_RET_STRUCT(SDAS_SUCCESS);
+}
+
+SDArchiverStateReturns internal_skip_chunked_encoded_chunk(
+    SDArchiverIOStream *in_f,
+    uint64_t *compressed_size) {
+  char buf[SIMPLE_ARCHIVER_BUFFER_SIZE];
+  while (1) {
+    uint32_t size_from_base10;
+    const int size_ret =
+      simple_archiver_internal_v7_read_frame_size(in_f, &size_from_base10);
+    if (size_ret == 1) {
+      fprintf(stderr,
+              "ERROR: Failed to skip chunked-encoded chunk "
+              "(base10 size)!\n");
+      return SDAS_INVALID_FILE;
+    } else if (size_ret == 2) {
+      fprintf(stderr,
+              "ERROR: Failed to skip chunked-encoded chunk "
+              "(base10 invalid char)!\n");
+      return SDAS_INVALID_FILE;
+    } else if (size_ret == 3) {
+      // Invalid chunk size: larger than 32KiB
+      fprintf(stderr,
+              "ERROR: \"mini-chunk\" (chunked-encoding) size is larger "
+              "than 32KiB!\n");
+      return SDAS_INVALID_FILE;
+    } else if (size_from_base10 == 0) {
+      // End of chunk.
+      break;
+    }
+
+    if (compressed_size) {
+      *compressed_size += size_from_base10;
+    }
+
+    // Skip the current mini-chunk.
+    if (simple_archiver_io_read(buf, 1, size_from_base10, in_f)
+        != size_from_base10) {
+      fprintf(stderr,
+              "ERROR: Failed to skip chunked-encoded chunk (data)!\n");
+      return SDAS_INVALID_FILE;
+    }
+  }
+
+  return SDAS_SUCCESS;
+}
+
+void simple_archiver_internal_columns_free(SDArchiverInternalColumns **columns) {
+  if (columns && *columns) {
+    free((*columns)->data);
+    free((*columns)->owners);
+    free((*columns)->matches);
+    free(*columns);
+    *columns = NULL;
+  }
+}
+
+void simple_archiver_internal_columns_be_64(uint64_t *values, uint64_t count) {
+  if (simple_archiver_helper_is_big_endian()) {
+    return;
+  }
+  // Kept branch-free so that it is vectorized.
+  for (uint64_t idx = 0; idx < count; ++idx) {
+    values[idx] = __builtin_bswap64(values[idx]);
+  }
+}
+
+void simple_archiver_internal_columns_be_32(uint32_t *values, uint64_t count) {
+  if (simple_archiver_helper_is_big_endian()) {
+    return;
+  }
+  for (uint64_t idx = 0; idx < count; ++idx) {
+    values[idx] = __builtin_bswap32(values[idx]);
+  }
+}
+
+/// Reads a string of the owner table. "*name" is set to NULL if its length is
+/// zero. Returns zero on success.
+int simple_archiver_internal_columns_owner_str(const uint8_t *data,
+                                               uint64_t size,
+                                               uint64_t *pos,
+                                               const char **name) {
+  uint16_t u16;
+  if (*pos + 2 > size) {
+    return 1;
+  }
+  memcpy(&u16, data + *pos, 2);
+  simple_archiver_helper_16_bit_be(&u16);
+  *pos += 2;
+  if (u16 == 0) {
+    *name = NULL;
+    return 0;
+  } else if (*pos + u16 + 1 > size
+             || data[*pos + u16] != 0
+             || memchr(data + *pos, 0, u16) != NULL) {
+    return 1;
+  }
+  *name = (const char *)data + *pos;
+  *pos += (uint64_t)u16 + 1;
+  return 0;
+}
+
+/// Reads the columns of a chunk of "count" files (file format 9).
+/// Returns NULL on error.
+SDArchiverInternalColumns *simple_archiver_internal_columns_read(
+    SDArchiverIOStream *in_f, uint64_t count) {
+  uint64_t size;
+  if (simple_archiver_io_read(&size, 8, 1, in_f) != 1) {
+    return NULL;
+  }
+  simple_archiver_helper_64_bit_be(&size);
+  // Fixed-size columns of 20 bytes per file, the owner count, and the size of
+  // the filenames.
+  if (size < 8 || count > (size - 8) / 20) {
+    fprintf(stderr, "ERROR: Invalid size of file metadata columns!\n");
+    return NULL;
+  }
+
+  __attribute__((cleanup(simple_archiver_internal_columns_free)))
+  SDArchiverInternalColumns *columns =
+    calloc(1, sizeof(SDArchiverInternalColumns));
+  columns->count = count;
+  columns->data = malloc(size);
+  columns->matches = malloc(count == 0 ? 1 : count);
+  if (!columns->data || !columns->matches) {
+    fprintf(stderr, "ERROR: Failed to allocate file metadata columns!\n");
+    return NULL;
+  } else if (simple_archiver_io_read(columns->data, 1, size, in_f) != size) {
+    return NULL;
+  }
+
+  uint8_t *data = columns->data;
+  columns->sizes = (uint64_t *)data;
+  columns->bit_flags = data + count * 8;
+  columns->owner_idxs = (uint32_t *)(data + count * 12);
+  columns->name_offsets = (uint32_t *)(data + count * 16);
+  simple_archiver_internal_columns_be_64(columns->sizes, count);
+  simple_archiver_internal_columns_be_32(columns->owner_idxs, count);
+  simple_archiver_internal_columns_be_32(columns->name_offsets, count);
+
+  uint64_t pos = count * 20;
+  uint32_t u32;
+  memcpy(&u32, data + pos, 4);
+  simple_archiver_helper_32_bit_be(&u32);
+  pos += 4;
+  columns->owner_count = u32;
+  if (u32 > (size - pos) / 12) {
+    fprintf(stderr, "ERROR: Invalid owner count in file metadata columns!\n");
+    return NULL;
+  }
+  columns->owners = malloc(sizeof(SDArchiverInternalColumnOwner)
+                           * (u32 == 0 ? 1 : u32));
+  for (uint32_t idx = 0; idx < columns->owner_count; ++idx) {
+    SDArchiverInternalColumnOwner *owner = columns->owners + idx;
+    if (pos + 8 > size) {
+      fprintf(stderr, "ERROR: Invalid owner in file metadata columns!\n");
+      return NULL;
+    }
+    memcpy(&owner->uid, data + pos, 4);
+    simple_archiver_helper_32_bit_be(&owner->uid);
+    memcpy(&owner->gid, data + pos + 4, 4);
+    simple_archiver_helper_32_bit_be(&owner->gid);
+    pos += 8;
+    if (simple_archiver_internal_columns_owner_str(data,
+                                                   size,
+                                                   &pos,
+                                                   &owner->username)
+        || simple_archiver_internal_columns_owner_str(data,
+                                                      size,
+                                                      &pos,
+                                                      &owner->groupname)) {
+      fprintf(stderr, "ERROR: Invalid owner in file metadata columns!\n");
+      return NULL;
+    }
+  }
+
+  if (pos + 4 > size) {
+    fprintf(stderr, "ERROR: Invalid filenames in file metadata columns!\n");
+    return NULL;
+  }
+  memcpy(&u32, data + pos, 4);
+  simple_archiver_helper_32_bit_be(&u32);
+  pos += 4;
+  const uint32_t names_size = u32;
+  if (pos + names_size != size
+      || (names_size == 0 && count != 0)
+      || (names_size != 0 && data[size - 1] != 0)) {
+    fprintf(stderr, "ERROR: Invalid filenames in file metadata columns!\n");
+    return NULL;
+  }
+  columns->names = (const char *)data + pos;
+
+  for (uint64_t idx = 0; idx < count; ++idx) {
+    if (columns->owner_idxs[idx] >= columns->owner_count
+        || columns->name_offsets[idx] >= names_size
+        || strlen(columns->names + columns->name_offsets[idx]) >= 0xFFFF) {
+      fprintf(stderr,
+              "ERROR: Invalid file %" PRIu64 " in file metadata columns!\n",
+              idx);
+      return NULL;
+    }
+  }
+
+  SDArchiverInternalColumns *ret = columns;
+  columns = NULL;
+  return ret;
+}
+
+/// Returns non-zero if a file passes the size/owner filters of "parsed".
+int_fast8_t simple_archiver_internal_filter_file(const SDArchiverParsed *parsed,
+                                                 uint64_t size,
+                                                 uint32_t uid,
+                                                 uint32_t gid) {
+  return size >= parsed->filter_min_size
+         && size <= parsed->filter_max_size
+         && (!parsed->filter_uid || *parsed->filter_uid == uid)
+         && (!parsed->filter_gid || *parsed->filter_gid == gid)
+         ? 1 : 0;
+}
+
+/// Sets "matches" of "columns" by evaluating the size/owner filters of
+/// "parsed" over whole columns. Returns the number of matching files.
+uint64_t simple_archiver_internal_filter_columns(
+    const SDArchiverParsed *parsed, SDArchiverInternalColumns *columns) {
+  const uint64_t count = columns->count;
+  const uint64_t min_size = parsed->filter_min_size;
+  const uint64_t max_size = parsed->filter_max_size;
+  const uint64_t *sizes = columns->sizes;
+  uint8_t *matches = columns->matches;
+
+  // Kept branch-free so that the size column is compared with SIMD.
+  for (uint64_t idx = 0; idx < count; ++idx) {
+    matches[idx] =
+      (uint8_t)((sizes[idx] >= min_size) & (sizes[idx] <= max_size));
+  }
+
+  if (parsed->filter_uid || parsed->filter_gid) {
+    // Owners are shared by many files, so test each owner once.
+    __attribute__((cleanup(simple_archiver_helper_cleanup_malloced)))
+    void *owner_matches_ptr =
+      malloc(columns->owner_count == 0 ? 1 : columns->owner_count);
+    uint8_t *owner_matches = owner_matches_ptr;
+    for (uint32_t idx = 0; idx < columns->owner_count; ++idx) {
+      owner_matches[idx] = (uint8_t)simple_archiver_internal_filter_file(
+        parsed, min_size, columns->owners[idx].uid, columns->owners[idx].gid);
+    }
+    for (uint64_t idx = 0; idx < count; ++idx) {
+      matches[idx] &= owner_matches[columns->owner_idxs[idx]];
+    }
+  }
+
+  uint64_t match_count = 0;
+  for (uint64_t idx = 0; idx < count; ++idx) {
+    match_count += matches[idx];
+  }
+  return match_count;
+}
+
+/// Skips the metadata columns of a chunk (file format 9). Returns zero on
+/// success.
+int simple_archiver_internal_columns_skip(SDArchiverIOStream *in_f) {
+  uint64_t size;
+  if (simple_archiver_io_read(&size, 8, 1, in_f) != 1) {
+    return 1;
+  }
+  simple_archiver_helper_64_bit_be(&size);
+  char buf[SIMPLE_ARCHIVER_BUFFER_SIZE];
+  return read_buf_full_from_fd(in_f,
+                               buf,
+                               SIMPLE_ARCHIVER_BUFFER_SIZE,
+                               size,
+                               NULL,
+                               NULL) == SDAS_SUCCESS ? 0 : 1;
+}
+
+/// Sets the two hashes used for double hashing of "size" bytes of "path" in a
+/// Bloom filter (file format 10).
+void simple_archiver_internal_bloom_hash(const char *path,
+                                         size_t size,
+                                         uint32_t *h1,
+                                         uint32_t *h2) {
+  uint64_t hash = simple_archiver_helper_fnv1a_64(SDA_HELPER_FNV1A_64_INIT,
+                                                  path,
+                                                  size);
+  // Mix so that the high bits depend on every byte too.
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCD;
+  hash ^= hash >> 33;
+  *h1 = (uint32_t)hash;
+  *h2 = (uint32_t)(hash >> 32) | 1;
+}
+
+/// "bits" must be a power of two.
+void simple_archiver_internal_bloom_add(uint8_t *bloom,
+                                        uint32_t bits,
+                                        uint8_t hashes,
+                                        const char *path,
+                                        size_t size) {
+  uint32_t h1;
+  uint32_t h2;
+  simple_archiver_internal_bloom_hash(path, size, &h1, &h2);
+  for (uint32_t idx = 0; idx < hashes; ++idx) {
+    const uint32_t bit = (h1 + idx * h2) & (bits - 1);
+    bloom[bit / 8] |= (uint8_t)(1 << (bit % 8));
+  }
+}
+
+/// "bits" must be a power of two. Returns non-zero if "path" may be in the
+/// Bloom filter.
+int_fast8_t simple_archiver_internal_bloom_test(const uint8_t *bloom,
+                                                uint32_t bits,
+                                                uint8_t hashes,
+                                                const char *path,
+                                                size_t size) {
+  uint32_t h1;
+  uint32_t h2;
+  simple_archiver_internal_bloom_hash(path, size, &h1, &h2);
+  for (uint32_t idx = 0; idx < hashes; ++idx) {
+    const uint32_t bit = (h1 + idx * h2) & (bits - 1);
+    if ((bloom[bit / 8] & (1 << (bit % 8))) == 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+typedef struct SDArchiverInternalBloomTest {
+  const uint8_t *bloom;
+  uint32_t bits;
+  uint8_t hashes;
+} SDArchiverInternalBloomTest;
+
+int simple_archiver_internal_bloom_test_arg(const void *key,
+                                            size_t key_size,
+                                            SDAR_ATTR_UNUSED const void *value,
+                                            void *ud) {
+  const SDArchiverInternalBloomTest *test = ud;
+  // Stop iterating on the first argument that may be in the chunk.
+  return simple_archiver_internal_bloom_test(test->bloom,
+                                             test->bits,
+                                             test->hashes,
+                                             key,
+                                             key_size - 1);
+}
+
+/// Reads the Bloom filter of a chunk's paths (file format 10). Sets
+/// "*may_match" to non-zero if a path given as an argument may be in the
+/// chunk, or if no paths were given. Returns zero on success.
+int simple_archiver_internal_bloom_read(SDArchiverIOStream *in_f,
+                                        const SDArchiverParsed *parsed,
+                                        int_fast8_t *may_match) {
+  uint32_t size;
+  uint8_t hashes;
+  if (simple_archiver_io_read(&size, 4, 1, in_f) != 1
+      || simple_archiver_io_read(&hashes, 1, 1, in_f) != 1) {
+    return 1;
+  }
+  simple_archiver_helper_32_bit_be(&size);
+  if (size < 8
+      || size > SD_SA_BLOOM_MAX_SIZE
+      || (size & (size - 1)) != 0
+      || hashes == 0) {
+    fprintf(stderr, "ERROR: Invalid Bloom filter of chunk!\n");
+    return 1;
+  }
+
+  __attribute__((cleanup(simple_archiver_helper_cleanup_malloced)))
+  void *bloom = malloc(size);
+  if (simple_archiver_io_read(bloom, 1, size, in_f) != size) {
+    return 1;
+  }
+
+  if (parsed->just_w_files->count == 0) {
+    *may_match = 1;
+  } else {
+    SDArchiverInternalBloomTest test = {bloom, size * 8, hashes};
+    *may_match = simple_archiver_hash_map_iter(
+      parsed->just_w_files,
+      simple_archiver_internal_bloom_test_arg,
+      &test) != 0 ? 1 : 0;
+  }
+  return 0;
+}
+
+/// Writes the Bloom filter of the "count" NULL-terminated paths in "names"
+/// and their parent dirs (file format 10).
+SDArchiverStateReturns simple_archiver_internal_bloom_write(
+    SDArchiverIOStream *out_f,
+    const char *names,
+    uint64_t names_size,
+    uint64_t count) {
+  // Count the distinct parent dirs to size the filter.
+  __attribute__((cleanup(simple_archiver_hash_map_free)))
+  SDArchiverHashMap *dirs_map = simple_archiver_hash_map_init();
+  uint64_t path_count = count;
+  for (uint64_t pos = 0; pos < names_size; pos += strlen(names + pos) + 1) {
+    for (const char *iter = names + pos; *iter != 0; ++iter) {
+      if (*iter == '/' && iter != names + pos) {
+        const size_t dir_len = (size_t)(iter - (names + pos));
+        char *dir = malloc(dir_len + 1);
+        memcpy(dir, names + pos, dir_len);
+        dir[dir_len] = 0;
+        if (simple_archiver_hash_map_get(dirs_map, dir, dir_len + 1)) {
+          free(dir);
+        } else {
+          simple_archiver_hash_map_insert(
+            dirs_map,
+            (void *)1,
+            dir,
+            dir_len + 1,
+            simple_archiver_helper_datastructure_cleanup_nop,
+            NULL);
+          ++path_count;
+        }
+      }
+    }
+  }
+
+  uint32_t bits = 64;
+  while (bits < path_count * SD_SA_BLOOM_BITS_PER_PATH
+         && bits < SD_SA_BLOOM_MAX_SIZE * 8) {
+    bits *= 2;
+  }
+  const uint8_t hashes = SD_SA_BLOOM_HASHES;
+  __attribute__((cleanup(simple_archiver_helper_cleanup_malloced)))
+  void *bloom_ptr = calloc(bits / 8, 1);
+  uint8_t *bloom = bloom_ptr;
+
+  for (uint64_t pos = 0; pos < names_size; pos += strlen(names + pos) + 1) {
+    const char *name = names + pos;
+    simple_archiver_internal_bloom_add(bloom, bits, hashes, name, strlen(name));
+    for (const char *iter = name; *iter != 0; ++iter) {
+      if (*iter == '/' && iter != name) {
+        simple_archiver_internal_bloom_add(bloom,
+                                           bits,
+                                           hashes,
+                                           name,
+                                           (size_t)(iter - name));
+      }
+    }
+  }
+
+  uint32_t u32 = bits / 8;
+  simple_archiver_helper_32_bit_be(&u32);
+  if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1
+      || simple_archiver_io_write(&hashes, 1, 1, out_f) != 1
+      || simple_archiver_io_write(bloom, 1, bits / 8, out_f) != bits / 8) {
+    return SDAS_FAILED_TO_WRITE;
+  }
+  return SDAS_SUCCESS;
+}
+
+/// Returns non-zero if "filename" was given as an argument, or is within a
+/// dir that was given as an argument, or if no arguments were given. Used by
+/// every file format.
+int_fast8_t simple_archiver_internal_arg_allowed(const SDArchiverParsed *parsed,
+                                                 const char *filename) {
+  if (parsed->just_w_files->count == 0) {
+    return 1;
+  }
+  const size_t len = strlen(filename);
+  if (simple_archiver_hash_map_get(parsed->just_w_files, filename, len + 1)) {
+    return 1;
+  }
+  __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+  char *dir = strdup(filename);
+  for (size_t idx = len; idx-- > 1;) {
+    if (dir[idx] == '/') {
+      dir[idx] = 0;
+      if (simple_archiver_hash_map_get(parsed->just_w_files, dir, idx + 1)) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+void simple_archiver_internal_free_dir_summary(void *data) {
+  SDArchiverInternalDirSummary *summary = data;
+  if (summary) {
+    free(summary->path);
+    free(summary);
+  }
+}
+
+int simple_archiver_internal_dir_summary_less_fn(void *a, void *b) {
+  const SDArchiverInternalDirSummary *a_summary = a;
+  const SDArchiverInternalDirSummary *b_summary = b;
+
+  return strcmp(a_summary->path, b_summary->path) < 0;
+}
+
+/// Adds "size" to the summary of "path" (of length "path_len") in
+/// "summaries", creating the summary if needed.
+void simple_archiver_internal_dir_summary_add(SDArchiverHashMap *summaries,
+                                              const char *path,
+                                              size_t path_len,
+                                              uint64_t size) {
+  SDArchiverInternalDirSummary *summary = NULL;
+  {
+    __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+    char *key = malloc(path_len + 1);
+    memcpy(key, path, path_len);
+    key[path_len] = 0;
+    summary = simple_archiver_hash_map_get(summaries, key, path_len + 1);
+    if (!summary) {
+      summary = calloc(1, sizeof(SDArchiverInternalDirSummary));
+      summary->path = strdup(key);
+      simple_archiver_hash_map_insert(summaries,
+                                      summary,
+                                      key,
+                                      path_len + 1,
+                                      simple_archiver_internal_free_dir_summary,
+                                      NULL);
+      key = NULL;
+    }
+  }
+  ++summary->file_count;
+  summary->total_size += size;
+  if (size > summary->max_size) {
+    summary->max_size = size;
+  }
+}
+
+int simple_archiver_internal_dir_summary_to_btree(
+    __attribute__((unused)) const void *key,
+    __attribute__((unused)) size_t key_size,
+    const void *value,
+    void *ud) {
+  simple_archiver_btree_insert(ud,
+                               (void *)value,
+                               simple_archiver_helper_datastructure_cleanup_nop);
+  return 0;
+}
+
+/// Writes the summary table of every dir holding the files of "files_lists"
+/// (file format 11). "prefix" (may be NULL) is prepended to every filename.
+SDArchiverStateReturns simple_archiver_internal_dir_summaries_write(
+    SDArchiverIOStream *out_f,
+    const char *prefix,
+    SDArchiverLinkedList *const files_lists[2]) {
+  __attribute__((cleanup(simple_archiver_hash_map_free)))
+  SDArchiverHashMap *summaries = simple_archiver_hash_map_init();
+
+  for (size_t list_idx = 0; list_idx < 2; ++list_idx) {
+    if (!files_lists[list_idx]) {
+      continue;
+    }
+    for (SDArchiverLLNode *node = files_lists[list_idx]->head->next;
+         node != files_lists[list_idx]->tail;
+         node = node->next) {
+      const SDArchiverInternalFileInfo *file_info = node->data;
+      __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+      char *path = prefix
+        ? simple_archiver_helper_combine_strs(prefix, file_info->filename)
+        : strdup(file_info->filename);
+      simple_archiver_internal_dir_summary_add(summaries,
+                                               "",
+                                               0,
+                                               file_info->file_size);
+      for (const char *iter = path + 1; *iter != 0; ++iter) {
+        if (*iter == '/' && iter[-1] != '/') {
+          simple_archiver_internal_dir_summary_add(summaries,
+                                                   path,
+                                                   (size_t)(iter - path),
+                                                   file_info->file_size);
+        }
+      }
+    }
+  }
+
+  __attribute__((cleanup(simple_archiver_btree_free)))
+  SDArchiverBTree *ordered =
+    simple_archiver_btree_init(simple_archiver_internal_dir_summary_less_fn);
+  simple_archiver_hash_map_iter(summaries,
+                                simple_archiver_internal_dir_summary_to_btree,
+                                ordered);
+
+  uint64_t u64 = simple_archiver_btree_size(ordered);
+  simple_archiver_helper_64_bit_be(&u64);
+  if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
+    return SDAS_FAILED_TO_WRITE;
+  }
+
+  SDArchiverBTreeIter iter = simple_archiver_btree_begin(ordered);
+  const SDArchiverInternalDirSummary *summary;
+  while ((summary = simple_archiver_btree_iter_next(&iter))) {
+    const size_t path_len = strlen(summary->path);
+    if (path_len >= 0xFFFFFFFF) {
+      fprintf(stderr, "ERROR: Dir path is too long for dir summary!\n");
+      return SDAS_INVALID_PARSED_STATE;
+    }
+    uint32_t u32 = (uint32_t)path_len;
+    simple_archiver_helper_32_bit_be(&u32);
+    if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1
+        || simple_archiver_io_write(summary->path, 1, path_len + 1, out_f)
+           != path_len + 1) {
+      return SDAS_FAILED_TO_WRITE;
+    }
+    const uint64_t values[3] = {summary->file_count,
+                                summary->total_size,
+                                summary->max_size};
+    for (size_t idx = 0; idx < 3; ++idx) {
+      u64 = values[idx];
+      simple_archiver_helper_64_bit_be(&u64);
+      if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
+        return SDAS_FAILED_TO_WRITE;
+      }
+    }
+  }
+
+  return SDAS_SUCCESS;
+}
+
+int simple_archiver_internal_str_less_fn(void *a, void *b) {
+  return strcmp(a, b) < 0;
+}
+
+const char *simple_archiver_internal_dir_summary_to_str(const void *data) {
+  return ((const SDArchiverInternalDirSummary *)data)->path;
+}
+
+int simple_archiver_internal_dir_summary_cmp(const void *key,
+                                             const void *data) {
+  return strcmp(key, ((const SDArchiverInternalDirSummary *)data)->path);
+}
+
+int simple_archiver_internal_du_arg_to_btree(
+    const void *key,
+    __attribute__((unused)) size_t key_size,
+    __attribute__((unused)) const void *value,
+    void *ud) {
+  simple_archiver_btree_insert(
+    ud,
+    (void *)key,
+    simple_archiver_helper_datastructure_cleanup_nop);
+  return 0;
+}
+
+int simple_archiver_internal_du_print(void *data, void *ud) {
+  const SDArchiverInternalDirSummary *summary = data;
+  fprintf(stdout,
+          "%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%s\n",
+          summary->total_size,
+          summary->file_count,
+          summary->max_size,
+          summary->path[0] == 0 ? "." : summary->path);
+  ++*(uint64_t *)ud;
+  return 0;
+}
+
+/// Prints the summaries of "summaries" (ordered by path) asked for by "--du",
+/// which are the dirs given as arguments and the dirs within them ("." being
+/// the top dir). The parser already removed trailing "/" from the arguments.
+/// Returns the number of summaries printed.
+uint64_t simple_archiver_internal_du_print_args(
+    const SDArchiverParsed *parsed, const SDArchiverBTree *summaries) {
+  uint64_t printed = 0;
+  if (simple_archiver_hash_map_get(parsed->just_w_files, ".", 2)) {
+    simple_archiver_btree_iter(summaries,
+                               simple_archiver_internal_du_print,
+                               &printed);
+    return printed;
+  }
+
+  __attribute__((cleanup(simple_archiver_btree_free)))
+  SDArchiverBTree *args =
+    simple_archiver_btree_init(simple_archiver_internal_str_less_fn);
+  simple_archiver_hash_map_iter(parsed->just_w_files,
+                                simple_archiver_internal_du_arg_to_btree,
+                                args);
+
+  SDArchiverBTreeIter arg_iter = simple_archiver_btree_begin(args);
+  const char *arg;
+  while ((arg = simple_archiver_btree_iter_next(&arg_iter))) {
+    // Skip args within the dir of another arg, it prints them already.
+    const char *last_slash = strrchr(arg, '/');
+    if (last_slash && last_slash != arg) {
+      __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+      char *parent = strdup(arg);
+      parent[last_slash - arg] = 0;
+      if (simple_archiver_internal_arg_allowed(parsed, parent)) {
+        continue;
+      }
+    }
+
+    SDArchiverBTreeIter iter = simple_archiver_btree_lower_bound(
+      summaries, arg, simple_archiver_internal_dir_summary_cmp);
+    SDArchiverInternalDirSummary *summary =
+      simple_archiver_btree_iter_next(&iter);
+    if (summary && strcmp(summary->path, arg) == 0) {
+      simple_archiver_internal_du_print(summary, &printed);
+    }
+
+    __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+    char *prefix = simple_archiver_helper_combine_strs(arg, "/");
+    simple_archiver_btree_prefix_iter(
+      summaries,
+      prefix,
+      simple_archiver_internal_dir_summary_to_str,
+      simple_archiver_internal_du_print,
+      &printed);
+  }
+
+  return printed;
+}
+
+/// Reads the summary table of dirs (file format 11). With "--du", the
+/// summaries asked for are printed to stdout, otherwise when not extracting
+/// they are printed to stderr.
+SDArchiverStateReturns simple_archiver_internal_dir_summaries_read(
+    SDArchiverIOStream *in_f,
+    const SDArchiverParsed *parsed,
+    int_fast8_t do_extract) {
+  const int_fast8_t is_du = parsed->du && !do_extract;
+  uint64_t count;
+  if (simple_archiver_io_read(&count, 8, 1, in_f) != 1) {
+    return SDAS_INVALID_FILE;
+  }
+  simple_archiver_helper_64_bit_be(&count);
+  if (!do_extract && !is_du) {
+    fprintf(stderr, "DIRECTORY SUMMARIES\n");
+  }
+
+  // With arguments, "--du" collects the summaries by path to print the
+  // subtree of each argument after the table is read.
+  __attribute__((cleanup(simple_archiver_btree_free)))
+  SDArchiverBTree *du_summaries =
+    is_du && parsed->just_w_files->count != 0
+      ? simple_archiver_btree_init(
+          simple_archiver_internal_dir_summary_less_fn)
+      : NULL;
+  uint64_t printed = 0;
+  for (uint64_t idx = 0; idx < count; ++idx) {
+    uint32_t u32;
+    if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
+      return SDAS_INVALID_FILE;
+    }
+    simple_archiver_helper_32_bit_be(&u32);
+    __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+    char *path = malloc((size_t)u32 + 1);
+    if (simple_archiver_io_read(path, 1, (size_t)u32 + 1, in_f)
+        != (size_t)u32 + 1) {
+      return SDAS_INVALID_FILE;
+    }
+    path[u32] = 0;
+    if (u32 != 0
+        && simple_archiver_helper_has_null_before_size(path, u32 - 1) != 0) {
+      fprintf(stderr, "ERROR: Invalid dir summary path: \"%s\"!\n", path);
+      return SDAS_INVALID_FILE;
+    }
+
+    uint64_t values[3];
+    if (simple_archiver_io_read(values, 8, 3, in_f) != 3) {
+      return SDAS_INVALID_FILE;
+    }
+    for (size_t value_idx = 0; value_idx < 3; ++value_idx) {
+      simple_archiver_helper_64_bit_be(values + value_idx);
+    }
+
+    const char *shown_path = u32 == 0 ? "." : path;
+    if (du_summaries) {
+      SDArchiverInternalDirSummary *summary =
+        malloc(sizeof(SDArchiverInternalDirSummary));
+      summary->path = path;
+      path = NULL;
+      summary->file_count = values[0];
+      summary->total_size = values[1];
+      summary->max_size = values[2];
+      simple_archiver_btree_insert(du_summaries,
+                                   summary,
+                                   simple_archiver_internal_free_dir_summary);
+    } else if (is_du) {
+      fprintf(stdout,
+              "%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%s\n",
+              values[1],
+              values[0],
+              values[2],
+              shown_path);
+      ++printed;
+    } else if (!do_extract) {
+      fprintf(stderr,
+              "  %s: %" PRIu64 " file(s), %" PRIu64 " bytes, largest %" PRIu64
+              " bytes\n",
+              shown_path,
+              values[0],
+              values[1],
+              values[2]);
+    }
+  }
+
+  if (du_summaries) {
+    printed = simple_archiver_internal_du_print_args(parsed, du_summaries);
+  }
+  if (is_du) {
+    fflush(stdout);
+    if (printed == 0 && parsed->just_w_files->count != 0) {
+      fprintf(stderr, "WARNING: No directory summaries matched the path(s)!\n");
+    }
+  }
+  return SDAS_SUCCESS;
+}
+
+/// Appends "size" bytes of "data" to "*buf", growing it as needed.
+void simple_archiver_internal_columns_append(uint8_t **buf,
+                                             uint64_t *buf_size,
+                                             uint64_t *buf_capacity,
+                                             const void *data,
+                                             uint64_t size) {
+  if (*buf_size + size > *buf_capacity) {
+    while (*buf_size + size > *buf_capacity) {
+      *buf_capacity *= 2;
+    }
+    *buf = realloc(*buf, *buf_capacity);
+  }
+  memcpy(*buf + *buf_size, data, size);
+  *buf_size += size;
+}
+
+/// Serializes the owner of a file for the owner table of a chunk in file
+/// format 9 into "record", applying forced/mapped users and groups the same
+/// way as the per-file metadata of older formats. Returns the record's size,
+/// or zero on error.
+uint64_t simple_archiver_internal_columns_owner_record(
+    const SDArchiverParsed *parsed,
+    const SDArchiverInternalFileInfo *file_info,
+    uint8_t *record) {
+  uint32_t u32 = file_info->uid;
+  if ((parsed->flags & 0x400) == 0) {
+    uint32_t mapped_uid;
+    if (simple_archiver_get_uid_mapping(parsed->mappings,
+                                        parsed->users_infos,
+                                        u32,
+                                        &mapped_uid,
+                                        NULL) == 0) {
+      u32 = mapped_uid;
+    }
+  }
+  simple_archiver_helper_32_bit_be(&u32);
+  memcpy(record, &u32, 4);
+
+  u32 = file_info->gid;
+  if ((parsed->flags & 0x800) == 0) {
+    uint32_t mapped_gid;
+    if (simple_archiver_get_gid_mapping(parsed->mappings,
+                                        parsed->users_infos,
+                                        u32,
+                                        &mapped_gid,
+                                        NULL) == 0) {
+      u32 = mapped_gid;
+    }
+  }
+  simple_archiver_helper_32_bit_be(&u32);
+  memcpy(record + 4, &u32, 4);
+  uint64_t size = 8;
+
+  u32 = file_info->uid;
+  __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+  char *to_cleanup_user = NULL;
+  const char *username = simple_archiver_hash_map_get(
+    parsed->users_infos.UidToUname, &u32, sizeof(uint32_t));
+  if (username && (parsed->flags & 0x400) == 0) {
+    uint32_t out_uid;
+    const char *mapped_username = NULL;
+    if (simple_archiver_get_user_mapping(parsed->mappings,
+                                         parsed->users_infos,
+                                         username,
+                                         &out_uid,
+                                         &mapped_username) == 0
+        && mapped_username) {
+      username = mapped_username;
+      to_cleanup_user = (char *)mapped_username;
+    }
+  }
+
+  u32 = file_info->gid;
+  __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+  char *to_cleanup_group = NULL;
+  const char *groupname = simple_archiver_hash_map_get(
+    parsed->users_infos.GidToGname, &u32, sizeof(uint32_t));
+  if (groupname && (parsed->flags & 0x800) == 0) {
+    uint32_t out_gid;
+    const char *mapped_group = NULL;
+    if (simple_archiver_get_group_mapping(parsed->mappings,
+                                          parsed->users_infos,
+                                          groupname,
+                                          &out_gid,
+                                          &mapped_group) == 0
+        && mapped_group) {
+      groupname = mapped_group;
+      to_cleanup_group = (char *)mapped_group;
+    }
+  }
+
+  const char *names[2] = {username, groupname};
+  for (uint32_t idx = 0; idx < 2; ++idx) {
+    const size_t name_length = names[idx] ? strlen(names[idx]) : 0;
+    if (name_length >= 0xFFFF) {
+      return 0;
+    }
+    uint16_t u16 = (uint16_t)name_length;
+    simple_archiver_helper_16_bit_be(&u16);
+    memcpy(record + size, &u16, 2);
+    size += 2;
+    if (name_length != 0) {
+      memcpy(record + size, names[idx], name_length + 1);
+      size += name_length + 1;
+    }
+  }
+
+  return size;
+}
+
+/// Writes the metadata of the "count" files after "file_node" as columns
+/// (file format 9), preceded by the Bloom filter of their paths (file format
+/// 10).
+SDArchiverStateReturns simple_archiver_internal_columns_write(
+    SDArchiverIOStream *out_f,
+    const SDArchiverParsed *parsed,
+    const SDArchiverLLNode *file_node,
+    uint64_t count) {
+  const size_t prefix_length = parsed->prefix ? strlen(parsed->prefix) : 0;
+
+  __attribute__((cleanup(simple_archiver_helper_cleanup_malloced)))
+  void *fixed_ptr = malloc(count == 0 ? 1 : count * 20);
+  uint8_t *fixed = fixed_ptr;
+  uint64_t *sizes = fixed_ptr;
+  uint8_t *bit_flags = fixed + count * 8;
+  uint32_t *owner_idxs = (uint32_t *)(fixed + count * 12);
+  uint32_t *name_offsets = (uint32_t *)(fixed + count * 16);
+
+  uint64_t owners_size = 0;
+  uint64_t owners_capacity = 256;
+  __attribute__((cleanup(simple_archiver_helper_cleanup_malloced)))
+  void *owners_ptr = malloc(owners_capacity);
+  uint64_t names_size = 0;
+  uint64_t names_capacity = 256;
+  __attribute__((cleanup(simple_archiver_helper_cleanup_malloced)))
+  void *names_ptr = malloc(names_capacity);
+  // Large enough for uid, gid, and two names of maximum length.
+  __attribute__((cleanup(simple_archiver_helper_cleanup_malloced)))
+  void *record_ptr = malloc(8 + (2 + 0x10000) * 2);
+
+  // Keys are owner records, values are their index in the owner table.
+  __attribute__((cleanup(simple_archiver_hash_map_free)))
+  SDArchiverHashMap *owners_map = simple_archiver_hash_map_init();
+  uint32_t owner_count = 0;
+
+  for (uint64_t idx = 0; idx < count; ++idx) {
+    file_node = file_node->next;
+    const SDArchiverInternalFileInfo *file_info = file_node->data;
+
+    sizes[idx] = file_info->file_size;
+    memcpy(bit_flags + idx * 4, file_info->bit_flags, 4);
+
+    const size_t filename_len = strlen(file_info->filename);
+    if (filename_len + prefix_length >= 0xFFFF) {
+      fprintf(stderr, "ERROR: Filename is too large!\n");
+      return SDAS_INVALID_FILE;
+    } else if (names_size + prefix_length + filename_len + 1 > 0xFFFFFFFF) {
+      fprintf(stderr, "ERROR: Filenames of chunk are too large!\n");
+      return SDAS_INVALID_FILE;
+    }
+    name_offsets[idx] = (uint32_t)names_size;
+    uint8_t *names = names_ptr;
+    if (prefix_length != 0) {
+      simple_archiver_internal_columns_append(&names,
+                                              &names_size,
+                                              &names_capacity,
+                                              parsed->prefix,
+                                              prefix_length);
+    }
+    simple_archiver_internal_columns_append(&names,
+                                            &names_size,
+                                            &names_capacity,
+                                            file_info->filename,
+                                            filename_len + 1);
+    names_ptr = names;
+
+    const uint64_t record_size = simple_archiver_internal_columns_owner_record(
+      parsed, file_info, record_ptr);
+    if (record_size == 0) {
+      return SDAS_INTERNAL_ERROR;
+    }
+    const uint32_t *owner_idx =
+      simple_archiver_hash_map_get(owners_map, record_ptr, record_size);
+    if (owner_idx) {
+      owner_idxs[idx] = *owner_idx;
+    } else {
+      uint8_t *owners = owners_ptr;
+      simple_archiver_internal_columns_append(&owners,
+                                              &owners_size,
+                                              &owners_capacity,
+                                              record_ptr,
+                                              record_size);
+      owners_ptr = owners;
+
+      void *key = malloc(record_size);
+      memcpy(key, record_ptr, record_size);
+      uint32_t *value = malloc(sizeof(uint32_t));
+      *value = owner_count;
+      simple_archiver_hash_map_insert(owners_map,
+                                      value,
+                                      key,
+                                      record_size,
+                                      NULL,
+                                      NULL);
+      owner_idxs[idx] = owner_count++;
+    }
+  }
+
+  if (parsed->write_version >= 10) {
+    SDArchiverStateReturns ret = simple_archiver_internal_bloom_write(
+      out_f, names_ptr, names_size, count);
+    if (ret != SDAS_SUCCESS) {
+      return ret;
+    }
+  }
+
+  simple_archiver_internal_columns_be_64(sizes, count);
+  simple_archiver_internal_columns_be_32(owner_idxs, count);
+  simple_archiver_internal_columns_be_32(name_offsets, count);
+
+  uint64_t u64 = count * 20 + 4 + owners_size + 4 + names_size;
+  simple_archiver_helper_64_bit_be(&u64);
+  uint32_t owner_count_be = owner_count;
+  simple_archiver_helper_32_bit_be(&owner_count_be);
+  uint32_t names_size_be = (uint32_t)names_size;
+  simple_archiver_helper_32_bit_be(&names_size_be);
+  if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1
+      || simple_archiver_io_write(fixed, 1, count * 20, out_f) != count * 20
+      || simple_archiver_io_write(&owner_count_be, 4, 1, out_f) != 1
+      || simple_archiver_io_write(owners_ptr, 1, owners_size, out_f)
+         != owners_size
+      || simple_archiver_io_write(&names_size_be, 4, 1, out_f) != 1
+      || simple_archiver_io_write(names_ptr, 1, names_size, out_f)
+         != names_size) {
+    return SDAS_FAILED_TO_WRITE;
+  }
+
+  return SDAS_SUCCESS;
+}
+
+void simple_archiver_internal_delta_ref_free(SDArchiverInternalDeltaRef **ref) {
+  if (ref && *ref) {
+    simple_archiver_io_stream_free(&(*ref)->in_f);
+    if ((*ref)->f) {
+      fclose((*ref)->f);
+    }
+    if ((*ref)->decompressor) {
+      free((*ref)->decompressor);
+    }
+    if ((*ref)->chunks) {
+      for (uint64_t idx = 0; idx < (*ref)->chunk_count; ++idx) {
+        if ((*ref)->chunks[idx].filenames) {
+          simple_archiver_hash_map_free(&(*ref)->chunks[idx].filenames);
+        }
+      }
+      free((*ref)->chunks);
+    }
+    free(*ref);
+    *ref = NULL;
+  }
+}
+
+void simple_archiver_internal_delta_ref_data_cleanup(
+    SDArchiverInternalDeltaRefData *data) {
+  if (data->fd >= 0) {
+    close(data->fd);
+    data->fd = -1;
+  }
+  if (data->path) {
+    unlink(data->path);
+    free(data->path);
+    data->path = NULL;
+  }
+}
+
+/// Skips a string prefixed with its 16-bit length that is absent if the
+/// length is zero. Returns zero on success.
+int simple_archiver_internal_delta_ref_skip_str(SDArchiverIOStream *f) {
+  uint16_t u16;
+  if (simple_archiver_io_read(&u16, 2, 1, f) != 1) {
+    return 1;
+  }
+  simple_archiver_helper_16_bit_be(&u16);
+  if (u16 != 0 && simple_archiver_io_seek(f, (long)u16 + 1, SEEK_CUR) != 0) {
+    return 1;
+  }
+  return 0;
+}
+
+/// Indexes the chunks of a file format 6, 7, 8, 9, or 10 archive.
+/// Returns NULL on error. Must be free'd with
+/// "simple_archiver_internal_delta_ref_free".
+SDArchiverInternalDeltaRef *simple_archiver_internal_delta_ref_load(
+    const char *filename) {
+  __attribute__((cleanup(simple_archiver_internal_delta_ref_free)))
+  SDArchiverInternalDeltaRef *ref = malloc(sizeof(SDArchiverInternalDeltaRef));
+  memset(ref, 0, sizeof(SDArchiverInternalDeltaRef));
+
+  ref->f = fopen(filename, "rb");
+  if (!ref->f) {
+    fprintf(stderr,
+            "ERROR: Failed to open reference archive \"%s\"!\n",
+            filename);
+    return NULL;
+  }
+  ref->in_f = simple_archiver_io_stream_init_FILE(ref->f, 0);
+
+  char buf[20];
+  uint8_t flags[4];
+  uint16_t u16;
+  uint32_t u32;
+  uint64_t u64;
+
+  if (simple_archiver_io_read(buf, 1, 20, ref->in_f) != 20
+      || memcmp(buf, "SIMPLE_ARCHIVE_VER", 18) != 0) {
+    fprintf(stderr, "ERROR: Reference archive is not a valid archive!\n");
+    return NULL;
+  }
+  memcpy(&u16, buf + 18, 2);
+  simple_archiver_helper_16_bit_be(&u16);
+  ref->version = u16;
+  if (ref->version < 6 || ref->version > 11) {
+    fprintf(stderr,
+            "ERROR: Reference archive must be file format 6 to 11!\n");
+    return NULL;
+  }
+
+  if (simple_archiver_io_read(flags, 1, 4, ref->in_f) != 4) {
+    goto INVALID_REF;
+  }
+  const int_fast8_t is_compressed = (flags[0] & 1) ? 1 : 0;
+
+  if (is_compressed) {
+    // Compressor.
+    if (simple_archiver_internal_delta_ref_skip_str(ref->in_f)) {
+      goto INVALID_REF;
+    }
+    // Decompressor.
+    if (simple_archiver_io_read(&u16, 2, 1, ref->in_f) != 1) {
+      goto INVALID_REF;
+    }
+    simple_archiver_helper_16_bit_be(&u16);
+    ref->decompressor = malloc((size_t)u16 + 1);
+    if (simple_archiver_io_read(ref->decompressor,
+                                1,
+                                (size_t)u16 + 1,
+                                ref->in_f)
+        != (size_t)u16 + 1) {
+      goto INVALID_REF;
+    }
+    ref->decompressor[u16] = 0;
+  }
 
-  return 0;
-}
-
-int greater_strlen_fn(void *a, void *b) {
-  return strlen(a) > strlen(b);
-}
+  if (ref->version >= 11) {
+    // Directory summaries.
+    if (simple_archiver_io_read(&u64, 8, 1, ref->in_f) != 1) {
+      goto INVALID_REF;
+    }
+    simple_archiver_helper_64_bit_be(&u64);
+    for (uint64_t idx = 0; idx < u64; ++idx) {
+      if (simple_archiver_io_read(&u32, 4, 1, ref->in_f) != 1) {
+        goto INVALID_REF;
+      }
+      simple_archiver_helper_32_bit_be(&u32);
+      if (simple_archiver_io_seek(ref->in_f, (long)u32 + 1 + 8 * 3, SEEK_CUR)
+          != 0) {
+        goto INVALID_REF;
+      }
+    }
+  }
 
-int greater_dirnamelen_fn(void *a, void *b) {
-  const SDArchiverInternalDirInfo *ad = a;
-  const SDArchiverInternalDirInfo *bd = b;
-  return strlen(ad->dirname) > strlen(bd->dirname);
-}
+  // Directories.
+  if (simple_archiver_io_read(&u64, 8, 1, ref->in_f) != 1) {
+    goto INVALID_REF;
+  }
+  simple_archiver_helper_64_bit_be(&u64);
+  for (uint64_t idx = 0; idx < u64; ++idx) {
+    if (simple_archiver_io_read(&u32, 4, 1, ref->in_f) != 1) {
+      goto INVALID_REF;
+    }
+    simple_archiver_helper_32_bit_be(&u32);
+    if (simple_archiver_io_seek(ref->in_f, (long)u32 + 1 + 2 + 8, SEEK_CUR) != 0
+        || simple_archiver_internal_delta_ref_skip_str(ref->in_f)
+        || simple_archiver_internal_delta_ref_skip_str(ref->in_f)) {
+      goto INVALID_REF;
+    }
+  }
 
-SDArchiverStateRetStruct prefix_dirs_to_forced_permissions(
-    const SDArchiverState *state) {
-  // Assumes cwd is already changed to specified with "-C" (if "-C" is used").
-  if ((state->parsed->flags & 0x800000) == 0) {
-    // Flag is not set. Do not return error.
-    return SDA_RET_STRUCT(SDAS_SUCCESS);
-  } else if (!state->parsed->prefix) {
-    // Prefix is not set. Do not return error.
-    return SDA_RET_STRUCT(SDAS_SUCCESS);
+  // Symlinks.
+  if (simple_archiver_io_read(&u64, 8, 1, ref->in_f) != 1) {
+    goto INVALID_REF;
+  }
+  simple_archiver_helper_64_bit_be(&u64);
+  for (uint64_t idx = 0; idx < u64; ++idx) {
+    if (simple_archiver_io_seek(ref->in_f, 2, SEEK_CUR) != 0
+        || simple_archiver_internal_delta_ref_skip_str(ref->in_f)
+        || simple_archiver_internal_delta_ref_skip_str(ref->in_f)
+        || simple_archiver_internal_delta_ref_skip_str(ref->in_f)
+        || simple_archiver_io_seek(ref->in_f, 8, SEEK_CUR) != 0
+        || simple_archiver_internal_delta_ref_skip_str(ref->in_f)
+        || simple_archiver_internal_delta_ref_skip_str(ref->in_f)) {
+      goto INVALID_REF;
+    }
   }
 
-  __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
-  char *buf = strdup(state->parsed->prefix);
+  // Chunks.
+  if (simple_archiver_io_read(&u64, 8, 1, ref->in_f) != 1) {
+    goto INVALID_REF;
+  }
+  simple_archiver_helper_64_bit_be(&u64);
+  ref->chunks = calloc(u64, sizeof(SDArchiverInternalDeltaRefChunk));
+  if (!ref->chunks && u64 != 0) {
+    goto INVALID_REF;
+  }
+  ref->chunk_count = u64;
 
-  const mode_t prefix_perms = simple_archiver_internal_permissions_to_mode_t(
-    state->parsed->prefix_dir_permissions);
+  for (uint64_t chunk_idx = 0; chunk_idx < ref->chunk_count; ++chunk_idx) {
+    SDArchiverInternalDeltaRefChunk *chunk = &ref->chunks[chunk_idx];
+    chunk->filenames = simple_archiver_hash_map_init();
 
-  for (size_t idx = strlen(buf); idx-- > 0;) {
-    if (buf[idx] == '/') {
-      buf[idx] = 0;
+    uint64_t file_count;
+    if (simple_archiver_io_read(&file_count, 8, 1, ref->in_f) != 1) {
+      goto INVALID_REF;
+    }
+    simple_archiver_helper_64_bit_be(&file_count);
+    if (ref->version >= 10) {
+      // Every chunk is indexed, so the Bloom filter is not needed.
+      uint32_t bloom_size;
+      if (simple_archiver_io_read(&bloom_size, 4, 1, ref->in_f) != 1) {
+        goto INVALID_REF;
+      }
+      simple_archiver_helper_32_bit_be(&bloom_size);
+      if (simple_archiver_io_seek(ref->in_f, (long)bloom_size + 1, SEEK_CUR)
+          != 0) {
+        goto INVALID_REF;
+      }
+    }
+    if (ref->version >= 9) {
+      __attribute__((cleanup(simple_archiver_internal_columns_free)))
+      SDArchiverInternalColumns *columns =
+        simple_archiver_internal_columns_read(ref->in_f, file_count);
+      if (!columns) {
+        goto INVALID_REF;
+      }
+      for (uint64_t file_idx = 0; file_idx < file_count; ++file_idx) {
+        const char *name = columns->names + columns->name_offsets[file_idx];
+        const size_t name_size = strlen(name) + 1;
+        if (simple_archiver_hash_map_get(chunk->filenames, name, name_size)
+            == NULL) {
+          char *name_copy = malloc(name_size);
+          memcpy(name_copy, name, name_size);
+          simple_archiver_hash_map_insert(
+            chunk->filenames,
+            (void *)1,
+            name_copy,
+            name_size,
+            simple_archiver_helper_datastructure_cleanup_nop,
+            NULL);
+        }
+      }
+      // The loop below is for the per-file metadata of older formats.
+      file_count = 0;
+    }
+    for (uint64_t file_idx = 0; file_idx < file_count; ++file_idx) {
+      if (simple_archiver_io_read(&u16, 2, 1, ref->in_f) != 1) {
+        goto INVALID_REF;
+      }
+      simple_archiver_helper_16_bit_be(&u16);
+      char *name = malloc((size_t)u16 + 1);
+      if (simple_archiver_io_read(name, 1, (size_t)u16 + 1, ref->in_f)
+          != (size_t)u16 + 1) {
+        free(name);
+        goto INVALID_REF;
+      }
+      name[u16] = 0;
+      if (simple_archiver_hash_map_get(chunk->filenames, name, (size_t)u16 + 1)
+          == NULL) {
+        simple_archiver_hash_map_insert(
+          chunk->filenames,
+          (void *)1,
+          name,
+          (size_t)u16 + 1,
+          simple_archiver_helper_datastructure_cleanup_nop,
+          NULL);
+      } else {
+        free(name);
+      }
 
-      int chmod_ret = chmod(buf, prefix_perms);
-      if (chmod_ret != 0) {
-        fprintf(stderr,
-                "ERROR: Failed to set perfix-dir permissions, errno %d\n",
-                errno);
-        return SDA_RET_STRUCT(SDAS_PERMISSION_SET_FAIL);
+      // Flags and uid/gid, username/groupname, file size.
+      if (simple_archiver_io_seek(ref->in_f, 4 + 8, SEEK_CUR) != 0
+          || simple_archiver_internal_delta_ref_skip_str(ref->in_f)
+          || simple_archiver_internal_delta_ref_skip_str(ref->in_f)
+          || simple_archiver_io_seek(ref->in_f, 8, SEEK_CUR) != 0) {
+        goto INVALID_REF;
       }
+    }
 
-      buf[idx] = '/';
+    uint8_t chunk_flags[2];
+    if (simple_archiver_io_read(chunk_flags, 1, 2, ref->in_f) != 2) {
+      goto INVALID_REF;
+    }
+    chunk->is_compressed = is_compressed && (chunk_flags[0] & 1) ? 1 : 0;
+    chunk->is_delta = ref->version >= 8 && (chunk_flags[0] & 2) ? 1 : 0;
+    if (chunk->is_delta
+        && simple_archiver_io_seek(ref->in_f, 24, SEEK_CUR) != 0) {
+      goto INVALID_REF;
+    }
+
+    chunk->data_pos = simple_archiver_io_tell(ref->in_f);
+    if (chunk->data_pos < 0) {
+      goto INVALID_REF;
+    }
+
+    if (!chunk->is_compressed || ref->version == 6) {
+      if (simple_archiver_io_read(&u64, 8, 1, ref->in_f) != 1) {
+        goto INVALID_REF;
+      }
+      simple_archiver_helper_64_bit_be(&u64);
+      if (!chunk->is_compressed) {
+        // "SA" is prepended to non-compressed chunks.
+        u64 += 2;
+      }
+      if (simple_archiver_io_seek(ref->in_f, (long)u64, SEEK_CUR) != 0) {
+        goto INVALID_REF;
+      }
+    } else if (internal_skip_chunked_encoded_chunk(ref->in_f, NULL)
+               != SDAS_SUCCESS) {
+      goto INVALID_REF;
     }
   }
 
-  return SDA_RET_STRUCT(SDAS_SUCCESS);
-}
+  SDArchiverInternalDeltaRef *ret = ref;
+  ref = NULL;
+  return ret;
 
-SDArchiverStateRetStruct prefix_dirs_to_forced_ownership(
-    const SDArchiverState *state) {
-  if (state->parsed->prefix && simple_archiver_helper_can_chown()) {
-    // Only set uid/gid if has CAP_CHOWN and args to set them were used.
-    uint32_t uid = getuid();
-    uint32_t gid = getgid();
-    int_fast8_t will_use_chown = 0;
+INVALID_REF:
+  fprintf(stderr,
+          "ERROR: Failed to parse reference archive \"%s\"!\n",
+          filename);
+  return NULL;
+}
 
-    if (state->parsed->flags & 0x1000000) {
-      uid = state->parsed->prefix_user.uid;
-      will_use_chown = 1;
-    } else if (state->parsed->flags & 0x2000000) {
-      uint32_t *uid_mapped = NULL;
-      uid_mapped = simple_archiver_hash_map_get(
-          state->parsed->users_infos.UnameToUid,
-          state->parsed->prefix_user.username,
-          strlen(state->parsed->prefix_user.username) + 1);
-      if (uid_mapped) {
-        uid = *uid_mapped;
-        will_use_chown = 1;
-      } else {
-        fprintf(stderr,
-                "WARNING: No mapping for username \"%s\" for setting prefix "
-                "dir user!\n",
-                state->parsed->prefix_user.username);
+/// Returns the index of the reference chunk with the most filenames in
+/// common with "names" (a list of c-strings), or negative if there is none.
+int64_t simple_archiver_internal_delta_ref_match(
+    const SDArchiverInternalDeltaRef *ref,
+    const SDArchiverLinkedList *names) {
+  int64_t best_idx = -1;
+  uint64_t best_count = 0;
+  for (uint64_t idx = 0; idx < ref->chunk_count; ++idx) {
+    const SDArchiverInternalDeltaRefChunk *chunk = &ref->chunks[idx];
+    if (chunk->is_delta) {
+      continue;
+    }
+    uint64_t count = 0;
+    for (const SDArchiverLLNode *node = names->head->next;
+         node != names->tail;
+         node = node->next) {
+      if (simple_archiver_hash_map_get(chunk->filenames,
+                                       node->data,
+                                       strlen(node->data) + 1)) {
+        ++count;
       }
     }
+    if (count > best_count) {
+      best_count = count;
+      best_idx = (int64_t)idx;
+    }
+  }
+  return best_idx;
+}
 
-    if (state->parsed->flags & 0x4000000) {
-      gid = state->parsed->prefix_group.gid;
-      will_use_chown = 1;
-    } else if (state->parsed->flags & 0x8000000) {
-      uint32_t *gid_mapped = NULL;
-      gid_mapped = simple_archiver_hash_map_get(
-          state->parsed->users_infos.GnameToGid,
-          state->parsed->prefix_group.groupname,
-          strlen(state->parsed->prefix_group.groupname) + 1);
-      if (gid_mapped) {
-        gid = *gid_mapped;
-        will_use_chown = 1;
-      } else {
-        fprintf(stderr,
-                "WARNING: No mapping found for groupname \"%s\" for setting "
-                "prefix dir group!\n",
-                state->parsed->prefix_group.groupname);
+/// Returns zero on success.
+int simple_archiver_internal_write_fd_full(int fd,
+                                           const char *buf,
+                                           size_t size) {
+  while (size != 0) {
+    const ssize_t written = write(fd, buf, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
       }
+      return 1;
     }
+    buf += written;
+    size -= (size_t)written;
+  }
+  return 0;
+}
 
-    if (will_use_chown) {
-      __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
-      char *buf = strdup(state->parsed->prefix);
-      for (size_t idx = strlen(buf); idx-- > 0;) {
-        if (buf[idx] == '/') {
-          buf[idx] = 0;
+/// Copies the chunked-encoded data at the current position of "in_f" to
+/// "fd" without the chunked-encoding.
+SDArchiverStateReturns simple_archiver_internal_delta_ref_copy_chunked(
+    SDArchiverIOStream *in_f,
+    int fd) {
+  char buf[SIMPLE_ARCHIVER_BUFFER_SIZE];
+  while (1) {
+    uint32_t size_from_base10;
+    if (simple_archiver_internal_v7_read_frame_size(in_f, &size_from_base10)
+        != 0) {
+      return SDAS_INVALID_FILE;
+    } else if (size_from_base10 == 0) {
+      return SDAS_SUCCESS;
+    }
 
-          int chown_ret =
-            fchownat(AT_FDCWD, buf, uid, gid, AT_SYMLINK_NOFOLLOW);
-          if (chown_ret != 0) {
-            fprintf(stderr,
-                    "ERROR: Failed to set prefix-dir ownership, errno %d\n",
-                    errno);
-            return SDA_RET_STRUCT(SDAS_PERMISSION_SET_FAIL);
-          }
+    if (simple_archiver_io_read(buf, 1, size_from_base10, in_f)
+        != size_from_base10) {
+      return SDAS_INVALID_FILE;
+    } else if (simple_archiver_internal_write_fd_full(fd,
+                                                      buf,
+                                                      size_from_base10)) {
+      return SDAS_DELTA_REF_ERROR;
+    }
+  }
+}
 
-          buf[idx] = '/';
-        }
-      }
+/// Puts the uncompressed data of reference chunk "chunk_idx" into a temporary
+/// file. "out" must be cleaned up with
+/// "simple_archiver_internal_delta_ref_data_cleanup" even on error.
+SDArchiverStateReturns simple_archiver_internal_delta_ref_get_data(
+    SDArchiverInternalDeltaRef *ref,
+    uint64_t chunk_idx,
+    const SDArchiverParsed *parsed,
+    SDArchiverInternalDeltaRefData *out) {
+  out->path = NULL;
+  out->fd = -1;
+  out->size = 0;
+  out->hash = SDA_HELPER_FNV1A_64_INIT;
+
+  if (chunk_idx >= ref->chunk_count || ref->chunks[chunk_idx].is_delta) {
+    fprintf(stderr,
+            "ERROR: Reference chunk %" PRIu64 " is not usable!\n",
+            chunk_idx + 1);
+    return SDAS_DELTA_REF_ERROR;
+  }
+  const SDArchiverInternalDeltaRefChunk *chunk = &ref->chunks[chunk_idx];
+
+  const char *temp_dir = parsed ? parsed->temp_dir : NULL;
+  if (!temp_dir) {
+    temp_dir = getenv("TMPDIR");
+  }
+  if (!temp_dir || temp_dir[0] == 0) {
+    temp_dir = "/tmp";
+  }
+  out->path = simple_archiver_helper_combine_strs(
+    temp_dir, "/simple_archiver_delta_ref_XXXXXX");
+  if (!out->path) {
+    return SDAS_INTERNAL_ERROR;
+  }
+  // The path is passed to the de/compressor cmd which is split on whitespace.
+  for (const char *c = out->path; *c != 0; ++c) {
+    if (*c == ' ' || *c == '\t' || *c == '\n') {
+      fprintf(stderr,
+              "ERROR: Temporary directory for reference data must not "
+              "contain whitespace!\n");
+      free(out->path);
+      out->path = NULL;
+      return SDAS_DELTA_REF_ERROR;
     }
   }
+  out->fd = mkstemp(out->path);
+  if (out->fd < 0) {
+    fprintf(stderr,
+            "ERROR: Failed to create temporary file for reference data!\n");
+    free(out->path);
+    out->path = NULL;
+    return SDAS_DELTA_REF_ERROR;
+  }
 
-  return SDA_RET_STRUCT(SDAS_SUCCESS);
-}
+  if (simple_archiver_io_seek(ref->in_f, chunk->data_pos, SEEK_SET) != 0) {
+    return SDAS_DELTA_REF_ERROR;
+  }
 
-SDArchiverStateReturns internal_skip_chunked_encoded_chunk(
-    FILE *in_f,
-    uint64_t *compressed_size) {
-  uint64_t size_from_base10;
-  char c = 0;
   char buf[SIMPLE_ARCHIVER_BUFFER_SIZE];
-  while (!feof(in_f) && !ferror(in_f)) {
-    size_from_base10 = 0;
-    size_t fread_amt = fread(&c, 1, 1, in_f);
+  uint64_t u64;
 
-    // Get the base10 number.
-    while (c != '\n') {
-      if (fread_amt != 1) {
-        fprintf(stderr,
-                "ERROR: Failed to skip chunked-encoded chunk "
-                "(base10 size)!\n");
-        return SDAS_INVALID_FILE;
-      } else if (c < '0' || c > '9') {
-        fprintf(stderr,
-                "ERROR: Failed to skip chunked-encoded chunk "
-                "(base10 invalid char)!\n");
+  if (!chunk->is_compressed) {
+    if (simple_archiver_io_read(&u64, 8, 1, ref->in_f) != 1) {
+      return SDAS_INVALID_FILE;
+    }
+    simple_archiver_helper_64_bit_be(&u64);
+    // Keep "SA" since it is part of the data the compressor got.
+    u64 += 2;
+    while (u64 != 0) {
+      const size_t amount = u64 > SIMPLE_ARCHIVER_BUFFER_SIZE
+                            ? SIMPLE_ARCHIVER_BUFFER_SIZE : (size_t)u64;
+      if (simple_archiver_io_read(buf, 1, amount, ref->in_f) != amount) {
         return SDAS_INVALID_FILE;
+      } else if (simple_archiver_internal_write_fd_full(out->fd,
+                                                        buf,
+                                                        amount)) {
+        return SDAS_DELTA_REF_ERROR;
       }
-      size_from_base10 = size_from_base10 * 10 + (uint64_t)(c - '0');
-      fread_amt = fread(&c, 1, 1, in_f);
+      u64 -= amount;
+    }
+  } else {
+    if (!ref->decompressor) {
+      return SDAS_NO_DECOMPRESSOR;
+    }
+    int pipe_into_cmd[2];
+    if (pipe(pipe_into_cmd) != 0) {
+      return SDAS_INTERNAL_ERROR;
     }
+    // The decompressor writes directly into the temporary file.
+    const int out_fd = dup(out->fd);
+    if (out_fd < 0) {
+      close(pipe_into_cmd[0]);
+      close(pipe_into_cmd[1]);
+      return SDAS_INTERNAL_ERROR;
+    }
+    int pipe_outof_cmd[2] = {out_fd, out_fd};
 
-    // Break if end of chunk.
-    if (size_from_base10 == 0) {
-      break;
-    } else if (size_from_base10 > SD_SA_32KiB) {
-      // Invalid chunk size: larger than 32KiB
+    __attribute__((cleanup(simple_archiver_internal_cleanup_decomp_pid)))
+    pid_t decompressor_pid = -1;
+    if (simple_archiver_de_compress(pipe_into_cmd,
+                                    pipe_outof_cmd,
+                                    ref->decompressor,
+                                    &decompressor_pid) != 0) {
       fprintf(stderr,
-              "ERROR: \"mini-chunk\" (chunked-encoding) size is larger "
-              "than 32KiB!\n");
-      return SDAS_INVALID_FILE;
+              "ERROR: Failed to start decompressor for reference data!\n");
+      return SDAS_DECOMPRESSION_ERROR;
     }
+    close(pipe_into_cmd[0]);
+    close(out_fd);
 
-    if (compressed_size) {
-      *compressed_size += size_from_base10;
+    __attribute__((cleanup(simple_archiver_internal_cleanup_int_fd)))
+    int into_cmd_fd = pipe_into_cmd[1];
+
+    is_sig_pipe_occurred = 0;
+    simple_archiver_helper_set_signal_action(SIGPIPE, handle_sig_pipe);
+
+    SDArchiverStateReturns ret = SDAS_SUCCESS;
+    if (ref->version == 6) {
+      if (simple_archiver_io_read(&u64, 8, 1, ref->in_f) != 1) {
+        ret = SDAS_INVALID_FILE;
+      }
+      simple_archiver_helper_64_bit_be(&u64);
+      while (ret == SDAS_SUCCESS && u64 != 0) {
+        const size_t amount = u64 > SIMPLE_ARCHIVER_BUFFER_SIZE
+                              ? SIMPLE_ARCHIVER_BUFFER_SIZE : (size_t)u64;
+        if (simple_archiver_io_read(buf, 1, amount, ref->in_f) != amount) {
+          ret = SDAS_INVALID_FILE;
+        } else if (simple_archiver_internal_write_fd_full(into_cmd_fd,
+                                                          buf,
+                                                          amount)) {
+          ret = SDAS_DELTA_REF_ERROR;
+        }
+        u64 -= amount;
+      }
+    } else {
+      ret = simple_archiver_internal_delta_ref_copy_chunked(ref->in_f,
+                                                            into_cmd_fd);
     }
+    simple_archiver_internal_cleanup_int_fd(&into_cmd_fd);
 
-    // Read/skip the current mini-chunk.
-    while (size_from_base10 != 0) {
-      if (size_from_base10 > SIMPLE_ARCHIVER_BUFFER_SIZE) {
-        fread_amt = fread(buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE, in_f);
-        size_from_base10 -= fread_amt;
-      } else {
-        fread_amt = fread(buf, 1, size_from_base10, in_f);
-        size_from_base10 -= fread_amt;
+    int status;
+    const pid_t waited = waitpid(decompressor_pid, &status, 0);
+    if (waited == decompressor_pid) {
+      decompressor_pid = -1;
+    }
+    if (ret != SDAS_SUCCESS) {
+      fprintf(stderr, "ERROR: Failed to decompress reference data!\n");
+      return ret;
+    } else if (waited < 0 || !WIFEXITED(status)
+               || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "ERROR: Failed to decompress reference data!\n");
+      return SDAS_DECOMPRESSION_ERROR;
+    }
+  }
+
+  if (lseek(out->fd, 0, SEEK_SET) != 0) {
+    return SDAS_DELTA_REF_ERROR;
+  }
+  while (1) {
+    const ssize_t read_amt = read(out->fd, buf, SIMPLE_ARCHIVER_BUFFER_SIZE);
+    if (read_amt < 0) {
+      if (errno == EINTR) {
+        continue;
       }
+      return SDAS_DELTA_REF_ERROR;
+    } else if (read_amt == 0) {
+      break;
     }
+    out->size += (uint64_t)read_amt;
+    out->hash = simple_archiver_helper_fnv1a_64(out->hash,
+                                                buf,
+                                                (size_t)read_amt);
   }
 
   return SDAS_SUCCESS;
@@ -3059,6 +5689,12 @@ char *simple_archiver_error_to_string(enum SDArchiverStateReturns error) {
       return "Failed to set permissions";
     case SDAS_UID_GID_SET_FAIL:
       return "Failed to set ownership";
+    case SDAS_INVALID_WRITER_ENTRY:
+      return "Invalid entry given to archive writer";
+    case SDAS_INVALID_IO:
+      return "Unusable I/O backend";
+    case SDAS_DELTA_REF_ERROR:
+      return "Failed to use reference archive for delta compression";
     default:
       return "Unknown error";
   }
@@ -3088,8 +5724,46 @@ void simple_archiver_free_state(SDArchiverState **state) {
   }
 }
 
-SDArchiverStateRetStruct simple_archiver_write_all(
-    FILE *out_f,
+/// Writes file formats 4 and up through a writer thread that owns the writes
+/// to "out_f", so compressing does not wait on slow output until
+/// "write_buffer_size" bytes are queued.
+SDArchiverStateRetStruct simple_archiver_internal_write_v4_async(
+    SDArchiverIOStream *out_f,
+    SDArchiverState *state,
+    SDArchiverHashMap *write_state) {
+  if (state->parsed->write_buffer_size == 0) {
+    return simple_archiver_write_v4v5v6v7(out_f, state, write_state);
+  }
+
+  // The writer thread writes to the backend of "out_f" after it.
+  if (simple_archiver_io_flush(out_f) != 0) {
+    fprintf(stderr, "ERROR: Failed to write to the archive output!\n");
+    return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+  }
+  __attribute__((cleanup(simple_archiver_io_free)))
+  SDArchiverIO *io = simple_archiver_io_init_async(
+    simple_archiver_io_stream_io(out_f),
+    state->parsed->write_buffer_size,
+    SD_SA_32KiB);
+  SDArchiverIOStream *async_f = simple_archiver_io_stream_init(io, 1);
+  if (!async_f) {
+    simple_archiver_io_free(&io);
+    return simple_archiver_write_v4v5v6v7(out_f, state, write_state);
+  }
+
+  SDArchiverStateRetStruct ret =
+    simple_archiver_write_v4v5v6v7(async_f, state, write_state);
+  const int close_ret = simple_archiver_io_stream_close(&async_f);
+  if ((simple_archiver_io_async_finish(io) != 0 || close_ret != 0)
+      && ret.ret == SDAS_SUCCESS) {
+    fprintf(stderr, "ERROR: Failed to write to the archive output!\n");
+    return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+  }
+  return ret;
+}
+
+SDArchiverStateRetStruct simple_archiver_internal_write_all(
+    SDArchiverIOStream *out_f,
     SDArchiverState *state) {
   simple_archiver_helper_set_signal_action(SIGINT, handle_sig_int);
   simple_archiver_helper_set_signal_action(SIGHUP, handle_sig_int);
@@ -3105,7 +5779,7 @@ SDArchiverStateRetStruct simple_archiver_write_all(
                                                               state,
                                                               write_state);
       if (ret.ret == SDAS_SUCCESS) {
-        internal_simple_archiver_parse_stats(write_state);
+        internal_simple_archiver_parse_stats(write_state, state->parsed);
       }
       return ret;
     }
@@ -3115,7 +5789,7 @@ SDArchiverStateRetStruct simple_archiver_write_all(
                                                               state,
                                                               write_state);
       if (ret.ret == SDAS_SUCCESS) {
-        internal_simple_archiver_parse_stats(write_state);
+        internal_simple_archiver_parse_stats(write_state, state->parsed);
       }
       return ret;
     }
@@ -3125,7 +5799,7 @@ SDArchiverStateRetStruct simple_archiver_write_all(
                                                               state,
                                                               write_state);
       if (ret.ret == SDAS_SUCCESS) {
-        internal_simple_archiver_parse_stats(write_state);
+        internal_simple_archiver_parse_stats(write_state, state->parsed);
       }
       return ret;
     }
@@ -3135,51 +5809,95 @@ SDArchiverStateRetStruct simple_archiver_write_all(
                                                               state,
                                                               write_state);
       if (ret.ret == SDAS_SUCCESS) {
-        internal_simple_archiver_parse_stats(write_state);
+        internal_simple_archiver_parse_stats(write_state, state->parsed);
       }
       return ret;
     }
     case 4:
     {
-      SDArchiverStateRetStruct ret = simple_archiver_write_v4v5v6v7(
+      SDArchiverStateRetStruct ret = simple_archiver_internal_write_v4_async(
           out_f,
           state,
           write_state);
       if (ret.ret == SDAS_SUCCESS) {
-        internal_simple_archiver_parse_stats(write_state);
+        internal_simple_archiver_parse_stats(write_state, state->parsed);
       }
       return ret;
     }
     case 5:
     {
-      SDArchiverStateRetStruct ret = simple_archiver_write_v4v5v6v7(
+      SDArchiverStateRetStruct ret = simple_archiver_internal_write_v4_async(
           out_f,
           state,
           write_state);
       if (ret.ret == SDAS_SUCCESS) {
-        internal_simple_archiver_parse_stats(write_state);
+        internal_simple_archiver_parse_stats(write_state, state->parsed);
       }
       return ret;
     }
     case 6:
     {
-      SDArchiverStateRetStruct ret = simple_archiver_write_v4v5v6v7(
+      SDArchiverStateRetStruct ret = simple_archiver_internal_write_v4_async(
+          out_f,
+          state,
+          write_state);
+      if (ret.ret == SDAS_SUCCESS) {
+        internal_simple_archiver_parse_stats(write_state, state->parsed);
+      }
+      return ret;
+    }
+    case 7:
+    {
+      SDArchiverStateRetStruct ret = simple_archiver_internal_write_v4_async(
+          out_f,
+          state,
+          write_state);
+      if (ret.ret == SDAS_SUCCESS) {
+        internal_simple_archiver_parse_stats(write_state, state->parsed);
+      }
+      return ret;
+    }
+    case 8:
+    {
+      SDArchiverStateRetStruct ret = simple_archiver_internal_write_v4_async(
+          out_f,
+          state,
+          write_state);
+      if (ret.ret == SDAS_SUCCESS) {
+        internal_simple_archiver_parse_stats(write_state, state->parsed);
+      }
+      return ret;
+    }
+    case 9:
+    {
+      SDArchiverStateRetStruct ret = simple_archiver_internal_write_v4_async(
+          out_f,
+          state,
+          write_state);
+      if (ret.ret == SDAS_SUCCESS) {
+        internal_simple_archiver_parse_stats(write_state, state->parsed);
+      }
+      return ret;
+    }
+    case 10:
+    {
+      SDArchiverStateRetStruct ret = simple_archiver_internal_write_v4_async(
           out_f,
           state,
           write_state);
       if (ret.ret == SDAS_SUCCESS) {
-        internal_simple_archiver_parse_stats(write_state);
+        internal_simple_archiver_parse_stats(write_state, state->parsed);
       }
       return ret;
     }
-    case 7:
+    case 11:
     {
-      SDArchiverStateRetStruct ret = simple_archiver_write_v4v5v6v7(
+      SDArchiverStateRetStruct ret = simple_archiver_internal_write_v4_async(
           out_f,
           state,
           write_state);
       if (ret.ret == SDAS_SUCCESS) {
-        internal_simple_archiver_parse_stats(write_state);
+        internal_simple_archiver_parse_stats(write_state, state->parsed);
       }
       return ret;
     }
@@ -3190,8 +5908,41 @@ SDArchiverStateRetStruct simple_archiver_write_all(
   }
 }
 
-SDArchiverStateRetStruct simple_archiver_write_v0(
+/// Takes ownership of "out_f".
+SDArchiverStateRetStruct simple_archiver_internal_write_all_stream(
+    SDArchiverIOStream *out_f,
+    SDArchiverState *state) {
+  if (!out_f) {
+    fprintf(stderr, "ERROR: Failed to open I/O backend for writing!\n");
+    return SDA_RET_STRUCT(SDAS_INVALID_IO);
+  }
+
+  SDArchiverStateRetStruct ret =
+    simple_archiver_internal_write_all(out_f, state);
+  if (simple_archiver_io_stream_close(&out_f) != 0
+      && ret.ret == SDAS_SUCCESS) {
+    fprintf(stderr, "ERROR: Failed to write to the archive output!\n");
+    return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+  }
+  return ret;
+}
+
+SDArchiverStateRetStruct simple_archiver_write_all(
     FILE *out_f,
+    SDArchiverState *state) {
+  return simple_archiver_internal_write_all_stream(
+    simple_archiver_io_stream_init_FILE(out_f, 1), state);
+}
+
+SDArchiverStateRetStruct simple_archiver_write_all_io(
+    SDArchiverIO *io,
+    SDArchiverState *state) {
+  return simple_archiver_internal_write_all_stream(
+    simple_archiver_io_stream_init(io, 1), state);
+}
+
+SDArchiverStateRetStruct simple_archiver_write_v0(
+    SDArchiverIOStream *out_f,
     SDArchiverState *state,
     SDArchiverHashMap *write_state) {
   fprintf(stderr, "Writing archive of file format 0\n");
@@ -3235,7 +5986,7 @@ SDArchiverStateRetStruct simple_archiver_write_v0(
     free(ptr_array);
   }
 
-  if (fwrite("SIMPLE_ARCHIVE_VER", 1, 18, out_f) != 18) {
+  if (simple_archiver_io_write("SIMPLE_ARCHIVE_VER", 1, 18, out_f) != 18) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
 
@@ -3244,7 +5995,7 @@ SDArchiverStateRetStruct simple_archiver_write_v0(
   // No need to convert to big-endian for version 0.
   // simple_archiver_helper_16_bit_be(&u16);
 
-  if (fwrite(&u16, 2, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
 
@@ -3255,12 +6006,12 @@ SDArchiverStateRetStruct simple_archiver_write_v0(
   } else if (state->parsed->compressor && state->parsed->decompressor) {
     // Write the four flag bytes with first bit set.
     uint8_t c = 1;
-    if (fwrite(&c, 1, 1, out_f) != 1) {
+    if (simple_archiver_io_write(&c, 1, 1, out_f) != 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
     c = 0;
     for (size_t i = 0; i < 3; ++i) {
-      if (fwrite(&c, 1, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&c, 1, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
     }
@@ -3275,14 +6026,14 @@ SDArchiverStateRetStruct simple_archiver_write_v0(
     // To big-endian.
     simple_archiver_helper_16_bit_be(&u16);
     // Write the size in big-endian.
-    if (fwrite(&u16, 2, 1, out_f) != 1) {
+    if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
     // From big-endian.
     simple_archiver_helper_16_bit_be(&u16);
     // Write the compressor cmd including the NULL at the end of the string.
-    if (fwrite(state->parsed->compressor, 1, u16 + 1, out_f) !=
-        (size_t)u16 + 1) {
+    if (simple_archiver_io_write(state->parsed->compressor, 1, u16 + 1, out_f)
+        != (size_t)u16 + 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
 
@@ -3295,21 +6046,21 @@ SDArchiverStateRetStruct simple_archiver_write_v0(
     // To big-endian.
     simple_archiver_helper_16_bit_be(&u16);
     // Write the size in big-endian.
-    if (fwrite(&u16, 2, 1, out_f) != 1) {
+    if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
     // From big-endian.
     simple_archiver_helper_16_bit_be(&u16);
     // Write the decompressor cmd including the NULL at the end of the string.
-    if (fwrite(state->parsed->decompressor, 1, u16 + 1, out_f) !=
-        (size_t)u16 + 1) {
+    if (simple_archiver_io_write(state->parsed->decompressor, 1, u16 + 1, out_f)
+        != (size_t)u16 + 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
   } else {
     // Write the four flag bytes with first bit NOT set.
     uint8_t c = 0;
     for (size_t i = 0; i < 4; ++i) {
-      if (fwrite(&c, 1, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&c, 1, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
     }
@@ -3323,7 +6074,7 @@ SDArchiverStateRetStruct simple_archiver_write_v0(
     }
     uint32_t u32 = (uint32_t)filenames_pruned->count;
     simple_archiver_helper_32_bit_be(&u32);
-    if (fwrite(&u32, 1, 4, out_f) != 4) {
+    if (simple_archiver_io_write(&u32, 1, 4, out_f) != 4) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
   }
@@ -3402,7 +6153,7 @@ SDArchiverStateRetStruct simple_archiver_write_v0(
 }
 
 SDArchiverStateRetStruct simple_archiver_write_v1(
-    FILE *out_f,
+    SDArchiverIOStream *out_f,
     SDArchiverState *state,
     SDArchiverHashMap *write_state) {
   fprintf(stderr, "Writing archive of file format 1\n");
@@ -3432,13 +6183,12 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
   SDArchiverStringList *symlinks_list = simple_archiver_slist_init();
   __attribute__((cleanup(simple_archiver_list_free)))
   SDArchiverLinkedList *files_list = simple_archiver_list_init();
-  __attribute__((cleanup(simple_archiver_priority_heap_free)))
-  SDArchiverPHeap *files_pheap = NULL;
+  __attribute__((cleanup(simple_archiver_btree_free)))
+  SDArchiverBTree *files_btree = NULL;
   if (state->parsed->flags & 0x80000) {
-    files_pheap = simple_archiver_priority_heap_init_less_generic_fn(
-        internal_strcmp_less_fn);
+    files_btree = simple_archiver_btree_init(internal_strcmp_less_fn);
   } else if (state->parsed->flags & 0x40) {
-    files_pheap = simple_archiver_priority_heap_init_less_fn(greater_fn);
+    files_btree = simple_archiver_btree_init(internal_size_greater_fn);
   }
   uint64_t from_files_count = 0;
   uint64_t *files_actual_size = malloc(sizeof(uint64_t));
@@ -3452,7 +6202,7 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
   ptr_array[0] = symlinks_list;
   ptr_array[1] = files_list;
   ptr_array[2] = (void *)state->parsed->user_cwd;
-  ptr_array[3] = files_pheap;
+  ptr_array[3] = files_btree;
   ptr_array[4] = NULL;
   ptr_array[5] = state;
   ptr_array[6] = &from_files_count;
@@ -3478,13 +6228,13 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
     NULL,
     simple_archiver_helper_datastructure_cleanup_nop);
 
-  if (files_pheap) {
-    while (simple_archiver_priority_heap_size(files_pheap) > 0) {
+  if (files_btree) {
+    while (simple_archiver_btree_size(files_btree) > 0) {
       simple_archiver_list_add(files_list,
-                               simple_archiver_priority_heap_pop(files_pheap),
+                               simple_archiver_btree_pop_first(files_btree),
                                free_internal_file_info);
     }
-    simple_archiver_priority_heap_free(&files_pheap);
+    simple_archiver_btree_free(&files_btree);
   }
 
   if (symlinks_list->count + files_list->count != from_files_count) {
@@ -3494,7 +6244,7 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
     return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
   }
 
-  if (fwrite("SIMPLE_ARCHIVE_VER", 1, 18, out_f) != 18) {
+  if (simple_archiver_io_write("SIMPLE_ARCHIVE_VER", 1, 18, out_f) != 18) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
 
@@ -3503,7 +6253,7 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
 
   simple_archiver_helper_16_bit_be(&u16);
 
-  if (fwrite(&u16, 2, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
 
@@ -3515,7 +6265,7 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
     // 4 bytes flags, using de/compressor.
     memset(buf, 0, 4);
     buf[0] |= 1;
-    if (fwrite(buf, 1, 4, out_f) != 4) {
+    if (simple_archiver_io_write(buf, 1, 4, out_f) != 4) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
 
@@ -3527,13 +6277,13 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
 
     u16 = (uint16_t)len;
     simple_archiver_helper_16_bit_be(&u16);
-    if (fwrite(&u16, 1, 2, out_f) != 2) {
+    if (simple_archiver_io_write(&u16, 1, 2, out_f) != 2) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
     simple_archiver_helper_16_bit_be(&u16);
 
-    if (fwrite(state->parsed->compressor, 1, u16 + 1, out_f) !=
-        (size_t)u16 + 1) {
+    if (simple_archiver_io_write(state->parsed->compressor, 1, u16 + 1, out_f)
+        != (size_t)u16 + 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
 
@@ -3545,19 +6295,19 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
 
     u16 = (uint16_t)len;
     simple_archiver_helper_16_bit_be(&u16);
-    if (fwrite(&u16, 1, 2, out_f) != 2) {
+    if (simple_archiver_io_write(&u16, 1, 2, out_f) != 2) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
     simple_archiver_helper_16_bit_be(&u16);
 
-    if (fwrite(state->parsed->decompressor, 1, u16 + 1, out_f) !=
-        (size_t)u16 + 1) {
+    if (simple_archiver_io_write(state->parsed->decompressor, 1, u16 + 1, out_f)
+        != (size_t)u16 + 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
   } else {
     // 4 bytes flags, not using de/compressor.
     memset(buf, 0, 4);
-    if (fwrite(buf, 1, 4, out_f) != 4) {
+    if (simple_archiver_io_write(buf, 1, 4, out_f) != 4) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
   }
@@ -3569,7 +6319,7 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
 
   uint32_t u32 = (uint32_t)symlinks_list->count;
   simple_archiver_helper_32_bit_be(&u32);
-  if (fwrite(&u32, 4, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
   simple_archiver_helper_32_bit_be(&u32);
@@ -3726,7 +6476,7 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
         buf[1] |= 4;
       }
 
-      if (fwrite(buf, 1, 2, out_f) != 2) {
+      if (simple_archiver_io_write(buf, 1, 2, out_f) != 2) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
@@ -3742,20 +6492,24 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
 
       u16 = (uint16_t)len;
       simple_archiver_helper_16_bit_be(&u16);
-      if (fwrite(&u16, 2, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
       simple_archiver_helper_16_bit_be(&u16);
       if (state->parsed->prefix) {
-        size_t fwrite_ret = fwrite(state->parsed->prefix,
-                                   1,
-                                   prefix_length,
-                                   out_f);
-        fwrite_ret += fwrite(node_str, 1, link_length + 1, out_f);
+        size_t fwrite_ret = simple_archiver_io_write(state->parsed->prefix,
+                                                     1,
+                                                     prefix_length,
+                                                     out_f);
+        fwrite_ret += simple_archiver_io_write(node_str,
+                                               1,
+                                               link_length + 1,
+                                               out_f);
         if (fwrite_ret != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
-      } else if (fwrite(node_str, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+      } else if (simple_archiver_io_write(node_str, 1, u16 + 1, out_f)
+                 != (size_t)u16 + 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
@@ -3780,11 +6534,12 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
 
           u16 = (uint16_t)abs_path_pref_length;
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(&u16, 2, 1, out_f) != 1) {
+          if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(abs_path_prefixed, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+          if (simple_archiver_io_write(abs_path_prefixed, 1, u16 + 1, out_f)
+              != (size_t)u16 + 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
         } else {
@@ -3797,17 +6552,18 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
 
           u16 = (uint16_t)abs_path_length;
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(&u16, 2, 1, out_f) != 1) {
+          if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(abs_path, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+          if (simple_archiver_io_write(abs_path, 1, u16 + 1, out_f)
+              != (size_t)u16 + 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
@@ -3833,11 +6589,12 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
 
           u16 = (uint16_t)rel_path_pref_length;
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(&u16, 2, 1, out_f) != 1) {
+          if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(rel_path_prefixed, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+          if (simple_archiver_io_write(rel_path_prefixed, 1, u16 + 1, out_f)
+              != (size_t)u16 + 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
         } else {
@@ -3850,17 +6607,18 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
 
           u16 = (uint16_t)len;
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(&u16, 2, 1, out_f) != 1) {
+          if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(rel_path, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+          if (simple_archiver_io_write(rel_path, 1, u16 + 1, out_f)
+              != (size_t)u16 + 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
@@ -3930,7 +6688,7 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
   }
   u32 = (uint32_t)chunk_counts->count;
   simple_archiver_helper_32_bit_be(&u32);
-  if (fwrite(&u32, 4, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
 
@@ -3964,7 +6722,7 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
 
     u32 = (uint32_t)(*((uint64_t *)chunk_c_node->data));
     simple_archiver_helper_32_bit_be(&u32);
-    if (fwrite(&u32, 4, 1, out_f) != 1) {
+    if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
     SDArchiverLLNode *saved_node = file_node;
@@ -3987,17 +6745,20 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
         }
         u16 = (uint16_t)total_length;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(state->parsed->prefix, 1, prefix_length, out_f)
+        if (simple_archiver_io_write(state->parsed->prefix,
+                                     1,
+                                     prefix_length,
+                                     out_f)
             != prefix_length) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
-        } else if (fwrite(file_info_struct->filename,
-                          1,
-                          filename_len + 1,
-                          out_f)
+        } else if (simple_archiver_io_write(file_info_struct->filename,
+                                            1,
+                                            filename_len + 1,
+                                            out_f)
                      != filename_len + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
@@ -4008,17 +6769,21 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
         }
         u16 = (uint16_t)filename_len;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(file_info_struct->filename, 1, u16 + 1, out_f) !=
-            (size_t)u16 + 1) {
+        if (simple_archiver_io_write(file_info_struct->filename,
+                                     1,
+                                     u16 + 1,
+                                     out_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
 
-      if (fwrite(file_info_struct->bit_flags, 1, 4, out_f) != 4) {
+      if (simple_archiver_io_write(file_info_struct->bit_flags, 1, 4, out_f)
+          != 4) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
@@ -4043,7 +6808,7 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
         }
       }
       simple_archiver_helper_32_bit_be(&u32);
-      if (fwrite(&u32, 4, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
@@ -4064,13 +6829,13 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
         }
       }
       simple_archiver_helper_32_bit_be(&u32);
-      if (fwrite(&u32, 4, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
       uint64_t u64 = file_info_struct->file_size;
       simple_archiver_helper_64_bit_be(&u64);
-      if (fwrite(&u64, 8, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
     }
@@ -4316,7 +7081,7 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
       // Write compressed chunk size.
       uint64_t u64 = (uint64_t)comp_chunk_size;
       simple_archiver_helper_64_bit_be(&u64);
-      if (fwrite(&u64, 8, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
       *files_compressed_size += (uint64_t)comp_chunk_size;
@@ -4334,7 +7099,10 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
         }
         size_t fread_ret = fread(buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE, temp_fd);
         if (fread_ret > 0) {
-          size_t fwrite_ret = fwrite(buf, 1, fread_ret, out_f);
+          size_t fwrite_ret = simple_archiver_io_write(buf,
+                                                       1,
+                                                       fread_ret,
+                                                       out_f);
           written_size += fwrite_ret;
           if (fwrite_ret != fread_ret) {
             fprintf(stderr,
@@ -4359,7 +7127,7 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
         return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
       }
       simple_archiver_helper_64_bit_be(non_c_chunk_size);
-      fwrite(non_c_chunk_size, 8, 1, out_f);
+      simple_archiver_io_write(non_c_chunk_size, 8, 1, out_f);
       for (uint64_t file_idx = 0; file_idx < *((uint64_t *)chunk_c_node->data);
            ++file_idx) {
         if (is_sig_int_occurred) {
@@ -4384,7 +7152,10 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
           }
           size_t fread_ret = fread(buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE, fd);
           if (fread_ret > 0) {
-            size_t fwrite_ret = fwrite(buf, 1, fread_ret, out_f);
+            size_t fwrite_ret = simple_archiver_io_write(buf,
+                                                         1,
+                                                         fread_ret,
+                                                         out_f);
             if (fwrite_ret != fread_ret) {
               fprintf(stderr, "ERROR: Writing to chunk, file write error!\n");
               return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
@@ -4411,7 +7182,7 @@ SDArchiverStateRetStruct simple_archiver_write_v1(
 }
 
 SDArchiverStateRetStruct simple_archiver_write_v2(
-    FILE *out_f,
+    SDArchiverIOStream *out_f,
     SDArchiverState *state,
     SDArchiverHashMap *write_state) {
   fprintf(stderr, "Writing archive of file format 2\n");
@@ -4446,13 +7217,12 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
   SDArchiverLinkedList *files_list = simple_archiver_list_init();
   __attribute__((cleanup(simple_archiver_slist_free)))
   SDArchiverStringList *dirs_list = simple_archiver_slist_init();
-  __attribute__((cleanup(simple_archiver_priority_heap_free)))
-  SDArchiverPHeap *files_pheap = NULL;
+  __attribute__((cleanup(simple_archiver_btree_free)))
+  SDArchiverBTree *files_btree = NULL;
   if (state->parsed->flags & 0x80000) {
-    files_pheap = simple_archiver_priority_heap_init_less_generic_fn(
-        internal_strcmp_less_fn);
+    files_btree = simple_archiver_btree_init(internal_strcmp_less_fn);
   } else if (state->parsed->flags & 0x40) {
-    files_pheap = simple_archiver_priority_heap_init_less_fn(greater_fn);
+    files_btree = simple_archiver_btree_init(internal_size_greater_fn);
   }
   uint64_t from_files_count = 0;
   uint64_t *files_actual_size = malloc(sizeof(uint64_t));
@@ -4466,7 +7236,7 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
   ptr_array[0] = symlinks_list;
   ptr_array[1] = files_list;
   ptr_array[2] = (void *)state->parsed->user_cwd;
-  ptr_array[3] = files_pheap;
+  ptr_array[3] = files_btree;
   ptr_array[4] = dirs_list;
   ptr_array[5] = state;
   ptr_array[6] = &from_files_count;
@@ -4492,13 +7262,13 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
     NULL,
     simple_archiver_helper_datastructure_cleanup_nop);
 
-  if (files_pheap) {
-    while (simple_archiver_priority_heap_size(files_pheap) > 0) {
+  if (files_btree) {
+    while (simple_archiver_btree_size(files_btree) > 0) {
       simple_archiver_list_add(files_list,
-                               simple_archiver_priority_heap_pop(files_pheap),
+                               simple_archiver_btree_pop_first(files_btree),
                                free_internal_file_info);
     }
-    simple_archiver_priority_heap_free(&files_pheap);
+    simple_archiver_btree_free(&files_btree);
   }
 
   if (symlinks_list->count
@@ -4517,7 +7287,7 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
     return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
   }
 
-  if (fwrite("SIMPLE_ARCHIVE_VER", 1, 18, out_f) != 18) {
+  if (simple_archiver_io_write("SIMPLE_ARCHIVE_VER", 1, 18, out_f) != 18) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
 
@@ -4530,7 +7300,7 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
 
   simple_archiver_helper_16_bit_be(&u16);
 
-  if (fwrite(&u16, 2, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
 
@@ -4542,7 +7312,7 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
     // 4 bytes flags, using de/compressor.
     memset(buf, 0, 4);
     buf[0] |= 1;
-    if (fwrite(buf, 1, 4, out_f) != 4) {
+    if (simple_archiver_io_write(buf, 1, 4, out_f) != 4) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
 
@@ -4554,13 +7324,13 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
 
     u16 = (uint16_t)len;
     simple_archiver_helper_16_bit_be(&u16);
-    if (fwrite(&u16, 1, 2, out_f) != 2) {
+    if (simple_archiver_io_write(&u16, 1, 2, out_f) != 2) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
     simple_archiver_helper_16_bit_be(&u16);
 
-    if (fwrite(state->parsed->compressor, 1, u16 + 1, out_f) !=
-        (size_t)u16 + 1) {
+    if (simple_archiver_io_write(state->parsed->compressor, 1, u16 + 1, out_f)
+        != (size_t)u16 + 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
 
@@ -4572,19 +7342,19 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
 
     u16 = (uint16_t)len;
     simple_archiver_helper_16_bit_be(&u16);
-    if (fwrite(&u16, 1, 2, out_f) != 2) {
+    if (simple_archiver_io_write(&u16, 1, 2, out_f) != 2) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
     simple_archiver_helper_16_bit_be(&u16);
 
-    if (fwrite(state->parsed->decompressor, 1, u16 + 1, out_f) !=
-        (size_t)u16 + 1) {
+    if (simple_archiver_io_write(state->parsed->decompressor, 1, u16 + 1, out_f)
+        != (size_t)u16 + 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
   } else {
     // 4 bytes flags, not using de/compressor.
     memset(buf, 0, 4);
-    if (fwrite(buf, 1, 4, out_f) != 4) {
+    if (simple_archiver_io_write(buf, 1, 4, out_f) != 4) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
   }
@@ -4596,7 +7366,7 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
 
   uint32_t u32 = (uint32_t)symlinks_list->count;
   simple_archiver_helper_32_bit_be(&u32);
-  if (fwrite(&u32, 4, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
   simple_archiver_helper_32_bit_be(&u32);
@@ -4750,7 +7520,7 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
         buf[1] |= 4;
       }
 
-      if (fwrite(buf, 1, 2, out_f) != 2) {
+      if (simple_archiver_io_write(buf, 1, 2, out_f) != 2) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
@@ -4766,20 +7536,24 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
 
       u16 = (uint16_t)len;
       simple_archiver_helper_16_bit_be(&u16);
-      if (fwrite(&u16, 2, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
       simple_archiver_helper_16_bit_be(&u16);
       if (state->parsed->prefix) {
-        size_t fwrite_ret = fwrite(state->parsed->prefix,
-                                   1,
-                                   prefix_length,
-                                   out_f);
-        fwrite_ret += fwrite(node_str, 1, link_length + 1, out_f);
+        size_t fwrite_ret = simple_archiver_io_write(state->parsed->prefix,
+                                                     1,
+                                                     prefix_length,
+                                                     out_f);
+        fwrite_ret += simple_archiver_io_write(node_str,
+                                               1,
+                                               link_length + 1,
+                                               out_f);
         if (fwrite_ret != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
-      } else if (fwrite(node_str, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+      } else if (simple_archiver_io_write(node_str, 1, u16 + 1, out_f)
+                 != (size_t)u16 + 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
@@ -4804,11 +7578,12 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
 
           u16 = (uint16_t)abs_path_pref_length;
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(&u16, 2, 1, out_f) != 1) {
+          if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(abs_path_prefixed, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+          if (simple_archiver_io_write(abs_path_prefixed, 1, u16 + 1, out_f)
+              != (size_t)u16 + 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
         } else {
@@ -4821,17 +7596,18 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
 
           u16 = (uint16_t)abs_path_length;
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(&u16, 2, 1, out_f) != 1) {
+          if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(abs_path, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+          if (simple_archiver_io_write(abs_path, 1, u16 + 1, out_f)
+              != (size_t)u16 + 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
@@ -4857,11 +7633,12 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
 
           u16 = (uint16_t)rel_path_pref_length;
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(&u16, 2, 1, out_f) != 1) {
+          if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(rel_path_prefixed, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+          if (simple_archiver_io_write(rel_path_prefixed, 1, u16 + 1, out_f)
+              != (size_t)u16 + 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
         } else {
@@ -4874,17 +7651,18 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
 
           u16 = (uint16_t)len;
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(&u16, 2, 1, out_f) != 1) {
+          if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(rel_path, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+          if (simple_archiver_io_write(rel_path, 1, u16 + 1, out_f)
+              != (size_t)u16 + 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
@@ -4959,7 +7737,7 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
   }
   u32 = (uint32_t)chunk_counts->count;
   simple_archiver_helper_32_bit_be(&u32);
-  if (fwrite(&u32, 4, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
 
@@ -4992,7 +7770,7 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
 
     u32 = (uint32_t)(*((uint64_t *)chunk_c_node->data));
     simple_archiver_helper_32_bit_be(&u32);
-    if (fwrite(&u32, 4, 1, out_f) != 1) {
+    if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
     SDArchiverLLNode *saved_node = file_node;
@@ -5015,17 +7793,20 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
         }
         u16 = (uint16_t)total_length;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(state->parsed->prefix, 1, prefix_length, out_f)
+        if (simple_archiver_io_write(state->parsed->prefix,
+                                     1,
+                                     prefix_length,
+                                     out_f)
             != prefix_length) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
-        } else if (fwrite(file_info_struct->filename,
-                          1,
-                          filename_len + 1,
-                          out_f)
+        } else if (simple_archiver_io_write(file_info_struct->filename,
+                                            1,
+                                            filename_len + 1,
+                                            out_f)
                      != filename_len + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
@@ -5036,17 +7817,21 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
         }
         u16 = (uint16_t)filename_len;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(file_info_struct->filename, 1, u16 + 1, out_f) !=
-            (size_t)u16 + 1) {
+        if (simple_archiver_io_write(file_info_struct->filename,
+                                     1,
+                                     u16 + 1,
+                                     out_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
 
-      if (fwrite(file_info_struct->bit_flags, 1, 4, out_f) != 4) {
+      if (simple_archiver_io_write(file_info_struct->bit_flags, 1, 4, out_f)
+          != 4) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
       // UID and GID.
@@ -5070,7 +7855,7 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
         }
       }
       simple_archiver_helper_32_bit_be(&u32);
-      if (fwrite(&u32, 4, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
       u32 = file_info_struct->gid;
@@ -5090,13 +7875,13 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
         }
       }
       simple_archiver_helper_32_bit_be(&u32);
-      if (fwrite(&u32, 4, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
       uint64_t u64 = file_info_struct->file_size;
       simple_archiver_helper_64_bit_be(&u64);
-      if (fwrite(&u64, 8, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
     }
@@ -5340,7 +8125,7 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
       // Write compressed chunk size.
       uint64_t u64 = (uint64_t)comp_chunk_size;
       simple_archiver_helper_64_bit_be(&u64);
-      if (fwrite(&u64, 8, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
       *files_compressed_size += (uint64_t)comp_chunk_size;
@@ -5358,7 +8143,10 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
         }
         size_t fread_ret = fread(buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE, temp_fd);
         if (fread_ret > 0) {
-          size_t fwrite_ret = fwrite(buf, 1, fread_ret, out_f);
+          size_t fwrite_ret = simple_archiver_io_write(buf,
+                                                       1,
+                                                       fread_ret,
+                                                       out_f);
           written_size += fwrite_ret;
           if (fwrite_ret != fread_ret) {
             fprintf(stderr,
@@ -5383,7 +8171,7 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
         return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
       }
       simple_archiver_helper_64_bit_be(non_c_chunk_size);
-      fwrite(non_c_chunk_size, 8, 1, out_f);
+      simple_archiver_io_write(non_c_chunk_size, 8, 1, out_f);
       for (uint64_t file_idx = 0; file_idx < *((uint64_t *)chunk_c_node->data);
            ++file_idx) {
         if (is_sig_int_occurred) {
@@ -5408,7 +8196,10 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
           }
           size_t fread_ret = fread(buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE, fd);
           if (fread_ret > 0) {
-            size_t fwrite_ret = fwrite(buf, 1, fread_ret, out_f);
+            size_t fwrite_ret = simple_archiver_io_write(buf,
+                                                         1,
+                                                         fread_ret,
+                                                         out_f);
             if (fwrite_ret != fread_ret) {
               fprintf(stderr, "ERROR: Writing to chunk, file write error!\n");
               return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
@@ -5445,7 +8236,7 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
 
   simple_archiver_helper_32_bit_be(&u32);
 
-  if (fwrite(&u32, 4, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
 
@@ -5465,7 +8256,7 @@ SDArchiverStateRetStruct simple_archiver_write_v2(
 }
 
 SDArchiverStateRetStruct simple_archiver_write_v3(
-    FILE *out_f,
+    SDArchiverIOStream *out_f,
     SDArchiverState *state,
     SDArchiverHashMap *write_state) {
   fprintf(stderr, "Writing archive of file format 3\n");
@@ -5497,13 +8288,12 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
   SDArchiverLinkedList *files_list = simple_archiver_list_init();
   __attribute__((cleanup(simple_archiver_slist_free)))
   SDArchiverStringList *dirs_list = simple_archiver_slist_init();
-  __attribute__((cleanup(simple_archiver_priority_heap_free)))
-  SDArchiverPHeap *files_pheap = NULL;
+  __attribute__((cleanup(simple_archiver_btree_free)))
+  SDArchiverBTree *files_btree = NULL;
   if (state->parsed->flags & 0x80000) {
-    files_pheap = simple_archiver_priority_heap_init_less_generic_fn(
-        internal_strcmp_less_fn);
+    files_btree = simple_archiver_btree_init(internal_strcmp_less_fn);
   } else if (state->parsed->flags & 0x40) {
-    files_pheap = simple_archiver_priority_heap_init_less_fn(greater_fn);
+    files_btree = simple_archiver_btree_init(internal_size_greater_fn);
   }
   uint64_t from_files_count = 0;
   uint64_t *files_actual_size = malloc(sizeof(uint64_t));
@@ -5517,7 +8307,7 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
   ptr_array[0] = symlinks_list;
   ptr_array[1] = files_list;
   ptr_array[2] = (void *)state->parsed->user_cwd;
-  ptr_array[3] = files_pheap;
+  ptr_array[3] = files_btree;
   ptr_array[4] = dirs_list;
   ptr_array[5] = state;
   ptr_array[6] = &from_files_count;
@@ -5543,13 +8333,13 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
     NULL,
     simple_archiver_helper_datastructure_cleanup_nop);
 
-  if (files_pheap) {
-    while (simple_archiver_priority_heap_size(files_pheap) > 0) {
+  if (files_btree) {
+    while (simple_archiver_btree_size(files_btree) > 0) {
       simple_archiver_list_add(files_list,
-                               simple_archiver_priority_heap_pop(files_pheap),
+                               simple_archiver_btree_pop_first(files_btree),
                                free_internal_file_info);
     }
-    simple_archiver_priority_heap_free(&files_pheap);
+    simple_archiver_btree_free(&files_btree);
   }
 
   if (symlinks_list->count
@@ -5568,7 +8358,7 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
     return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
   }
 
-  if (fwrite("SIMPLE_ARCHIVE_VER", 1, 18, out_f) != 18) {
+  if (simple_archiver_io_write("SIMPLE_ARCHIVE_VER", 1, 18, out_f) != 18) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
 
@@ -5577,7 +8367,7 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
 
   simple_archiver_helper_16_bit_be(&u16);
 
-  if (fwrite(&u16, 2, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
 
@@ -5593,7 +8383,7 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
     // 4 bytes flags, using de/compressor.
     memset(buf, 0, 4);
     buf[0] |= 1;
-    if (fwrite(buf, 1, 4, out_f) != 4) {
+    if (simple_archiver_io_write(buf, 1, 4, out_f) != 4) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
 
@@ -5605,13 +8395,13 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
 
     u16 = (uint16_t)len;
     simple_archiver_helper_16_bit_be(&u16);
-    if (fwrite(&u16, 1, 2, out_f) != 2) {
+    if (simple_archiver_io_write(&u16, 1, 2, out_f) != 2) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
     simple_archiver_helper_16_bit_be(&u16);
 
-    if (fwrite(state->parsed->compressor, 1, u16 + 1, out_f) !=
-        (size_t)u16 + 1) {
+    if (simple_archiver_io_write(state->parsed->compressor, 1, u16 + 1, out_f)
+        != (size_t)u16 + 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
 
@@ -5623,19 +8413,19 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
 
     u16 = (uint16_t)len;
     simple_archiver_helper_16_bit_be(&u16);
-    if (fwrite(&u16, 1, 2, out_f) != 2) {
+    if (simple_archiver_io_write(&u16, 1, 2, out_f) != 2) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
     simple_archiver_helper_16_bit_be(&u16);
 
-    if (fwrite(state->parsed->decompressor, 1, u16 + 1, out_f) !=
-        (size_t)u16 + 1) {
+    if (simple_archiver_io_write(state->parsed->decompressor, 1, u16 + 1, out_f)
+        != (size_t)u16 + 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
   } else {
     // 4 bytes flags, not using de/compressor.
     memset(buf, 0, 4);
-    if (fwrite(buf, 1, 4, out_f) != 4) {
+    if (simple_archiver_io_write(buf, 1, 4, out_f) != 4) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
   }
@@ -5647,7 +8437,7 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
 
   uint32_t u32 = (uint32_t)symlinks_list->count;
   simple_archiver_helper_32_bit_be(&u32);
-  if (fwrite(&u32, 4, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
   simple_archiver_helper_32_bit_be(&u32);
@@ -5802,7 +8592,7 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
         buf[1] |= 4;
       }
 
-      if (fwrite(buf, 1, 2, out_f) != 2) {
+      if (simple_archiver_io_write(buf, 1, 2, out_f) != 2) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
@@ -5818,20 +8608,24 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
 
       u16 = (uint16_t)len;
       simple_archiver_helper_16_bit_be(&u16);
-      if (fwrite(&u16, 2, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
       simple_archiver_helper_16_bit_be(&u16);
       if (state->parsed->prefix) {
-        size_t fwrite_ret = fwrite(state->parsed->prefix,
-                                   1,
-                                   prefix_length,
-                                   out_f);
-        fwrite_ret += fwrite(node_str, 1, link_length + 1, out_f);
+        size_t fwrite_ret = simple_archiver_io_write(state->parsed->prefix,
+                                                     1,
+                                                     prefix_length,
+                                                     out_f);
+        fwrite_ret += simple_archiver_io_write(node_str,
+                                               1,
+                                               link_length + 1,
+                                               out_f);
         if (fwrite_ret != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
-      } else if (fwrite(node_str, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+      } else if (simple_archiver_io_write(node_str, 1, u16 + 1, out_f)
+                 != (size_t)u16 + 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
@@ -5856,11 +8650,12 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
 
           u16 = (uint16_t)abs_path_pref_length;
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(&u16, 2, 1, out_f) != 1) {
+          if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(abs_path_prefixed, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+          if (simple_archiver_io_write(abs_path_prefixed, 1, u16 + 1, out_f)
+              != (size_t)u16 + 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
         } else {
@@ -5873,17 +8668,18 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
 
           u16 = (uint16_t)abs_path_length;
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(&u16, 2, 1, out_f) != 1) {
+          if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(abs_path, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+          if (simple_archiver_io_write(abs_path, 1, u16 + 1, out_f)
+              != (size_t)u16 + 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
@@ -5909,11 +8705,12 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
 
           u16 = (uint16_t)rel_path_pref_length;
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(&u16, 2, 1, out_f) != 1) {
+          if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(rel_path_prefixed, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+          if (simple_archiver_io_write(rel_path_prefixed, 1, u16 + 1, out_f)
+              != (size_t)u16 + 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
         } else {
@@ -5926,17 +8723,18 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
 
           u16 = (uint16_t)len;
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(&u16, 2, 1, out_f) != 1) {
+          if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(rel_path, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+          if (simple_archiver_io_write(rel_path, 1, u16 + 1, out_f)
+              != (size_t)u16 + 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
@@ -5960,7 +8758,7 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
         }
       }
       simple_archiver_helper_32_bit_be(&u32);
-      if (fwrite(&u32, 4, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
@@ -5983,7 +8781,7 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
         }
       }
       simple_archiver_helper_32_bit_be(&u32);
-      if (fwrite(&u32, 4, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
@@ -6022,16 +8820,17 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
         }
         u16 = (uint16_t)name_length;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(username, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+        if (simple_archiver_io_write(username, 1, u16 + 1, out_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
@@ -6071,16 +8870,17 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
         }
         u16 = (uint16_t)group_length;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(groupname, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+        if (simple_archiver_io_write(groupname, 1, u16 + 1, out_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
@@ -6155,7 +8955,7 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
   }
   u32 = (uint32_t)chunk_counts->count;
   simple_archiver_helper_32_bit_be(&u32);
-  if (fwrite(&u32, 4, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
 
@@ -6188,7 +8988,7 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
 
     u32 = (uint32_t)(*((uint64_t *)chunk_c_node->data));
     simple_archiver_helper_32_bit_be(&u32);
-    if (fwrite(&u32, 4, 1, out_f) != 1) {
+    if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
     SDArchiverLLNode *saved_node = file_node;
@@ -6211,17 +9011,20 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
         }
         u16 = (uint16_t)total_length;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(state->parsed->prefix, 1, prefix_length, out_f)
+        if (simple_archiver_io_write(state->parsed->prefix,
+                                     1,
+                                     prefix_length,
+                                     out_f)
             != prefix_length) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
-        } else if (fwrite(file_info_struct->filename,
-                          1,
-                          filename_len + 1,
-                          out_f)
+        } else if (simple_archiver_io_write(file_info_struct->filename,
+                                            1,
+                                            filename_len + 1,
+                                            out_f)
                      != filename_len + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
@@ -6232,17 +9035,21 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
         }
         u16 = (uint16_t)filename_len;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(file_info_struct->filename, 1, u16 + 1, out_f) !=
-            (size_t)u16 + 1) {
+        if (simple_archiver_io_write(file_info_struct->filename,
+                                     1,
+                                     u16 + 1,
+                                     out_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
 
-      if (fwrite(file_info_struct->bit_flags, 1, 4, out_f) != 4) {
+      if (simple_archiver_io_write(file_info_struct->bit_flags, 1, 4, out_f)
+          != 4) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
       // UID and GID.
@@ -6266,7 +9073,7 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
         }
       }
       simple_archiver_helper_32_bit_be(&u32);
-      if (fwrite(&u32, 4, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
       u32 = file_info_struct->gid;
@@ -6286,7 +9093,7 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
         }
       }
       simple_archiver_helper_32_bit_be(&u32);
-      if (fwrite(&u32, 4, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
@@ -6320,16 +9127,17 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
         }
         u16 = (uint16_t)name_length;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(username, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+        if (simple_archiver_io_write(username, 1, u16 + 1, out_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
@@ -6364,22 +9172,23 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
         }
         u16 = (uint16_t)group_length;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(groupname, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+        if (simple_archiver_io_write(groupname, 1, u16 + 1, out_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
       uint64_t u64 = file_info_struct->file_size;
       simple_archiver_helper_64_bit_be(&u64);
-      if (fwrite(&u64, 8, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
     }
@@ -6601,156 +9410,977 @@ SDArchiverStateRetStruct simple_archiver_write_v3(
           } else if (read_ret == 0) {
             // EOF.
             break;
-          } else {
-            size_t fwrite_ret = fwrite(buf, 1, (size_t)read_ret, temp_fd);
-            if (fwrite_ret != (size_t)read_ret) {
-              fprintf(stderr,
-                      "ERROR: Reading from compressor, failed to write to "
-                      "temporary file!\n");
-              return SDA_RET_STRUCT(SDAS_COMPRESSION_ERROR);
-            }
+          } else {
+            size_t fwrite_ret = fwrite(buf, 1, (size_t)read_ret, temp_fd);
+            if (fwrite_ret != (size_t)read_ret) {
+              fprintf(stderr,
+                      "ERROR: Reading from compressor, failed to write to "
+                      "temporary file!\n");
+              return SDA_RET_STRUCT(SDAS_COMPRESSION_ERROR);
+            }
+          }
+        }
+      }
+
+      long comp_chunk_size = ftell(temp_fd);
+      if (comp_chunk_size < 0) {
+        fprintf(stderr,
+                "ERROR: Temp file reported negative size after compression!\n");
+        return SDA_RET_STRUCT(SDAS_COMPRESSION_ERROR);
+      }
+
+      // Write compressed chunk size.
+      uint64_t u64 = (uint64_t)comp_chunk_size;
+      simple_archiver_helper_64_bit_be(&u64);
+      if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
+        return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+      }
+      *files_compressed_size += (uint64_t)comp_chunk_size;
+
+      rewind(temp_fd);
+
+      size_t written_size = 0;
+
+      // Write compressed chunk.
+      while (!feof(temp_fd)) {
+        if (is_sig_int_occurred) {
+          return SDA_RET_STRUCT(SDAS_SIGINT);
+        } else if (ferror(temp_fd)) {
+          return SDA_RET_STRUCT(SDAS_COMPRESSED_WRITE_FAIL);
+        }
+        size_t fread_ret = fread(buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE, temp_fd);
+        if (fread_ret > 0) {
+          size_t fwrite_ret = simple_archiver_io_write(buf,
+                                                       1,
+                                                       fread_ret,
+                                                       out_f);
+          written_size += fwrite_ret;
+          if (fwrite_ret != fread_ret) {
+            fprintf(stderr,
+                    "ERROR: Partial write of read bytes from temp file to "
+                    "output file!\n");
+            return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+          }
+        }
+      }
+
+      if (written_size != (size_t)comp_chunk_size) {
+        fprintf(stderr,
+                "ERROR: Written chunk size is not actual chunk size!\n");
+        return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+      }
+
+      // Cleanup and remove temp_fd.
+      simple_archiver_helper_cleanup_FILE(&temp_fd);
+    } else {
+      // Is NOT compressing.
+      if (!non_c_chunk_size) {
+        return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
+      }
+      simple_archiver_helper_64_bit_be(non_c_chunk_size);
+      simple_archiver_io_write(non_c_chunk_size, 8, 1, out_f);
+      for (uint64_t file_idx = 0; file_idx < *((uint64_t *)chunk_c_node->data);
+           ++file_idx) {
+        if (is_sig_int_occurred) {
+          return SDA_RET_STRUCT(SDAS_SIGINT);
+        }
+        file_node = file_node->next;
+        if (file_node == files_list->tail) {
+          return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
+        }
+        const SDArchiverInternalFileInfo *file_info_struct = file_node->data;
+        fprintf(stderr,
+                "  FILE %3" PRIu64 " of %3" PRIu64 ": %s\n",
+                file_idx + 1,
+                *(uint64_t *)chunk_c_node->data,
+                file_info_struct->filename);
+        __attribute__((cleanup(simple_archiver_helper_cleanup_FILE))) FILE *fd =
+            fopen(file_info_struct->filename, "rb");
+        while (!feof(fd)) {
+          if (ferror(fd)) {
+            fprintf(stderr, "ERROR: Writing to chunk, file read error!\n");
+            return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
+          }
+          size_t fread_ret = fread(buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE, fd);
+          if (fread_ret > 0) {
+            size_t fwrite_ret = simple_archiver_io_write(buf,
+                                                         1,
+                                                         fread_ret,
+                                                         out_f);
+            if (fwrite_ret != fread_ret) {
+              fprintf(stderr, "ERROR: Writing to chunk, file write error!\n");
+              return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  if (*files_compressed_size != 0) {
+    uint64_t *compressed_size_ptr = files_compressed_size;
+    files_compressed_size = NULL;
+    simple_archiver_hash_map_insert(
+      write_state,
+      compressed_size_ptr,
+      SDA_PSTATE_CMP_SIZE_KEY,
+      SDA_PSTATE_CMP_SIZE_KEY_SIZE,
+      NULL,
+      simple_archiver_helper_datastructure_cleanup_nop);
+  }
+
+  // Write directory entries.
+
+  if (dirs_list->count > 0xFFFFFFFF) {
+    return SDA_RET_STRUCT(SDAS_TOO_MANY_DIRS);
+  }
+
+  u32 = (uint32_t)dirs_list->count;
+  if (u32 != 0) {
+    fprintf(stderr, "Directories:\n");
+  }
+
+  simple_archiver_helper_32_bit_be(&u32);
+
+  if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
+    return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+  }
+
+  void **void_ptrs = malloc(sizeof(void*) * 2);
+  void_ptrs[0] = out_f;
+  void_ptrs[1] = state;
+
+  if (simple_archiver_slist_get(dirs_list,
+                                internal_write_dir_entries_v2_v3_v4_v5_v6,
+                                void_ptrs)) {
+    free(void_ptrs);
+    return SDA_RET_STRUCT(SDAS_DIR_ENTRY_WRITE_FAIL);
+  }
+  free(void_ptrs);
+
+  return SDA_RET_STRUCT(SDAS_SUCCESS);
+}
+
+/// Returns a temporary file that is already unlinked, or NULL on error.
+FILE *simple_archiver_internal_slice_temp_file(const SDArchiverParsed *parsed) {
+  char *temp_filename = NULL;
+  FILE *temp_f = simple_archiver_helper_temp_dir(parsed, &temp_filename);
+  if (temp_filename) {
+    unlink(temp_filename);
+    free(temp_filename);
+  }
+  if (!temp_f) {
+    temp_f = tmpfile();
+  }
+  return temp_f;
+}
+
+/// Connects to the jobserver of the GNU make in "MAKEFLAGS", either a named
+/// fifo ("--jobserver-auth=fifo:<path>") or inherited pipe fds
+/// ("--jobserver-auth=<r>,<w>" or "--jobserver-fds=<r>,<w>").
+/// Returns 0 on success, 1 if "MAKEFLAGS" has no jobserver, and 2 if it is
+/// not usable (like when make did not pass the fds to a recipe without "+").
+int simple_archiver_internal_jobserver_init(SDArchiverInternalJobserver *js,
+                                            uint32_t max_tokens) {
+  js->read_fd = -1;
+  js->write_fd = -1;
+  js->owns_read_fd = 0;
+  js->tokens = NULL;
+  js->held = 0;
+
+  const char *makeflags = getenv("MAKEFLAGS");
+  if (!makeflags) {
+    return 1;
+  }
+
+  // The last jobserver option is the one that applies.
+  const char *auth = NULL;
+  for (const char *iter = makeflags; *iter != 0; ++iter) {
+    if (iter != makeflags && iter[-1] != ' ') {
+      continue;
+    } else if (strncmp(iter, "--jobserver-auth=", 17) == 0) {
+      auth = iter + 17;
+    } else if (strncmp(iter, "--jobserver-fds=", 16) == 0) {
+      auth = iter + 16;
+    }
+  }
+  if (!auth) {
+    return 1;
+  }
+
+  const char *auth_end = strchr(auth, ' ');
+  const size_t auth_len = auth_end ? (size_t)(auth_end - auth) : strlen(auth);
+  if (auth_len > 5 && strncmp(auth, "fifo:", 5) == 0) {
+    __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+    char *path = malloc(auth_len - 4);
+    memcpy(path, auth + 5, auth_len - 5);
+    path[auth_len - 5] = 0;
+    // Opened read-write so that opening never waits for a writer.
+    js->read_fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (js->read_fd < 0) {
+      return 2;
+    }
+    js->write_fd = js->read_fd;
+    js->owns_read_fd = 1;
+  } else {
+    int read_fd;
+    int write_fd;
+    if (sscanf(auth, "%d,%d", &read_fd, &write_fd) != 2 || read_fd < 0
+        || write_fd < 0 || fcntl(read_fd, F_GETFD) == -1
+        || fcntl(write_fd, F_GETFD) == -1) {
+      return 2;
+    }
+    js->read_fd = read_fd;
+    js->write_fd = write_fd;
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+    // The pipe is shared with make and its other jobs, so it must not be made
+    // non-blocking. Opening it again gives a non-blocking open file
+    // description of our own.
+    char proc_path[64];
+    snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", read_fd);
+    const int own_fd = open(proc_path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (own_fd >= 0) {
+      js->read_fd = own_fd;
+      js->owns_read_fd = 1;
+    }
+#endif
+  }
+
+  js->tokens = malloc(max_tokens > 0 ? max_tokens : 1);
+  return 0;
+}
+
+/// Takes one token from the jobserver without waiting.
+/// Returns 0 if a token was taken.
+int simple_archiver_internal_jobserver_try_acquire(
+    SDArchiverInternalJobserver *js) {
+  if (js->read_fd < 0) {
+    return 1;
+  }
+  // Without a non-blocking fd of our own (inherited pipe fds when not on
+  // Linux), another job may take the token between the poll and the read, and
+  // then the read waits until a token is given back.
+  if (!js->owns_read_fd) {
+    struct pollfd pfd = {js->read_fd, POLLIN, 0};
+    if (poll(&pfd, 1, 0) != 1 || !(pfd.revents & POLLIN)) {
+      return 1;
+    }
+  }
+
+  ssize_t read_ret;
+  do {
+    read_ret = read(js->read_fd, js->tokens + js->held, 1);
+  } while (read_ret < 0 && errno == EINTR);
+  if (read_ret != 1) {
+    return 1;
+  }
+  ++js->held;
+  return 0;
+}
+
+/// Gives back tokens to the jobserver until at most "keep" are held.
+void simple_archiver_internal_jobserver_release(SDArchiverInternalJobserver *js,
+                                                uint32_t keep) {
+  while (js->held > keep) {
+    const ssize_t write_ret =
+      write(js->write_fd, js->tokens + js->held - 1, 1);
+    if (write_ret < 0 && errno == EINTR) {
+      continue;
+    } else if (write_ret != 1) {
+      fprintf(stderr,
+              "WARNING: Failed to give back a token to the make jobserver!\n");
+    }
+    --js->held;
+  }
+}
+
+void simple_archiver_internal_jobserver_free(SDArchiverInternalJobserver *js) {
+  if (js->read_fd >= 0) {
+    simple_archiver_internal_jobserver_release(js, 0);
+    if (js->owns_read_fd) {
+      close(js->read_fd);
+    }
+    js->read_fd = -1;
+    js->write_fd = -1;
+  }
+  free(js->tokens);
+  js->tokens = NULL;
+}
+
+void simple_archiver_internal_slice_jobs_free(
+    SDArchiverInternalSliceJobs *jobs) {
+  if (jobs->jobs) {
+    for (uint32_t idx = 0; idx < jobs->size; ++idx) {
+      simple_archiver_internal_cleanup_decomp_pid(&jobs->jobs[idx].pid);
+      simple_archiver_helper_cleanup_FILE(&jobs->jobs[idx].in_f);
+      simple_archiver_helper_cleanup_FILE(&jobs->jobs[idx].out_f);
+    }
+    free(jobs->jobs);
+    jobs->jobs = NULL;
+  }
+  // Tokens are given back only after the compressors holding them have ended.
+  simple_archiver_internal_jobserver_free(&jobs->jobserver);
+}
+
+/// Waits for the oldest running slice compressor and appends its output to
+/// "temp_chunk_f" if non-NULL, otherwise to "out_f" as chunked-encoding.
+SDArchiverStateReturns simple_archiver_internal_slice_jobs_finish_oldest(
+    SDArchiverInternalSliceJobs *jobs,
+    SDArchiverIOStream *out_f,
+    FILE *temp_chunk_f,
+    uint64_t *files_compressed_size) {
+  SDArchiverInternalSliceJob *job = &jobs->jobs[jobs->head];
+
+  int status;
+  const pid_t waited = waitpid(job->pid, &status, 0);
+  if (waited != job->pid) {
+    fprintf(stderr, "ERROR: Failed to wait on compressor of chunk slice!\n");
+    return SDAS_COMPRESSION_ERROR;
+  }
+  job->pid = -1;
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr,
+            "ERROR: Compressor of chunk slice failed! Invalid cmd?\n");
+    return SDAS_COMPRESSION_ERROR;
+  }
+
+  rewind(job->out_f);
+  // Without "temp_chunk_f", each read goes straight into the buffer of
+  // "out_f" as a chunked-encoding frame.
+  char temp_buf[SD_SA_32KiB];
+  while (1) {
+    char *frame = NULL;
+    char *buf = temp_buf;
+    if (!temp_chunk_f) {
+      frame = simple_archiver_internal_v7_reserve_frame(out_f);
+      if (!frame) {
+        fprintf(stderr, "ERROR: Failed to write chunked-encoding data!\n");
+        return SDAS_COMPRESSED_WRITE_FAIL;
+      }
+      buf = frame + SD_SA_V7_HEADER_SPACE;
+    }
+    const size_t fread_ret = fread(buf, 1, SD_SA_32KiB, job->out_f);
+    if (fread_ret == 0) {
+      break;
+    } else if (temp_chunk_f) {
+      if (fwrite(buf, 1, fread_ret, temp_chunk_f) != fread_ret) {
+        fprintf(stderr,
+                "ERROR: Failed to write compressed slice to temporary "
+                "file!\n");
+        return SDAS_COMPRESSED_WRITE_FAIL;
+      }
+    } else {
+      simple_archiver_internal_v7_commit_frame(out_f, frame, fread_ret);
+    }
+    *files_compressed_size += fread_ret;
+  }
+  if (ferror(job->out_f)) {
+    fprintf(stderr, "ERROR: Failed to read compressed slice!\n");
+    return SDAS_COMPRESSED_WRITE_FAIL;
+  }
+
+  simple_archiver_helper_cleanup_FILE(&job->in_f);
+  simple_archiver_helper_cleanup_FILE(&job->out_f);
+  jobs->head = (jobs->head + 1) % jobs->size;
+  --jobs->running;
+
+  return SDAS_SUCCESS;
+}
+
+/// Fills "gear" with the per-byte values of the "--rsyncable" rolling hash.
+/// The values must never change, or archives of the same data would no longer
+/// share their compressed slices.
+void simple_archiver_internal_rsyncable_gear(uint64_t gear[256]) {
+  // splitmix64
+  uint64_t seed = 0x5341525359434E43;
+  for (uint32_t idx = 0; idx < 256; ++idx) {
+    seed += 0x9E3779B97F4A7C15;
+    uint64_t value = seed;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EB;
+    gear[idx] = value ^ (value >> 31);
+  }
+}
+
+/// Compresses the data of the chunk's "file_count" files after "*file_node"
+/// as "compress_slice_size" slices, with up to "compress_jobs" compressors
+/// running at once. The compressed slices are written in order, so the result
+/// is one chunk of concatenated compressed streams.
+/// With "rsyncable", slices instead end where a rolling hash of the last 64
+/// uncompressed bytes has its top bits clear (see "SD_SA_RSYNCABLE_AVERAGE"),
+/// so a change in the data only changes the compressed slices around it.
+/// "*file_node" is set to the chunk's last file.
+SDArchiverStateReturns simple_archiver_internal_write_chunk_slices(
+    SDArchiverIOStream *out_f,
+    const SDArchiverState *state,
+    SDArchiverLLNode **file_node,
+    const SDArchiverLinkedList *files_list,
+    uint64_t file_count,
+    uint64_t *files_compressed_size,
+    SDArchiverInternalFileTimes *file_times,
+    SDArchiverInternalPressure *pressure) {
+  __attribute__((cleanup(simple_archiver_internal_slice_jobs_free)))
+  SDArchiverInternalSliceJobs jobs;
+  jobs.size = state->parsed->compress_jobs;
+  jobs.head = 0;
+  jobs.running = 0;
+  jobs.jobs = malloc(sizeof(SDArchiverInternalSliceJob) * jobs.size);
+  for (uint32_t idx = 0; idx < jobs.size; ++idx) {
+    jobs.jobs[idx].in_f = NULL;
+    jobs.jobs[idx].out_f = NULL;
+    jobs.jobs[idx].pid = -1;
+  }
+  if (state->parsed->make_jobserver && jobs.size > 1) {
+    simple_archiver_internal_jobserver_init(&jobs.jobserver, jobs.size - 1);
+  } else {
+    jobs.jobserver.read_fd = -1;
+    jobs.jobserver.tokens = NULL;
+  }
+
+  // Versions before 7 store the size of the compressed chunk before it.
+  __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
+  FILE *temp_chunk_f = NULL;
+  if (state->parsed->write_version < 7) {
+    temp_chunk_f = simple_archiver_internal_slice_temp_file(state->parsed);
+    if (!temp_chunk_f) {
+      fprintf(stderr,
+              "ERROR: Failed to create a temporary file for archival!\n");
+      return SDAS_COMPRESSION_ERROR;
+    }
+  }
+
+  char buf[SIMPLE_ARCHIVER_BUFFER_SIZE];
+  // Read data in "buf" not yet written to a slice starts at "buf_idx".
+  size_t buf_idx = 0;
+  size_t buf_size = 0;
+  int_fast8_t to_write_header = state->parsed->write_version >= 5 ? 1 : 0;
+  __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
+  FILE *fd = NULL;
+  const SDArchiverInternalFileInfo *file_info_struct = NULL;
+  SDArchiverInternalFileTimer file_timer = {0, 0, 0};
+  uint64_t file_idx = 0;
+  uint64_t slice_count = 0;
+  int_fast8_t is_data_done = 0;
+
+  uint64_t gear[256];
+  uint64_t rolling_hash = 0;
+  uint64_t boundary_mask = 0;
+  uint64_t boundary_min = 0;
+  uint64_t slice_max = state->parsed->compress_slice_size;
+  if (state->parsed->rsyncable) {
+    simple_archiver_internal_rsyncable_gear(gear);
+    uint32_t bits = 0;
+    while (((uint64_t)1 << (bits + 1)) <= SD_SA_RSYNCABLE_AVERAGE) {
+      ++bits;
+    }
+    boundary_mask = (~(uint64_t)0) << (64 - bits);
+    boundary_min = SD_SA_RSYNCABLE_AVERAGE / 4;
+    slice_max = (uint64_t)SD_SA_RSYNCABLE_AVERAGE * 8;
+  }
+
+  while (!is_data_done) {
+    if (is_sig_int_occurred) {
+      return SDAS_SIGINT;
+    }
+
+    const uint32_t max_running =
+      pressure ? simple_archiver_internal_pressure_jobs(pressure,
+                                                        state->parsed)
+               : jobs.size;
+    // Time spent waiting on a compressor while a file is partially read is
+    // counted as that file's compressor wait.
+    const uint64_t wait_start = file_times && fd
+                                ? simple_archiver_helper_monotonic_ns()
+                                : 0;
+    // Without a free jobserver token, the next slice reuses the token of the
+    // oldest compressor instead of waiting on the jobserver.
+    while (jobs.running >= max_running
+           || (jobs.jobserver.read_fd >= 0
+               && jobs.running > jobs.jobserver.held
+               && simple_archiver_internal_jobserver_try_acquire(
+                    &jobs.jobserver) != 0)) {
+      SDArchiverStateReturns ret =
+        simple_archiver_internal_slice_jobs_finish_oldest(
+          &jobs, out_f, temp_chunk_f, files_compressed_size);
+      if (ret != SDAS_SUCCESS) {
+        return ret;
+      }
+    }
+    if (file_times && fd) {
+      file_timer.wait_ns += simple_archiver_helper_monotonic_ns() - wait_start;
+    }
+    if (jobs.jobserver.read_fd >= 0) {
+      // Gives back the tokens of compressors no longer running.
+      simple_archiver_internal_jobserver_release(&jobs.jobserver,
+                                                 jobs.running);
+    }
+
+    SDArchiverInternalSliceJob *job =
+      &jobs.jobs[(jobs.head + jobs.running) % jobs.size];
+    job->in_f = simple_archiver_internal_slice_temp_file(state->parsed);
+    job->out_f = simple_archiver_internal_slice_temp_file(state->parsed);
+    if (!job->in_f || !job->out_f) {
+      fprintf(stderr,
+              "ERROR: Failed to create a temporary file for archival!\n");
+      return SDAS_COMPRESSION_ERROR;
+    }
+
+    uint64_t slice_remaining = slice_max;
+    uint64_t slice_written = 0;
+    if (to_write_header) {
+      if (fwrite("SA", 1, 2, job->in_f) != 2) {
+        return SDAS_COMPRESSION_ERROR;
+      }
+      slice_remaining = slice_remaining > 2 ? slice_remaining - 2 : 0;
+      slice_written = 2;
+      to_write_header = 0;
+    }
+
+    while (slice_remaining > 0) {
+      if (buf_idx == buf_size) {
+        if (!fd) {
+          if (file_idx == file_count) {
+            is_data_done = 1;
+            break;
+          }
+          *file_node = (*file_node)->next;
+          if (*file_node == files_list->tail) {
+            return SDAS_INTERNAL_ERROR;
+          }
+          file_info_struct = (*file_node)->data;
+          fprintf(stderr,
+                  "  FILE %7" PRIu64 " of %7" PRIu64 ": %s\n",
+                  file_idx + 1,
+                  file_count,
+                  file_info_struct->filename);
+          simple_archiver_internal_file_timer_start(file_times, &file_timer);
+          fd = simple_archiver_internal_open_file_info(file_info_struct);
+          simple_archiver_internal_file_timer_opened(file_times, &file_timer);
+          if (!fd) {
+            fprintf(stderr, "ERROR: Writing to chunk, file open error!\n");
+            return SDAS_COMPRESSION_ERROR;
+          }
+          ++file_idx;
+        }
+
+        buf_idx = 0;
+        buf_size = fread(buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE, fd);
+        if (ferror(fd)) {
+          fprintf(stderr, "ERROR: Writing to chunk, file read error!\n");
+          return SDAS_COMPRESSION_ERROR;
+        } else if (feof(fd)) {
+          simple_archiver_helper_cleanup_FILE(&fd);
+          simple_archiver_internal_file_timer_done(file_times,
+                                                   &file_timer,
+                                                   file_info_struct->filename,
+                                                   file_info_struct->file_size);
+        }
+        continue;
+      }
+
+      size_t amount = buf_size - buf_idx;
+      if (amount > slice_remaining) {
+        amount = (size_t)slice_remaining;
+      }
+      if (state->parsed->rsyncable) {
+        for (size_t idx = 0; idx < amount; ++idx) {
+          rolling_hash = (rolling_hash << 1)
+                         + gear[(uint8_t)buf[buf_idx + idx]];
+          if (slice_written + idx + 1 >= boundary_min
+              && (rolling_hash & boundary_mask) == 0) {
+            amount = idx + 1;
+            slice_remaining = amount;
+            break;
           }
         }
       }
-
-      long comp_chunk_size = ftell(temp_fd);
-      if (comp_chunk_size < 0) {
+      if (fwrite(buf + buf_idx, 1, amount, job->in_f) != amount) {
         fprintf(stderr,
-                "ERROR: Temp file reported negative size after compression!\n");
-        return SDA_RET_STRUCT(SDAS_COMPRESSION_ERROR);
+                "ERROR: Failed to write slice to temporary file!\n");
+        return SDAS_COMPRESSION_ERROR;
       }
+      buf_idx += amount;
+      slice_remaining -= amount;
+      slice_written += amount;
+    }
 
-      // Write compressed chunk size.
-      uint64_t u64 = (uint64_t)comp_chunk_size;
-      simple_archiver_helper_64_bit_be(&u64);
-      if (fwrite(&u64, 8, 1, out_f) != 1) {
-        return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+    if (slice_count > 0 && ftell(job->in_f) == 0) {
+      // The previous slice ended exactly at the end of the data.
+      simple_archiver_helper_cleanup_FILE(&job->in_f);
+      simple_archiver_helper_cleanup_FILE(&job->out_f);
+      break;
+    }
+
+    if (fflush(job->in_f) != 0) {
+      return SDAS_COMPRESSION_ERROR;
+    }
+    rewind(job->in_f);
+
+    // The compressor reads the slice from, and writes to, the temporary files
+    // directly.
+    const int in_fd = dup(fileno(job->in_f));
+    if (in_fd < 0) {
+      return SDAS_COMPRESSION_ERROR;
+    }
+    const int out_fd = dup(fileno(job->out_f));
+    if (out_fd < 0) {
+      close(in_fd);
+      return SDAS_COMPRESSION_ERROR;
+    }
+    int pipe_into_cmd[2] = {in_fd, in_fd};
+    int pipe_outof_cmd[2] = {out_fd, out_fd};
+    if (simple_archiver_de_compress(pipe_into_cmd,
+                                    pipe_outof_cmd,
+                                    state->parsed->compressor,
+                                    &job->pid) != 0) {
+      job->pid = -1;
+      fprintf(stderr,
+              "WARNING: Failed to start compressor cmd! Invalid cmd?\n");
+      return SDAS_COMPRESSION_ERROR;
+    }
+    close(in_fd);
+    close(out_fd);
+
+    ++jobs.running;
+    ++slice_count;
+  }
+
+  while (jobs.running > 0) {
+    SDArchiverStateReturns ret =
+      simple_archiver_internal_slice_jobs_finish_oldest(
+        &jobs, out_f, temp_chunk_f, files_compressed_size);
+    if (ret != SDAS_SUCCESS) {
+      return ret;
+    } else if (jobs.jobserver.read_fd >= 0) {
+      simple_archiver_internal_jobserver_release(
+        &jobs.jobserver, jobs.running > 0 ? jobs.running - 1 : 0);
+    }
+  }
+
+  fprintf(stderr,
+          "  Compressed %" PRIu64 " slice(s) with up to %" PRIu32
+          " compressor(s)\n",
+          slice_count,
+          jobs.size);
+
+  if (temp_chunk_f) {
+    const long comp_chunk_size = ftell(temp_chunk_f);
+    if (comp_chunk_size < 0) {
+      return SDAS_COMPRESSION_ERROR;
+    }
+    uint64_t u64 = (uint64_t)comp_chunk_size;
+    simple_archiver_helper_64_bit_be(&u64);
+    if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
+      return SDAS_FAILED_TO_WRITE;
+    }
+    rewind(temp_chunk_f);
+    size_t fread_ret;
+    while ((fread_ret = fread(buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE,
+                              temp_chunk_f)) > 0) {
+      if (simple_archiver_io_write(buf, 1, fread_ret, out_f) != fread_ret) {
+        return SDAS_FAILED_TO_WRITE;
       }
-      *files_compressed_size += (uint64_t)comp_chunk_size;
+    }
+    if (ferror(temp_chunk_f)) {
+      return SDAS_COMPRESSED_WRITE_FAIL;
+    }
+  } else if (simple_archiver_io_write("0\n", 1, 2, out_f) != 2) {
+    fprintf(stderr, "ERROR: Failed to write end of chunked-encoding!\n");
+    return SDAS_FAILED_TO_WRITE;
+  }
 
-      rewind(temp_fd);
+  return SDAS_SUCCESS;
+}
 
-      size_t written_size = 0;
+/// Starts "cmd" as a compressor with non-blocking pipes into and out of it.
+/// On success, "*pid", "*into_write", and "*outof_read" must be cleaned up by
+/// the caller.
+SDArchiverStateReturns simple_archiver_internal_start_compressor(
+    const char *cmd,
+    pid_t *pid,
+    int *into_write,
+    int *outof_read) {
+  int pipe_into_cmd[2];
+  int pipe_outof_cmd[2];
+
+  if (pipe(pipe_into_cmd) != 0) {
+    // Unable to create pipes.
+    return SDAS_COMPRESSION_ERROR;
+  } else if (pipe(pipe_outof_cmd) != 0) {
+    // Unable to create second set of pipes.
+    close(pipe_into_cmd[0]);
+    close(pipe_into_cmd[1]);
+    return SDAS_COMPRESSION_ERROR;
+  } else if (fcntl(pipe_into_cmd[1], F_SETFL, O_NONBLOCK) == -1
+      || fcntl(pipe_outof_cmd[0], F_SETFL, O_NONBLOCK) == -1) {
+    fprintf(stderr, "ERROR: Unable to set non-blocking on pipes!\n");
+    close(pipe_into_cmd[0]);
+    close(pipe_into_cmd[1]);
+    close(pipe_outof_cmd[0]);
+    close(pipe_outof_cmd[1]);
+    return SDAS_COMPRESSION_ERROR;
+  } else if (simple_archiver_de_compress(pipe_into_cmd,
+                                         pipe_outof_cmd,
+                                         cmd,
+                                         pid) != 0) {
+    // Failed to spawn compressor.
+    close(pipe_into_cmd[1]);
+    close(pipe_outof_cmd[0]);
+    fprintf(stderr, "WARNING: Failed to start compressor cmd! Invalid cmd?\n");
+    return SDAS_COMPRESSION_ERROR;
+  }
+
+  // Close unnecessary pipe fds on this end of the transfer.
+  close(pipe_into_cmd[0]);
+  close(pipe_outof_cmd[1]);
+  *into_write = pipe_into_cmd[1];
+  *outof_read = pipe_outof_cmd[0];
+  return SDAS_SUCCESS;
+}
 
-      // Write compressed chunk.
-      while (!feof(temp_fd)) {
-        if (is_sig_int_occurred) {
-          return SDA_RET_STRUCT(SDAS_SIGINT);
-        } else if (ferror(temp_fd)) {
-          return SDA_RET_STRUCT(SDAS_COMPRESSED_WRITE_FAIL);
-        }
-        size_t fread_ret = fread(buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE, temp_fd);
-        if (fread_ret > 0) {
-          size_t fwrite_ret = fwrite(buf, 1, fread_ret, out_f);
-          written_size += fwrite_ret;
-          if (fwrite_ret != fread_ret) {
-            fprintf(stderr,
-                    "ERROR: Partial write of read bytes from temp file to "
-                    "output file!\n");
-            return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
-          }
-        }
+/// Reads available output of the compressor into the data of "*frame" (a
+/// frame in the buffer of "out_f", reserved first if NULL), committing it
+/// every time it is full and adding what was committed to "*compressed_size".
+/// "*read_size" is set to the number of bytes read, and is zero on EOF.
+SDArchiverStateReturns simple_archiver_internal_v7_read_compressed(
+    int outof_read,
+    SDArchiverIOStream *out_f,
+    char **frame,
+    size_t *frame_idx,
+    ssize_t *read_size,
+    uint64_t *compressed_size) {
+  if (!*frame) {
+    *frame = simple_archiver_internal_v7_reserve_frame(out_f);
+    if (!*frame) {
+      fprintf(stderr, "ERROR: Failed to write chunked-encoding data!\n");
+      return SDAS_COMPRESSED_WRITE_FAIL;
+    }
+  }
+  *read_size = read(outof_read,
+                    *frame + SD_SA_V7_HEADER_SPACE + *frame_idx,
+                    SD_SA_32KiB - *frame_idx);
+  if (*read_size < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      fprintf(stderr, "ERROR: Reading from compressor, pipe read error!\n");
+      return SDAS_COMPRESSION_ERROR;
+    }
+  } else if (*read_size > 0) {
+    *frame_idx += (size_t)*read_size;
+    if (*frame_idx == SD_SA_32KiB) {
+      simple_archiver_internal_v7_commit_frame(out_f, *frame, SD_SA_32KiB);
+      *compressed_size += SD_SA_32KiB;
+      *frame = NULL;
+      *frame_idx = 0;
+    }
+  }
+  return SDAS_SUCCESS;
+}
+
+/// Gives the next data to compress in "*out" and "*out_size", which is zero
+/// once all data was given.
+typedef SDArchiverStateReturns (*SDArchiverInternalChunkSrcFn)(
+    void *ud,
+    const char **out,
+    size_t *out_size);
+
+/// Compresses "SA" (file format 5 and above) followed by the data given by
+/// "src_fn" with "cmd", writing the output as chunked-encoding (file format 7)
+/// and adding its size to "*compressed_size". Time spent waiting on the
+/// compressor is added to "*wait_ns" if it is non-NULL.
+SDArchiverStateRetStruct simple_archiver_internal_v7_compress_chunk(
+    SDArchiverIOStream *out_f,
+    const char *cmd,
+    SDArchiverInternalChunkSrcFn src_fn,
+    void *src_ud,
+    uint64_t *wait_ns,
+    uint64_t *compressed_size) {
+  // Handle SIGPIPE.
+  is_sig_pipe_occurred = 0;
+  simple_archiver_helper_set_signal_action(SIGPIPE, handle_sig_pipe);
+
+  __attribute__((cleanup(
+      simple_archiver_internal_cleanup_decomp_pid))) pid_t compressor_pid = -1;
+  __attribute__((cleanup(
+      simple_archiver_internal_cleanup_int_fd))) int pipe_outof_read = -1;
+  __attribute__((cleanup(
+      simple_archiver_internal_cleanup_int_fd))) int pipe_into_write = -1;
+  SDArchiverStateReturns ret = simple_archiver_internal_start_compressor(
+    cmd, &compressor_pid, &pipe_into_write, &pipe_outof_read);
+  if (ret != SDAS_SUCCESS) {
+    return SDA_RET_STRUCT(ret);
+  }
+
+  // Compressor output is read straight into the data of the current frame in
+  // the buffer of "out_f", which is committed when full. Nothing else may
+  // write to "out_f" until then.
+  char *frame = NULL;
+  size_t frame_idx = 0;
+  ssize_t read_size;
+
+  const char *pending = "SA";
+  size_t pending_size = 2;
+  while (1) {
+    if (is_sig_int_occurred) {
+      return SDA_RET_STRUCT(SDAS_SIGINT);
+    } else if (is_sig_pipe_occurred) {
+      fprintf(stderr, "ERROR: SIGPIPE while compressing!\n");
+      return SDA_RET_STRUCT(SDAS_COMPRESSION_ERROR);
+    }
+
+    if (pending_size == 0) {
+      ret = src_fn(src_ud, &pending, &pending_size);
+      if (ret != SDAS_SUCCESS) {
+        return SDA_RET_STRUCT(ret);
+      } else if (pending_size == 0) {
+        break;
       }
+    }
 
-      if (written_size != (size_t)comp_chunk_size) {
-        fprintf(stderr,
-                "ERROR: Written chunk size is not actual chunk size!\n");
+    ssize_t write_ret = write(pipe_into_write, pending, pending_size);
+    if (write_ret < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        fprintf(stderr, "ERROR: Writing to compressor, pipe write error!\n");
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
-
-      // Cleanup and remove temp_fd.
-      simple_archiver_helper_cleanup_FILE(&temp_fd);
     } else {
-      // Is NOT compressing.
-      if (!non_c_chunk_size) {
-        return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
-      }
-      simple_archiver_helper_64_bit_be(non_c_chunk_size);
-      fwrite(non_c_chunk_size, 8, 1, out_f);
-      for (uint64_t file_idx = 0; file_idx < *((uint64_t *)chunk_c_node->data);
-           ++file_idx) {
-        if (is_sig_int_occurred) {
-          return SDA_RET_STRUCT(SDAS_SIGINT);
-        }
-        file_node = file_node->next;
-        if (file_node == files_list->tail) {
-          return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
-        }
-        const SDArchiverInternalFileInfo *file_info_struct = file_node->data;
-        fprintf(stderr,
-                "  FILE %3" PRIu64 " of %3" PRIu64 ": %s\n",
-                file_idx + 1,
-                *(uint64_t *)chunk_c_node->data,
-                file_info_struct->filename);
-        __attribute__((cleanup(simple_archiver_helper_cleanup_FILE))) FILE *fd =
-            fopen(file_info_struct->filename, "rb");
-        while (!feof(fd)) {
-          if (ferror(fd)) {
-            fprintf(stderr, "ERROR: Writing to chunk, file read error!\n");
-            return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
-          }
-          size_t fread_ret = fread(buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE, fd);
-          if (fread_ret > 0) {
-            size_t fwrite_ret = fwrite(buf, 1, fread_ret, out_f);
-            if (fwrite_ret != fread_ret) {
-              fprintf(stderr, "ERROR: Writing to chunk, file write error!\n");
-              return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
-            }
-          }
-        }
-      }
+      pending += write_ret;
+      pending_size -= (size_t)write_ret;
     }
-  }
 
-  if (*files_compressed_size != 0) {
-    uint64_t *compressed_size_ptr = files_compressed_size;
-    files_compressed_size = NULL;
-    simple_archiver_hash_map_insert(
-      write_state,
-      compressed_size_ptr,
-      SDA_PSTATE_CMP_SIZE_KEY,
-      SDA_PSTATE_CMP_SIZE_KEY_SIZE,
-      NULL,
-      simple_archiver_helper_datastructure_cleanup_nop);
+    ret = simple_archiver_internal_v7_read_compressed(pipe_outof_read,
+                                                      out_f,
+                                                      &frame,
+                                                      &frame_idx,
+                                                      &read_size,
+                                                      compressed_size);
+    if (ret != SDAS_SUCCESS) {
+      return SDA_RET_STRUCT(ret);
+    } else if (write_ret < 0 && read_size < 0) {
+      // Both pipes are full/empty, wait for the compressor.
+      simple_archiver_internal_nonblock_sleep(wait_ns);
+    }
   }
 
-  // Write directory entries.
+  simple_archiver_internal_cleanup_int_fd(&pipe_into_write);
 
-  if (dirs_list->count > 0xFFFFFFFF) {
-    return SDA_RET_STRUCT(SDAS_TOO_MANY_DIRS);
+  // Finish writing.
+  while (1) {
+    if (is_sig_int_occurred) {
+      return SDA_RET_STRUCT(SDAS_SIGINT);
+    }
+    ret = simple_archiver_internal_v7_read_compressed(pipe_outof_read,
+                                                      out_f,
+                                                      &frame,
+                                                      &frame_idx,
+                                                      &read_size,
+                                                      compressed_size);
+    if (ret != SDAS_SUCCESS) {
+      return SDA_RET_STRUCT(ret);
+    } else if (read_size == 0) {
+      // EOF.
+      break;
+    } else if (read_size < 0) {
+      nanosleep(&nonblock_sleep, NULL);
+    }
   }
 
-  u32 = (uint32_t)dirs_list->count;
-  if (u32 != 0) {
-    fprintf(stderr, "Directories:\n");
+  // Write remaining chunked-encoding data if exists.
+  if (frame_idx != 0) {
+    simple_archiver_internal_v7_commit_frame(out_f, frame, frame_idx);
+    *compressed_size += frame_idx;
   }
-
-  simple_archiver_helper_32_bit_be(&u32);
-
-  if (fwrite(&u32, 4, 1, out_f) != 1) {
+  // End of chunked-encoding.
+  if (simple_archiver_io_write("0\n", 1, 2, out_f) != 2) {
+    fprintf(stderr, "ERROR: Failed to write end of chunked-encoding!\n");
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
 
-  void **void_ptrs = malloc(sizeof(void*) * 2);
-  void_ptrs[0] = out_f;
-  void_ptrs[1] = state;
+  return SDA_RET_STRUCT(SDAS_SUCCESS);
+}
 
-  if (simple_archiver_slist_get(dirs_list,
-                                internal_write_dir_entries_v2_v3_v4_v5_v6,
-                                void_ptrs)) {
-    free(void_ptrs);
-    return SDA_RET_STRUCT(SDAS_DIR_ENTRY_WRITE_FAIL);
-  }
-  free(void_ptrs);
+/// Files of a chunk given to "simple_archiver_internal_v7_compress_chunk".
+typedef struct SDArchiverInternalChunkFiles {
+  /// Advanced to each file as it is given.
+  SDArchiverLLNode **file_node;
+  const SDArchiverLinkedList *files_list;
+  uint64_t file_count;
+  uint64_t file_idx;
+  /// Is NULL between files, must be cleaned up by the caller.
+  FILE *fd;
+  SDArchiverInternalFileTimes *file_times;
+  SDArchiverInternalFileTimer *file_timer;
+  char buf[SIMPLE_ARCHIVER_BUFFER_SIZE];
+} SDArchiverInternalChunkFiles;
 
-  return SDA_RET_STRUCT(SDAS_SUCCESS);
+SDArchiverStateReturns simple_archiver_internal_chunk_files_next(
+    void *ud,
+    const char **out,
+    size_t *out_size) {
+  SDArchiverInternalChunkFiles *files = ud;
+  while (1) {
+    if (files->fd) {
+      const size_t fread_ret =
+        fread(files->buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE, files->fd);
+      if (fread_ret > 0) {
+        *out = files->buf;
+        *out_size = fread_ret;
+        return SDAS_SUCCESS;
+      } else if (ferror(files->fd)) {
+        fprintf(stderr, "ERROR: Writing to chunk, file read error!\n");
+        return SDAS_COMPRESSION_ERROR;
+      }
+      simple_archiver_helper_cleanup_FILE(&files->fd);
+      const SDArchiverInternalFileInfo *file_info_struct =
+        (*files->file_node)->data;
+      simple_archiver_internal_file_timer_done(files->file_times,
+                                               files->file_timer,
+                                               file_info_struct->filename,
+                                               file_info_struct->file_size);
+    }
+
+    if (files->file_idx == files->file_count) {
+      *out_size = 0;
+      return SDAS_SUCCESS;
+    }
+    *files->file_node = (*files->file_node)->next;
+    if (*files->file_node == files->files_list->tail) {
+      return SDAS_INTERNAL_ERROR;
+    }
+    ++files->file_idx;
+    const SDArchiverInternalFileInfo *file_info_struct =
+      (*files->file_node)->data;
+    fprintf(stderr,
+            "  FILE %7" PRIu64 " of %7" PRIu64 ": %s\n",
+            files->file_idx,
+            files->file_count,
+            file_info_struct->filename);
+    simple_archiver_internal_file_timer_start(files->file_times,
+                                              files->file_timer);
+    files->fd = simple_archiver_internal_open_file_info(file_info_struct);
+    simple_archiver_internal_file_timer_opened(files->file_times,
+                                               files->file_timer);
+    if (!files->fd) {
+      fprintf(stderr,
+              "ERROR: Failed to open \"%s\"!\n",
+              file_info_struct->filename);
+      return SDAS_COMPRESSION_ERROR;
+    }
+  }
 }
 
 SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
-    FILE *out_f,
+    SDArchiverIOStream *out_f,
     SDArchiverState *state,
     SDArchiverHashMap *write_state) {
-  if (state->parsed->write_version == 7) {
+  if (state->parsed->write_version == 11) {
+    fprintf(stderr, "Writing archive of file format 11\n");
+  } else if (state->parsed->write_version == 10) {
+    fprintf(stderr, "Writing archive of file format 10\n");
+  } else if (state->parsed->write_version == 9) {
+    fprintf(stderr, "Writing archive of file format 9\n");
+  } else if (state->parsed->write_version == 8) {
+    fprintf(stderr, "Writing archive of file format 8\n");
+  } else if (state->parsed->write_version == 7) {
     fprintf(stderr, "Writing archive of file format 7\n");
   } else if (state->parsed->write_version == 6) {
     fprintf(stderr, "Writing archive of file format 6\n");
@@ -6760,6 +10390,32 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
     fprintf(stderr, "Writing archive of file format 4\n");
   }
 
+  if (state->parsed->make_jobserver && state->parsed->compress_jobs > 1) {
+    SDArchiverInternalJobserver jobserver;
+    const int ret = simple_archiver_internal_jobserver_init(&jobserver, 1);
+    simple_archiver_internal_jobserver_free(&jobserver);
+    if (ret == 1) {
+      fprintf(stderr,
+              "WARNING: No make jobserver in MAKEFLAGS, running up to %" PRIu32
+              " compressors per chunk!\n",
+              state->parsed->compress_jobs);
+    } else if (ret != 0) {
+      fprintf(stderr,
+              "WARNING: The make jobserver in MAKEFLAGS is not usable (is the "
+              "make recipe missing \"+\"?), running up to %" PRIu32
+              " compressors per chunk!\n",
+              state->parsed->compress_jobs);
+    }
+  }
+
+  SDArchiverInternalFileTimes *file_times =
+    simple_archiver_internal_file_times_get(write_state, state->parsed);
+  SDArchiverInternalFileTimer file_timer = {0, 0, 0};
+  SDArchiverInternalPressure *pressure =
+    state->parsed->compress_jobs > 1
+      ? simple_archiver_internal_pressure_get(write_state, state->parsed)
+      : NULL;
+
   // First create a "set" of absolute paths to given filenames.
   fprintf(stderr, "INFO: Getting absolute path(s) from given path(s)...\n");
 
@@ -6804,17 +10460,16 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
   SDArchiverLinkedList *files_list = simple_archiver_list_init();
   __attribute__((cleanup(simple_archiver_slist_free)))
   SDArchiverStringList *dirs_list = simple_archiver_slist_init();
-  __attribute__((cleanup(simple_archiver_priority_heap_free)))
-  SDArchiverPHeap *files_pheap = NULL;
+  __attribute__((cleanup(simple_archiver_btree_free)))
+  SDArchiverBTree *files_btree = NULL;
   if (state->parsed->write_version >= 6) {
-    files_pheap = simple_archiver_priority_heap_init_less_generic_fn_ud(
-        internal_pheap_file_ext_less_fn,
+    files_btree = simple_archiver_btree_init_ud(
+        internal_file_ext_less_fn,
         state->parsed->not_to_compress_file_extensions);
-  } else if (state->parsed->flags & 0x80000) {
-    files_pheap = simple_archiver_priority_heap_init_less_generic_fn(
-        internal_strcmp_less_fn);
+  } else if (state->parsed->flags & 0x180000) {
+    files_btree = simple_archiver_btree_init(internal_strcmp_less_fn);
   } else if (state->parsed->flags & 0x40) {
-    files_pheap = simple_archiver_priority_heap_init_less_fn(greater_fn);
+    files_btree = simple_archiver_btree_init(internal_size_greater_fn);
   }
   uint64_t from_files_count = 0;
   uint64_t *files_actual_size = malloc(sizeof(uint64_t));
@@ -6828,7 +10483,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
   ptr_array[0] = symlinks_list;
   ptr_array[1] = files_list;
   ptr_array[2] = (void *)state->parsed->user_cwd;
-  ptr_array[3] = files_pheap;
+  ptr_array[3] = files_btree;
   ptr_array[4] = dirs_list;
   ptr_array[5] = state;
   ptr_array[6] = &from_files_count;
@@ -6866,26 +10521,25 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
     simple_archiver_helper_datastructure_cleanup_nop);
 
   int_fast8_t has_non_compressible_chunk = 0;
-  if (files_pheap) {
+  if (files_btree) {
     if (state->parsed->write_version >= 6) {
-      __attribute__((cleanup(simple_archiver_priority_heap_free)))
-      SDArchiverPHeap *name_pheap =
-        simple_archiver_priority_heap_init_less_generic_fn(
-          internal_strcmp_less_fn);
+      __attribute__((cleanup(simple_archiver_btree_free)))
+      SDArchiverBTree *name_btree =
+        simple_archiver_btree_init(internal_strcmp_less_fn);
 
-      // Put not-to-compress into name-sorting-heap
-      while (simple_archiver_priority_heap_size(files_pheap) != 0) {
+      // Not-to-compress files are ordered first, put them in name order.
+      while (simple_archiver_btree_size(files_btree) != 0) {
         if (is_sig_int_occurred) {
-          fprintf(stderr, "Interrupt, stop populating priority heap...\n");
+          fprintf(stderr, "Interrupt, stop ordering files...\n");
           return SDA_RET_STRUCT(SDAS_SIGINT);
         }
-        SDArchiverInternalFileInfo *popped =
-          simple_archiver_priority_heap_pop(files_pheap);
+        SDArchiverInternalFileInfo *first =
+          simple_archiver_btree_first(files_btree);
         __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
         char *ext = NULL;
-        for (size_t idx = strlen(popped->filename); idx-- > 0;) {
-          if (popped->filename[idx] == '.') {
-            ext = simple_archiver_helper_to_lower(popped->filename + idx);
+        for (size_t idx = strlen(first->filename); idx-- > 0;) {
+          if (first->filename[idx] == '.') {
+            ext = simple_archiver_helper_to_lower(first->filename + idx);
             break;
           }
         }
@@ -6895,112 +10549,93 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
                   ext,
                   strlen(ext))) {
           has_non_compressible_chunk = 1;
-          simple_archiver_priority_heap_insert(
-              name_pheap,
-              0,
-              popped,
+          simple_archiver_btree_insert(
+              name_btree,
+              simple_archiver_btree_pop_first(files_btree),
               free_internal_file_info);
         } else {
-          simple_archiver_priority_heap_insert(
-              files_pheap,
-              0,
-              popped,
-              free_internal_file_info);
           break;
         }
       }
 
       // Add name-sorted not-compressible to list
-      while (simple_archiver_priority_heap_size(name_pheap) != 0) {
+      while (simple_archiver_btree_size(name_btree) != 0) {
         if (is_sig_int_occurred) {
-          fprintf(stderr, "Interrupt, stop populating priority heap...\n");
+          fprintf(stderr, "Interrupt, stop ordering files...\n");
           return SDA_RET_STRUCT(SDAS_SIGINT);
         }
         simple_archiver_list_add(
           non_comp_files_list,
-          simple_archiver_priority_heap_pop(name_pheap),
+          simple_archiver_btree_pop_first(name_btree),
           free_internal_file_info);
       }
 
-      // Put rest of data in selected heap type and list afterwards
-      if (state->parsed->flags & 0x80000) {
-        __attribute__((cleanup(simple_archiver_priority_heap_free)))
-        SDArchiverPHeap *pheap =
-          simple_archiver_priority_heap_init_less_generic_fn(
-            internal_strcmp_less_fn);
-        while (simple_archiver_priority_heap_size(files_pheap) != 0) {
-          if (is_sig_int_occurred) {
-            fprintf(stderr, "Interrupt, stop populating priority heap...\n");
-            return SDA_RET_STRUCT(SDAS_SIGINT);
-          }
-          simple_archiver_priority_heap_insert(
-              pheap,
-              0,
-              simple_archiver_priority_heap_pop(files_pheap),
-              free_internal_file_info);
-        }
-        while (simple_archiver_priority_heap_size(pheap) != 0) {
-          if (is_sig_int_occurred) {
-            fprintf(stderr, "Interrupt, stop populating priority heap...\n");
-            return SDA_RET_STRUCT(SDAS_SIGINT);
-          }
-          simple_archiver_list_add(
-              files_list,
-              simple_archiver_priority_heap_pop(pheap),
-              free_internal_file_info);
+      // Put rest of data in selected order and list afterwards
+      if (state->parsed->flags & 0x100000) {
+        SDArchiverStateReturns ret =
+          simple_archiver_internal_sort_files_by_similarity(files_btree,
+                                                            files_list,
+                                                            state);
+        if (ret != SDAS_SUCCESS) {
+          return SDA_RET_STRUCT(ret);
         }
-      } else if (state->parsed->flags & 0x40) {
-        __attribute__((cleanup(simple_archiver_priority_heap_free)))
-        SDArchiverPHeap *pheap =
-          simple_archiver_priority_heap_init_less_fn(
-            greater_fn);
-        while (simple_archiver_priority_heap_size(files_pheap) != 0) {
+      } else if (state->parsed->flags & 0x80040) {
+        __attribute__((cleanup(simple_archiver_btree_free)))
+        SDArchiverBTree *btree = simple_archiver_btree_init(
+          state->parsed->flags & 0x80000 ? internal_strcmp_less_fn
+                                         : internal_size_greater_fn);
+        while (simple_archiver_btree_size(files_btree) != 0) {
           if (is_sig_int_occurred) {
-            fprintf(stderr, "Interrupt, stop populating priority heap...\n");
+            fprintf(stderr, "Interrupt, stop ordering files...\n");
             return SDA_RET_STRUCT(SDAS_SIGINT);
           }
-          SDArchiverInternalFileInfo *file_info =
-            simple_archiver_priority_heap_pop(files_pheap);
-          simple_archiver_priority_heap_insert(
-              pheap,
-              (int64_t)file_info->file_size,
-              file_info,
+          simple_archiver_btree_insert(
+              btree,
+              simple_archiver_btree_pop_first(files_btree),
               free_internal_file_info);
         }
-        while (simple_archiver_priority_heap_size(pheap) != 0) {
+        while (simple_archiver_btree_size(btree) != 0) {
           if (is_sig_int_occurred) {
-            fprintf(stderr, "Interrupt, stop populating priority heap...\n");
+            fprintf(stderr, "Interrupt, stop ordering files...\n");
             return SDA_RET_STRUCT(SDAS_SIGINT);
           }
           simple_archiver_list_add(
               files_list,
-              simple_archiver_priority_heap_pop(pheap),
+              simple_archiver_btree_pop_first(btree),
               free_internal_file_info);
         }
       } else {
-        while (simple_archiver_priority_heap_size(files_pheap) != 0) {
+        while (simple_archiver_btree_size(files_btree) != 0) {
           if (is_sig_int_occurred) {
-            fprintf(stderr, "Interrupt, stop populating priority heap...\n");
+            fprintf(stderr, "Interrupt, stop ordering files...\n");
             return SDA_RET_STRUCT(SDAS_SIGINT);
           }
           simple_archiver_list_add(
               files_list,
-              simple_archiver_priority_heap_pop(files_pheap),
+              simple_archiver_btree_pop_first(files_btree),
               free_internal_file_info);
         }
       }
+    } else if (state->parsed->flags & 0x100000) {
+      SDArchiverStateReturns ret =
+        simple_archiver_internal_sort_files_by_similarity(files_btree,
+                                                          files_list,
+                                                          state);
+      if (ret != SDAS_SUCCESS) {
+        return SDA_RET_STRUCT(ret);
+      }
     } else {
-      while (simple_archiver_priority_heap_size(files_pheap) > 0) {
+      while (simple_archiver_btree_size(files_btree) > 0) {
         if (is_sig_int_occurred) {
-          fprintf(stderr, "Interrupt, stop populating priority heap...\n");
+          fprintf(stderr, "Interrupt, stop ordering files...\n");
           return SDA_RET_STRUCT(SDAS_SIGINT);
         }
         simple_archiver_list_add(files_list,
-                                 simple_archiver_priority_heap_pop(files_pheap),
+                                 simple_archiver_btree_pop_first(files_btree),
                                  free_internal_file_info);
       }
     }
-    simple_archiver_priority_heap_free(&files_pheap);
+    simple_archiver_btree_free(&files_btree);
   }
 
   if (symlinks_list->count
@@ -7013,13 +10648,21 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
     return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
   }
 
-  if (fwrite("SIMPLE_ARCHIVE_VER", 1, 18, out_f) != 18) {
+  if (simple_archiver_io_write("SIMPLE_ARCHIVE_VER", 1, 18, out_f) != 18) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
 
   char buf[SIMPLE_ARCHIVER_BUFFER_SIZE];
   uint16_t u16;
-  if (state->parsed->write_version == 7) {
+  if (state->parsed->write_version == 11) {
+    u16 = 11;
+  } else if (state->parsed->write_version == 10) {
+    u16 = 10;
+  } else if (state->parsed->write_version == 9) {
+    u16 = 9;
+  } else if (state->parsed->write_version == 8) {
+    u16 = 8;
+  } else if (state->parsed->write_version == 7) {
     u16 = 7;
   } else if (state->parsed->write_version == 6) {
     u16 = 6;
@@ -7031,7 +10674,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
 
   simple_archiver_helper_16_bit_be(&u16);
 
-  if (fwrite(&u16, 2, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
 
@@ -7047,7 +10690,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
     // 4 bytes flags, using de/compressor.
     memset(buf, 0, 4);
     buf[0] |= 1;
-    if (fwrite(buf, 1, 4, out_f) != 4) {
+    if (simple_archiver_io_write(buf, 1, 4, out_f) != 4) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
 
@@ -7059,13 +10702,13 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
 
     u16 = (uint16_t)len;
     simple_archiver_helper_16_bit_be(&u16);
-    if (fwrite(&u16, 1, 2, out_f) != 2) {
+    if (simple_archiver_io_write(&u16, 1, 2, out_f) != 2) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
     simple_archiver_helper_16_bit_be(&u16);
 
-    if (fwrite(state->parsed->compressor, 1, u16 + 1, out_f) !=
-        (size_t)u16 + 1) {
+    if (simple_archiver_io_write(state->parsed->compressor, 1, u16 + 1, out_f)
+        != (size_t)u16 + 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
 
@@ -7077,32 +10720,63 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
 
     u16 = (uint16_t)len;
     simple_archiver_helper_16_bit_be(&u16);
-    if (fwrite(&u16, 1, 2, out_f) != 2) {
+    if (simple_archiver_io_write(&u16, 1, 2, out_f) != 2) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
     simple_archiver_helper_16_bit_be(&u16);
 
-    if (fwrite(state->parsed->decompressor, 1, u16 + 1, out_f) !=
-        (size_t)u16 + 1) {
+    if (simple_archiver_io_write(state->parsed->decompressor, 1, u16 + 1, out_f)
+        != (size_t)u16 + 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
   } else {
     // 4 bytes flags, not using de/compressor.
     memset(buf, 0, 4);
-    if (fwrite(buf, 1, 4, out_f) != 4) {
+    if (simple_archiver_io_write(buf, 1, 4, out_f) != 4) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
   }
 
+  __attribute__((cleanup(simple_archiver_internal_delta_ref_free)))
+  SDArchiverInternalDeltaRef *delta_ref = NULL;
+  if (state->parsed->delta_from && state->parsed->rsyncable) {
+    // Delta compressed chunks are compressed whole, not as slices.
+    fprintf(stderr,
+            "ERROR: \"--rsyncable\" cannot be used with \"--delta-from\"!\n");
+    return SDA_RET_STRUCT(SDAS_INVALID_PARSED_STATE);
+  } else if (state->parsed->write_version >= 8
+      && state->parsed->delta_from
+      && state->parsed->compressor) {
+    delta_ref = simple_archiver_internal_delta_ref_load(
+      state->parsed->delta_from);
+    if (!delta_ref) {
+      return SDA_RET_STRUCT(SDAS_DELTA_REF_ERROR);
+    }
+    fprintf(stderr,
+            "Using reference archive with %" PRIu64 " chunk(s)\n",
+            delta_ref->chunk_count);
+  }
+
   uint32_t u32;
   uint64_t u64;
 
+  if (state->parsed->write_version >= 11) {
+    fprintf(stderr, "Archiving Directory Summaries\n");
+    SDArchiverLinkedList *const summary_lists[2] = {non_comp_files_list,
+                                                    files_list};
+    SDArchiverStateReturns ret = simple_archiver_internal_dir_summaries_write(
+      out_f, state->parsed->prefix, summary_lists);
+    if (ret != SDAS_SUCCESS) {
+      return SDA_RET_STRUCT(ret);
+    }
+  }
+
   if (state->parsed->write_version >= 6) {
     // Directories.
     fprintf(stderr, "Archiving Directories\n");
     u64 = state->parsed->working_dirs->count;
     simple_archiver_helper_64_bit_be(&u64);
-    if (fwrite(&u64, 8, 1, out_f) != 1) {
+    if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
 
@@ -7128,11 +10802,11 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
               dir_path);
       u32 = (uint32_t)strlen(dir_path);
       simple_archiver_helper_32_bit_be(&u32);
-      if (fwrite(&u32, 4, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
       simple_archiver_helper_32_bit_be(&u32);
-      if (fwrite(dir_path, 1, u32 + 1, out_f) != u32 + 1) {
+      if (simple_archiver_io_write(dir_path, 1, u32 + 1, out_f) != u32 + 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
@@ -7205,7 +10879,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         pbits[1] |= is_dir_empty ? 0 : 2;
       }
 
-      if (fwrite(pbits, 1, 2, out_f) != 2) {
+      if (simple_archiver_io_write(pbits, 1, 2, out_f) != 2) {
         fprintf(stderr,
                 "ERROR: Failed to write permission bits for \"%s\"!\n",
                 dir_path);
@@ -7227,7 +10901,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
       }
 
       simple_archiver_helper_32_bit_be(&u32);
-      if (fwrite(&u32, 4, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
         fprintf(stderr, "ERROR: Failed to write UID for \"%s\"!\n", dir_path);
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
@@ -7246,7 +10920,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         }
       }
       simple_archiver_helper_32_bit_be(&u32);
-      if (fwrite(&u32, 4, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
         fprintf(stderr, "ERROR: Failed to write GID for \"%s\"!\n", dir_path);
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
@@ -7282,13 +10956,14 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         }
         u16 = (uint16_t)length;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           fprintf(
             stderr,
             "ERROR: Failed to write username length for dir \"%s\"!\n",
             dir_path);
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
-        } else if (fwrite(username, 1, length + 1, out_f) != length + 1) {
+        } else if (simple_archiver_io_write(username, 1, length + 1, out_f)
+                   != length + 1) {
           fprintf(stderr,
                   "ERROR: Failed to write username for dir \"%s\"!\n",
                   dir_path);
@@ -7296,7 +10971,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           fprintf(
             stderr,
             "ERROR: Failed to write 0 bytes for username for dir \"%s\"\n!",
@@ -7336,12 +11011,13 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         }
         u16 = (uint16_t)length;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           fprintf(stderr,
                   "ERROR: Failed to write Groupname length for dir \"%s\"!\n",
                   dir_path);
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
-        } else if (fwrite(groupname, 1, length + 1, out_f) != length + 1) {
+        } else if (simple_archiver_io_write(groupname, 1, length + 1, out_f)
+                   != length + 1) {
           fprintf(stderr,
                   "ERROR: Failed to write Groupname for dir \"%s\"!\n",
                   dir_path);
@@ -7349,7 +11025,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           fprintf(
             stderr,
             "ERROR: Failed to write 0 bytes for Groupname for dir \"%s\"\n!",
@@ -7362,7 +11038,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
 
   u64 = symlinks_list->count;
   simple_archiver_helper_64_bit_be(&u64);
-  if (fwrite(&u64, 8, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
   simple_archiver_helper_64_bit_be(&u64);
@@ -7517,7 +11193,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         buf[1] |= 4;
       }
 
-      if (fwrite(buf, 1, 2, out_f) != 2) {
+      if (simple_archiver_io_write(buf, 1, 2, out_f) != 2) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
@@ -7533,20 +11209,24 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
 
       u16 = (uint16_t)len;
       simple_archiver_helper_16_bit_be(&u16);
-      if (fwrite(&u16, 2, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
       simple_archiver_helper_16_bit_be(&u16);
       if (state->parsed->prefix) {
-        size_t fwrite_ret = fwrite(state->parsed->prefix,
-                                   1,
-                                   prefix_length,
-                                   out_f);
-        fwrite_ret += fwrite(node_str, 1, link_length + 1, out_f);
+        size_t fwrite_ret = simple_archiver_io_write(state->parsed->prefix,
+                                                     1,
+                                                     prefix_length,
+                                                     out_f);
+        fwrite_ret += simple_archiver_io_write(node_str,
+                                               1,
+                                               link_length + 1,
+                                               out_f);
         if (fwrite_ret != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
-      } else if (fwrite(node_str, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+      } else if (simple_archiver_io_write(node_str, 1, u16 + 1, out_f)
+                 != (size_t)u16 + 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
@@ -7571,11 +11251,12 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
 
           u16 = (uint16_t)abs_path_pref_length;
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(&u16, 2, 1, out_f) != 1) {
+          if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(abs_path_prefixed, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+          if (simple_archiver_io_write(abs_path_prefixed, 1, u16 + 1, out_f)
+              != (size_t)u16 + 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
         } else {
@@ -7588,17 +11269,18 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
 
           u16 = (uint16_t)abs_path_length;
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(&u16, 2, 1, out_f) != 1) {
+          if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(abs_path, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+          if (simple_archiver_io_write(abs_path, 1, u16 + 1, out_f)
+              != (size_t)u16 + 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
@@ -7624,11 +11306,12 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
 
           u16 = (uint16_t)rel_path_pref_length;
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(&u16, 2, 1, out_f) != 1) {
+          if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(rel_path_prefixed, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+          if (simple_archiver_io_write(rel_path_prefixed, 1, u16 + 1, out_f)
+              != (size_t)u16 + 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
         } else {
@@ -7641,17 +11324,18 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
 
           u16 = (uint16_t)len;
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(&u16, 2, 1, out_f) != 1) {
+          if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
           simple_archiver_helper_16_bit_be(&u16);
-          if (fwrite(rel_path, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+          if (simple_archiver_io_write(rel_path, 1, u16 + 1, out_f)
+              != (size_t)u16 + 1) {
             return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
@@ -7670,7 +11354,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         }
       }
       simple_archiver_helper_32_bit_be(&u32);
-      if (fwrite(&u32, 4, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
@@ -7688,7 +11372,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         }
       }
       simple_archiver_helper_32_bit_be(&u32);
-      if (fwrite(&u32, 4, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
@@ -7722,16 +11406,17 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         }
         u16 = (uint16_t)name_length;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(username, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+        if (simple_archiver_io_write(username, 1, u16 + 1, out_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
@@ -7766,16 +11451,17 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         }
         u16 = (uint16_t)group_length;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(groupname, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+        if (simple_archiver_io_write(groupname, 1, u16 + 1, out_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
@@ -7868,7 +11554,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
   // Write number of chunks.
   u64 = chunk_counts->count;
   simple_archiver_helper_64_bit_be(&u64);
-  if (fwrite(&u64, 8, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
 
@@ -7902,7 +11588,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
 
     u64 = (*((uint64_t *)chunk_c_node->data));
     simple_archiver_helper_64_bit_be(&u64);
-    if (fwrite(&u64, 8, 1, out_f) != 1) {
+    if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
       return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
     }
 
@@ -7917,6 +11603,10 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
       if (non_c_chunk_size) {
         *non_c_chunk_size += file_info_struct->file_size;
       }
+      if (state->parsed->write_version >= 9) {
+        // Metadata is written as columns after this loop.
+        continue;
+      }
       const size_t filename_len = strlen(file_info_struct->filename);
 
       if (state->parsed->prefix) {
@@ -7927,17 +11617,20 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         }
         u16 = (uint16_t)total_length;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(state->parsed->prefix, 1, prefix_length, out_f)
+        if (simple_archiver_io_write(state->parsed->prefix,
+                                     1,
+                                     prefix_length,
+                                     out_f)
             != prefix_length) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
-        } else if (fwrite(file_info_struct->filename,
-                          1,
-                          filename_len + 1,
-                          out_f)
+        } else if (simple_archiver_io_write(file_info_struct->filename,
+                                            1,
+                                            filename_len + 1,
+                                            out_f)
                      != filename_len + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
@@ -7948,17 +11641,21 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         }
         u16 = (uint16_t)filename_len;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(file_info_struct->filename, 1, u16 + 1, out_f) !=
-            (size_t)u16 + 1) {
+        if (simple_archiver_io_write(file_info_struct->filename,
+                                     1,
+                                     u16 + 1,
+                                     out_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
 
-      if (fwrite(file_info_struct->bit_flags, 1, 4, out_f) != 4) {
+      if (simple_archiver_io_write(file_info_struct->bit_flags, 1, 4, out_f)
+          != 4) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
       // UID and GID.
@@ -7977,7 +11674,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         }
       }
       simple_archiver_helper_32_bit_be(&u32);
-      if (fwrite(&u32, 4, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
       u32 = file_info_struct->gid;
@@ -7992,7 +11689,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         }
       }
       simple_archiver_helper_32_bit_be(&u32);
-      if (fwrite(&u32, 4, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
 
@@ -8021,16 +11718,17 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         }
         u16 = (uint16_t)name_length;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(username, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+        if (simple_archiver_io_write(username, 1, u16 + 1, out_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
@@ -8060,29 +11758,46 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         }
         u16 = (uint16_t)group_length;
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
         simple_archiver_helper_16_bit_be(&u16);
-        if (fwrite(groupname, 1, u16 + 1, out_f) != (size_t)u16 + 1) {
+        if (simple_archiver_io_write(groupname, 1, u16 + 1, out_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       } else {
         u16 = 0;
-        if (fwrite(&u16, 2, 1, out_f) != 1) {
+        if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
       uint64_t u64 = file_info_struct->file_size;
       simple_archiver_helper_64_bit_be(&u64);
-      if (fwrite(&u64, 8, 1, out_f) != 1) {
+      if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
         return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
       }
     }
 
+    if (state->parsed->write_version >= 9) {
+      SDArchiverStateReturns ret = simple_archiver_internal_columns_write(
+        out_f,
+        state->parsed,
+        saved_node,
+        *((uint64_t *)chunk_c_node->data));
+      if (ret != SDAS_SUCCESS) {
+        return SDA_RET_STRUCT(ret);
+      }
+    }
+
     // File format version 6: two-byte bit-flags.
     // Default, compressed bit is set, but is overwritten when using v6.
     int_fast8_t compressed_bit_set = 1;
+    // File format version 8: reference chunk data to delta compress against.
+    __attribute__((cleanup(simple_archiver_internal_delta_ref_data_cleanup)))
+    SDArchiverInternalDeltaRefData delta_ref_data = {NULL, -1, 0, 0};
+    __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+    char *delta_compressor_cmd = NULL;
     if (state->parsed->write_version >= 6) {
       compressed_bit_set = is_first_chunk && has_non_compressible_chunk ? 0 : 1;
 
@@ -8100,12 +11815,74 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
 
       is_first_chunk = 0;
 
-      uint8_t v6_byte_flags[2];
-      v6_byte_flags[0] = 0;
-      v6_byte_flags[0] |= compressed_bit_set ? 1 : 0;
-      v6_byte_flags[1] = 0;
-      if (fwrite(v6_byte_flags, 1, 2, out_f) != 2) {
-        return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+      int64_t delta_ref_idx = -1;
+      // Bytes given to the compressor, which zstd must know in advance to
+      // "--patch-from" with stdin.
+      uint64_t delta_stream_size = v5_to_write_header ? 2 : 0;
+      if (delta_ref && compressed_bit_set) {
+        __attribute__((cleanup(simple_archiver_list_free)))
+        SDArchiverLinkedList *delta_names = simple_archiver_list_init();
+        SDArchiverLLNode *node = saved_node;
+        for (uint64_t file_idx = 0;
+             file_idx < *((uint64_t *)chunk_c_node->data);
+             ++file_idx) {
+          node = node->next;
+          const SDArchiverInternalFileInfo *file_info_struct = node->data;
+          delta_stream_size += file_info_struct->file_size;
+          simple_archiver_list_add(
+            delta_names,
+            state->parsed->prefix
+              ? simple_archiver_helper_combine_strs(state->parsed->prefix,
+                                                    file_info_struct->filename)
+              : strdup(file_info_struct->filename),
+            NULL);
+        }
+        delta_ref_idx =
+          simple_archiver_internal_delta_ref_match(delta_ref, delta_names);
+      }
+
+      uint8_t v6_byte_flags[2];
+      v6_byte_flags[0] = 0;
+      v6_byte_flags[0] |= compressed_bit_set ? 1 : 0;
+      v6_byte_flags[0] |= delta_ref_idx >= 0 ? 2 : 0;
+      v6_byte_flags[1] = 0;
+      if (simple_archiver_io_write(v6_byte_flags, 1, 2, out_f) != 2) {
+        return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+      }
+
+      if (delta_ref_idx >= 0) {
+        SDArchiverStateReturns ret =
+          simple_archiver_internal_delta_ref_get_data(delta_ref,
+                                                      (uint64_t)delta_ref_idx,
+                                                      state->parsed,
+                                                      &delta_ref_data);
+        if (ret != SDAS_SUCCESS) {
+          return SDA_RET_STRUCT(ret);
+        }
+        uint64_t delta_header[3];
+        delta_header[0] = (uint64_t)delta_ref_idx;
+        delta_header[1] = delta_ref_data.size;
+        delta_header[2] = delta_ref_data.hash;
+        for (size_t idx = 0; idx < 3; ++idx) {
+          simple_archiver_helper_64_bit_be(delta_header + idx);
+        }
+        if (simple_archiver_io_write(delta_header, 8, 3, out_f) != 3) {
+          return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+        }
+
+        char stream_size_arg[48];
+        snprintf(stream_size_arg,
+                 sizeof(stream_size_arg),
+                 " --stream-size=%" PRIu64 " --patch-from=",
+                 delta_stream_size);
+        __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+        char *patch_arg = simple_archiver_helper_combine_strs(
+          stream_size_arg, delta_ref_data.path);
+        delta_compressor_cmd = simple_archiver_helper_combine_strs(
+          state->parsed->compressor, patch_arg);
+        fprintf(stderr,
+                "Delta compressing against reference chunk %" PRIu64 "\n",
+                (uint64_t)delta_ref_idx + 1);
       }
 
       fprintf(
@@ -8119,9 +11896,54 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
     file_node = saved_node;
 
     if (state->parsed->compressor
+        && state->parsed->decompressor
+        && (state->parsed->write_version <= 5 || compressed_bit_set)
+        && (state->parsed->compress_jobs > 1 || state->parsed->rsyncable)
+        && !delta_compressor_cmd) {
+      // Is compressing slices of the chunk with multiple compressors.
+      SDArchiverStateReturns ret = simple_archiver_internal_write_chunk_slices(
+        out_f,
+        state,
+        &file_node,
+        files_list,
+        *((uint64_t *)chunk_c_node->data),
+        files_compressed_size,
+        file_times,
+        pressure);
+      if (ret != SDAS_SUCCESS) {
+        return SDA_RET_STRUCT(ret);
+      }
+    } else if (state->parsed->compressor
+        && state->parsed->decompressor
+        && state->parsed->write_version >= 7
+        && compressed_bit_set) {
+      // Is compressing into chunked-encoding.
+      SDArchiverInternalChunkFiles chunk_files;
+      chunk_files.file_node = &file_node;
+      chunk_files.files_list = files_list;
+      chunk_files.file_count = *((uint64_t *)chunk_c_node->data);
+      chunk_files.file_idx = 0;
+      chunk_files.fd = NULL;
+      chunk_files.file_times = file_times;
+      chunk_files.file_timer = &file_timer;
+      SDArchiverStateRetStruct ret =
+        simple_archiver_internal_v7_compress_chunk(
+          out_f,
+          delta_compressor_cmd ? delta_compressor_cmd
+                               : state->parsed->compressor,
+          simple_archiver_internal_chunk_files_next,
+          &chunk_files,
+          file_times ? &file_timer.wait_ns : NULL,
+          files_compressed_size);
+      simple_archiver_helper_cleanup_FILE(&chunk_files.fd);
+      if (ret.ret != SDAS_SUCCESS) {
+        return ret;
+      }
+      v5_to_write_header = 0;
+    } else if (state->parsed->compressor
         && state->parsed->decompressor
         && (state->parsed->write_version <= 5 || compressed_bit_set)) {
-      // Is compressing.
+      // Is compressing into a temporary file (file formats 4 to 6).
       __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
       char *temp_filename = NULL;
 
@@ -8131,20 +11953,16 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
       ptrs_array[1] = NULL;
 
       __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
-      FILE *temp_fd = NULL;
-
-      if (state->parsed->write_version < 7) {
-        temp_fd =
-          simple_archiver_helper_temp_dir(state->parsed, &temp_filename);
-        ptrs_array[0] = temp_filename;
+      FILE *temp_fd =
+        simple_archiver_helper_temp_dir(state->parsed, &temp_filename);
+      ptrs_array[0] = temp_filename;
 
+      if (!temp_fd) {
+        temp_fd = tmpfile();
         if (!temp_fd) {
-          temp_fd = tmpfile();
-          if (!temp_fd) {
-            fprintf(stderr,
-                    "ERROR: Failed to create a temporary file for archival!\n");
-            return SDA_RET_STRUCT(SDAS_COMPRESSION_ERROR);
-          }
+          fprintf(stderr,
+                  "ERROR: Failed to create a temporary file for archival!\n");
+          return SDA_RET_STRUCT(SDAS_COMPRESSION_ERROR);
         }
       }
 
@@ -8152,58 +11970,21 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
       is_sig_pipe_occurred = 0;
       simple_archiver_helper_set_signal_action(SIGPIPE, handle_sig_pipe);
 
-      int pipe_into_cmd[2];
-      int pipe_outof_cmd[2];
       __attribute__((cleanup(
           simple_archiver_internal_cleanup_decomp_pid))) pid_t compressor_pid =
           -1;
-
-      if (pipe(pipe_into_cmd) != 0) {
-        // Unable to create pipes.
-        return SDA_RET_STRUCT(SDAS_COMPRESSION_ERROR);
-      } else if (pipe(pipe_outof_cmd) != 0) {
-        // Unable to create second set of pipes.
-        close(pipe_into_cmd[0]);
-        close(pipe_into_cmd[1]);
-        return SDA_RET_STRUCT(SDAS_COMPRESSION_ERROR);
-      } else if (fcntl(pipe_into_cmd[1], F_SETFL, O_NONBLOCK) == -1) {
-        fprintf(stderr,
-                "ERROR: Unable to set non-blocking on into-write-pipe!\n");
-        close(pipe_into_cmd[0]);
-        close(pipe_into_cmd[1]);
-        close(pipe_outof_cmd[0]);
-        close(pipe_outof_cmd[1]);
-        return SDA_RET_STRUCT(SDAS_COMPRESSION_ERROR);
-      } else if (fcntl(pipe_outof_cmd[0], F_SETFL, O_NONBLOCK) == -1) {
-        fprintf(stderr,
-                "ERROR: Unable to set non-blocking on outof-read-pipe!\n");
-        close(pipe_into_cmd[0]);
-        close(pipe_into_cmd[1]);
-        close(pipe_outof_cmd[0]);
-        close(pipe_outof_cmd[1]);
-        return SDA_RET_STRUCT(SDAS_COMPRESSION_ERROR);
-      } else if (simple_archiver_de_compress(pipe_into_cmd, pipe_outof_cmd,
-                                             state->parsed->compressor,
-                                             &compressor_pid) != 0) {
-        // Failed to spawn compressor.
-        close(pipe_into_cmd[1]);
-        close(pipe_outof_cmd[0]);
-        fprintf(stderr,
-                "WARNING: Failed to start compressor cmd! Invalid cmd?\n");
-        return SDA_RET_STRUCT(SDAS_COMPRESSION_ERROR);
-      }
-
-      // Close unnecessary pipe fds on this end of the transfer.
-      close(pipe_into_cmd[0]);
-      close(pipe_outof_cmd[1]);
-
-      // Set up cleanup so that remaining open pipes in this side is cleaned up.
       __attribute__((cleanup(
-          simple_archiver_internal_cleanup_int_fd))) int pipe_outof_read =
-          pipe_outof_cmd[0];
+          simple_archiver_internal_cleanup_int_fd))) int pipe_outof_read = -1;
       __attribute__((cleanup(
-          simple_archiver_internal_cleanup_int_fd))) int pipe_into_write =
-          pipe_into_cmd[1];
+          simple_archiver_internal_cleanup_int_fd))) int pipe_into_write = -1;
+      SDArchiverStateReturns start_ret =
+        simple_archiver_internal_start_compressor(state->parsed->compressor,
+                                                  &compressor_pid,
+                                                  &pipe_into_write,
+                                                  &pipe_outof_read);
+      if (start_ret != SDAS_SUCCESS) {
+        return SDA_RET_STRUCT(start_ret);
+      }
 
       while (v5_to_write_header) {
         ssize_t write_ret = write(pipe_into_write, "SA", 2);
@@ -8223,10 +12004,6 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         }
       }
 
-      char v7_hold_buf[SD_SA_V7_HOLD_SIZE];
-      size_t v7_hold_buf_idx = 0;
-      uint_fast8_t is_first_half = 1;
-
       int_fast8_t to_temp_finished = 0;
       for (uint64_t file_idx = 0; file_idx < *((uint64_t *)chunk_c_node->data);
            ++file_idx) {
@@ -8243,8 +12020,11 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
                 file_idx + 1,
                 *(uint64_t *)chunk_c_node->data,
                 file_info_struct->filename);
+        simple_archiver_internal_file_timer_start(file_times, &file_timer);
         __attribute__((cleanup(simple_archiver_helper_cleanup_FILE))) FILE *fd =
-            fopen(file_info_struct->filename, "rb");
+            simple_archiver_internal_open_file_info(file_info_struct);
+        simple_archiver_internal_file_timer_opened(file_times, &file_timer);
+        uint64_t *file_wait_ns = file_times ? &file_timer.wait_ns : NULL;
 
         int_fast8_t to_comp_finished = 0;
         char hold_buf[SIMPLE_ARCHIVER_BUFFER_SIZE];
@@ -8270,7 +12050,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
                     // Non-blocking write.
                     has_hold = (int)fread_ret;
                     memcpy(hold_buf, buf, fread_ret);
-                    nanosleep(&nonblock_sleep, NULL);
+                    simple_archiver_internal_nonblock_sleep(file_wait_ns);
                   } else {
                     fprintf(
                         stderr,
@@ -8297,7 +12077,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
               if (write_ret < 0) {
                 if (errno == EAGAIN || errno == EWOULDBLOCK) {
                   // Non-blocking write.
-                  nanosleep(&nonblock_sleep, NULL);
+                  simple_archiver_internal_nonblock_sleep(file_wait_ns);
                 } else {
                   return SDA_RET_STRUCT(SDAS_COMPRESSION_ERROR);
                 }
@@ -8320,7 +12100,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
           if (read_ret < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
               // Non-blocking read.
-              nanosleep(&nonblock_sleep, NULL);
+              simple_archiver_internal_nonblock_sleep(file_wait_ns);
             } else {
               fprintf(stderr,
                       "ERROR: Reading from compressor, pipe read error!\n");
@@ -8330,66 +12110,19 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
             // EOF.
             to_temp_finished = 1;
           } else {
-            if (state->parsed->write_version < 7) {
-              size_t fwrite_ret = fwrite(buf, 1, (size_t)read_ret, temp_fd);
-              if (fwrite_ret != (size_t)read_ret) {
-                fprintf(stderr,
-                        "ERROR: Reading from compressor, failed to write to "
-                        "temporary file!\n");
-                return SDA_RET_STRUCT(SDAS_COMPRESSED_WRITE_FAIL);
-              }
-            } else {
-              // chunked-encoding
-              memcpy(v7_hold_buf
-                       + v7_hold_buf_idx
-                       + (is_first_half ? 0 : SD_SA_V7_2ND_OFFSET),
-                     buf,
-                     (size_t)read_ret);
-              v7_hold_buf_idx += (size_t)read_ret;
-
-              if (v7_hold_buf_idx >= SD_SA_32KiB) {
-                __attribute__((cleanup(
-                    simple_archiver_helper_cleanup_c_string)))
-                char *base10 =
-                    simple_archiver_helper_value_to_base10_with_newline(
-                      SD_SA_32KiB);
-                size_t fwrite_ret = fwrite(base10, 1, strlen(base10), out_f);
-                if (fwrite_ret != (size_t)strlen(base10)) {
-                  fprintf(stderr,
-                          "ERROR: Failed to write chunked-encoding "
-                          "(base10 size)!\n");
-                  return SDA_RET_STRUCT(SDAS_COMPRESSED_WRITE_FAIL);
-                }
-
-                fwrite_ret = fwrite(
-                    v7_hold_buf + (is_first_half ? 0 : SD_SA_V7_2ND_OFFSET),
-                    1,
-                    SD_SA_32KiB,
-                    out_f);
-                if (fwrite_ret != SD_SA_32KiB) {
-                  fprintf(stderr,
-                          "ERROR: Failed to write chunked-encoding data!\n");
-                  return SDA_RET_STRUCT(SDAS_COMPRESSED_WRITE_FAIL);
-                }
-
-                *files_compressed_size += SD_SA_32KiB;
-
-                if (v7_hold_buf_idx > SD_SA_32KiB) {
-                  memcpy(v7_hold_buf
-                           + (is_first_half ? SD_SA_V7_2ND_OFFSET : 0),
-                         v7_hold_buf
-                           + (is_first_half ? 0 : SD_SA_V7_2ND_OFFSET)
-                           + SD_SA_32KiB,
-                         v7_hold_buf_idx - SD_SA_32KiB);
-                  is_first_half = is_first_half ? 0 : 1;
-                  v7_hold_buf_idx -= SD_SA_32KiB;
-                } else {
-                  v7_hold_buf_idx = 0;
-                }
-              }
+            size_t fwrite_ret = fwrite(buf, 1, (size_t)read_ret, temp_fd);
+            if (fwrite_ret != (size_t)read_ret) {
+              fprintf(stderr,
+                      "ERROR: Reading from compressor, failed to write to "
+                      "temporary file!\n");
+              return SDA_RET_STRUCT(SDAS_COMPRESSED_WRITE_FAIL);
             }
           }
         }
+        simple_archiver_internal_file_timer_done(file_times,
+                                                 &file_timer,
+                                                 file_info_struct->filename,
+                                                 file_info_struct->file_size);
       }
 
       simple_archiver_internal_cleanup_int_fd(&pipe_into_write);
@@ -8416,157 +12149,71 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
             // EOF.
             break;
           } else {
-            if (state->parsed->write_version < 7) {
-              size_t fwrite_ret = fwrite(buf, 1, (size_t)read_ret, temp_fd);
-              if (fwrite_ret != (size_t)read_ret) {
-                fprintf(stderr,
-                        "ERROR: Reading from compressor, failed to write to "
-                        "temporary file!\n");
-                return SDA_RET_STRUCT(SDAS_COMPRESSED_WRITE_FAIL);
-              }
-            } else {
-              // chunked-encoding
-              memcpy(v7_hold_buf
-                       + v7_hold_buf_idx
-                       + (is_first_half ? 0 : SD_SA_V7_2ND_OFFSET),
-                     buf,
-                     (size_t)read_ret);
-              v7_hold_buf_idx += (size_t)read_ret;
-
-              if (v7_hold_buf_idx >= SD_SA_32KiB) {
-                __attribute__((cleanup(
-                    simple_archiver_helper_cleanup_c_string)))
-                char *base10 =
-                    simple_archiver_helper_value_to_base10_with_newline(
-                      SD_SA_32KiB);
-                size_t fwrite_ret = fwrite(base10, 1, strlen(base10), out_f);
-                if (fwrite_ret != (size_t)strlen(base10)) {
-                  fprintf(stderr,
-                          "ERROR: Failed to write chunked-encoding "
-                          "(base10 size)!\n");
-                  return SDA_RET_STRUCT(SDAS_COMPRESSED_WRITE_FAIL);
-                }
-
-                fwrite_ret = fwrite(
-                    v7_hold_buf + (is_first_half ? 0 : SD_SA_V7_2ND_OFFSET),
-                    1,
-                    SD_SA_32KiB,
-                    out_f);
-                if (fwrite_ret != SD_SA_32KiB) {
-                  fprintf(stderr,
-                          "ERROR: Failed to write chunked-encoding data!\n");
-                  return SDA_RET_STRUCT(SDAS_COMPRESSED_WRITE_FAIL);
-                }
-
-                *files_compressed_size += SD_SA_32KiB;
-
-                if (v7_hold_buf_idx > SD_SA_32KiB) {
-                  memcpy(v7_hold_buf
-                           + (is_first_half ? SD_SA_V7_2ND_OFFSET : 0),
-                         v7_hold_buf
-                           + (is_first_half ? 0 : SD_SA_V7_2ND_OFFSET)
-                           + SD_SA_32KiB,
-                         v7_hold_buf_idx - SD_SA_32KiB);
-                  is_first_half = is_first_half ? 0 : 1;
-                  v7_hold_buf_idx -= SD_SA_32KiB;
-                } else {
-                  v7_hold_buf_idx = 0;
-                }
-              }
+            size_t fwrite_ret = fwrite(buf, 1, (size_t)read_ret, temp_fd);
+            if (fwrite_ret != (size_t)read_ret) {
+              fprintf(stderr,
+                      "ERROR: Reading from compressor, failed to write to "
+                      "temporary file!\n");
+              return SDA_RET_STRUCT(SDAS_COMPRESSED_WRITE_FAIL);
             }
           }
         }
       }
 
-      if (state->parsed->write_version < 7) {
-        long comp_chunk_size = ftell(temp_fd);
-        if (comp_chunk_size < 0) {
-          fprintf(stderr,
-                  "ERROR: Temp file reported negative size after compression!"
-                  "\n");
-          return SDA_RET_STRUCT(SDAS_COMPRESSION_ERROR);
-        }
-
-        // Write compressed chunk size.
-        uint64_t u64 = (uint64_t)comp_chunk_size;
-        simple_archiver_helper_64_bit_be(&u64);
-        if (fwrite(&u64, 8, 1, out_f) != 1) {
-          return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
-        }
-        *files_compressed_size += (uint64_t)comp_chunk_size;
+      long comp_chunk_size = ftell(temp_fd);
+      if (comp_chunk_size < 0) {
+        fprintf(stderr,
+                "ERROR: Temp file reported negative size after compression!"
+                "\n");
+        return SDA_RET_STRUCT(SDAS_COMPRESSION_ERROR);
+      }
 
-        rewind(temp_fd);
+      // Write compressed chunk size.
+      uint64_t u64 = (uint64_t)comp_chunk_size;
+      simple_archiver_helper_64_bit_be(&u64);
+      if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
+        return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+      }
+      *files_compressed_size += (uint64_t)comp_chunk_size;
 
-        size_t written_size = 0;
+      rewind(temp_fd);
 
-        // Write compressed chunk.
-        while (!feof(temp_fd)) {
-          if (is_sig_int_occurred) {
-            return SDA_RET_STRUCT(SDAS_SIGINT);
-          } else if (ferror(temp_fd)) {
-            return SDA_RET_STRUCT(SDAS_COMPRESSED_WRITE_FAIL);
-          }
-          size_t fread_ret = fread(buf,
-                                   1,
-                                   SIMPLE_ARCHIVER_BUFFER_SIZE,
-                                   temp_fd);
-          if (fread_ret > 0) {
-            size_t fwrite_ret = fwrite(buf, 1, fread_ret, out_f);
-            written_size += fwrite_ret;
-            if (fwrite_ret != fread_ret) {
-              fprintf(stderr,
-                      "ERROR: Partial write of read bytes from temp file to "
-                      "output file!\n");
-              return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
-            }
-          }
-        }
+      size_t written_size = 0;
 
-        if (written_size != (size_t)comp_chunk_size) {
-          fprintf(stderr,
-                  "ERROR: Written chunk size is not actual chunk size!\n");
-          return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+      // Write compressed chunk.
+      while (!feof(temp_fd)) {
+        if (is_sig_int_occurred) {
+          return SDA_RET_STRUCT(SDAS_SIGINT);
+        } else if (ferror(temp_fd)) {
+          return SDA_RET_STRUCT(SDAS_COMPRESSED_WRITE_FAIL);
         }
-
-        // Cleanup and remove temp_fd.
-        simple_archiver_helper_cleanup_FILE(&temp_fd);
-      } else {
-        // Write remaining chunked-encoding data if exists
-        if (v7_hold_buf_idx != 0) {
-          __attribute__((cleanup(
-              simple_archiver_helper_cleanup_c_string)))
-          char *base10 =
-              simple_archiver_helper_value_to_base10_with_newline(
-                (uint64_t)v7_hold_buf_idx);
-          size_t fwrite_ret = fwrite(base10, 1, strlen(base10), out_f);
-          if (fwrite_ret != (size_t)strlen(base10)) {
-            fprintf(stderr,
-                    "ERROR: Failed to write chunked-encoding "
-                    "(last base10 size)!\n");
-            return SDA_RET_STRUCT(SDAS_COMPRESSED_WRITE_FAIL);
-          }
-
-          fwrite_ret = fwrite(
-              v7_hold_buf + (is_first_half ? 0 : SD_SA_V7_2ND_OFFSET),
-              1,
-              v7_hold_buf_idx,
-              out_f);
-          if (fwrite_ret != v7_hold_buf_idx) {
+        size_t fread_ret = fread(buf,
+                                 1,
+                                 SIMPLE_ARCHIVER_BUFFER_SIZE,
+                                 temp_fd);
+        if (fread_ret > 0) {
+          size_t fwrite_ret = simple_archiver_io_write(buf,
+                                                       1,
+                                                       fread_ret,
+                                                       out_f);
+          written_size += fwrite_ret;
+          if (fwrite_ret != fread_ret) {
             fprintf(stderr,
-                    "ERROR: Failed to write chunked-encoding data!\n");
-            return SDA_RET_STRUCT(SDAS_COMPRESSED_WRITE_FAIL);
+                    "ERROR: Partial write of read bytes from temp file to "
+                    "output file!\n");
+            return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
-
-          *files_compressed_size += v7_hold_buf_idx;
-        }
-        // End of chunked-encoding
-        size_t fwrite_ret = fwrite("0\n", 1, 2, out_f);
-        if (fwrite_ret != 2) {
-          fprintf(stderr,
-                  "ERROR: Failed to write end of chunked-encoding!\n");
-          return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
       }
+
+      if (written_size != (size_t)comp_chunk_size) {
+        fprintf(stderr,
+                "ERROR: Written chunk size is not actual chunk size!\n");
+        return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+      }
+
+      // Cleanup and remove temp_fd.
+      simple_archiver_helper_cleanup_FILE(&temp_fd);
     } else {
       // Is NOT compressing.
       if (!non_c_chunk_size) {
@@ -8577,9 +12224,9 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
         *files_compressed_size += *non_c_chunk_size;
       }
       simple_archiver_helper_64_bit_be(non_c_chunk_size);
-      fwrite(non_c_chunk_size, 8, 1, out_f);
+      simple_archiver_io_write(non_c_chunk_size, 8, 1, out_f);
       if (v5_to_write_header) {
-        size_t fwrite_ret = fwrite("SA", 1, 2, out_f);
+        size_t fwrite_ret = simple_archiver_io_write("SA", 1, 2, out_f);
         if (fwrite_ret != 2) {
           return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
         }
@@ -8600,8 +12247,10 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
                 file_idx + 1,
                 *(uint64_t *)chunk_c_node->data,
                 file_info_struct->filename);
+        simple_archiver_internal_file_timer_start(file_times, &file_timer);
         __attribute__((cleanup(simple_archiver_helper_cleanup_FILE))) FILE *fd =
-            fopen(file_info_struct->filename, "rb");
+            simple_archiver_internal_open_file_info(file_info_struct);
+        simple_archiver_internal_file_timer_opened(file_times, &file_timer);
         while (!feof(fd)) {
           if (is_sig_int_occurred) {
             return SDA_RET_STRUCT(SDAS_SIGINT);
@@ -8611,13 +12260,20 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
           }
           size_t fread_ret = fread(buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE, fd);
           if (fread_ret > 0) {
-            size_t fwrite_ret = fwrite(buf, 1, fread_ret, out_f);
+            size_t fwrite_ret = simple_archiver_io_write(buf,
+                                                         1,
+                                                         fread_ret,
+                                                         out_f);
             if (fwrite_ret != fread_ret) {
               fprintf(stderr, "ERROR: Writing to chunk, file write error!\n");
               return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
             }
           }
         }
+        simple_archiver_internal_file_timer_done(file_times,
+                                                 &file_timer,
+                                                 file_info_struct->filename,
+                                                 file_info_struct->file_size);
       }
     }
   }
@@ -8646,7 +12302,7 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
 
   simple_archiver_helper_64_bit_be(&u64);
 
-  if (fwrite(&u64, 8, 1, out_f) != 1) {
+  if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
     return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
   }
 
@@ -8665,8 +12321,8 @@ SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
   return SDA_RET_STRUCT(SDAS_SUCCESS);
 }
 
-SDArchiverStateRetStruct simple_archiver_parse_archive_info(
-    FILE *in_f,
+SDArchiverStateRetStruct simple_archiver_internal_parse_archive_info(
+    SDArchiverIOStream *in_f,
     int_fast8_t do_extract,
     SDArchiverState *state) {
   simple_archiver_helper_set_signal_action(SIGINT, handle_sig_int);
@@ -8677,11 +12333,11 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_info(
   memset(buf, 0, 32);
   uint16_t u16;
 
-  if (fread(buf, 1, 18, in_f) != 18) {
+  if (simple_archiver_io_read(buf, 1, 18, in_f) != 18) {
     return SDA_RET_STRUCT(SDAS_INVALID_FILE);
   } else if (memcmp(buf, "SIMPLE_ARCHIVE_VER", 18) != 0) {
     return SDA_RET_STRUCT(SDAS_INVALID_FILE);
-  } else if (fread(buf, 1, 2, in_f) != 2) {
+  } else if (simple_archiver_io_read(buf, 1, 2, in_f) != 2) {
     return SDA_RET_STRUCT(SDAS_INVALID_FILE);
   }
 
@@ -8693,6 +12349,14 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_info(
   memcpy(&u16, buf, 2);
   simple_archiver_helper_16_bit_be(&u16);
 
+  if (state->parsed->du && !do_extract && u16 < 11) {
+    fprintf(stderr,
+            "ERROR: \"--du\" requires an archive of file format 11 or above "
+            "(archive is file format %" PRIu16 ")!\n",
+            u16);
+    return SDA_RET_STRUCT(SDAS_INVALID_FILE);
+  }
+
   if (u16 == 0) {
     fprintf(stderr, "File format version 0\n");
     state->parsed->write_version = 0;
@@ -8700,7 +12364,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_info(
                                                          do_extract,
                                                          state,
                                                          parse_state);
-    internal_simple_archiver_parse_stats(parse_state);
+    internal_simple_archiver_parse_stats(parse_state, state->parsed);
     return ret_struct;
   } else if (u16 == 1) {
     fprintf(stderr, "File format version 1\n");
@@ -8709,7 +12373,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_info(
                                                          do_extract,
                                                          state,
                                                          parse_state);
-    internal_simple_archiver_parse_stats(parse_state);
+    internal_simple_archiver_parse_stats(parse_state, state->parsed);
     return ret_struct;
   } else if (u16 == 2) {
     fprintf(stderr, "File format version 2\n");
@@ -8718,7 +12382,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_info(
                                                          do_extract,
                                                          state,
                                                          parse_state);
-    internal_simple_archiver_parse_stats(parse_state);
+    internal_simple_archiver_parse_stats(parse_state, state->parsed);
     return ret_struct;
   } else if (u16 == 3) {
     fprintf(stderr, "File format version 3\n");
@@ -8727,7 +12391,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_info(
                                                          do_extract,
                                                          state,
                                                          parse_state);
-    internal_simple_archiver_parse_stats(parse_state);
+    internal_simple_archiver_parse_stats(parse_state, state->parsed);
     return ret_struct;
   } else if (u16 == 4) {
     fprintf(stderr, "File format version 4\n");
@@ -8736,7 +12400,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_info(
                                                                do_extract,
                                                                state,
                                                                parse_state);
-    internal_simple_archiver_parse_stats(parse_state);
+    internal_simple_archiver_parse_stats(parse_state, state->parsed);
     return ret_struct;
   } else if (u16 == 5) {
     fprintf(stderr, "File format version 5\n");
@@ -8745,7 +12409,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_info(
                                                                do_extract,
                                                                state,
                                                                parse_state);
-    internal_simple_archiver_parse_stats(parse_state);
+    internal_simple_archiver_parse_stats(parse_state, state->parsed);
     return ret_struct;
   } else if (u16 == 6) {
     fprintf(stderr, "File format version 6\n");
@@ -8754,7 +12418,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_info(
                                                                do_extract,
                                                                state,
                                                                parse_state);
-    internal_simple_archiver_parse_stats(parse_state);
+    internal_simple_archiver_parse_stats(parse_state, state->parsed);
     return ret_struct;
   } else if (u16 == 7) {
     fprintf(stderr, "File format version 7\n");
@@ -8763,7 +12427,45 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_info(
                                                                do_extract,
                                                                state,
                                                                parse_state);
-    internal_simple_archiver_parse_stats(parse_state);
+    internal_simple_archiver_parse_stats(parse_state, state->parsed);
+    return ret_struct;
+  } else if (u16 == 8) {
+    fprintf(stderr, "File format version 8\n");
+    state->parsed->write_version = 8;
+    ret_struct = simple_archiver_parse_archive_version_4_5_6_7(in_f,
+                                                               do_extract,
+                                                               state,
+                                                               parse_state);
+    internal_simple_archiver_parse_stats(parse_state, state->parsed);
+    return ret_struct;
+  } else if (u16 == 9) {
+    fprintf(stderr, "File format version 9\n");
+    state->parsed->write_version = 9;
+    ret_struct = simple_archiver_parse_archive_version_4_5_6_7(in_f,
+                                                               do_extract,
+                                                               state,
+                                                               parse_state);
+    internal_simple_archiver_parse_stats(parse_state, state->parsed);
+    return ret_struct;
+  } else if (u16 == 10) {
+    fprintf(stderr, "File format version 10\n");
+    state->parsed->write_version = 10;
+    ret_struct = simple_archiver_parse_archive_version_4_5_6_7(in_f,
+                                                               do_extract,
+                                                               state,
+                                                               parse_state);
+    internal_simple_archiver_parse_stats(parse_state, state->parsed);
+    return ret_struct;
+  } else if (u16 == 11) {
+    fprintf(stderr, "File format version 11\n");
+    state->parsed->write_version = 11;
+    ret_struct = simple_archiver_parse_archive_version_4_5_6_7(in_f,
+                                                               do_extract,
+                                                               state,
+                                                               parse_state);
+    if (!state->parsed->du || do_extract) {
+      internal_simple_archiver_parse_stats(parse_state, state->parsed);
+    }
     return ret_struct;
   } else {
     fprintf(stderr, "ERROR Unsupported archive version %" PRIu16 "!\n", u16);
@@ -8771,9 +12473,36 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_info(
   }
 }
 
-SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
+SDArchiverStateRetStruct simple_archiver_parse_archive_info(
     FILE *in_f,
     int_fast8_t do_extract,
+    SDArchiverState *state) {
+  __attribute__((cleanup(simple_archiver_io_stream_free)))
+  SDArchiverIOStream *in_stream = simple_archiver_io_stream_init_FILE(in_f, 0);
+  if (!in_stream) {
+    return SDA_RET_STRUCT(SDAS_INVALID_FILE);
+  }
+  return simple_archiver_internal_parse_archive_info(in_stream,
+                                                     do_extract,
+                                                     state);
+}
+
+SDArchiverStateRetStruct simple_archiver_parse_archive_info_io(
+    SDArchiverIO *io,
+    int_fast8_t do_extract,
+    SDArchiverState *state) {
+  __attribute__((cleanup(simple_archiver_io_stream_free)))
+  SDArchiverIOStream *in_f = simple_archiver_io_stream_init(io, 0);
+  if (!in_f) {
+    fprintf(stderr, "ERROR: Failed to open I/O backend for reading!\n");
+    return SDA_RET_STRUCT(SDAS_INVALID_IO);
+  }
+  return simple_archiver_internal_parse_archive_info(in_f, do_extract, state);
+}
+
+SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
+    SDArchiverIOStream *in_f,
+    int_fast8_t do_extract,
     const SDArchiverState *state,
     SDArchiverHashMap *parsed_state) {
   uint8_t buf[SIMPLE_ARCHIVER_BUFFER_SIZE];
@@ -8785,7 +12514,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
   uint64_t compressed_size = 0;
   uint64_t actual_size = 0;
 
-  if (fread(buf, 1, 4, in_f) != 4) {
+  if (simple_archiver_io_read(buf, 1, 4, in_f) != 4) {
     return SDA_RET_STRUCT(SDAS_INVALID_FILE);
   }
 
@@ -8803,13 +12532,13 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
     is_compressed = 1;
 
     // Read compressor data.
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
     fprintf(stderr, "Compressor size is %" PRIu16 "\n", u16);
     if (u16 < SIMPLE_ARCHIVER_BUFFER_SIZE) {
-      if (fread(buf, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+      if (simple_archiver_io_read(buf, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       buf[SIMPLE_ARCHIVER_BUFFER_SIZE - 1] = 0;
@@ -8824,7 +12553,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
           cleanup(simple_archiver_helper_cleanup_malloced))) void *heap_buf =
           malloc(u16 + 1);
       uint8_t *uc_heap_buf = heap_buf;
-      if (fread(uc_heap_buf, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+      if (simple_archiver_io_read(uc_heap_buf, 1, u16 + 1, in_f)
+          != (size_t)u16 + 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       uc_heap_buf[u16 - 1] = 0;
@@ -8839,13 +12569,13 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
     }
 
     // Read decompressor data.
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
     fprintf(stderr, "Decompressor size is %" PRIu16 "\n", u16);
     if (u16 < SIMPLE_ARCHIVER_BUFFER_SIZE) {
-      if (fread(buf, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+      if (simple_archiver_io_read(buf, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       buf[SIMPLE_ARCHIVER_BUFFER_SIZE - 1] = 0;
@@ -8863,7 +12593,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
           cleanup(simple_archiver_helper_cleanup_malloced))) void *heap_buf =
           malloc(u16 + 1);
       uint8_t *uc_heap_buf = heap_buf;
-      if (fread(uc_heap_buf, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+      if (simple_archiver_io_read(uc_heap_buf, 1, u16 + 1, in_f)
+          != (size_t)u16 + 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       uc_heap_buf[u16 - 1] = 0;
@@ -8884,7 +12615,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
 
   int_fast8_t not_tested_once = (state->parsed->flags & 0x3) == 2 ? 1 : 0;
 
-  if (fread(&u32, 1, 4, in_f) != 4) {
+  if (simple_archiver_io_read(&u32, 1, 4, in_f) != 4) {
     return SDA_RET_STRUCT(SDAS_INVALID_FILE);
   }
   simple_archiver_helper_32_bit_be(&u32);
@@ -8919,9 +12650,9 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
       return SDA_RET_STRUCT(SDAS_SIGINT);
     }
     skip = 0;
-    if (feof(in_f) || ferror(in_f)) {
+    if (simple_archiver_io_eof(in_f) || simple_archiver_io_error(in_f)) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
-    } else if (fread(&u16, 2, 1, in_f) != 1) {
+    } else if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -8939,7 +12670,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
     uint_fast8_t lists_allowed;
 
     if (u16 < SIMPLE_ARCHIVER_BUFFER_SIZE) {
-      if (fread(buf, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+      if (simple_archiver_io_read(buf, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       buf[SIMPLE_ARCHIVER_BUFFER_SIZE - 1] = 0;
@@ -8964,11 +12695,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
       }
 
       arg_allowed =
-        state->parsed->just_w_files->count == 0
-        || simple_archiver_hash_map_get(state->parsed->just_w_files,
-                                        buf,
-                                        strlen((char*)buf) + 1) != NULL
-        ? 1 : 0;
+        simple_archiver_internal_arg_allowed(state->parsed, (const char *)buf);
       lists_allowed = simple_archiver_helper_string_allowed_lists(
         (char *)buf, state->parsed->flags & 0x20000 ? 1 : 0, state->parsed);
 
@@ -9045,7 +12772,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
           cleanup(simple_archiver_helper_cleanup_malloced))) void *heap_buf =
           malloc((uint32_t)u16 + 1);
       uint8_t *uc_heap_buf = heap_buf;
-      if (fread(uc_heap_buf, 1, (uint32_t)u16 + 1, in_f) != (size_t)u16 + 1) {
+      if (simple_archiver_io_read(uc_heap_buf, 1, (uint32_t)u16 + 1, in_f)
+          != (size_t)u16 + 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       uc_heap_buf[u16] = 0;
@@ -9070,11 +12798,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
       }
 
       arg_allowed =
-        state->parsed->just_w_files->count == 0
-        || simple_archiver_hash_map_get(state->parsed->just_w_files,
-                                        uc_heap_buf,
-                                        u16 + 1) != NULL
-        ? 1 : 0;
+        simple_archiver_internal_arg_allowed(state->parsed,
+                                             (const char *)uc_heap_buf);
       lists_allowed = simple_archiver_helper_string_allowed_lists(
         (char *)uc_heap_buf,
         state->parsed->flags & 0x20000 ? 1 : 0,
@@ -9147,7 +12872,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
       }
     }
 
-    if (fread(buf, 1, 4, in_f) != 4) {
+    if (simple_archiver_io_read(buf, 1, 4, in_f) != 4) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
 
@@ -9297,7 +13022,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
 
     if ((buf[0] & 1) == 0) {
       // Not a sybolic link.
-      if (fread(&u64, 8, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&u64, 8, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_64_bit_be(&u64);
@@ -9493,7 +13218,10 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
 
                 // amount_to_read is at most SIMPLE_ARCHIVER_BUFFER_SIZE, so
                 // it should be safe to convert to size_t.
-                fread_ret = fread(buf, 1, (size_t)amount_to_read, in_f);
+                fread_ret = simple_archiver_io_read(buf,
+                                                    1,
+                                                    (size_t)amount_to_read,
+                                                    in_f);
 
                 if (fread_ret > 0) {
                   compressed_file_size -= fread_ret;
@@ -9608,8 +13336,11 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
           size_t fread_ret;
           while (compressed_file_size != 0) {
             if (compressed_file_size > SIMPLE_ARCHIVER_BUFFER_SIZE) {
-              fread_ret = fread(buf, 1, SIMPLE_ARCHIVER_BUFFER_SIZE, in_f);
-              if (ferror(in_f)) {
+              fread_ret = simple_archiver_io_read(buf,
+                                                  1,
+                                                  SIMPLE_ARCHIVER_BUFFER_SIZE,
+                                                  in_f);
+              if (simple_archiver_io_error(in_f)) {
                 // Error.
                 return SDA_RET_STRUCT(SDAS_NON_DEC_EXTRACT_ERROR);
               }
@@ -9625,8 +13356,11 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
             } else {
               // Safe to convert to size_t since in this branch it is not
               // bigger than SIMPLE_ARCHIVER_BUFFER_SIZE.
-              fread_ret = fread(buf, 1, (size_t)compressed_file_size, in_f);
-              if (ferror(in_f)) {
+              fread_ret = simple_archiver_io_read(buf,
+                                                  1,
+                                                  (size_t)compressed_file_size,
+                                                  in_f);
+              if (simple_archiver_io_error(in_f)) {
                 // Error.
                 return SDA_RET_STRUCT(SDAS_NON_DEC_EXTRACT_ERROR);
               }
@@ -9658,6 +13392,19 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
         if (out_f) {
           fprintf(stderr, "  Extracted.\n");
         }
+      } else {
+        // Skip over the data of a file that is not extracted, "in_f" may be
+        // stdin so it is read instead of seeked.
+        uint64_t skip_size = u64;
+        while (skip_size != 0) {
+          const size_t to_read = skip_size > SIMPLE_ARCHIVER_BUFFER_SIZE
+                                   ? SIMPLE_ARCHIVER_BUFFER_SIZE
+                                   : (size_t)skip_size;
+          if (simple_archiver_io_read(buf, 1, to_read, in_f) != to_read) {
+            return SDA_RET_STRUCT(SDAS_INVALID_FILE);
+          }
+          skip_size -= to_read;
+        }
       }
     } else {
       // Is a symbolic link.
@@ -9672,7 +13419,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
       __attribute__((cleanup(
           simple_archiver_helper_cleanup_malloced))) void *rel_path = NULL;
 
-      if (fread(&u16, 2, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_16_bit_be(&u16);
@@ -9681,7 +13428,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
           fprintf(stderr, "  Link does not have absolute path.\n");
         }
       } else if (u16 < SIMPLE_ARCHIVER_BUFFER_SIZE) {
-        if (fread(buf, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+        if (simple_archiver_io_read(buf, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_INVALID_FILE);
         }
         buf[SIMPLE_ARCHIVER_BUFFER_SIZE - 1] = 0;
@@ -9697,7 +13444,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
         strncpy(abs_path, (char *)buf, (size_t)u16 + 1);
       } else {
         abs_path = malloc(u16 + 1);
-        if (fread(abs_path, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+        if (simple_archiver_io_read(abs_path, 1, u16 + 1, in_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_INVALID_FILE);
         }
         ((char *)abs_path)[u16 - 1] = 0;
@@ -9713,7 +13461,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
         }
       }
 
-      if (fread(&u16, 2, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_16_bit_be(&u16);
@@ -9722,7 +13470,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
           fprintf(stderr, "  Link does not have relative path.\n");
         }
       } else if (u16 < SIMPLE_ARCHIVER_BUFFER_SIZE) {
-        if (fread(buf, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+        if (simple_archiver_io_read(buf, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_INVALID_FILE);
         }
         buf[SIMPLE_ARCHIVER_BUFFER_SIZE - 1] = 0;
@@ -9738,7 +13486,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
         strncpy(rel_path, (char *)buf, (size_t)u16 + 1);
       } else {
         rel_path = malloc(u16 + 1);
-        if (fread(rel_path, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+        if (simple_archiver_io_read(rel_path, 1, u16 + 1, in_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_INVALID_FILE);
         }
         ((char *)rel_path)[u16] = 0;
@@ -10088,7 +13837,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
 }
 
 SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
-    FILE *in_f,
+    SDArchiverIOStream *in_f,
     int_fast8_t do_extract,
     const SDArchiverState *state,
     SDArchiverHashMap *parsed_state) {
@@ -10100,7 +13849,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
   uint64_t compressed_size = 0;
   uint64_t actual_size = 0;
 
-  if (fread(buf, 1, 4, in_f) != 4) {
+  if (simple_archiver_io_read(buf, 1, 4, in_f) != 4) {
     return SDA_RET_STRUCT(SDAS_INVALID_FILE);
   }
 
@@ -10135,7 +13884,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
       simple_archiver_helper_cleanup_c_string))) char *decompressor_cmd = NULL;
 
   if (is_compressed) {
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -10158,7 +13907,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
 
     fprintf(stderr, "Compressor command: %s\n", compressor_cmd);
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -10194,7 +13943,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
                                : 0;
 
   // Link count.
-  if (fread(&u32, 4, 1, in_f) != 1) {
+  if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
     return SDA_RET_STRUCT(SDAS_INVALID_FILE);
   }
   simple_archiver_helper_32_bit_be(&u32);
@@ -10205,7 +13954,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
     if (is_sig_int_occurred) {
       return SDA_RET_STRUCT(SDAS_SIGINT);
     }
-    if (fread(buf, 1, 2, in_f) != 2) {
+    if (simple_archiver_io_read(buf, 1, 2, in_f) != 2) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     const uint_fast8_t absolute_preferred = (buf[0] & 1) ? 1 : 0;
@@ -10217,7 +13966,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
     uint_fast8_t link_extracted = 0;
     uint_fast8_t skip_due_to_invalid = is_invalid ? 1 : 0;
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -10258,11 +14007,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
     }
 
     const int_fast8_t arg_allowed =
-      state->parsed->just_w_files->count == 0
-      || simple_archiver_hash_map_get(state->parsed->just_w_files,
-                                      link_name,
-                                      strlen(link_name) + 1)
-      ? 1 : 0;
+      simple_archiver_internal_arg_allowed(state->parsed, link_name);
 
     const uint_fast8_t lists_allowed =
       simple_archiver_helper_string_allowed_lists(
@@ -10314,7 +14059,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
     __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
     char *abs_path_prefixed = NULL;
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -10433,7 +14178,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
     __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
     char *rel_path_prefixed = NULL;
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -10582,7 +14327,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
     }
   }
 
-  if (fread(&u32, 4, 1, in_f) != 1) {
+  if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
     return SDA_RET_STRUCT(SDAS_INVALID_FILE);
   }
   simple_archiver_helper_32_bit_be(&u32);
@@ -10600,7 +14345,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
 
     skip_chunk = 1;
 
-    if (fread(&u32, 4, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_32_bit_be(&u32);
@@ -10617,7 +14362,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
       file_info = malloc(sizeof(SDArchiverInternalFileInfo));
       memset(file_info, 0, sizeof(SDArchiverInternalFileInfo));
 
-      if (fread(&u16, 2, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_16_bit_be(&u16);
@@ -10658,10 +14403,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
                                               file_info->filename);
       }
 
-      if (state->parsed->just_w_files->count == 0
-          || simple_archiver_hash_map_get(state->parsed->just_w_files,
-                                          file_info->filename,
-                                          strlen(file_info->filename) + 1)) {
+      if (simple_archiver_internal_arg_allowed(state->parsed,
+                                               file_info->filename)) {
         file_info->other_flags |= 4;
       }
       if (simple_archiver_helper_string_allowed_lists(
@@ -10709,11 +14452,11 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
         }
       }
 
-      if (fread(file_info->bit_flags, 1, 4, in_f) != 4) {
+      if (simple_archiver_io_read(file_info->bit_flags, 1, 4, in_f) != 4) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
 
-      if (fread(&u32, 4, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_32_bit_be(&u32);
@@ -10769,7 +14512,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
         }
       }
 
-      if (fread(&u32, 4, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_32_bit_be(&u32);
@@ -10824,7 +14567,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
         }
       }
 
-      if (fread(&u64, 8, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&u64, 8, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_64_bit_be(&u64);
@@ -10844,7 +14587,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
       file_info = NULL;
     }
 
-    if (fread(&u64, 8, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u64, 8, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_64_bit_be(&u64);
@@ -11014,7 +14757,12 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
         &compressed_size,
         pipe_outof_read,
         state->parsed->write_version,
-        0
+        0,
+        NULL,
+        NULL,
+        NULL,
+        0,
+        -1
       };
 
       while (node->next != file_info_list->tail) {
@@ -11397,7 +15145,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
 }
 
 SDArchiverStateRetStruct simple_archiver_parse_archive_version_2(
-    FILE *in_f,
+    SDArchiverIOStream *in_f,
     int_fast8_t do_extract,
     const SDArchiverState *state,
     SDArchiverHashMap *parsed_state) {
@@ -11418,7 +15166,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_2(
   }
 
   uint32_t u32;
-  if (fread(&u32, 4, 1, in_f) != 1) {
+  if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
     fprintf(stderr, "ERROR: Failed to read directory count!\n");
     return SDA_RET_STRUCT(SDAS_INVALID_FILE);
   }
@@ -11431,7 +15179,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_2(
 
   const uint32_t size = u32;
   for (uint32_t idx = 0; idx < size; ++idx) {
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       fprintf(stderr, "ERROR: Failed to read directory name length!\n");
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
@@ -11440,7 +15188,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_2(
     simple_archiver_helper_cleanup_c_string(&buf);
     buf = malloc(u16 + 1);
 
-    if (fread(buf, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+    if (simple_archiver_io_read(buf, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
       fprintf(stderr, "ERROR: Failed to read directory name!\n");
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
@@ -11464,13 +15212,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_2(
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
 
-    const uint_fast8_t arg_allowed =
-      state->parsed->just_w_files->count == 0
-      || simple_archiver_hash_map_get(state->parsed->just_w_files,
-                                      buf,
-                                      u16 + 1) != NULL
-        ? 1
-        : 0;
+    const int_fast8_t arg_allowed =
+      simple_archiver_internal_arg_allowed(state->parsed, (const char *)buf);
 
     const uint_fast8_t lists_allowed =
       simple_archiver_helper_string_allowed_lists(
@@ -11483,7 +15226,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_2(
     }
 
     uint8_t perms_flags[4];
-    if (fread(perms_flags, 1, 2, in_f) != 2) {
+    if (simple_archiver_io_read(perms_flags, 1, 2, in_f) != 2) {
       fprintf(stderr,
               "ERROR: Failed to read permission flags for \"%s\"!\n",
               buf);
@@ -11493,7 +15236,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_2(
     perms_flags[3] = 0;
 
     uint32_t uid;
-    if (fread(&uid, 4, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&uid, 4, 1, in_f) != 1) {
       fprintf(stderr,
               "ERROR: Failed to read UID for \"%s\"!\n", buf);
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
@@ -11501,7 +15244,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_2(
     simple_archiver_helper_32_bit_be(&uid);
 
     uint32_t gid;
-    if (fread(&gid, 4, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&gid, 4, 1, in_f) != 1) {
       fprintf(stderr,
               "ERROR: Failed to read GID for \"%s\"!\n", buf);
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
@@ -11697,7 +15440,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_2(
 }
 
 SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
-    FILE *in_f,
+    SDArchiverIOStream *in_f,
     int_fast8_t do_extract,
     const SDArchiverState *state,
     SDArchiverHashMap *parsed_state) {
@@ -11709,7 +15452,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
   uint64_t compressed_size = 0;
   uint64_t actual_size = 0;
 
-  if (fread(buf, 1, 4, in_f) != 4) {
+  if (simple_archiver_io_read(buf, 1, 4, in_f) != 4) {
     return SDA_RET_STRUCT(SDAS_INVALID_FILE);
   }
 
@@ -11744,7 +15487,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
       simple_archiver_helper_cleanup_c_string))) char *decompressor_cmd = NULL;
 
   if (is_compressed) {
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -11767,7 +15510,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
 
     fprintf(stderr, "Compressor command: %s\n", compressor_cmd);
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -11803,7 +15546,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
                                : 0;
 
   // Link count.
-  if (fread(&u32, 4, 1, in_f) != 1) {
+  if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
     return SDA_RET_STRUCT(SDAS_INVALID_FILE);
   }
   simple_archiver_helper_32_bit_be(&u32);
@@ -11815,7 +15558,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
     if (is_sig_int_occurred) {
       return SDA_RET_STRUCT(SDAS_SIGINT);
     }
-    if (fread(buf, 1, 2, in_f) != 2) {
+    if (simple_archiver_io_read(buf, 1, 2, in_f) != 2) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     const uint_fast8_t absolute_preferred = (buf[0] & 1) ? 1 : 0;
@@ -11827,7 +15570,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
     uint_fast8_t link_extracted = 0;
     uint_fast8_t skip_due_to_invalid = is_invalid ? 1 : 0;
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -11868,11 +15611,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
     }
 
     const int_fast8_t arg_allowed =
-      state->parsed->just_w_files->count == 0
-      || simple_archiver_hash_map_get(state->parsed->just_w_files,
-                                      link_name,
-                                      strlen(link_name) + 1) != NULL
-      ? 1 : 0;
+      simple_archiver_internal_arg_allowed(state->parsed, link_name);
 
     const uint_fast8_t lists_allowed =
       simple_archiver_helper_string_allowed_lists(
@@ -11923,7 +15662,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
       fprintf(stderr, "  Skipping not specified in args...\n");
     }
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -11977,7 +15716,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
       fprintf(stderr, "  No Absolute path.\n");
     }
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -12027,7 +15766,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
       fprintf(stderr, "  No Relative path.\n");
     }
 
-    if (fread(&u32, 4, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
       fprintf(stderr, "  ERROR: Failed to read UID for symlink!\n");
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
@@ -12038,7 +15777,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
       fprintf(stderr, "  UID: %" PRIu32 "\n", uid);
     }
 
-    if (fread(&u32, 4, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
       fprintf(stderr, "  ERROR: Failed to read GID for symlink!\n");
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
@@ -12049,7 +15788,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
       fprintf(stderr, "  GID: %" PRIu32 "\n", gid);
     }
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       fprintf(stderr, "  ERROR: Failed to read Username length for symlink!\n");
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
@@ -12059,7 +15798,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
     char *username = malloc(u16 + 1);
 
     if (u16 != 0) {
-      if (fread(username, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+      if (simple_archiver_io_read(username, 1, u16 + 1, in_f)
+          != (size_t)u16 + 1) {
         fprintf(stderr, "  ERROR: Failed to read Username for symlink!\n");
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
@@ -12133,7 +15873,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
       }
     }
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       fprintf(stderr,
               "  ERROR: Failed to read Groupname length for symlink!\n");
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
@@ -12144,7 +15884,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
     char *groupname = malloc(u16 + 1);
 
     if (u16 != 0) {
-      if (fread(groupname, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+      if (simple_archiver_io_read(groupname, 1, u16 + 1, in_f)
+          != (size_t)u16 + 1) {
         fprintf(stderr, "  ERROR: Failed to read Groupname for symlink!\n");
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
@@ -12470,7 +16211,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
     }
   }
 
-  if (fread(&u32, 4, 1, in_f) != 1) {
+  if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
     return SDA_RET_STRUCT(SDAS_INVALID_FILE);
   }
   simple_archiver_helper_32_bit_be(&u32);
@@ -12488,7 +16229,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
 
     skip_chunk = 1;
 
-    if (fread(&u32, 4, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_32_bit_be(&u32);
@@ -12505,7 +16246,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
       file_info = malloc(sizeof(SDArchiverInternalFileInfo));
       memset(file_info, 0, sizeof(SDArchiverInternalFileInfo));
 
-      if (fread(&u16, 2, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_16_bit_be(&u16);
@@ -12553,11 +16294,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
         file_info->other_flags |= 1;
       } else {
         const int_fast8_t arg_allowed =
-          state->parsed->just_w_files->count == 0
-          || simple_archiver_hash_map_get(state->parsed->just_w_files,
-                                          file_info->filename,
-                                          strlen(file_info->filename) + 1)
-          ? 1 : 0;
+          simple_archiver_internal_arg_allowed(state->parsed,
+                                               file_info->filename);
         const int_fast8_t list_allowed =
           simple_archiver_helper_string_allowed_lists(
             file_info->filename,
@@ -12601,11 +16339,11 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
         }
       }
 
-      if (fread(file_info->bit_flags, 1, 4, in_f) != 4) {
+      if (simple_archiver_io_read(file_info->bit_flags, 1, 4, in_f) != 4) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
 
-      if (fread(&u32, 4, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_32_bit_be(&u32);
@@ -12628,7 +16366,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
         }
       }
 
-      if (fread(&u32, 4, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_32_bit_be(&u32);
@@ -12651,7 +16389,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
         }
       }
 
-      if (fread(&u16, 2, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_16_bit_be(&u16);
@@ -12660,7 +16398,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
       char *username = malloc(u16 + 1);
 
       if (u16 != 0) {
-        if (fread(username, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+        if (simple_archiver_io_read(username, 1, u16 + 1, in_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_INVALID_FILE);
         }
         username[u16] = 0;
@@ -12693,7 +16432,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
         }
       }
 
-      if (fread(&u16, 2, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_16_bit_be(&u16);
@@ -12702,7 +16441,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
       char *groupname = malloc(u16 + 1);
 
       if (u16 != 0) {
-        if (fread(groupname, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+        if (simple_archiver_io_read(groupname, 1, u16 + 1, in_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_INVALID_FILE);
         }
         groupname[u16] = 0;
@@ -12799,7 +16539,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
         }
       }
 
-      if (fread(&u64, 8, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&u64, 8, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_64_bit_be(&u64);
@@ -12819,7 +16559,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
       file_info = NULL;
     }
 
-    if (fread(&u64, 8, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u64, 8, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_64_bit_be(&u64);
@@ -12989,7 +16729,12 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
         &compressed_size,
         pipe_outof_read,
         state->parsed->write_version,
-        0
+        0,
+        NULL,
+        NULL,
+        NULL,
+        0,
+        -1
       };
 
       while (node->next != file_info_list->tail) {
@@ -13352,7 +17097,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
     simple_archiver_safe_links_enforce(links_list, files_map);
   }
 
-  if (fread(&u32, 4, 1, in_f) != 1) {
+  if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
     fprintf(stderr, "ERROR: Failed to read directory count!\n");
     return SDA_RET_STRUCT(SDAS_INVALID_FILE);
   }
@@ -13361,7 +17106,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
 
   const uint32_t size = u32;
   for (uint32_t idx = 0; idx < size; ++idx) {
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       fprintf(stderr, "ERROR: Failed to read directory name length!\n");
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
@@ -13371,7 +17116,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
     __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
     char *archive_dir_name = malloc(u16 + 1);
 
-    if (fread(archive_dir_name, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+    if (simple_archiver_io_read(archive_dir_name, 1, u16 + 1, in_f)
+        != (size_t)u16 + 1) {
       fprintf(stderr, "ERROR: Failed to read directory name!\n");
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
@@ -13399,13 +17145,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
 
-    const uint_fast8_t arg_allowed =
-      state->parsed->just_w_files->count == 0
-      || simple_archiver_hash_map_get(state->parsed->just_w_files,
-                                      archive_dir_name,
-                                      u16 + 1) != NULL
-        ? 1
-        : 0;
+    const int_fast8_t arg_allowed =
+      simple_archiver_internal_arg_allowed(state->parsed, archive_dir_name);
 
     const uint_fast8_t lists_allowed =
       simple_archiver_helper_string_allowed_lists(
@@ -13418,7 +17159,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
     }
 
     uint8_t perms_flags[4];
-    if (fread(perms_flags, 1, 2, in_f) != 2) {
+    if (simple_archiver_io_read(perms_flags, 1, 2, in_f) != 2) {
       fprintf(stderr,
               "ERROR: Failed to read permission flags for \"%s\"!\n",
               archive_dir_name);
@@ -13428,7 +17169,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
     perms_flags[3] = 0;
 
     uint32_t uid;
-    if (fread(&uid, 4, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&uid, 4, 1, in_f) != 1) {
       fprintf(stderr,
               "ERROR: Failed to read UID for \"%s\"!\n", archive_dir_name);
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
@@ -13436,14 +17177,14 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
     simple_archiver_helper_32_bit_be(&uid);
 
     uint32_t gid;
-    if (fread(&gid, 4, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&gid, 4, 1, in_f) != 1) {
       fprintf(stderr,
               "ERROR: Failed to read GID for \"%s\"!\n", archive_dir_name);
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_32_bit_be(&gid);
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -13452,7 +17193,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
     char *username = malloc(u16 + 1);
 
     if (u16 != 0) {
-      if (fread(username, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+      if (simple_archiver_io_read(username, 1, u16 + 1, in_f)
+          != (size_t)u16 + 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       username[u16] = 0;
@@ -13466,7 +17208,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
       username = NULL;
     }
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -13475,7 +17217,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
     char *groupname = malloc(u16 + 1);
 
     if (u16 != 0) {
-      if (fread(groupname, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+      if (simple_archiver_io_read(groupname, 1, u16 + 1, in_f)
+          != (size_t)u16 + 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       groupname[u16] = 0;
@@ -13740,7 +17483,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
 }
 
 SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
-    FILE *in_f,
+    SDArchiverIOStream *in_f,
     int_fast8_t do_extract,
     const SDArchiverState *state,
     SDArchiverHashMap *parsed_state) {
@@ -13751,8 +17494,13 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
 
   uint64_t compressed_size = 0;
   uint64_t actual_size = 0;
+  SDArchiverInternalFileTimes *file_times =
+    do_extract
+    ? simple_archiver_internal_file_times_get(parsed_state, state->parsed)
+    : NULL;
+  SDArchiverInternalFileTimer file_timer = {0, 0, 0};
 
-  if (fread(buf, 1, 4, in_f) != 4) {
+  if (simple_archiver_io_read(buf, 1, 4, in_f) != 4) {
     return SDA_RET_STRUCT(SDAS_INVALID_FILE);
   }
 
@@ -13762,6 +17510,13 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     }
   }
 
+  // Where supported, extracted paths are resolved by the kernel beneath the
+  // extraction dir, so a symlink in the archive (or one planted there
+  // meanwhile) cannot redirect writes outside of it.
+  __attribute__((cleanup(simple_archiver_internal_cleanup_int_fd)))
+  int extract_dir_fd = do_extract ? simple_archiver_helper_beneath_dir_fd()
+                                  : -1;
+
   __attribute__((cleanup(simple_archiver_list_free)))
   SDArchiverLinkedList *links_list =
       do_extract && state && state->parsed && state->parsed->flags & 0x80
@@ -13785,7 +17540,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
       simple_archiver_helper_cleanup_c_string))) char *decompressor_cmd = NULL;
 
   if (is_compressed) {
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -13808,7 +17563,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
 
     fprintf(stderr, "Compressor command: %s\n", compressor_cmd);
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -13839,18 +17594,30 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     return SDA_RET_STRUCT(SDAS_SIGINT);
   }
 
-  __attribute__((cleanup(simple_archiver_priority_heap_free)))
-  SDArchiverPHeap *dir_heap =
-    simple_archiver_priority_heap_init_less_generic_fn(greater_strlen_fn);
+  if (state->parsed->write_version >= 11) {
+    SDArchiverStateReturns ret =
+      simple_archiver_internal_dir_summaries_read(in_f,
+                                                  state->parsed,
+                                                  do_extract);
+    if (ret != SDAS_SUCCESS) {
+      return SDA_RET_STRUCT(ret);
+    } else if (state->parsed->du && !do_extract) {
+      // Only the summaries were asked for.
+      return SDA_RET_STRUCT(SDAS_SUCCESS);
+    }
+  }
+
+  __attribute__((cleanup(simple_archiver_btree_free)))
+  SDArchiverBTree *dir_btree = simple_archiver_btree_init(greater_strcmp_fn);
 
-  __attribute__((cleanup(simple_archiver_priority_heap_free)))
-  SDArchiverPHeap *dir_heap_post_process =
-    simple_archiver_priority_heap_init_less_generic_fn(greater_dirnamelen_fn);
+  __attribute__((cleanup(simple_archiver_btree_free)))
+  SDArchiverBTree *dir_btree_post_process =
+    simple_archiver_btree_init(greater_dirname_strcmp_fn);
 
   if (state->parsed->write_version >= 6) {
     // Directories.
     fprintf(stderr, "DIRECTORIES\n");
-    if (fread(&u64, 8, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u64, 8, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_64_bit_be(&u64);
@@ -13860,14 +17627,15 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     char *abs_path_dir = realpath(".", NULL);
 
     for (uint64_t dir_idx = 0; dir_idx < dir_count; ++dir_idx) {
-      if (fread(&u32, 4, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_32_bit_be(&u32);
       const uint32_t dir_path_size = u32;
       __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
       char *dir_path = malloc(dir_path_size + 1);
-      if (fread(dir_path, 1, dir_path_size + 1, in_f) != dir_path_size + 1) {
+      if (simple_archiver_io_read(dir_path, 1, dir_path_size + 1, in_f)
+          != dir_path_size + 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       dir_path[dir_path_size] = 0;
@@ -13893,7 +17661,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
       }
 
       uint8_t pbits[2];
-      if (fread(pbits, 1, 2, in_f) != 2) {
+      if (simple_archiver_io_read(pbits, 1, 2, in_f) != 2) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       if (!do_extract) {
@@ -13924,11 +17692,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
 
       if ((state->parsed->flags & 0x200000) != 0
           && ((pbits[1] & 2) != 0 || (state->parsed->flags & 0x400000))) {
-        simple_archiver_priority_heap_insert(
-            dir_heap,
-            1,
-            strdup(dir_path),
-            NULL);
+        simple_archiver_btree_insert(dir_btree, strdup(dir_path), NULL);
       }
 
       if (do_extract) {
@@ -13948,19 +17712,18 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
                     state->parsed->empty_dir_permissions)
                 : simple_archiver_internal_bits_to_mode_t(pbits);
         }
-        simple_archiver_priority_heap_insert(dir_heap_post_process,
-                                             1,
-                                             dinfo,
-                                             internal_cleanup_dirinfo_fn);
+        simple_archiver_btree_insert(dir_btree_post_process,
+                                     dinfo,
+                                     internal_cleanup_dirinfo_fn);
       }
 
       uint32_t uid;
-      if (fread(&uid, 4, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&uid, 4, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_32_bit_be(&uid);
       uint32_t gid;
-      if (fread(&gid, 4, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&gid, 4, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_32_bit_be(&gid);
@@ -13971,7 +17734,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
                 gid);
       }
 
-      if (fread(&u16, 2, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_16_bit_be(&u16);
@@ -13979,7 +17742,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
       char *username = NULL;
       if (u16 != 0) {
         username = malloc(u16 + 1);
-        if (fread(username, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+        if (simple_archiver_io_read(username, 1, u16 + 1, in_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_INVALID_FILE);
         }
         username[u16] = 0;
@@ -13993,7 +17757,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
         }
       }
 
-      if (fread(&u16, 2, 1, in_f) != 1) {
+      if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_16_bit_be(&u16);
@@ -14001,7 +17765,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
       char *groupname = NULL;
       if (u16 != 0) {
         groupname = malloc(u16 + 1);
-        if (fread(groupname, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+        if (simple_archiver_io_read(groupname, 1, u16 + 1, in_f)
+            != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_INVALID_FILE);
         }
         groupname[u16] = 0;
@@ -14132,9 +17897,12 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
       SAHelperStringParts parts =
         simple_archiver_helper_string_parts_init();
 
-      simple_archiver_helper_string_parts_add(parts, abs_path_dir);
-      if (abs_path_dir[strlen(abs_path_dir) - 1] != '/') {
-        simple_archiver_helper_string_parts_add(parts, "/");
+      // Paths beneath "extract_dir_fd" must be relative to it.
+      if (extract_dir_fd < 0) {
+        simple_archiver_helper_string_parts_add(parts, abs_path_dir);
+        if (abs_path_dir[strlen(abs_path_dir) - 1] != '/') {
+          simple_archiver_helper_string_parts_add(parts, "/");
+        }
       }
 
       if (state && state->parsed->prefix) {
@@ -14142,11 +17910,6 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
       }
 
       simple_archiver_helper_string_parts_add(parts, dir_path);
-
-      __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
-      char *abs_dir_path =
-        simple_archiver_helper_string_parts_combine(parts);
-
       simple_archiver_helper_string_parts_add(parts, "/UNUSED");
 
       __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
@@ -14155,7 +17918,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
 
       if (do_extract) {
         int ret =
-          simple_archiver_helper_make_dirs_perms(
+          simple_archiver_helper_make_dirs_perms_beneath(
+            extract_dir_fd,
             abs_dir_path_with_suffix,
             S_IRWXU,
             (state->parsed->flags & 0x400) ? state->parsed->uid : uid,
@@ -14175,7 +17939,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
                                : 0;
 
   // Link count.
-  if (fread(&u64, 8, 1, in_f) != 1) {
+  if (simple_archiver_io_read(&u64, 8, 1, in_f) != 1) {
     return SDA_RET_STRUCT(SDAS_INVALID_FILE);
   }
   simple_archiver_helper_64_bit_be(&u64);
@@ -14187,7 +17951,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     if (is_sig_int_occurred) {
       return SDA_RET_STRUCT(SDAS_SIGINT);
     }
-    if (fread(buf, 1, 2, in_f) != 2) {
+    if (simple_archiver_io_read(buf, 1, 2, in_f) != 2) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     const uint_fast8_t absolute_preferred = (buf[0] & 1) ? 1 : 0;
@@ -14200,7 +17964,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     uint_fast8_t skip_due_to_map = 0;
     uint_fast8_t skip_due_to_invalid = is_invalid ? 1 : 0;
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -14241,12 +18005,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     }
 
     const int_fast8_t arg_allowed =
-      state->parsed->just_w_files->count == 0
-      || simple_archiver_hash_map_get(state->parsed->just_w_files,
-                                      link_name,
-                                      strlen(link_name) + 1) != NULL
-      ? 1
-      : 0;
+      simple_archiver_internal_arg_allowed(state->parsed, link_name);
 
     const uint_fast8_t lists_allowed =
       simple_archiver_helper_string_allowed_lists(
@@ -14294,15 +18053,12 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     }
 
     if (do_extract
-        && state->parsed->just_w_files->count != 0
-        && simple_archiver_hash_map_get(state->parsed->just_w_files,
-                                        link_name,
-                                        u16 + 1) == NULL) {
+        && !simple_archiver_internal_arg_allowed(state->parsed, link_name)) {
       skip_due_to_map = 1;
       fprintf(stderr, "  Skipping not specified in args...\n");
     }
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -14356,7 +18112,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
       fprintf(stderr, "  No Absolute path.\n");
     }
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -14406,7 +18162,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
       fprintf(stderr, "  No Relative path.\n");
     }
 
-    if (fread(&u32, 4, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
       fprintf(stderr, "  ERROR: Failed to read UID for symlink!\n");
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
@@ -14417,7 +18173,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
       fprintf(stderr, "  UID: %" PRIu32 "\n", uid);
     }
 
-    if (fread(&u32, 4, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
       fprintf(stderr, "  ERROR: Failed to read GID for symlink!\n");
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
@@ -14428,7 +18184,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
       fprintf(stderr, "  GID: %" PRIu32 "\n", gid);
     }
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       fprintf(stderr, "  ERROR: Failed to read Username length for symlink!\n");
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
@@ -14438,7 +18194,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     char *username = malloc(u16 + 1);
 
     if (u16 != 0) {
-      if (fread(username, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+      if (simple_archiver_io_read(username, 1, u16 + 1, in_f)
+          != (size_t)u16 + 1) {
         fprintf(stderr, "  ERROR: Failed to read Username for symlink!\n");
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
@@ -14512,7 +18269,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
       }
     }
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       fprintf(stderr,
               "  ERROR: Failed to read Groupname length for symlink!\n");
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
@@ -14523,7 +18280,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     char *groupname = malloc(u16 + 1);
 
     if (u16 != 0) {
-      if (fread(groupname, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+      if (simple_archiver_io_read(groupname, 1, u16 + 1, in_f)
+          != (size_t)u16 + 1) {
         fprintf(stderr, "  ERROR: Failed to read Groupname for symlink!\n");
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
@@ -14607,7 +18365,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
         && lists_allowed
         && absolute_preferred
         && parsed_abs_path) {
-      simple_archiver_helper_make_dirs_perms(
+      simple_archiver_helper_make_dirs_perms_beneath(
+        extract_dir_fd,
         link_name_prefixed ? link_name_prefixed : link_name,
         (state->parsed->flags & 0x2000)
           ? simple_archiver_internal_permissions_to_mode_t(
@@ -14618,11 +18377,16 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
       int_fast8_t link_create_retry = 0;
       int iret;
     V4_SYMLINK_CREATE_RETRY_0:
-      iret = symlink(
+      iret = simple_archiver_helper_symlink_beneath(
+        extract_dir_fd,
         abs_path_prefixed ? abs_path_prefixed : parsed_abs_path,
         link_name_prefixed ? link_name_prefixed : link_name);
       if (iret == -1) {
-        if (link_create_retry) {
+        if (errno == EXDEV) {
+          fprintf(stderr,
+                  "ERROR: \"%s\" resolves outside of the extraction dir!\n",
+                  link_name_prefixed ? link_name_prefixed : link_name);
+        } else if (link_create_retry) {
           fprintf(
               stderr,
               "  WARNING: Failed to create symlink after removing existing "
@@ -14639,17 +18403,20 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
                     "  NOTICE: Symlink already exists and "
                     "\"--overwrite-extract\" specified, attempting to "
                     "overwrite...\n");
-            unlink(link_name_prefixed ? link_name_prefixed : link_name);
+            simple_archiver_helper_unlink_beneath(
+              extract_dir_fd,
+              link_name_prefixed ? link_name_prefixed : link_name);
             link_create_retry = 1;
             goto V4_SYMLINK_CREATE_RETRY_0;
           }
         }
         return SDA_RET_STRUCT(SDAS_FAILED_TO_EXTRACT_SYMLINK);
       }
-      iret = fchmodat(AT_FDCWD,
-                     link_name_prefixed ? link_name_prefixed : link_name,
-                     permissions,
-                     AT_SYMLINK_NOFOLLOW);
+      iret = simple_archiver_helper_fchmodat_beneath(
+        extract_dir_fd,
+        link_name_prefixed ? link_name_prefixed : link_name,
+        permissions,
+        AT_SYMLINK_NOFOLLOW);
       if (iret == -1) {
         if (errno == EOPNOTSUPP) {
           fprintf(stderr,
@@ -14675,7 +18442,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
         && lists_allowed
         && !absolute_preferred
         && parsed_rel_path) {
-      simple_archiver_helper_make_dirs_perms(
+      simple_archiver_helper_make_dirs_perms_beneath(
+        extract_dir_fd,
         link_name_prefixed ? link_name_prefixed : link_name,
         (state->parsed->flags & 0x2000)
           ? simple_archiver_internal_permissions_to_mode_t(
@@ -14686,11 +18454,16 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
       int_fast8_t link_create_retry = 0;
       int iret;
     V4_SYMLINK_CREATE_RETRY_1:
-      iret = symlink(
+      iret = simple_archiver_helper_symlink_beneath(
+        extract_dir_fd,
         rel_path_prefixed ? rel_path_prefixed : parsed_rel_path,
         link_name_prefixed ? link_name_prefixed : link_name);
       if (iret == -1) {
-        if (link_create_retry) {
+        if (errno == EXDEV) {
+          fprintf(stderr,
+                  "ERROR: \"%s\" resolves outside of the extraction dir!\n",
+                  link_name_prefixed ? link_name_prefixed : link_name);
+        } else if (link_create_retry) {
           fprintf(
               stderr,
               "  WARNING: Failed to create symlink after removing existing "
@@ -14707,17 +18480,20 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
                     "  NOTICE: Symlink already exists and "
                     "\"--overwrite-extract\" specified, attempting to "
                     "overwrite...\n");
-            unlink(link_name_prefixed ? link_name_prefixed : link_name);
+            simple_archiver_helper_unlink_beneath(
+              extract_dir_fd,
+              link_name_prefixed ? link_name_prefixed : link_name);
             link_create_retry = 1;
             goto V4_SYMLINK_CREATE_RETRY_1;
           }
         }
         return SDA_RET_STRUCT(SDAS_FAILED_TO_EXTRACT_SYMLINK);
       }
-      iret = fchmodat(AT_FDCWD,
-                     link_name_prefixed ? link_name_prefixed : link_name,
-                     permissions,
-                     AT_SYMLINK_NOFOLLOW);
+      iret = simple_archiver_helper_fchmodat_beneath(
+        extract_dir_fd,
+        link_name_prefixed ? link_name_prefixed : link_name,
+        permissions,
+        AT_SYMLINK_NOFOLLOW);
       if (iret == -1) {
         if (errno == EOPNOTSUPP) {
           fprintf(stderr,
@@ -14812,8 +18588,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
           picked_gid = gid;
         }
       }
-      int iret = fchownat(
-          AT_FDCWD,
+      int iret = simple_archiver_helper_fchownat_beneath(
+          extract_dir_fd,
           link_name_prefixed ? link_name_prefixed : link_name,
           state->parsed->flags & 0x400 ? state->parsed->uid : picked_uid,
           state->parsed->flags & 0x800 ? state->parsed->gid : picked_gid,
@@ -14853,7 +18629,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     }
   }
 
-  if (fread(&u64, 8, 1, in_f) != 1) {
+  if (simple_archiver_io_read(&u64, 8, 1, in_f) != 1) {
     return SDA_RET_STRUCT(SDAS_INVALID_FILE);
   }
   simple_archiver_helper_64_bit_be(&u64);
@@ -14862,10 +18638,19 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
   int_fast8_t skip_chunk;
   int_fast8_t v5_to_skip;
   uint64_t not_compressed_size = 0;
+  __attribute__((cleanup(simple_archiver_internal_delta_ref_free)))
+  SDArchiverInternalDeltaRef *delta_ref = NULL;
+  // Holds the file infos of a chunk and their strings, reset for each chunk.
+  __attribute__((cleanup(simple_archiver_arena_free)))
+  SDArchiverArena *chunk_arena = simple_archiver_arena_init(0);
+  if (!chunk_arena) {
+    return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
+  }
   for (uint64_t chunk_idx = 0; chunk_idx < chunk_count; ++chunk_idx) {
     if (is_sig_int_occurred) {
       return SDA_RET_STRUCT(SDAS_SIGINT);
     }
+    simple_archiver_arena_reset(chunk_arena);
     v5_to_skip = state->parsed->write_version >= 5 ? 1 : 0;
     fprintf(stderr,
             "CHUNK %3" PRIu64 " of %3" PRIu64 "\n",
@@ -14874,36 +18659,99 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
 
     skip_chunk = 1;
 
-    if (fread(&u64, 8, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u64, 8, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_64_bit_be(&u64);
 
     const uint64_t file_count = u64;
 
-    __attribute__((cleanup(simple_archiver_list_free)))
-    SDArchiverLinkedList *file_info_list = simple_archiver_list_init();
+    // File Format 9: the files' metadata is stored as columns.
+    __attribute__((cleanup(simple_archiver_internal_columns_free)))
+    SDArchiverInternalColumns *columns = NULL;
+    uint64_t file_info_count = file_count;
+    int_fast8_t may_match = 1;
+    if (state->parsed->write_version >= 10) {
+      if (simple_archiver_internal_bloom_read(in_f, state->parsed, &may_match)
+          != 0) {
+        return SDA_RET_STRUCT(SDAS_INVALID_FILE);
+      } else if (!may_match) {
+        // None of the paths given as arguments is in this chunk.
+        if (simple_archiver_internal_columns_skip(in_f) != 0) {
+          return SDA_RET_STRUCT(SDAS_INVALID_FILE);
+        }
+        file_info_count = 0;
+      }
+    }
+    if (state->parsed->write_version >= 9 && may_match) {
+      columns = simple_archiver_internal_columns_read(in_f, file_count);
+      if (!columns) {
+        return SDA_RET_STRUCT(SDAS_INVALID_FILE);
+      }
+      for (uint64_t file_idx = 0; file_idx < file_count; ++file_idx) {
+        actual_size += columns->sizes[file_idx];
+      }
+      if (simple_archiver_internal_filter_columns(state->parsed, columns)
+          == 0) {
+        // No file passes the size/owner filters, so skip the chunk without
+        // going through its files.
+        file_info_count = 0;
+      }
+    }
 
-    __attribute__((cleanup(cleanup_internal_file_info)))
-    SDArchiverInternalFileInfo *file_info = NULL;
+    // Contiguous, so the extraction loops go through them in order.
+    SDArchiverInternalFileInfo *file_infos = NULL;
+    if (file_info_count != 0) {
+      file_infos =
+        file_info_count <= SIZE_MAX / sizeof(SDArchiverInternalFileInfo)
+        ? simple_archiver_arena_alloc(
+            chunk_arena,
+            (size_t)file_info_count * sizeof(SDArchiverInternalFileInfo))
+        : NULL;
+      if (!file_infos) {
+        fprintf(stderr,
+                "ERROR: Failed to allocate the info of %" PRIu64 " files!\n",
+                file_info_count);
+        return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
+      }
+      memset(file_infos,
+             0,
+             (size_t)file_info_count * sizeof(SDArchiverInternalFileInfo));
+    }
 
-    for (uint64_t file_idx = 0; file_idx < file_count; ++file_idx) {
-      file_info = malloc(sizeof(SDArchiverInternalFileInfo));
-      memset(file_info, 0, sizeof(SDArchiverInternalFileInfo));
+    for (uint64_t file_idx = 0; file_idx < file_info_count; ++file_idx) {
+      SDArchiverInternalFileInfo *file_info = file_infos + file_idx;
+      const SDArchiverInternalColumnOwner *owner =
+        columns ? columns->owners + columns->owner_idxs[file_idx] : NULL;
 
-      if (fread(&u16, 2, 1, in_f) != 1) {
-        return SDA_RET_STRUCT(SDAS_INVALID_FILE);
-      }
-      simple_archiver_helper_16_bit_be(&u16);
+      if (columns) {
+        const char *name = columns->names + columns->name_offsets[file_idx];
+        u16 = (uint16_t)strlen(name);
+        file_info->filename =
+          simple_archiver_internal_arena_strcat(chunk_arena, name, NULL);
+        if (!file_info->filename) {
+          return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
+        }
+      } else {
+        if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
+          return SDA_RET_STRUCT(SDAS_INVALID_FILE);
+        }
+        simple_archiver_helper_16_bit_be(&u16);
 
-      file_info->filename = malloc(u16 + 1);
-      SDArchiverStateReturns ret =
-          read_buf_full_from_fd(in_f, (char *)buf, SIMPLE_ARCHIVER_BUFFER_SIZE,
-                                u16 + 1, file_info->filename, NULL);
-      if (ret != SDAS_SUCCESS) {
-        return SDA_RET_STRUCT(ret);
+        file_info->filename = simple_archiver_arena_alloc(chunk_arena,
+                                                          u16 + 1);
+        if (!file_info->filename) {
+          return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
+        }
+        SDArchiverStateReturns ret =
+            read_buf_full_from_fd(in_f, (char *)buf,
+                                  SIMPLE_ARCHIVER_BUFFER_SIZE, u16 + 1,
+                                  file_info->filename, NULL);
+        if (ret != SDAS_SUCCESS) {
+          return SDA_RET_STRUCT(ret);
+        }
+        file_info->filename[u16] = 0;
       }
-      file_info->filename[u16] = 0;
 
       if (simple_archiver_helper_has_null_before_size(
             file_info->filename, u16 - 1) != 0) {
@@ -14928,17 +18776,17 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
 
       if (state && state->parsed->prefix) {
         file_info->prefixed_filename =
-          simple_archiver_helper_combine_strs(state->parsed->prefix,
-                                              file_info->filename);
+          simple_archiver_internal_arena_strcat(chunk_arena,
+                                                state->parsed->prefix,
+                                                file_info->filename);
+        if (!file_info->prefixed_filename) {
+          return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
+        }
       }
 
       const int_fast8_t arg_allowed =
-        state->parsed->just_w_files->count == 0
-        || simple_archiver_hash_map_get(state->parsed->just_w_files,
-                                        file_info->filename,
-                                        u16 + 1) != NULL
-        ? 1
-        : 0;
+        simple_archiver_internal_arg_allowed(state->parsed,
+                                             file_info->filename);
 
       if (simple_archiver_validate_file_path(file_info->filename)) {
         fprintf(stderr,
@@ -14954,8 +18802,6 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
               ? 1 : 0;
         if (arg_allowed && list_allowed) {
           file_info->other_flags |= 6;
-          skip_chunk = 0;
-          not_tested_once = 0;
         } else if (arg_allowed) {
           file_info->other_flags |= 4;
         } else if (list_allowed) {
@@ -14963,40 +18809,22 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
         }
       }
 
-      if (do_extract
-          && state
-          && state->parsed
-          && (state->parsed->flags & 8) != 0
-          && (file_info->other_flags & 4) != 0
-          && (file_info->other_flags & 2) != 0) {
-        int fd = open((const char *)buf, O_RDONLY | O_NOFOLLOW);
-        if (fd == -1) {
-          if (errno == ELOOP) {
-            // Exists as a symlink.
-            fprintf(stderr,
-                    "WARNING: Filename \"%s\" already exists as symlink, "
-                    "removing...\n",
-                    (const char *)buf);
-            unlink((const char *)buf);
-          } else {
-            // File doesn't exist, do nothing.
-          }
-        } else {
-          close(fd);
-          fprintf(stderr, "WARNING: File \"%s\" already exists, removing...\n",
-                  (const char *)buf);
-          unlink((const char *)buf);
-        }
-      }
-
-      if (fread(file_info->bit_flags, 1, 4, in_f) != 4) {
+      if (columns) {
+        memcpy(file_info->bit_flags, columns->bit_flags + file_idx * 4, 4);
+      } else if (simple_archiver_io_read(file_info->bit_flags, 1, 4, in_f)
+                 != 4) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
 
-      if (fread(&u32, 4, 1, in_f) != 1) {
+      if (owner) {
+        u32 = owner->uid;
+      } else if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
+      } else {
+        simple_archiver_helper_32_bit_be(&u32);
       }
-      simple_archiver_helper_32_bit_be(&u32);
+      // Filters apply to the uid/gid as stored in the archive.
+      const uint32_t stored_uid = u32;
       __attribute__((cleanup(simple_archiver_helper_cleanup_uint32)))
       uint32_t *remapped_uid = NULL;
       if (do_extract && state && (state->parsed->flags & 0x400)) {
@@ -15016,10 +18844,14 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
         }
       }
 
-      if (fread(&u32, 4, 1, in_f) != 1) {
+      if (owner) {
+        u32 = owner->gid;
+      } else if (simple_archiver_io_read(&u32, 4, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
+      } else {
+        simple_archiver_helper_32_bit_be(&u32);
       }
-      simple_archiver_helper_32_bit_be(&u32);
+      const uint32_t stored_gid = u32;
       __attribute__((cleanup(simple_archiver_helper_cleanup_uint32)))
       uint32_t *remapped_gid = NULL;
       if (do_extract && state && (state->parsed->flags & 0x800)) {
@@ -15039,16 +18871,24 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
         }
       }
 
-      if (fread(&u16, 2, 1, in_f) != 1) {
+      if (owner) {
+        u16 = owner->username ? (uint16_t)strlen(owner->username) : 0;
+      } else if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
+      } else {
+        simple_archiver_helper_16_bit_be(&u16);
       }
-      simple_archiver_helper_16_bit_be(&u16);
 
-      __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
-      char *username = malloc(u16 + 1);
+      char *username = NULL;
 
       if (u16 != 0) {
-        if (fread(username, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+        username = simple_archiver_arena_alloc(chunk_arena, u16 + 1);
+        if (!username) {
+          return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
+        } else if (owner) {
+          memcpy(username, owner->username, u16 + 1);
+        } else if (simple_archiver_io_read(username, 1, u16 + 1, in_f)
+                   != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_INVALID_FILE);
         }
         username[u16] = 0;
@@ -15061,10 +18901,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
           return SDA_RET_STRUCT(SDAS_INVALID_FILE);
         }
 
-        file_info->username = strdup(username);
-      } else {
-        free(username);
-        username = NULL;
+        file_info->username = username;
       }
 
       __attribute__((cleanup(simple_archiver_helper_cleanup_uint32)))
@@ -15081,16 +18918,24 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
         }
       }
 
-      if (fread(&u16, 2, 1, in_f) != 1) {
+      if (owner) {
+        u16 = owner->groupname ? (uint16_t)strlen(owner->groupname) : 0;
+      } else if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
+      } else {
+        simple_archiver_helper_16_bit_be(&u16);
       }
-      simple_archiver_helper_16_bit_be(&u16);
 
-      __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
-      char *groupname = malloc(u16 + 1);
+      char *groupname = NULL;
 
       if (u16 != 0) {
-        if (fread(groupname, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+        groupname = simple_archiver_arena_alloc(chunk_arena, u16 + 1);
+        if (!groupname) {
+          return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
+        } else if (owner) {
+          memcpy(groupname, owner->groupname, u16 + 1);
+        } else if (simple_archiver_io_read(groupname, 1, u16 + 1, in_f)
+                   != (size_t)u16 + 1) {
           return SDA_RET_STRUCT(SDAS_INVALID_FILE);
         }
         groupname[u16] = 0;
@@ -15103,10 +18948,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
           return SDA_RET_STRUCT(SDAS_INVALID_FILE);
         }
 
-        file_info->groupname = strdup(groupname);
-      } else {
-        free(groupname);
-        groupname = NULL;
+        file_info->groupname = groupname;
       }
 
       __attribute__((cleanup(simple_archiver_helper_cleanup_uint32)))
@@ -15187,12 +19029,66 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
         }
       }
 
-      if (fread(&u64, 8, 1, in_f) != 1) {
+      if (columns) {
+        file_info->file_size = columns->sizes[file_idx];
+      } else if (simple_archiver_io_read(&u64, 8, 1, in_f) != 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
+      } else {
+        simple_archiver_helper_64_bit_be(&u64);
+        file_info->file_size = u64;
+        actual_size += u64;
+      }
+
+      if ((file_info->other_flags & 2) != 0
+          && (columns
+              ? !columns->matches[file_idx]
+              : !simple_archiver_internal_filter_file(state->parsed,
+                                                      file_info->file_size,
+                                                      stored_uid,
+                                                      stored_gid))) {
+        file_info->other_flags &= ~2;
+      }
+      if ((file_info->other_flags & 6) == 6) {
+        skip_chunk = 0;
+        not_tested_once = 0;
+      }
+
+      if (do_extract
+          && state
+          && state->parsed
+          && (state->parsed->flags & 8) != 0
+          && (file_info->other_flags & 4) != 0
+          && (file_info->other_flags & 2) != 0
+          && !simple_archiver_internal_in_place_candidate(
+                state->parsed,
+                file_info->prefixed_filename
+                  ? file_info->prefixed_filename
+                  : file_info->filename,
+                file_info->file_size)) {
+        int fd = simple_archiver_helper_open_beneath(extract_dir_fd,
+                                                     file_info->filename,
+                                                     O_RDONLY | O_NOFOLLOW,
+                                                     0);
+        if (fd == -1) {
+          if (errno == ELOOP) {
+            // Exists as a symlink.
+            fprintf(stderr,
+                    "WARNING: Filename \"%s\" already exists as symlink, "
+                    "removing...\n",
+                    file_info->filename);
+            simple_archiver_helper_unlink_beneath(extract_dir_fd,
+                                                  file_info->filename);
+          } else {
+            // File doesn't exist, do nothing.
+          }
+        } else {
+          close(fd);
+          fprintf(stderr, "WARNING: File \"%s\" already exists, removing...\n",
+                  file_info->filename);
+          simple_archiver_helper_unlink_beneath(extract_dir_fd,
+                                                file_info->filename);
+        }
       }
-      simple_archiver_helper_64_bit_be(&u64);
-      file_info->file_size = u64;
-      actual_size += u64;
 
       if (files_map && file_info->other_flags & 2) {
         simple_archiver_internal_paths_to_files_map(
@@ -15201,21 +19097,86 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
             ? file_info->prefixed_filename
             : file_info->filename);
       }
-
-      simple_archiver_list_add(file_info_list, file_info,
-                               free_internal_file_info);
-      file_info = NULL;
     }
 
     // File Format 6: two-bytes bit-flags
     int_fast8_t compressed_bit_set = 1;
+    // File Format 8: reference chunk data to delta decompress against.
+    __attribute__((cleanup(simple_archiver_internal_delta_ref_data_cleanup)))
+    SDArchiverInternalDeltaRefData delta_ref_data = {NULL, -1, 0, 0};
+    __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+    char *delta_decompressor_cmd = NULL;
     if (state->parsed->write_version >= 6) {
       uint8_t v6_flags_bytes[2];
 
-      if (fread(v6_flags_bytes, 1, 2, in_f) != 2) {
+      if (simple_archiver_io_read(v6_flags_bytes, 1, 2, in_f) != 2) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       compressed_bit_set = (v6_flags_bytes[0] & 1) ? 1 : 0;
+
+      if (state->parsed->write_version >= 8 && (v6_flags_bytes[0] & 2)) {
+        uint64_t delta_header[3];
+        if (simple_archiver_io_read(delta_header, 8, 3, in_f) != 3) {
+          return SDA_RET_STRUCT(SDAS_INVALID_FILE);
+        }
+        for (size_t idx = 0; idx < 3; ++idx) {
+          simple_archiver_helper_64_bit_be(delta_header + idx);
+        }
+        if (!is_compressed || !compressed_bit_set) {
+          fprintf(stderr,
+                  "ERROR: Chunk is delta compressed but not compressed!\n");
+          return SDA_RET_STRUCT(SDAS_INVALID_FILE);
+        }
+        fprintf(stderr,
+                "  Delta compressed against reference chunk %" PRIu64 "\n",
+                delta_header[0] + 1);
+
+        if (skip_chunk) {
+          // Nothing to decompress.
+        } else if (!state->parsed->delta_from) {
+          if (do_extract) {
+            fprintf(stderr,
+                    "ERROR: Chunk is delta compressed, the archive it was "
+                    "created from must be given with \"--delta-from\"!\n");
+            return SDA_RET_STRUCT(SDAS_DELTA_REF_ERROR);
+          }
+          fprintf(stderr,
+                  "NOTICE: Not decompressing delta compressed chunk without "
+                  "\"--delta-from\".\n");
+          skip_chunk = 1;
+        } else {
+          if (!delta_ref) {
+            delta_ref = simple_archiver_internal_delta_ref_load(
+              state->parsed->delta_from);
+            if (!delta_ref) {
+              return SDA_RET_STRUCT(SDAS_DELTA_REF_ERROR);
+            }
+          }
+          SDArchiverStateReturns ret =
+            simple_archiver_internal_delta_ref_get_data(delta_ref,
+                                                        delta_header[0],
+                                                        state->parsed,
+                                                        &delta_ref_data);
+          if (ret != SDAS_SUCCESS) {
+            return SDA_RET_STRUCT(ret);
+          } else if (delta_ref_data.size != delta_header[1]
+                     || delta_ref_data.hash != delta_header[2]) {
+            fprintf(stderr,
+                    "ERROR: Reference chunk does not match the one the "
+                    "archive was created with!\n");
+            return SDA_RET_STRUCT(SDAS_DELTA_REF_ERROR);
+          }
+
+          __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+          char *patch_arg = simple_archiver_helper_combine_strs(
+            " --patch-from=", delta_ref_data.path);
+          delta_decompressor_cmd = simple_archiver_helper_combine_strs(
+            state->parsed->decompressor
+              ? state->parsed->decompressor
+              : decompressor_cmd,
+            patch_arg);
+        }
+      }
     }
 
     uint64_t chunk_size = 0;
@@ -15225,7 +19186,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     if (state->parsed->write_version < 7
         || !is_compressed
         || !compressed_bit_set) {
-      if (fread(&u64, 1, 8, in_f) != 8) {
+      if (simple_archiver_io_read(&u64, 1, 8, in_f) != 8) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       simple_archiver_helper_64_bit_be(&u64);
@@ -15275,7 +19236,6 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     int_fast8_t did_print_skipped_a = 0;
     int_fast8_t did_print_skipped_wb = 0;
 
-    SDArchiverLLNode *node = file_info_list->head;
     uint64_t file_idx = 0;
 
     if (skip_chunk && state->parsed->write_version < 7) {
@@ -15358,9 +19318,12 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
         return SDA_RET_STRUCT(SDAS_DECOMPRESSION_ERROR);
       }
 
-      if (state && state->parsed && state->parsed->decompressor) {
+      if (delta_decompressor_cmd
+          || (state && state->parsed && state->parsed->decompressor)) {
         if (simple_archiver_de_compress(pipe_into_cmd, pipe_outof_cmd,
-                                        state->parsed->decompressor,
+                                        delta_decompressor_cmd
+                                          ? delta_decompressor_cmd
+                                          : state->parsed->decompressor,
                                         &decompressor_pid) != 0) {
           // Failed to spawn decompressor.
           close(pipe_into_cmd[1]);
@@ -15436,15 +19399,19 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
         &compressed_size,
         pipe_outof_read,
         state->parsed->write_version,
-        0
+        0,
+        NULL,
+        NULL,
+        NULL,
+        0,
+        extract_dir_fd
       };
 
-      while (node->next != file_info_list->tail) {
+      while (file_idx < file_info_count) {
         if (is_sig_int_occurred) {
           return SDA_RET_STRUCT(SDAS_SIGINT);
         }
-        node = node->next;
-        const SDArchiverInternalFileInfo *file_info = node->data;
+        const SDArchiverInternalFileInfo *file_info = file_infos + file_idx;
         ++file_idx;
 
         decomp_info.file_size = file_info->file_size;
@@ -15471,7 +19438,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
         } else if ((file_info->other_flags & 2) == 0) {
           if (!did_print_skipped_wb) {
             fprintf(stderr,
-                    "\n    Skipping not allowed by white/black lists...\n\n");
+                    "\n    Skipping not allowed by white/black lists or "
+                    "filters...\n\n");
             did_print_skipped_wb = 1;
           }
         }
@@ -15500,7 +19468,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
           if ((state->parsed->flags & 8) == 0) {
             // Check if file already exists.
             __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
-            FILE *temp_fd = fopen(
+            FILE *temp_fd = simple_archiver_helper_fopen_beneath(
+              extract_dir_fd,
               file_info->prefixed_filename
               ? file_info->prefixed_filename
               : file_info->filename,
@@ -15518,7 +19487,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
             }
           }
 
-          simple_archiver_helper_make_dirs_perms(
+          simple_archiver_helper_make_dirs_perms_beneath(
+            extract_dir_fd,
             file_info->prefixed_filename
             ? file_info->prefixed_filename
             : file_info->filename,
@@ -15532,33 +19502,62 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
             (state->parsed->flags & 0x800)
               ? state->parsed->gid
               : file_info->gid);
-          decomp_info.out_filename =
-              file_info->prefixed_filename
-              ? file_info->prefixed_filename
-              : file_info->filename;
+          simple_archiver_internal_file_timer_start(file_times, &file_timer);
+          __attribute__((cleanup(simple_archiver_internal_in_place_cleanup)))
+          SDArchiverInternalInPlace in_place = {-1, NULL, NULL, 0};
+          if (simple_archiver_internal_in_place_open(
+                &in_place,
+                state->parsed,
+                extract_dir_fd,
+                file_info->prefixed_filename
+                  ? file_info->prefixed_filename
+                  : file_info->filename,
+                file_info->file_size)) {
+            decomp_info.out_f = in_place.f;
+          } else {
+            decomp_info.out_filename =
+                file_info->prefixed_filename
+                ? file_info->prefixed_filename
+                : file_info->filename;
+          }
+          if (file_times) {
+            decomp_info.open_ns = &file_timer.open_ns;
+            decomp_info.wait_ns = &file_timer.wait_ns;
+          }
           SDArchiverStateReturns ret = read_decomp_to_out_file(&decomp_info);
           decomp_info.out_filename = NULL;
+          decomp_info.out_f = NULL;
+          decomp_info.open_ns = NULL;
+          decomp_info.wait_ns = NULL;
           if (ret != SDAS_SUCCESS) {
             return SDA_RET_STRUCT(ret);
+          } else if (in_place.f
+                     && simple_archiver_internal_in_place_finish(&in_place)
+                          != 0) {
+            return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
-          if (simple_archiver_helper_can_chown() &&
-                     chown(file_info->prefixed_filename
-                           ? file_info->prefixed_filename
-                           : file_info->filename,
-                           file_info->uid,
-                           file_info->gid) != 0) {
+          simple_archiver_internal_file_timer_done(file_times,
+                                                   &file_timer,
+                                                   file_info->filename,
+                                                   file_info->file_size);
+          ret = simple_archiver_internal_set_owner_perms(
+            extract_dir_fd,
+            -1,
+            file_info->prefixed_filename
+            ? file_info->prefixed_filename
+            : file_info->filename,
+            file_info->uid,
+            file_info->gid,
+            permissions);
+          if (ret == SDAS_UID_GID_SET_FAIL) {
             fprintf(stderr,
                     "    ERROR Failed to set UID/GID of file \"%s\"!\n",
                     file_info->prefixed_filename
                     ? file_info->prefixed_filename
                     : file_info->filename);
-            return SDA_RET_STRUCT(SDAS_UID_GID_SET_FAIL);
-          } else if (chmod(file_info->prefixed_filename
-                    ? file_info->prefixed_filename
-                    : file_info->filename,
-                    permissions)
-                == -1) {
-            return SDA_RET_STRUCT(SDAS_PERMISSION_SET_FAIL);
+            return SDA_RET_STRUCT(ret);
+          } else if (ret != SDAS_SUCCESS) {
+            return SDA_RET_STRUCT(ret);
           }
         } else if ((file_info->other_flags & 4) != 0
             && (file_info->other_flags & 1) == 0
@@ -15665,12 +19664,11 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
         fprintf(stderr, "WARNING decompressor didn't reach EOF!\n");
       }
     } else {
-      while (node->next != file_info_list->tail) {
+      while (file_idx < file_info_count) {
         if (is_sig_int_occurred) {
           return SDA_RET_STRUCT(SDAS_SIGINT);
         }
-        node = node->next;
-        const SDArchiverInternalFileInfo *file_info = node->data;
+        const SDArchiverInternalFileInfo *file_info = file_infos + file_idx;
         ++file_idx;
         if ((file_info->other_flags & 6) == 6) {
           fprintf(stderr,
@@ -15695,7 +19693,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
         } else if ((file_info->other_flags & 2) == 0) {
           if (!did_print_skipped_wb) {
             fprintf(stderr,
-                    "\n    Skipping not allowed by white/black lists...\n\n");
+                    "\n    Skipping not allowed by white/black lists or "
+                    "filters...\n\n");
             did_print_skipped_wb = 1;
           }
         }
@@ -15726,10 +19725,12 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
           if ((state->parsed->flags & 8) == 0) {
             // Check if file already exists.
             __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
-            FILE *temp_fd = fopen(file_info->prefixed_filename
-                                  ? file_info->prefixed_filename
-                                  : file_info->filename,
-                                  "r");
+            FILE *temp_fd = simple_archiver_helper_fopen_beneath(
+              extract_dir_fd,
+              file_info->prefixed_filename
+              ? file_info->prefixed_filename
+              : file_info->filename,
+              "r");
             if (temp_fd) {
               fprintf(stderr,
                       "  WARNING: File already exists and "
@@ -15747,7 +19748,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
               continue;
             }
           }
-          simple_archiver_helper_make_dirs_perms(
+          simple_archiver_helper_make_dirs_perms_beneath(
+            extract_dir_fd,
             file_info->prefixed_filename
             ? file_info->prefixed_filename
             : file_info->filename,
@@ -15761,49 +19763,85 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
             (state->parsed->flags & 0x800)
               ? state->parsed->gid
               : file_info->gid);
+          simple_archiver_internal_file_timer_start(file_times, &file_timer);
+          __attribute__((cleanup(simple_archiver_internal_in_place_cleanup)))
+          SDArchiverInternalInPlace in_place = {-1, NULL, NULL, 0};
           __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
-          FILE *out_fd = fopen(file_info->prefixed_filename
-                               ? file_info->prefixed_filename
-                               : file_info->filename,
-                               "wb");
+          FILE *out_fd = NULL;
+          if (!simple_archiver_internal_in_place_open(
+                &in_place,
+                state->parsed,
+                extract_dir_fd,
+                file_info->prefixed_filename
+                  ? file_info->prefixed_filename
+                  : file_info->filename,
+                file_info->file_size)) {
+            out_fd = simple_archiver_helper_fopen_beneath(
+              extract_dir_fd,
+              file_info->prefixed_filename
+              ? file_info->prefixed_filename
+              : file_info->filename,
+              "wb");
+            if (!out_fd) {
+              fprintf(stderr,
+                      errno == EXDEV
+                        ? "ERROR \"%s\" resolves outside of the extraction "
+                          "dir!\n"
+                        : "ERROR Failed to open \"%s\" for writing!\n",
+                      file_info->prefixed_filename
+                      ? file_info->prefixed_filename
+                      : file_info->filename);
+              return SDA_RET_STRUCT(SDAS_FILE_CREATE_FAIL);
+            }
+          }
+          simple_archiver_internal_file_timer_opened(file_times, &file_timer);
           SDArchiverStateReturns ret =
             read_fd_to_out_fd(in_f,
-                              out_fd,
+                              in_place.f ? in_place.f : out_fd,
                               (char *)buf,
                               SIMPLE_ARCHIVER_BUFFER_SIZE,
                               file_info->file_size,
                               &v5_to_skip);
           if (ret != SDAS_SUCCESS) {
             return SDA_RET_STRUCT(ret);
+          } else if (in_place.f
+                     && simple_archiver_internal_in_place_finish(&in_place)
+                          != 0) {
+            return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
           }
-          simple_archiver_helper_cleanup_FILE(&out_fd);
           //fprintf(stderr,
           // "DEBUG: permissions: %x octal: %o\n", permissions, permissions);
-          if (simple_archiver_helper_can_chown() &&
-                     chown(file_info->prefixed_filename
-                           ? file_info->prefixed_filename
-                           : file_info->filename,
-                           file_info->uid,
-                           file_info->gid) != 0) {
+          // Set through the still open file, saving a path lookup.
+          ret = simple_archiver_internal_set_owner_perms(
+            extract_dir_fd,
+            out_fd ? fileno(out_fd) : -1,
+            file_info->prefixed_filename
+            ? file_info->prefixed_filename
+            : file_info->filename,
+            file_info->uid,
+            file_info->gid,
+            permissions);
+          simple_archiver_helper_cleanup_FILE(&out_fd);
+          simple_archiver_internal_file_timer_done(file_times,
+                                                   &file_timer,
+                                                   file_info->filename,
+                                                   file_info->file_size);
+          if (ret == SDAS_UID_GID_SET_FAIL) {
             fprintf(
               stderr,
               "    ERROR Failed to set UID/GID of file \"%s\"!\n",
               file_info->prefixed_filename
               ? file_info->prefixed_filename
               : file_info->filename);
-            return SDA_RET_STRUCT(SDAS_UID_GID_SET_FAIL);
-          } else if (chmod(file_info->prefixed_filename
-                    ? file_info->prefixed_filename
-                    : file_info->filename,
-                    permissions)
-                == -1) {
+            return SDA_RET_STRUCT(ret);
+          } else if (ret != SDAS_SUCCESS) {
             fprintf(
               stderr,
               "ERROR Failed to set permissions of file \"%s\"!\n",
               file_info->prefixed_filename
               ? file_info->prefixed_filename
               : file_info->filename);
-            return SDA_RET_STRUCT(SDAS_PERMISSION_SET_FAIL);
+            return SDA_RET_STRUCT(ret);
           }
         } else if ((file_info->other_flags & 4) != 0
             && (file_info->other_flags & 1) == 0
@@ -15869,9 +19907,9 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
               "NOTICE: --v6-remove-empty-dirs specified, removing now empty "
               "dirs (and wasn't empty when archived)...\n");
       // Check remove empty dirs
-      while (simple_archiver_priority_heap_size(dir_heap) != 0) {
+      while (simple_archiver_btree_size(dir_btree) != 0) {
         __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
-        char *dir = simple_archiver_priority_heap_pop(dir_heap);
+        char *dir = simple_archiver_btree_pop_first(dir_btree);
         __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
         char *result_dir = NULL;
         if (state->parsed->prefix) {
@@ -15902,10 +19940,10 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
 
     if (do_extract) {
       // Set dir permissions.
-      while (simple_archiver_priority_heap_size(dir_heap_post_process) != 0) {
+      while (simple_archiver_btree_size(dir_btree_post_process) != 0) {
         __attribute__((cleanup(internal_cleanup_dirinfo_fn_cleanup)))
         SDArchiverInternalDirInfo *dinfo =
-          simple_archiver_priority_heap_pop(dir_heap_post_process);
+          simple_archiver_btree_pop_first(dir_btree_post_process);
         __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
         char *dir_path = NULL;
         if (state->parsed->prefix) {
@@ -15919,10 +19957,16 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
           dir_path = strdup(dinfo->dirname);
         }
         // Check if dir exists first.
-        int dirfd = open(dir_path, O_RDONLY | O_DIRECTORY);
+        int dirfd = simple_archiver_helper_open_beneath(extract_dir_fd,
+                                                        dir_path,
+                                                        O_RDONLY | O_DIRECTORY,
+                                                        0);
         if (dirfd >= 0) {
           close(dirfd);
-          int ret = chmod(dir_path, dinfo->permissions);
+          int ret = simple_archiver_helper_fchmodat_beneath(extract_dir_fd,
+                                                            dir_path,
+                                                            dinfo->permissions,
+                                                            0);
           if (ret != 0) {
             fprintf(stderr,
                     "WARNING: Failed to set permissions for dir \"%s\"!\n",
@@ -15973,7 +20017,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     return SDA_RET_STRUCT(SDAS_SUCCESS);
   }
 
-  if (fread(&u64, 8, 1, in_f) != 1) {
+  if (simple_archiver_io_read(&u64, 8, 1, in_f) != 1) {
     fprintf(stderr, "ERROR: Failed to read directory count!\n");
     return SDA_RET_STRUCT(SDAS_INVALID_FILE);
   }
@@ -15982,7 +20026,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
 
   const uint64_t size = u64;
   for (uint64_t idx = 0; idx < size; ++idx) {
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       fprintf(stderr, "ERROR: Failed to read directory name length!\n");
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
@@ -15992,7 +20036,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
     char *archive_dir_name = malloc(u16 + 1);
 
-    if (fread(archive_dir_name, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+    if (simple_archiver_io_read(archive_dir_name, 1, u16 + 1, in_f)
+        != (size_t)u16 + 1) {
       fprintf(stderr, "ERROR: Failed to read directory name!\n");
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
@@ -16016,12 +20061,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     }
 
     const uint_fast8_t arg_allowed =
-      state->parsed->just_w_files->count == 0
-      || simple_archiver_hash_map_get(state->parsed->just_w_files,
-                                      archive_dir_name,
-                                      u16 + 1) != NULL
-        ? 1
-        : 0;
+      (uint_fast8_t)simple_archiver_internal_arg_allowed(state->parsed,
+                                                         archive_dir_name);
 
     const uint_fast8_t lists_allowed =
       simple_archiver_helper_string_allowed_lists(
@@ -16034,7 +20075,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     }
 
     uint8_t perms_flags[4];
-    if (fread(perms_flags, 1, 2, in_f) != 2) {
+    if (simple_archiver_io_read(perms_flags, 1, 2, in_f) != 2) {
       fprintf(stderr,
               "ERROR: Failed to read permission flags for \"%s\"!\n",
               archive_dir_name);
@@ -16044,7 +20085,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     perms_flags[3] = 0;
 
     uint32_t uid;
-    if (fread(&uid, 4, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&uid, 4, 1, in_f) != 1) {
       fprintf(stderr,
               "ERROR: Failed to read UID for \"%s\"!\n", archive_dir_name);
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
@@ -16052,14 +20093,14 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     simple_archiver_helper_32_bit_be(&uid);
 
     uint32_t gid;
-    if (fread(&gid, 4, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&gid, 4, 1, in_f) != 1) {
       fprintf(stderr,
               "ERROR: Failed to read GID for \"%s\"!\n", archive_dir_name);
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_32_bit_be(&gid);
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -16068,7 +20109,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     char *username = malloc(u16 + 1);
 
     if (u16 != 0) {
-      if (fread(username, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+      if (simple_archiver_io_read(username, 1, u16 + 1, in_f)
+          != (size_t)u16 + 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       username[u16] = 0;
@@ -16082,7 +20124,7 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
       username = NULL;
     }
 
-    if (fread(&u16, 2, 1, in_f) != 1) {
+    if (simple_archiver_io_read(&u16, 2, 1, in_f) != 1) {
       return SDA_RET_STRUCT(SDAS_INVALID_FILE);
     }
     simple_archiver_helper_16_bit_be(&u16);
@@ -16091,7 +20133,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
     char *groupname = malloc(u16 + 1);
 
     if (u16 != 0) {
-      if (fread(groupname, 1, u16 + 1, in_f) != (size_t)u16 + 1) {
+      if (simple_archiver_io_read(groupname, 1, u16 + 1, in_f)
+          != (size_t)u16 + 1) {
         return SDA_RET_STRUCT(SDAS_INVALID_FILE);
       }
       groupname[u16] = 0;
@@ -16256,23 +20299,26 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
       }
     }
 
-    __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
-    char *abs_path_dir = realpath(".", NULL);
-    if (!abs_path_dir) {
-      fprintf(
-        stderr,
-        "ERROR: Failed to get abs_path_dir of current working directory!\n");
-      return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
-    }
-
     __attribute__((cleanup(simple_archiver_helper_string_parts_free)))
     SAHelperStringParts string_parts =
       simple_archiver_helper_string_parts_init();
 
-    simple_archiver_helper_string_parts_add(string_parts, abs_path_dir);
+    // Paths beneath "extract_dir_fd" must be relative to it.
+    if (extract_dir_fd < 0) {
+      __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+      char *abs_path_dir = realpath(".", NULL);
+      if (!abs_path_dir) {
+        fprintf(
+          stderr,
+          "ERROR: Failed to get abs_path_dir of current working directory!\n");
+        return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
+      }
 
-    if (abs_path_dir[strlen(abs_path_dir) - 1] != '/') {
-      simple_archiver_helper_string_parts_add(string_parts, "/");
+      simple_archiver_helper_string_parts_add(string_parts, abs_path_dir);
+
+      if (abs_path_dir[strlen(abs_path_dir) - 1] != '/') {
+        simple_archiver_helper_string_parts_add(string_parts, "/");
+      }
     }
 
     if (state && state->parsed->prefix) {
@@ -16293,7 +20339,8 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
       simple_archiver_helper_string_parts_combine(string_parts);
 
     if (do_extract && arg_allowed && lists_allowed) {
-      int ret = simple_archiver_helper_make_dirs_perms(
+      int ret = simple_archiver_helper_make_dirs_perms_beneath(
+        extract_dir_fd,
         abs_dir_path_with_suffix,
         state && (state->parsed->flags & 0x2000)
           ? simple_archiver_internal_permissions_to_mode_t(
@@ -16306,11 +20353,14 @@ SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
         return SDA_RET_STRUCT(SDAS_INTERNAL_ERROR);
       }
       mode_t perms = simple_archiver_internal_bits_to_mode_t(perms_flags);
-      ret = chmod(abs_dir_path,
-                  state && (state->parsed->flags & 0x10000)
-                    ? simple_archiver_internal_permissions_to_mode_t(
-                        state->parsed->empty_dir_permissions)
-                    : perms);
+      ret = simple_archiver_helper_fchmodat_beneath(
+        extract_dir_fd,
+        abs_dir_path,
+        state && (state->parsed->flags & 0x10000)
+          ? simple_archiver_internal_permissions_to_mode_t(
+              state->parsed->empty_dir_permissions)
+          : perms,
+        0);
       if (ret != 0) {
         fprintf(stderr,
                 "WARNING: Failed to set permissions on dir \"%s\"!\n",
@@ -16562,3 +20612,578 @@ void simple_archiver_safe_links_enforce(SDArchiverLinkedList *links_list,
     }
   }
 }
+
+/// Orders writer entries by path, which puts every dir after its parent dirs.
+int simple_archiver_internal_writer_path_less_fn(void *a, void *b) {
+  const SDArchiverInternalWriterEntry *entry_a = a;
+  const SDArchiverInternalWriterEntry *entry_b = b;
+  return strcmp(entry_a->path, entry_b->path) < 0;
+}
+
+void simple_archiver_internal_free_writer_entry(void *data) {
+  SDArchiverInternalWriterEntry *entry = data;
+  if (entry) {
+    if (entry->path) {
+      free(entry->path);
+    }
+    if (entry->username) {
+      free(entry->username);
+    }
+    if (entry->groupname) {
+      free(entry->groupname);
+    }
+    if (entry->link_target) {
+      free(entry->link_target);
+    }
+    free(entry);
+  }
+}
+
+/// Takes ownership of "out_f".
+SDArchiverWriter *simple_archiver_internal_writer_begin(
+    SDArchiverIOStream *out_f,
+    const SDArchiverState *state) {
+  if (!out_f || !state || !state->parsed) {
+    simple_archiver_io_stream_free(&out_f);
+    return NULL;
+  }
+
+  SDArchiverWriter *writer = malloc(sizeof(SDArchiverWriter));
+  writer->out_f = out_f;
+  writer->state = state;
+  writer->dirs = simple_archiver_list_init();
+  writer->symlinks = simple_archiver_list_init();
+  writer->files = simple_archiver_list_init();
+  writer->paths = simple_archiver_hash_map_init();
+  writer->parent_dirs = simple_archiver_hash_map_init();
+  writer->is_finished = 0;
+
+  return writer;
+}
+
+SDArchiverWriter *simple_archiver_writer_begin(FILE *out_f,
+                                               const SDArchiverState *state) {
+  return simple_archiver_internal_writer_begin(
+    simple_archiver_io_stream_init_FILE(out_f, 1), state);
+}
+
+SDArchiverWriter *simple_archiver_writer_begin_io(
+    SDArchiverIO *io,
+    const SDArchiverState *state) {
+  return simple_archiver_internal_writer_begin(
+    simple_archiver_io_stream_init(io, 1), state);
+}
+
+void simple_archiver_writer_free(SDArchiverWriter **writer) {
+  if (writer && *writer) {
+    simple_archiver_io_stream_free(&(*writer)->out_f);
+    simple_archiver_list_free(&(*writer)->dirs);
+    simple_archiver_list_free(&(*writer)->symlinks);
+    simple_archiver_list_free(&(*writer)->files);
+    simple_archiver_hash_map_free(&(*writer)->paths);
+    simple_archiver_hash_map_free(&(*writer)->parent_dirs);
+    free(*writer);
+    *writer = NULL;
+  }
+}
+
+/// Returns NULL if "path" or "meta" is invalid.
+SDArchiverInternalWriterEntry *simple_archiver_internal_writer_new_entry(
+    SDArchiverWriter *writer,
+    const char *path,
+    const SDArchiverWriterMeta *meta) {
+  if (!writer || writer->is_finished || !path || !meta) {
+    return NULL;
+  }
+
+  const size_t path_len = strlen(path);
+  if (path_len == 0 || path_len >= 0xFFFF) {
+    fprintf(stderr, "ERROR: Writer entry path has invalid length!\n");
+    return NULL;
+  } else if (simple_archiver_validate_file_path(path) != 0
+      || path[path_len - 1] == '/') {
+    fprintf(stderr, "ERROR: Writer entry path \"%s\" is invalid!\n", path);
+    return NULL;
+  } else if ((meta->username && strlen(meta->username) >= 0xFFFF)
+      || (meta->groupname && strlen(meta->groupname) >= 0xFFFF)) {
+    fprintf(stderr,
+            "ERROR: Writer entry \"%s\" username/groupname is too long!\n",
+            path);
+    return NULL;
+  } else if (simple_archiver_hash_map_get(writer->paths, path, path_len + 1)) {
+    fprintf(stderr, "ERROR: Writer entry \"%s\" already added!\n", path);
+    return NULL;
+  }
+
+  int sentinel = 1;
+  simple_archiver_hash_map_insert(writer->paths,
+                                  &sentinel,
+                                  strdup(path),
+                                  path_len + 1,
+                                  simple_archiver_helper_datastructure_cleanup_nop,
+                                  NULL);
+
+  for (size_t idx = path_len; idx-- > 0;) {
+    if (path[idx] == '/') {
+      if (!simple_archiver_hash_map_get(writer->parent_dirs, path, idx)) {
+        char *parent = malloc(idx + 1);
+        memcpy(parent, path, idx);
+        parent[idx] = 0;
+        simple_archiver_hash_map_insert(
+          writer->parent_dirs,
+          &sentinel,
+          parent,
+          idx,
+          simple_archiver_helper_datastructure_cleanup_nop,
+          NULL);
+      }
+      break;
+    }
+  }
+
+  SDArchiverInternalWriterEntry *entry =
+    malloc(sizeof(SDArchiverInternalWriterEntry));
+  memset(entry, 0, sizeof(SDArchiverInternalWriterEntry));
+  entry->path = strdup(path);
+  entry->username = meta->username ? strdup(meta->username) : NULL;
+  entry->groupname = meta->groupname ? strdup(meta->groupname) : NULL;
+  entry->uid = meta->uid;
+  entry->gid = meta->gid;
+  entry->permissions = meta->permissions;
+
+  return entry;
+}
+
+SDArchiverStateRetStruct simple_archiver_writer_add_dir(
+    SDArchiverWriter *writer,
+    const char *path,
+    const SDArchiverWriterMeta *meta) {
+  SDArchiverInternalWriterEntry *entry =
+    simple_archiver_internal_writer_new_entry(writer, path, meta);
+  if (!entry) {
+    return SDA_RET_STRUCT(SDAS_INVALID_WRITER_ENTRY);
+  }
+
+  simple_archiver_list_add(writer->dirs,
+                           entry,
+                           simple_archiver_internal_free_writer_entry);
+  return SDA_RET_STRUCT(SDAS_SUCCESS);
+}
+
+SDArchiverStateRetStruct simple_archiver_writer_add_symlink(
+    SDArchiverWriter *writer,
+    const char *path,
+    const char *target,
+    const SDArchiverWriterMeta *meta) {
+  if (!target || target[0] == 0 || strlen(target) >= 0xFFFF) {
+    fprintf(stderr, "ERROR: Writer symlink target is invalid!\n");
+    return SDA_RET_STRUCT(SDAS_INVALID_WRITER_ENTRY);
+  }
+
+  SDArchiverInternalWriterEntry *entry =
+    simple_archiver_internal_writer_new_entry(writer, path, meta);
+  if (!entry) {
+    return SDA_RET_STRUCT(SDAS_INVALID_WRITER_ENTRY);
+  }
+  entry->link_target = strdup(target);
+
+  simple_archiver_list_add(writer->symlinks,
+                           entry,
+                           simple_archiver_internal_free_writer_entry);
+  return SDA_RET_STRUCT(SDAS_SUCCESS);
+}
+
+SDArchiverStateRetStruct simple_archiver_writer_add_file_buf(
+    SDArchiverWriter *writer,
+    const char *path,
+    const void *buf,
+    uint64_t size,
+    const SDArchiverWriterMeta *meta) {
+  if (!buf && size != 0) {
+    return SDA_RET_STRUCT(SDAS_INVALID_WRITER_ENTRY);
+  }
+
+  SDArchiverInternalWriterEntry *entry =
+    simple_archiver_internal_writer_new_entry(writer, path, meta);
+  if (!entry) {
+    return SDA_RET_STRUCT(SDAS_INVALID_WRITER_ENTRY);
+  }
+  entry->buf = buf ? buf : "";
+  entry->size = size;
+
+  simple_archiver_list_add(writer->files,
+                           entry,
+                           simple_archiver_internal_free_writer_entry);
+  return SDA_RET_STRUCT(SDAS_SUCCESS);
+}
+
+SDArchiverStateRetStruct simple_archiver_writer_add_file_fn(
+    SDArchiverWriter *writer,
+    const char *path,
+    uint64_t size,
+    SDArchiverWriterReadFn read_fn,
+    void *ud,
+    const SDArchiverWriterMeta *meta) {
+  if (!read_fn) {
+    return SDA_RET_STRUCT(SDAS_INVALID_WRITER_ENTRY);
+  }
+
+  SDArchiverInternalWriterEntry *entry =
+    simple_archiver_internal_writer_new_entry(writer, path, meta);
+  if (!entry) {
+    return SDA_RET_STRUCT(SDAS_INVALID_WRITER_ENTRY);
+  }
+  entry->read_fn = read_fn;
+  entry->read_ud = ud;
+  entry->size = size;
+
+  simple_archiver_list_add(writer->files,
+                           entry,
+                           simple_archiver_internal_free_writer_entry);
+  return SDA_RET_STRUCT(SDAS_SUCCESS);
+}
+
+/// Writes 16-bit length, then the string with its NULL, or a zero length if
+/// "str" is NULL.
+/// Returns zero on success.
+int simple_archiver_internal_writer_write_str(SDArchiverIOStream *out_f,
+                                              const char *str) {
+  uint16_t u16 = str ? (uint16_t)strlen(str) : 0;
+  const size_t len = u16;
+  simple_archiver_helper_16_bit_be(&u16);
+  if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
+    return 1;
+  } else if (str
+             && simple_archiver_io_write(str, 1, len + 1, out_f) != len + 1) {
+    return 1;
+  }
+  return 0;
+}
+
+/// Writes UID, GID, username, and groupname of "entry".
+/// Returns zero on success.
+int simple_archiver_internal_writer_write_owner(
+    SDArchiverIOStream *out_f,
+    const SDArchiverInternalWriterEntry *entry) {
+  uint32_t u32 = entry->uid;
+  simple_archiver_helper_32_bit_be(&u32);
+  if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
+    return 1;
+  }
+  u32 = entry->gid;
+  simple_archiver_helper_32_bit_be(&u32);
+  if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1) {
+    return 1;
+  } else if (simple_archiver_internal_writer_write_str(out_f,
+                                                       entry->username)) {
+    return 1;
+  } else if (simple_archiver_internal_writer_write_str(out_f,
+                                                       entry->groupname)) {
+    return 1;
+  }
+  return 0;
+}
+
+/// Gets the next piece of "entry"'s data starting at "*offset".
+/// "buf" must be at least SIMPLE_ARCHIVER_BUFFER_SIZE bytes, and is only used
+/// if "entry" was added with a read fn.
+SDArchiverStateReturns simple_archiver_internal_writer_next_data(
+    SDArchiverInternalWriterEntry *entry,
+    uint64_t *offset,
+    char *buf,
+    const char **out,
+    size_t *out_size) {
+  const uint64_t remaining = entry->size - *offset;
+  if (entry->buf) {
+    *out = entry->buf + *offset;
+    *out_size = remaining > 0x40000000 ? 0x40000000 : (size_t)remaining;
+  } else {
+    const uint64_t to_read = remaining > SIMPLE_ARCHIVER_BUFFER_SIZE
+                             ? SIMPLE_ARCHIVER_BUFFER_SIZE
+                             : remaining;
+    int64_t read_ret = entry->read_fn(entry->read_ud, buf, to_read);
+    if (read_ret <= 0 || (uint64_t)read_ret > to_read) {
+      fprintf(stderr,
+              "ERROR: Writer failed to get data of \"%s\"!\n",
+              entry->path);
+      return SDAS_INVALID_WRITER_ENTRY;
+    }
+    *out = buf;
+    *out_size = (size_t)read_ret;
+  }
+  *offset += *out_size;
+  return SDAS_SUCCESS;
+}
+
+/// Entries of a chunk given to "simple_archiver_internal_v7_compress_chunk".
+typedef struct SDArchiverInternalWriterChunk {
+  /// Advanced to each entry as it is given.
+  const SDArchiverLLNode *node;
+  SDArchiverInternalWriterEntry *entry;
+  uint64_t file_count;
+  uint64_t file_idx;
+  uint64_t offset;
+  char buf[SIMPLE_ARCHIVER_BUFFER_SIZE];
+} SDArchiverInternalWriterChunk;
+
+SDArchiverStateReturns simple_archiver_internal_writer_chunk_next(
+    void *ud,
+    const char **out,
+    size_t *out_size) {
+  SDArchiverInternalWriterChunk *chunk = ud;
+  while (!chunk->entry || chunk->offset == chunk->entry->size) {
+    if (chunk->file_idx == chunk->file_count) {
+      *out_size = 0;
+      return SDAS_SUCCESS;
+    }
+    chunk->node = chunk->node->next;
+    chunk->entry = chunk->node->data;
+    chunk->offset = 0;
+    ++chunk->file_idx;
+  }
+  return simple_archiver_internal_writer_next_data(
+    chunk->entry, &chunk->offset, chunk->buf, out, out_size);
+}
+
+SDArchiverStateRetStruct simple_archiver_writer_finish(
+    SDArchiverWriter *writer) {
+  if (!writer) {
+    return SDA_RET_STRUCT(SDAS_INVALID_PARSED_STATE);
+  } else if (writer->is_finished) {
+    return SDA_RET_STRUCT(SDAS_HEADER_ALREADY_WRITTEN);
+  }
+  writer->is_finished = 1;
+
+  const SDArchiverParsed *parsed = writer->state->parsed;
+  SDArchiverIOStream *out_f = writer->out_f;
+  uint8_t bytes[4];
+  uint16_t u16;
+  uint32_t u32;
+  uint64_t u64;
+
+  if (parsed->compressor && !parsed->decompressor) {
+    return SDA_RET_STRUCT(SDAS_NO_DECOMPRESSOR);
+  } else if (!parsed->compressor && parsed->decompressor) {
+    return SDA_RET_STRUCT(SDAS_NO_COMPRESSOR);
+  } else if (parsed->compressor
+      && (strlen(parsed->compressor) >= 0xFFFF
+        || strlen(parsed->decompressor) >= 0xFFFF)) {
+    fprintf(stderr, "ERROR: De/compressor cmd is too long!\n");
+    return SDA_RET_STRUCT(SDAS_INVALID_PARSED_STATE);
+  }
+  const int_fast8_t is_compressing = parsed->compressor ? 1 : 0;
+
+  if (simple_archiver_io_write("SIMPLE_ARCHIVE_VER", 1, 18, out_f) != 18) {
+    return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+  }
+  u16 = 7;
+  simple_archiver_helper_16_bit_be(&u16);
+  if (simple_archiver_io_write(&u16, 2, 1, out_f) != 1) {
+    return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+  }
+
+  memset(bytes, 0, 4);
+  bytes[0] = is_compressing ? 1 : 0;
+  if (simple_archiver_io_write(bytes, 1, 4, out_f) != 4) {
+    return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+  } else if (is_compressing
+      && (simple_archiver_internal_writer_write_str(out_f, parsed->compressor)
+        || simple_archiver_internal_writer_write_str(out_f,
+                                                     parsed->decompressor))) {
+    return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+  }
+
+  // Directories, parents must come first so order by path.
+  u64 = writer->dirs->count;
+  simple_archiver_helper_64_bit_be(&u64);
+  if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
+    return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+  }
+  {
+    __attribute__((cleanup(simple_archiver_btree_free)))
+    SDArchiverBTree *dirs_btree =
+      simple_archiver_btree_init(simple_archiver_internal_writer_path_less_fn);
+    for (SDArchiverLLNode *node = writer->dirs->head->next;
+         node != writer->dirs->tail;
+         node = node->next) {
+      simple_archiver_btree_insert(
+        dirs_btree,
+        node->data,
+        simple_archiver_helper_datastructure_cleanup_nop);
+    }
+    SDArchiverBTreeIter iter = simple_archiver_btree_begin(dirs_btree);
+    const SDArchiverInternalWriterEntry *entry;
+    while ((entry = simple_archiver_btree_iter_next(&iter))) {
+      const size_t path_len = strlen(entry->path);
+      u32 = (uint32_t)path_len;
+      simple_archiver_helper_32_bit_be(&u32);
+      bytes[0] = entry->permissions & 0xFF;
+      bytes[1] = ((entry->permissions & 0x100) >> 8)
+                 | ((entry->permissions & 0xE00) >> 7);
+      if (simple_archiver_hash_map_get(writer->parent_dirs,
+                                       entry->path,
+                                       path_len)) {
+        // Is a non-empty dir.
+        bytes[1] |= 2;
+      }
+      if (simple_archiver_io_write(&u32, 4, 1, out_f) != 1
+          || simple_archiver_io_write(entry->path, 1, path_len + 1, out_f)
+             != path_len + 1
+          || simple_archiver_io_write(bytes, 1, 2, out_f) != 2
+          || simple_archiver_internal_writer_write_owner(out_f, entry)) {
+        return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+      }
+    }
+  }
+
+  // Symlinks.
+  u64 = writer->symlinks->count;
+  simple_archiver_helper_64_bit_be(&u64);
+  if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
+    return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+  }
+  for (SDArchiverLLNode *node = writer->symlinks->head->next;
+       node != writer->symlinks->tail;
+       node = node->next) {
+    const SDArchiverInternalWriterEntry *entry = node->data;
+    const int_fast8_t is_abs = entry->link_target[0] == '/' ? 1 : 0;
+    bytes[0] = (uint8_t)(((entry->permissions & 0x7F) << 1) | (is_abs ? 1 : 0));
+    bytes[1] = (entry->permissions >> 7) & 0x3;
+    if (simple_archiver_io_write(bytes, 1, 2, out_f) != 2
+        || simple_archiver_internal_writer_write_str(out_f, entry->path)
+        || simple_archiver_internal_writer_write_str(
+             out_f, is_abs ? entry->link_target : NULL)
+        || simple_archiver_internal_writer_write_str(
+             out_f, is_abs ? NULL : entry->link_target)
+        || simple_archiver_internal_writer_write_owner(out_f, entry)) {
+      return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+    }
+  }
+
+  // Chunks, split the same way as "files_to_chunk_count".
+  __attribute__((cleanup(simple_archiver_list_free)))
+  SDArchiverLinkedList *chunk_counts = simple_archiver_list_init();
+  {
+    uint64_t current_size = 0;
+    uint64_t current_count = 0;
+    for (SDArchiverLLNode *node = writer->files->head->next;
+         node != writer->files->tail;
+         node = node->next) {
+      const SDArchiverInternalWriterEntry *entry = node->data;
+      ++current_count;
+      current_size += entry->size;
+      if (current_size >= parsed->minimum_chunk_size) {
+        uint64_t *count = malloc(sizeof(uint64_t));
+        *count = current_count;
+        simple_archiver_list_add(chunk_counts, count, NULL);
+        current_count = 0;
+        current_size = 0;
+      }
+    }
+    if (current_count > 0) {
+      uint64_t *count = malloc(sizeof(uint64_t));
+      *count = current_count;
+      simple_archiver_list_add(chunk_counts, count, NULL);
+    }
+  }
+
+  u64 = chunk_counts->count;
+  simple_archiver_helper_64_bit_be(&u64);
+  if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
+    return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+  }
+
+  char buf[SIMPLE_ARCHIVER_BUFFER_SIZE];
+  const SDArchiverLLNode *file_node = writer->files->head;
+  for (SDArchiverLLNode *chunk_c_node = chunk_counts->head->next;
+       chunk_c_node != chunk_counts->tail;
+       chunk_c_node = chunk_c_node->next) {
+    if (is_sig_int_occurred) {
+      return SDA_RET_STRUCT(SDAS_SIGINT);
+    }
+    const uint64_t file_count = *((uint64_t *)chunk_c_node->data);
+    u64 = file_count;
+    simple_archiver_helper_64_bit_be(&u64);
+    if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
+      return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+    }
+
+    uint64_t chunk_size = 0;
+    const SDArchiverLLNode *node = file_node;
+    for (uint64_t file_idx = 0; file_idx < file_count; ++file_idx) {
+      node = node->next;
+      const SDArchiverInternalWriterEntry *entry = node->data;
+      chunk_size += entry->size;
+      memset(bytes, 0, 4);
+      bytes[0] = entry->permissions & 0xFF;
+      bytes[1] = ((entry->permissions & 0x100) >> 8)
+                 | ((entry->permissions & 0xE00) >> 7);
+      u64 = entry->size;
+      simple_archiver_helper_64_bit_be(&u64);
+      if (simple_archiver_internal_writer_write_str(out_f, entry->path)
+          || simple_archiver_io_write(bytes, 1, 4, out_f) != 4
+          || simple_archiver_internal_writer_write_owner(out_f, entry)
+          || simple_archiver_io_write(&u64, 8, 1, out_f) != 1) {
+        return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+      }
+    }
+
+    // File format 6: two-byte bit-flags, compressed bit is always set.
+    bytes[0] = 1;
+    bytes[1] = 0;
+    if (simple_archiver_io_write(bytes, 1, 2, out_f) != 2) {
+      return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+    }
+
+    if (is_compressing) {
+      SDArchiverInternalWriterChunk chunk;
+      chunk.node = file_node;
+      chunk.entry = NULL;
+      chunk.file_count = file_count;
+      chunk.file_idx = 0;
+      chunk.offset = 0;
+      uint64_t compressed_size = 0;
+      SDA_RET_ON_ERROR_FN(simple_archiver_internal_v7_compress_chunk(
+        out_f,
+        parsed->compressor,
+        simple_archiver_internal_writer_chunk_next,
+        &chunk,
+        NULL,
+        &compressed_size));
+      file_node = node;
+      continue;
+    }
+
+    u64 = chunk_size;
+    simple_archiver_helper_64_bit_be(&u64);
+    if (simple_archiver_io_write(&u64, 8, 1, out_f) != 1
+        || simple_archiver_io_write("SA", 1, 2, out_f) != 2) {
+      return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+    }
+    for (uint64_t file_idx = 0; file_idx < file_count; ++file_idx) {
+      file_node = file_node->next;
+      SDArchiverInternalWriterEntry *entry = file_node->data;
+      uint64_t offset = 0;
+      while (offset < entry->size) {
+        if (is_sig_int_occurred) {
+          return SDA_RET_STRUCT(SDAS_SIGINT);
+        }
+        const char *data;
+        size_t data_size;
+        SDArchiverStateReturns ret = simple_archiver_internal_writer_next_data(
+          entry, &offset, buf, &data, &data_size);
+        if (ret != SDAS_SUCCESS) {
+          return SDA_RET_STRUCT(ret);
+        } else if (simple_archiver_io_write(data, 1, data_size, out_f)
+                   != data_size) {
+          return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+        }
+      }
+    }
+  }
+
+  if (simple_archiver_io_flush(out_f) != 0) {
+    return SDA_RET_STRUCT(SDAS_FAILED_TO_WRITE);
+  }
+  return SDA_RET_STRUCT(SDAS_SUCCESS);
+}
@@ -26,6 +26,7 @@
 // Local includes.
 #include "data_structures/hash_map.h"
 #include "data_structures/linked_list.h"
+#include "io.h"
 #include "parser.h"
 
 typedef struct SDArchiverState {
@@ -33,7 +34,7 @@ typedef struct SDArchiverState {
    */
   uint32_t flags;
   SDArchiverParsed *parsed;
-  FILE *out_f;
+  SDArchiverIOStream *out_f;
   SDArchiverHashMap *map;
   size_t count;
   uint64_t max;
@@ -64,6 +65,9 @@ typedef enum SDArchiverStateReturns {
   SDAS_DIR_ENTRY_WRITE_FAIL,
   SDAS_PERMISSION_SET_FAIL,
   SDAS_UID_GID_SET_FAIL,
+  SDAS_INVALID_WRITER_ENTRY,
+  SDAS_INVALID_IO,
+  SDAS_DELTA_REF_ERROR,
   SDAS_MAX_RETURN_VAL,
   SDAS_STATUS_RET_MASK = 0x3FFFFFFF,
   // Used by parse v. 1/2 functions.
@@ -92,6 +96,10 @@ typedef struct SDArchiverStateRetStruct {
 #define SDA_PSTATE_ACT_SIZE_KEY_SIZE 20
 #define SDA_PSTATE_NOT_CMP_SIZE_KEY "SDA_NotCompressed_Size_Key"
 #define SDA_PSTATE_NOT_CMP_SIZE_KEY_SIZE 27
+#define SDA_PSTATE_FILE_TIMES_KEY "SDA_File_Times_Key"
+#define SDA_PSTATE_FILE_TIMES_KEY_SIZE 19
+#define SDA_PSTATE_PRESSURE_KEY "SDA_Pressure_Key"
+#define SDA_PSTATE_PRESSURE_KEY_SIZE 17
 
 /// Returned pointer must not be freed.
 char *simple_archiver_error_to_string(enum SDArchiverStateReturns error);
@@ -104,68 +112,156 @@ SDArchiverStateRetStruct simple_archiver_write_all(
   FILE *out_f,
   SDArchiverState *state);
 
+/// Same as "simple_archiver_write_all" but writes to "io".
+/// Returns zero in "ret" field on success.
+SDArchiverStateRetStruct simple_archiver_write_all_io(
+  SDArchiverIO *io,
+  SDArchiverState *state);
+
 SDArchiverStateRetStruct simple_archiver_write_v0(
-  FILE *out_f,
+  SDArchiverIOStream *out_f,
   SDArchiverState *state,
   SDArchiverHashMap *write_state);
 
 SDArchiverStateRetStruct simple_archiver_write_v1(
-  FILE *out_f,
+  SDArchiverIOStream *out_f,
   SDArchiverState *state,
   SDArchiverHashMap *write_state);
 
 SDArchiverStateRetStruct simple_archiver_write_v2(
-  FILE *out_f,
+  SDArchiverIOStream *out_f,
   SDArchiverState *state,
   SDArchiverHashMap *write_state);
 
 SDArchiverStateRetStruct simple_archiver_write_v3(
-  FILE *out_f,
+  SDArchiverIOStream *out_f,
   SDArchiverState *state,
   SDArchiverHashMap *write_state);
 
 SDArchiverStateRetStruct simple_archiver_write_v4v5v6v7(
-  FILE *out_f,
+  SDArchiverIOStream *out_f,
   SDArchiverState *state,
   SDArchiverHashMap *write_state);
 
+/// Builds an archive from entries given by the caller instead of from files
+/// on disk. Use "simple_archiver_writer_begin", add entries, then call
+/// "simple_archiver_writer_finish".
+typedef struct SDArchiverWriter SDArchiverWriter;
+
+/// Metadata of an entry added to a SDArchiverWriter.
+typedef struct SDArchiverWriterMeta {
+  /// Same bit layout as "file_permissions" in SDArchiverParsed.
+  uint_fast16_t permissions;
+  uint32_t uid;
+  uint32_t gid;
+  /// May be NULL.
+  const char *username;
+  /// May be NULL.
+  const char *groupname;
+} SDArchiverWriterMeta;
+
+/// Fills "buf" with up to "buf_size" bytes of a file's data.
+/// Returns the number of bytes put into "buf", or negative on error.
+typedef int64_t (*SDArchiverWriterReadFn)(void *ud,
+                                          char *buf,
+                                          uint64_t buf_size);
+
+/// Always writes file format version 7. Uses "compressor", "decompressor", and
+/// "minimum_chunk_size" of "state->parsed".
+/// Returned pointer must be free'd with "simple_archiver_writer_free".
+SDArchiverWriter *simple_archiver_writer_begin(FILE *out_f,
+                                               const SDArchiverState *state);
+
+/// Same as "simple_archiver_writer_begin" but writes to "io".
+SDArchiverWriter *simple_archiver_writer_begin_io(SDArchiverIO *io,
+                                                  const SDArchiverState *state);
+void simple_archiver_writer_free(SDArchiverWriter **writer);
+
+/// Returns zero in "ret" field on success.
+SDArchiverStateRetStruct simple_archiver_writer_add_dir(
+  SDArchiverWriter *writer,
+  const char *path,
+  const SDArchiverWriterMeta *meta);
+
+/// A "target" starting with '/' is stored as an absolute link, otherwise it is
+/// stored as a relative link.
+/// Returns zero in "ret" field on success.
+SDArchiverStateRetStruct simple_archiver_writer_add_symlink(
+  SDArchiverWriter *writer,
+  const char *path,
+  const char *target,
+  const SDArchiverWriterMeta *meta);
+
+/// "buf" is not copied and must stay valid until
+/// "simple_archiver_writer_finish" returns.
+/// Returns zero in "ret" field on success.
+SDArchiverStateRetStruct simple_archiver_writer_add_file_buf(
+  SDArchiverWriter *writer,
+  const char *path,
+  const void *buf,
+  uint64_t size,
+  const SDArchiverWriterMeta *meta);
+
+/// "read_fn" is called by "simple_archiver_writer_finish" until exactly "size"
+/// bytes were given.
+/// Returns zero in "ret" field on success.
+SDArchiverStateRetStruct simple_archiver_writer_add_file_fn(
+  SDArchiverWriter *writer,
+  const char *path,
+  uint64_t size,
+  SDArchiverWriterReadFn read_fn,
+  void *ud,
+  const SDArchiverWriterMeta *meta);
+
+/// Writes the whole archive. No entries can be added afterwards.
+/// Returns zero in "ret" field on success.
+SDArchiverStateRetStruct simple_archiver_writer_finish(
+  SDArchiverWriter *writer);
+
 /// Returns zero in "ret" field on success.
 SDArchiverStateRetStruct simple_archiver_parse_archive_info(
   FILE *in_f,
   int_fast8_t do_extract,
   SDArchiverState *state);
 
+/// Same as "simple_archiver_parse_archive_info" but reads from "io".
+/// Returns zero in "ret" field on success.
+SDArchiverStateRetStruct simple_archiver_parse_archive_info_io(
+  SDArchiverIO *io,
+  int_fast8_t do_extract,
+  SDArchiverState *state);
+
 /// Returns zero in "ret" field on success.
 SDArchiverStateRetStruct simple_archiver_parse_archive_version_0(
-  FILE *in_f,
+  SDArchiverIOStream *in_f,
   int_fast8_t do_extract,
   const SDArchiverState *state,
   SDArchiverHashMap *parse_state);
 
 /// Returns zero in "ret" field on success.
 SDArchiverStateRetStruct simple_archiver_parse_archive_version_1(
-  FILE *in_f,
+  SDArchiverIOStream *in_f,
   int_fast8_t do_extract,
   const SDArchiverState *state,
   SDArchiverHashMap *parse_state);
 
 /// Returns zero in "ret" field on success.
 SDArchiverStateRetStruct simple_archiver_parse_archive_version_2(
-  FILE *in_f,
+  SDArchiverIOStream *in_f,
   int_fast8_t do_extract,
   const SDArchiverState *state,
   SDArchiverHashMap *parse_state);
 
 /// Returns zero in "ret" field on success.
 SDArchiverStateRetStruct simple_archiver_parse_archive_version_3(
-  FILE *in_f,
+  SDArchiverIOStream *in_f,
   int_fast8_t do_extract,
   const SDArchiverState *state,
   SDArchiverHashMap *parse_state);
 
 /// Returns zero in "ret" field on success.
 SDArchiverStateRetStruct simple_archiver_parse_archive_version_4_5_6_7(
-  FILE *in_f,
+  SDArchiverIOStream *in_f,
   int_fast8_t do_extract,
   const SDArchiverState *state,
   SDArchiverHashMap *parse_state);
@@ -0,0 +1,717 @@
+// ISC License
+//
+// Copyright (c) 2024-2026 Stephen Seo
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//
+// `bench.c` is the source for benchmarking code.
+
+// Standard library includes.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+// Unix includes.
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Local includes.
+#include "archiver.h"
+#include "data_structures/btree.h"
+#include "data_structures/priority_heap.h"
+#include "helpers.h"
+#include "io.h"
+#include "parser.h"
+
+#define SDA_BENCH_FILE_COUNT 64
+#define SDA_BENCH_FILE_SIZE 0x100000
+#define SDA_BENCH_ITERATIONS 5
+
+#define SDA_BENCH_PUMP_BULK_COUNT 4
+#define SDA_BENCH_PUMP_BULK_SIZE 0x400000
+#define SDA_BENCH_PUMP_SMALL_COUNT 256
+#define SDA_BENCH_PUMP_SMALL_SIZE 1024
+#define SDA_BENCH_PUMP_ITERATIONS 3
+
+#define SDA_BENCH_ORDER_COUNT 200000
+#define SDA_BENCH_ORDER_DIRS 256
+#define SDA_BENCH_ORDER_ITERATIONS 3
+
+/// Path of this executable, used to run it as a stand-in de/compressor.
+static char bench_self_path[4096];
+
+static double bench_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+}
+
+static void bench_print(const char *name, double ms, uint64_t bytes) {
+  printf("  %-24s %10.3f ms %10.1f MiB/s\n",
+         name,
+         ms,
+         ms > 0.0 ? (double)bytes / (double)0x100000 / (ms / 1000.0) : 0.0);
+}
+
+/// Suppresses the per-entry listing "simple_archiver_parse_archive_info"
+/// prints to stderr. Returns the fd to restore stderr with.
+static int bench_mute_stderr(void) {
+  fflush(stderr);
+  int saved = dup(STDERR_FILENO);
+  int null_fd = open("/dev/null", O_WRONLY);
+  if (null_fd >= 0) {
+    dup2(null_fd, STDERR_FILENO);
+    close(null_fd);
+  }
+  return saved;
+}
+
+static void bench_unmute_stderr(int saved) {
+  if (saved >= 0) {
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+  }
+}
+
+/// Writes the benchmark archive to "io", returns zero on success.
+static int bench_write_archive(SDArchiverIO *io,
+                               const SDArchiverState *state,
+                               const char *data) {
+  SDArchiverWriter *writer = simple_archiver_writer_begin_io(io, state);
+  if (!writer) {
+    return 1;
+  }
+  SDArchiverWriterMeta meta = {
+    .permissions = 0x4B, .uid = 0, .gid = 0, .username = NULL, .groupname = NULL
+  };
+  char name[32];
+  int ret = 0;
+  for (uint32_t idx = 0; idx < SDA_BENCH_FILE_COUNT; ++idx) {
+    snprintf(name, sizeof(name), "file_%" PRIu32, idx);
+    if (simple_archiver_writer_add_file_buf(writer,
+                                            name,
+                                            data,
+                                            SDA_BENCH_FILE_SIZE,
+                                            &meta).ret != SDAS_SUCCESS) {
+      ret = 1;
+    }
+  }
+  if (simple_archiver_writer_finish(writer).ret != SDAS_SUCCESS) {
+    ret = 1;
+  }
+  simple_archiver_writer_free(&writer);
+  return ret;
+}
+
+/// Compares I/O backends by writing and listing the same archive.
+static int bench_io_backends(void) {
+  printf("I/O backends (%d files of %d bytes, best of %d):\n",
+         SDA_BENCH_FILE_COUNT,
+         SDA_BENCH_FILE_SIZE,
+         SDA_BENCH_ITERATIONS);
+
+  SDArchiverParsed parsed = simple_archiver_create_parsed();
+  SDArchiverState *state = simple_archiver_init_state(&parsed);
+  char *data = malloc(SDA_BENCH_FILE_SIZE);
+  for (uint32_t idx = 0; idx < SDA_BENCH_FILE_SIZE; ++idx) {
+    data[idx] = (char)(idx * 31);
+  }
+
+  char tmp_name[] = "/tmp/simplearchiver_bench_XXXXXX";
+  int tmp_fd = mkstemp(tmp_name);
+  if (tmp_fd < 0) {
+    fprintf(stderr, "ERROR: Failed to create temporary file!\n");
+    free(data);
+    simple_archiver_free_state(&state);
+    simple_archiver_free_parsed(&parsed);
+    return 1;
+  }
+  unlink(tmp_name);
+  FILE *tmp_f = fdopen(dup(tmp_fd), "w+b");
+
+  const uint64_t total = (uint64_t)SDA_BENCH_FILE_COUNT * SDA_BENCH_FILE_SIZE;
+  double best[6] = {1e30, 1e30, 1e30, 1e30, 1e30, 1e30};
+  int ret = 0;
+  SDArchiverIO *mem_archive = NULL;
+
+  for (int iter = 0; iter < SDA_BENCH_ITERATIONS; ++iter) {
+    // Writing.
+    SDArchiverIO *ios[3];
+    ios[0] = simple_archiver_io_init_stdio(tmp_f);
+    ios[1] = simple_archiver_io_init_fd(tmp_fd);
+    ios[2] = simple_archiver_io_init_mem(NULL, 0);
+    for (int idx = 0; idx < 3; ++idx) {
+      int64_t offset = 0;
+      ios[idx]->seek(ios[idx]->ud, &offset, SEEK_SET);
+      double start = bench_now_ms();
+      ret |= bench_write_archive(ios[idx], state, data);
+      double elapsed = bench_now_ms() - start;
+      if (elapsed < best[idx]) {
+        best[idx] = elapsed;
+      }
+    }
+    simple_archiver_io_free(&ios[0]);
+    simple_archiver_io_free(&ios[1]);
+    simple_archiver_io_free(&mem_archive);
+    mem_archive = ios[2];
+
+    // Reading.
+    uint64_t archive_size = 0;
+    const char *archive = simple_archiver_io_mem_buf(mem_archive,
+                                                     &archive_size);
+    ios[0] = simple_archiver_io_init_stdio(tmp_f);
+    ios[1] = simple_archiver_io_init_fd(tmp_fd);
+    ios[2] = simple_archiver_io_init_mem(archive, archive_size);
+    for (int idx = 0; idx < 3; ++idx) {
+      int64_t offset = 0;
+      ios[idx]->seek(ios[idx]->ud, &offset, SEEK_SET);
+      int saved = bench_mute_stderr();
+      double start = bench_now_ms();
+      SDArchiverStateRetStruct parse_ret =
+        simple_archiver_parse_archive_info_io(ios[idx], 0, state);
+      double elapsed = bench_now_ms() - start;
+      bench_unmute_stderr(saved);
+      if (parse_ret.ret != SDAS_SUCCESS) {
+        ret = 1;
+      }
+      if (elapsed < best[3 + idx]) {
+        best[3 + idx] = elapsed;
+      }
+      simple_archiver_io_free(&ios[idx]);
+    }
+  }
+
+  bench_print("write stdio", best[0], total);
+  bench_print("write fd", best[1], total);
+  bench_print("write memory", best[2], total);
+  bench_print("list stdio", best[3], total);
+  bench_print("list fd", best[4], total);
+  bench_print("list memory", best[5], total);
+
+  simple_archiver_io_free(&mem_archive);
+  fclose(tmp_f);
+  close(tmp_fd);
+  free(data);
+  simple_archiver_free_state(&state);
+  simple_archiver_free_parsed(&parsed);
+
+  if (ret != 0) {
+    fprintf(stderr, "ERROR: I/O backend benchmark failed!\n");
+  }
+  return ret;
+}
+
+static int bench_write_all(int fd, const char *buf, size_t size) {
+  while (size > 0) {
+    ssize_t write_ret = write(fd, buf, size);
+    if (write_ret <= 0) {
+      return 1;
+    }
+    buf += write_ret;
+    size -= (size_t)write_ret;
+  }
+  return 0;
+}
+
+/// Stand-in de/compressors, run as "bench_simplearchiver --filter <name>".
+/// "throttled" copies 16KiB every 0.5ms, "bursty" holds 256KiB before writing
+/// it all at once, "pack" run-length encodes, and "expand" decodes "pack".
+/// Returns the exit code.
+static int bench_filter(const char *name) {
+  const struct timespec throttle_sleep = {.tv_sec = 0, .tv_nsec = 500000};
+  const struct timespec burst_sleep = {.tv_sec = 0, .tv_nsec = 2000000};
+  const size_t hold_size = 0x40000;
+  char *hold = malloc(hold_size);
+  char *out = malloc(hold_size * 128);
+  size_t held = 0;
+  int ret = 0;
+  ssize_t read_ret;
+
+  while (ret == 0
+         && (read_ret = read(STDIN_FILENO, hold + held, hold_size - held))
+              > 0) {
+    held += (size_t)read_ret;
+    if (strcmp(name, "throttled") == 0) {
+      if (held >= 0x4000) {
+        ret = bench_write_all(STDOUT_FILENO, hold, held);
+        held = 0;
+        nanosleep(&throttle_sleep, NULL);
+      }
+    } else if (strcmp(name, "bursty") == 0) {
+      if (held == hold_size) {
+        ret = bench_write_all(STDOUT_FILENO, hold, held);
+        held = 0;
+        nanosleep(&burst_sleep, NULL);
+      }
+    } else if (strcmp(name, "pack") == 0) {
+      // Pairs of (run length, byte), the last byte is kept for the next read.
+      size_t out_size = 0;
+      size_t idx = 0;
+      while (idx + 1 < held) {
+        size_t run = 1;
+        while (idx + run < held - 1
+               && run < 255
+               && hold[idx + run] == hold[idx]) {
+          ++run;
+        }
+        out[out_size++] = (char)run;
+        out[out_size++] = hold[idx];
+        idx += run;
+      }
+      memmove(hold, hold + idx, held - idx);
+      held -= idx;
+      ret = bench_write_all(STDOUT_FILENO, out, out_size);
+    } else if (strcmp(name, "expand") == 0) {
+      size_t out_size = 0;
+      size_t idx = 0;
+      for (; idx + 1 < held; idx += 2) {
+        memset(out + out_size, hold[idx + 1], (uint8_t)hold[idx]);
+        out_size += (uint8_t)hold[idx];
+      }
+      memmove(hold, hold + idx, held - idx);
+      held -= idx;
+      ret = bench_write_all(STDOUT_FILENO, out, out_size);
+    } else {
+      fprintf(stderr, "ERROR: Unknown filter \"%s\"!\n", name);
+      ret = 1;
+    }
+  }
+
+  if (ret == 0 && held > 0) {
+    if (strcmp(name, "pack") == 0) {
+      out[0] = 1;
+      out[1] = hold[0];
+      ret = bench_write_all(STDOUT_FILENO, out, 2);
+    } else if (strcmp(name, "expand") != 0) {
+      ret = bench_write_all(STDOUT_FILENO, hold, held);
+    }
+  }
+  free(hold);
+  free(out);
+  return ret;
+}
+
+static uint64_t bench_cpu_us(void) {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+         + (uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+/// Creates "dir/name" holding "count" files of "size" bytes each.
+/// Returns zero on success.
+static int bench_pump_make_files(const char *dir,
+                                 const char *name,
+                                 uint32_t count,
+                                 uint32_t size,
+                                 const char *data) {
+  char path[4200];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  if (mkdir(path, 0700) != 0) {
+    return 1;
+  }
+  for (uint32_t idx = 0; idx < count; ++idx) {
+    snprintf(path, sizeof(path), "%s/%s/file_%" PRIu32, dir, name, idx);
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+      return 1;
+    }
+    size_t fwrite_ret = fwrite(data, 1, size, f);
+    fclose(f);
+    if (fwrite_ret != size) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void bench_pump_remove_files(const char *dir,
+                                    const char *name,
+                                    uint32_t count) {
+  char path[4200];
+  for (uint32_t idx = 0; idx < count; ++idx) {
+    snprintf(path, sizeof(path), "%s/%s/file_%" PRIu32, dir, name, idx);
+    unlink(path);
+  }
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  rmdir(path);
+}
+
+/// Archives "dir/name" with the stand-in filters into "archive" when
+/// "is_create" is non-zero, otherwise lists "archive". Sets "ms" to the wall
+/// time and "cpu_ms" to the CPU time of this process.
+/// Returns zero on success.
+static int bench_pump_run(int_fast8_t is_create,
+                          const char *dir,
+                          const char *name,
+                          const char *archive,
+                          const char *compressor,
+                          const char *decompressor,
+                          double *ms,
+                          double *cpu_ms) {
+  char cwd[4200];
+  char comp_arg[4224];
+  char decomp_arg[4224];
+  snprintf(cwd, sizeof(cwd), "%s/%s", dir, name);
+  snprintf(comp_arg, sizeof(comp_arg), "--compressor=%s", compressor);
+  snprintf(decomp_arg, sizeof(decomp_arg), "--decompressor=%s", decompressor);
+  const char *create_args[] = {"bench", "-c", "-f", archive,
+                               "--overwrite-create", "--write-version=7",
+                               "--slow-files=0", comp_arg, decomp_arg, "-C",
+                               cwd, ".", NULL};
+  const char *list_args[] = {"bench", "-t", "-f", archive, NULL};
+
+  // Parsing the args also prints while walking the files.
+  int saved = bench_mute_stderr();
+  SDArchiverParsed parsed = simple_archiver_create_parsed();
+  if (simple_archiver_parse_args(is_create ? 12 : 4,
+                                 is_create ? create_args : list_args,
+                                 &parsed) != 0) {
+    bench_unmute_stderr(saved);
+    simple_archiver_free_parsed(&parsed);
+    return 1;
+  }
+  SDArchiverState *state = simple_archiver_init_state(&parsed);
+  FILE *f = fopen(archive, is_create ? "wb" : "rb");
+  int ret = f ? 0 : 1;
+  if (f) {
+    const uint64_t cpu_start = bench_cpu_us();
+    const double start = bench_now_ms();
+    SDArchiverStateRetStruct run_ret =
+      is_create
+      ? simple_archiver_write_all(f, state)
+      : simple_archiver_parse_archive_info(f, 0, state);
+    *ms = bench_now_ms() - start;
+    *cpu_ms = (double)(bench_cpu_us() - cpu_start) / 1000.0;
+    bench_unmute_stderr(saved);
+    saved = -1;
+    if ((run_ret.ret & SDAS_STATUS_RET_MASK) != SDAS_SUCCESS) {
+      fprintf(stderr,
+              "ERROR: %s with \"%s\" failed: %s\n",
+              is_create ? "Creating" : "Listing",
+              compressor,
+              simple_archiver_error_to_string(run_ret.ret
+                                              & SDAS_STATUS_RET_MASK));
+      ret = 1;
+    }
+    fclose(f);
+  }
+  bench_unmute_stderr(saved);
+  simple_archiver_free_state(&state);
+  simple_archiver_free_parsed(&parsed);
+  return ret;
+}
+
+/// Drives the compress and decompress pipe loops with stand-in commands.
+static int bench_pipe_pump(void) {
+  printf("Pipe pump (%d files of %d bytes, %d files of %d bytes, "
+         "best of %d):\n",
+         SDA_BENCH_PUMP_BULK_COUNT,
+         SDA_BENCH_PUMP_BULK_SIZE,
+         SDA_BENCH_PUMP_SMALL_COUNT,
+         SDA_BENCH_PUMP_SMALL_SIZE,
+         SDA_BENCH_PUMP_ITERATIONS);
+  if (bench_self_path[0] == 0 || strchr(bench_self_path, ' ')) {
+    fprintf(stderr, "ERROR: Cannot run stand-in filters from \"%s\"!\n",
+            bench_self_path);
+    return 1;
+  }
+
+  // Runs of equal bytes so that "pack" shrinks the data.
+  char *data = malloc(SDA_BENCH_PUMP_BULK_SIZE);
+  for (uint32_t idx = 0; idx < SDA_BENCH_PUMP_BULK_SIZE; ++idx) {
+    data[idx] = (char)((idx / 64) * 31);
+  }
+  char dir[] = "/tmp/simplearchiver_bench_XXXXXX";
+  if (!mkdtemp(dir)) {
+    fprintf(stderr, "ERROR: Failed to create temporary directory!\n");
+    free(data);
+    return 1;
+  }
+  char archive[64];
+  snprintf(archive, sizeof(archive), "%s/archive", dir);
+  int ret = bench_pump_make_files(dir,
+                                  "bulk",
+                                  SDA_BENCH_PUMP_BULK_COUNT,
+                                  SDA_BENCH_PUMP_BULK_SIZE,
+                                  data);
+  ret |= bench_pump_make_files(dir,
+                               "small",
+                               SDA_BENCH_PUMP_SMALL_COUNT,
+                               SDA_BENCH_PUMP_SMALL_SIZE,
+                               data);
+
+  const struct {
+    const char *name;
+    const char *compressor;
+    const char *decompressor;
+  } stand_ins[] = {
+    {"cat", "cat", "cat"},
+    {"throttled", "throttled", "throttled"},
+    {"bursty", "bursty", "bursty"},
+    {"expander", "pack", "expand"},
+  };
+
+  printf("  %-10s %-7s %12s %8s %12s %8s\n",
+         "stand-in", "op", "bulk MiB/s", "cpu", "small us/f", "cpu");
+  const size_t stand_in_count = sizeof(stand_ins) / sizeof(stand_ins[0]);
+  for (size_t idx = 0; ret == 0 && idx < stand_in_count; ++idx) {
+    char compressor[4200];
+    char decompressor[4200];
+    if (strcmp(stand_ins[idx].compressor, "cat") == 0) {
+      snprintf(compressor, sizeof(compressor), "cat");
+      snprintf(decompressor, sizeof(decompressor), "cat");
+    } else {
+      snprintf(compressor, sizeof(compressor), "%s --filter %s",
+               bench_self_path, stand_ins[idx].compressor);
+      snprintf(decompressor, sizeof(decompressor), "%s --filter %s",
+               bench_self_path, stand_ins[idx].decompressor);
+    }
+
+    // [create, list][bulk, small] best wall time and its CPU time.
+    double best[2][2] = {{1e30, 1e30}, {1e30, 1e30}};
+    double best_cpu[2][2] = {{0.0, 0.0}, {0.0, 0.0}};
+    for (int iter = 0; ret == 0 && iter < SDA_BENCH_PUMP_ITERATIONS; ++iter) {
+      for (int set = 0; ret == 0 && set < 2; ++set) {
+        for (int op = 0; ret == 0 && op < 2; ++op) {
+          double ms = 0.0;
+          double cpu_ms = 0.0;
+          ret = bench_pump_run(op == 0 ? 1 : 0,
+                               dir,
+                               set == 0 ? "bulk" : "small",
+                               archive,
+                               compressor,
+                               decompressor,
+                               &ms,
+                               &cpu_ms);
+          if (ms < best[op][set]) {
+            best[op][set] = ms;
+            best_cpu[op][set] = cpu_ms;
+          }
+        }
+      }
+    }
+
+    const double bulk_mib = (double)SDA_BENCH_PUMP_BULK_COUNT
+                            * SDA_BENCH_PUMP_BULK_SIZE / (double)0x100000;
+    for (int op = 0; ret == 0 && op < 2; ++op) {
+      printf("  %-10s %-7s %12.1f %7.1f%% %12.1f %7.1f%%\n",
+             stand_ins[idx].name,
+             op == 0 ? "create" : "list",
+             bulk_mib / (best[op][0] / 1000.0),
+             100.0 * best_cpu[op][0] / best[op][0],
+             1000.0 * best[op][1] / SDA_BENCH_PUMP_SMALL_COUNT,
+             100.0 * best_cpu[op][1] / best[op][1]);
+    }
+  }
+
+  bench_pump_remove_files(dir, "bulk", SDA_BENCH_PUMP_BULK_COUNT);
+  bench_pump_remove_files(dir, "small", SDA_BENCH_PUMP_SMALL_COUNT);
+  unlink(archive);
+  rmdir(dir);
+  free(data);
+
+  if (ret != 0) {
+    fprintf(stderr, "ERROR: Pipe pump benchmark failed!\n");
+  }
+  return ret;
+}
+
+typedef struct SDABenchOrderEntry {
+  char path[48];
+  uint64_t size;
+} SDABenchOrderEntry;
+
+static int bench_order_strcmp_less(void *a, void *b) {
+  return strcmp(((SDABenchOrderEntry *)a)->path,
+                ((SDABenchOrderEntry *)b)->path) < 0;
+}
+
+static int bench_order_size_greater(void *a, void *b) {
+  return ((SDABenchOrderEntry *)a)->size > ((SDABenchOrderEntry *)b)->size;
+}
+
+static const char *bench_order_to_str(const void *data) {
+  return ((const SDABenchOrderEntry *)data)->path;
+}
+
+static int bench_order_count_fn(void *data, void *ud) {
+  *((uint64_t *)ud) += ((SDABenchOrderEntry *)data)->size;
+  return 0;
+}
+
+/// Fills and drains a heap and a B-tree with the same entries in the orders
+/// used to write files, and compares selecting one subtree by prefix.
+static int bench_ordering(void) {
+  printf("Ordering (%d entries, best of %d):\n",
+         SDA_BENCH_ORDER_COUNT,
+         SDA_BENCH_ORDER_ITERATIONS);
+
+  SDABenchOrderEntry *entries =
+    malloc(sizeof(SDABenchOrderEntry) * SDA_BENCH_ORDER_COUNT);
+  uint64_t rand = 1;
+  for (uint32_t idx = 0; idx < SDA_BENCH_ORDER_COUNT; ++idx) {
+    rand = rand * 6364136223846793005ULL + 1442695040888963407ULL;
+    snprintf(entries[idx].path,
+             sizeof(entries[idx].path),
+             "dir_%03" PRIu32 "/file_%08" PRIx32,
+             (uint32_t)((rand >> 33) % SDA_BENCH_ORDER_DIRS),
+             (uint32_t)(rand >> 20));
+    entries[idx].size = (rand >> 40) % 0x100000;
+  }
+
+  const struct {
+    const char *name;
+    int (*less_fn)(void *, void *);
+  } orders[] = {
+    {"by name", bench_order_strcmp_less},
+    {"by size", bench_order_size_greater},
+  };
+
+  printf("  %-10s %14s %14s\n", "order", "heap ms", "btree ms");
+  for (size_t order = 0; order < sizeof(orders) / sizeof(orders[0]);
+       ++order) {
+    double best_heap = 1e30;
+    double best_btree = 1e30;
+    for (int iter = 0; iter < SDA_BENCH_ORDER_ITERATIONS; ++iter) {
+      double start = bench_now_ms();
+      SDArchiverPHeap *heap =
+        simple_archiver_priority_heap_init_less_generic_fn(
+          orders[order].less_fn);
+      for (uint32_t idx = 0; idx < SDA_BENCH_ORDER_COUNT; ++idx) {
+        simple_archiver_priority_heap_insert(
+          heap, 0, entries + idx,
+          simple_archiver_helper_datastructure_cleanup_nop);
+      }
+      while (simple_archiver_priority_heap_pop(heap)) {
+      }
+      simple_archiver_priority_heap_free(&heap);
+      double ms = bench_now_ms() - start;
+      if (ms < best_heap) {
+        best_heap = ms;
+      }
+
+      start = bench_now_ms();
+      SDArchiverBTree *btree =
+        simple_archiver_btree_init(orders[order].less_fn);
+      for (uint32_t idx = 0; idx < SDA_BENCH_ORDER_COUNT; ++idx) {
+        simple_archiver_btree_insert(
+          btree, entries + idx,
+          simple_archiver_helper_datastructure_cleanup_nop);
+      }
+      while (simple_archiver_btree_pop_first(btree)) {
+      }
+      simple_archiver_btree_free(&btree);
+      ms = bench_now_ms() - start;
+      if (ms < best_btree) {
+        best_btree = ms;
+      }
+    }
+    printf("  %-10s %14.3f %14.3f\n",
+           orders[order].name, best_heap, best_btree);
+  }
+
+  // Selecting one dir from a heap means popping everything and filtering.
+  SDArchiverPHeap *heap =
+    simple_archiver_priority_heap_init_less_generic_fn(
+      bench_order_strcmp_less);
+  SDArchiverBTree *btree = simple_archiver_btree_init(bench_order_strcmp_less);
+  for (uint32_t idx = 0; idx < SDA_BENCH_ORDER_COUNT; ++idx) {
+    simple_archiver_btree_insert(
+      btree, entries + idx, simple_archiver_helper_datastructure_cleanup_nop);
+  }
+  double best_heap = 1e30;
+  double best_btree = 1e30;
+  uint64_t heap_sum = 0;
+  uint64_t btree_sum = 0;
+  for (int iter = 0; iter < SDA_BENCH_ORDER_ITERATIONS; ++iter) {
+    for (uint32_t idx = 0; idx < SDA_BENCH_ORDER_COUNT; ++idx) {
+      simple_archiver_priority_heap_insert(
+        heap, 0, entries + idx,
+        simple_archiver_helper_datastructure_cleanup_nop);
+    }
+    heap_sum = 0;
+    double start = bench_now_ms();
+    SDABenchOrderEntry *entry;
+    while ((entry = simple_archiver_priority_heap_pop(heap))) {
+      if (strncmp(entry->path, "dir_042/", 8) == 0) {
+        heap_sum += entry->size;
+      }
+    }
+    double ms = bench_now_ms() - start;
+    if (ms < best_heap) {
+      best_heap = ms;
+    }
+
+    btree_sum = 0;
+    start = bench_now_ms();
+    simple_archiver_btree_prefix_iter(btree, "dir_042/", bench_order_to_str,
+                                      bench_order_count_fn, &btree_sum);
+    ms = bench_now_ms() - start;
+    if (ms < best_btree) {
+      best_btree = ms;
+    }
+  }
+  printf("  %-10s %14.3f %14.3f\n", "one dir", best_heap, best_btree);
+  simple_archiver_priority_heap_free(&heap);
+  simple_archiver_btree_free(&btree);
+  free(entries);
+
+  if (heap_sum != btree_sum) {
+    fprintf(stderr, "ERROR: Ordering benchmark subtree mismatch!\n");
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc == 3 && strcmp(argv[1], "--filter") == 0) {
+    return bench_filter(argv[2]);
+  }
+  ssize_t self_len =
+    readlink("/proc/self/exe", bench_self_path, sizeof(bench_self_path) - 1);
+  bench_self_path[self_len > 0 ? self_len : 0] = 0;
+
+  // Runs every benchmark, or only those named in the args.
+  const struct {
+    const char *name;
+    int (*fn)(void);
+  } benches[] = {
+    {"io", bench_io_backends},
+    {"pump", bench_pipe_pump},
+    {"order", bench_ordering},
+  };
+  const size_t bench_count = sizeof(benches) / sizeof(benches[0]);
+
+  int ret = 0;
+  for (size_t idx = 0; idx < bench_count; ++idx) {
+    int_fast8_t selected = argc <= 1 ? 1 : 0;
+    for (int arg_idx = 1; arg_idx < argc; ++arg_idx) {
+      if (strcmp(argv[arg_idx], benches[idx].name) == 0) {
+        selected = 1;
+      }
+    }
+    if (selected) {
+      ret |= benches[idx].fn();
+    }
+  }
+  return ret;
+}
@@ -0,0 +1,145 @@
+// ISC License
+//
+// Copyright (c) 2024-2026 Stephen Seo
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//
+// `arena.c` is the source for an arena (bump) allocator.
+
+#include "arena.h"
+
+#include <stdlib.h>
+
+#define SC_SA_DS_ARENA_ALIGN 16
+
+/// Size of the block header, padded so that block data is aligned.
+static const size_t SC_SA_DS_ARENA_HEADER_SIZE =
+  (sizeof(SDArchiverArenaBlock) + SC_SA_DS_ARENA_ALIGN - 1)
+  & ~(size_t)(SC_SA_DS_ARENA_ALIGN - 1);
+
+SDArchiverArenaBlock *simple_archiver_arena_internal_new_block(size_t size) {
+  SDArchiverArenaBlock *block = malloc(SC_SA_DS_ARENA_HEADER_SIZE + size);
+  if (!block) {
+    return NULL;
+  }
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+void simple_archiver_arena_internal_free_blocks(SDArchiverArenaBlock *block) {
+  while (block) {
+    SDArchiverArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+}
+
+SDArchiverArena *simple_archiver_arena_init(size_t block_size) {
+  SDArchiverArena *arena = malloc(sizeof(SDArchiverArena));
+  arena->blocks = NULL;
+  arena->current = NULL;
+  arena->large_blocks = NULL;
+  arena->block_size =
+    block_size == 0 ? SC_SA_DS_ARENA_DEFAULT_BLOCK_SIZE : block_size;
+  arena->used = 0;
+  return arena;
+}
+
+void simple_archiver_arena_free_single_ptr(SDArchiverArena *arena) {
+  if (arena) {
+    simple_archiver_arena_internal_free_blocks(arena->blocks);
+    simple_archiver_arena_internal_free_blocks(arena->large_blocks);
+    free(arena);
+  }
+}
+
+void simple_archiver_arena_free(SDArchiverArena **arena) {
+  if (arena && *arena) {
+    simple_archiver_arena_free_single_ptr(*arena);
+    *arena = NULL;
+  }
+}
+
+void *simple_archiver_arena_alloc(SDArchiverArena *arena, size_t size) {
+  if (size == 0) {
+    return NULL;
+  }
+  const size_t padded =
+    (size + SC_SA_DS_ARENA_ALIGN - 1) & ~(size_t)(SC_SA_DS_ARENA_ALIGN - 1);
+  if (padded < size) {
+    return NULL;
+  }
+
+  SDArchiverArenaBlock *block;
+  if (padded > arena->block_size) {
+    block = simple_archiver_arena_internal_new_block(padded);
+    if (!block) {
+      return NULL;
+    }
+    block->next = arena->large_blocks;
+    arena->large_blocks = block;
+  } else {
+    block = arena->current;
+    while (block && block->size - block->used < padded) {
+      // Blocks after "current" are empty ones kept by a reset.
+      block = block->next;
+    }
+    if (!block) {
+      block = simple_archiver_arena_internal_new_block(arena->block_size);
+      if (!block) {
+        return NULL;
+      }
+      if (arena->current) {
+        block->next = arena->current->next;
+        arena->current->next = block;
+      } else {
+        arena->blocks = block;
+      }
+    }
+    arena->current = block;
+  }
+
+  void *ptr = (char *)block + SC_SA_DS_ARENA_HEADER_SIZE + block->used;
+  block->used += padded;
+  arena->used += size;
+  return ptr;
+}
+
+void simple_archiver_arena_unalloc_last(SDArchiverArena *arena, size_t size) {
+  if (size == 0) {
+    return;
+  }
+  const size_t padded =
+    (size + SC_SA_DS_ARENA_ALIGN - 1) & ~(size_t)(SC_SA_DS_ARENA_ALIGN - 1);
+  if (padded > arena->block_size) {
+    SDArchiverArenaBlock *block = arena->large_blocks;
+    arena->large_blocks = block->next;
+    free(block);
+  } else {
+    arena->current->used -= padded;
+  }
+  arena->used -= size;
+}
+
+void simple_archiver_arena_reset(SDArchiverArena *arena) {
+  for (SDArchiverArenaBlock *block = arena->blocks; block;
+       block = block->next) {
+    block->used = 0;
+  }
+  arena->current = arena->blocks;
+  simple_archiver_arena_internal_free_blocks(arena->large_blocks);
+  arena->large_blocks = NULL;
+  arena->used = 0;
+}
@@ -0,0 +1,69 @@
+// ISC License
+//
+// Copyright (c) 2024-2026 Stephen Seo
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//
+// `arena.h` is the header for an arena (bump) allocator.
+
+#ifndef SEODISPARATE_COM_SIMPLE_ARCHIVER_DATA_STRUCTURE_ARENA_H_
+#define SEODISPARATE_COM_SIMPLE_ARCHIVER_DATA_STRUCTURE_ARENA_H_
+
+#define SC_SA_DS_ARENA_DEFAULT_BLOCK_SIZE 1048576
+
+// Standard library includes.
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct SDArchiverArenaBlock {
+  struct SDArchiverArenaBlock *next;
+  size_t size;
+  size_t used;
+} SDArchiverArenaBlock;
+
+/// Hands out memory from large blocks, and frees all of it at once.
+typedef struct SDArchiverArena {
+  /// Blocks of "block_size" bytes.
+  SDArchiverArenaBlock *blocks;
+  /// Block that allocations are currently taken from.
+  SDArchiverArenaBlock *current;
+  /// Blocks for allocations larger than "block_size", one each.
+  SDArchiverArenaBlock *large_blocks;
+  size_t block_size;
+  /// Number of bytes handed out since init or the last reset.
+  uint64_t used;
+} SDArchiverArena;
+
+/// If "block_size" is zero, SC_SA_DS_ARENA_DEFAULT_BLOCK_SIZE is used.
+SDArchiverArena *simple_archiver_arena_init(size_t block_size);
+
+/// It is recommended to use the double-pointer version of arena free as that
+/// will ensure the variable holding the pointer will end up pointing to NULL
+/// after free.
+void simple_archiver_arena_free_single_ptr(SDArchiverArena *arena);
+void simple_archiver_arena_free(SDArchiverArena **arena);
+
+/// Returned memory is aligned for any basic type and must not be free'd. It
+/// stays valid until the arena is reset or free'd.
+/// Returns NULL if "size" is zero or on error.
+void *simple_archiver_arena_alloc(SDArchiverArena *arena, size_t size);
+
+/// Gives back the latest allocation of "arena", which was "size" bytes, so the
+/// next allocation reuses its memory.
+void simple_archiver_arena_unalloc_last(SDArchiverArena *arena, size_t size);
+
+/// Invalidates all memory handed out. Blocks of "block_size" are kept to be
+/// reused and larger blocks are free'd.
+void simple_archiver_arena_reset(SDArchiverArena *arena);
+
+#endif
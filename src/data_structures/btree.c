@@ -0,0 +1,371 @@
+// ISC License
+//
+// Copyright (c) 2024-2026 Stephen Seo
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//
+// `btree.c` is the source for an ordered B+tree implementation.
+
+#include "btree.h"
+
+// Standard library includes.
+#include <stdlib.h>
+#include <string.h>
+
+int simple_archiver_btree_internal_less(const SDArchiverBTree *btree,
+                                        void *a, void *b) {
+  if (btree->less_fn_ud) {
+    return btree->less_fn_ud(a, b, btree->ud);
+  }
+  return btree->less_fn(a, b);
+}
+
+SDArchiverBTreeNode *simple_archiver_btree_internal_node_init(int is_leaf) {
+  SDArchiverBTreeNode *node = malloc(sizeof(SDArchiverBTreeNode));
+  node->next = NULL;
+  node->count = 0;
+  node->is_leaf = is_leaf;
+  return node;
+}
+
+void simple_archiver_btree_internal_node_free(SDArchiverBTreeNode *node) {
+  if (node->is_leaf) {
+    for (uint32_t idx = 0; idx < node->count; ++idx) {
+      if (node->links[idx].data_cleanup_fn) {
+        node->links[idx].data_cleanup_fn(node->items[idx]);
+      } else {
+        free(node->items[idx]);
+      }
+    }
+  } else {
+    for (uint32_t idx = 0; idx < node->count; ++idx) {
+      simple_archiver_btree_internal_node_free(node->links[idx].child);
+    }
+  }
+  free(node);
+}
+
+/// Returns the first index from "start" whose item is ordered after "data",
+/// or "count" if there is none.
+uint32_t simple_archiver_btree_internal_upper_bound(
+    const SDArchiverBTree *btree,
+    const SDArchiverBTreeNode *node,
+    void *data,
+    uint32_t start) {
+  uint32_t low = start;
+  uint32_t high = node->count;
+  while (low < high) {
+    const uint32_t mid = low + (high - low) / 2;
+    if (simple_archiver_btree_internal_less(btree, data, node->items[mid])) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+  return low;
+}
+
+/// Returns the first index from "start" whose item is not ordered before
+/// "key", or "count" if there is none.
+uint32_t simple_archiver_btree_internal_lower_bound_idx(
+    const SDArchiverBTreeNode *node,
+    const void *key,
+    int (*cmp_fn)(const void *, const void *, void *),
+    void *ud,
+    uint32_t start) {
+  uint32_t low = start;
+  uint32_t high = node->count;
+  while (low < high) {
+    const uint32_t mid = low + (high - low) / 2;
+    if (cmp_fn(key, node->items[mid], ud) <= 0) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+  return low;
+}
+
+/// Splits the full child at "idx" of "parent" into two halves.
+void simple_archiver_btree_internal_split(SDArchiverBTreeNode *parent,
+                                          uint32_t idx) {
+  SDArchiverBTreeNode *left = parent->links[idx].child;
+  SDArchiverBTreeNode *right =
+    simple_archiver_btree_internal_node_init(left->is_leaf);
+  const uint32_t half = SC_SA_DS_BTREE_ORDER / 2;
+
+  right->count = left->count - half;
+  memcpy(right->items, left->items + half, sizeof(void *) * right->count);
+  memcpy(right->links,
+         left->links + half,
+         sizeof(SDArchiverBTreeLink) * right->count);
+  left->count = half;
+  if (left->is_leaf) {
+    right->next = left->next;
+    left->next = right;
+  }
+
+  memmove(parent->items + idx + 2,
+          parent->items + idx + 1,
+          sizeof(void *) * (parent->count - idx - 1));
+  memmove(parent->links + idx + 2,
+          parent->links + idx + 1,
+          sizeof(SDArchiverBTreeLink) * (parent->count - idx - 1));
+  parent->items[idx + 1] = right->items[0];
+  parent->links[idx + 1].child = right;
+  ++parent->count;
+}
+
+/// Removes the first leaf from the subtree at "node" if it is empty, along
+/// with any inner nodes left without children.
+/// Returns non-zero if "node" itself is now empty.
+int simple_archiver_btree_internal_remove_empty_first(
+    SDArchiverBTreeNode *node) {
+  if (node->is_leaf) {
+    return node->count == 0;
+  }
+  SDArchiverBTreeNode *child = node->links[0].child;
+  if (simple_archiver_btree_internal_remove_empty_first(child)) {
+    free(child);
+    --node->count;
+    memmove(node->items, node->items + 1, sizeof(void *) * node->count);
+    memmove(node->links,
+            node->links + 1,
+            sizeof(SDArchiverBTreeLink) * node->count);
+  }
+  return node->count == 0;
+}
+
+SDArchiverBTreeIter simple_archiver_btree_internal_lower_bound(
+    const SDArchiverBTree *btree,
+    const void *key,
+    int (*cmp_fn)(const void *, const void *, void *),
+    void *ud) {
+  SDArchiverBTreeIter iter = {NULL, 0};
+  if (!btree || !btree->root) {
+    return iter;
+  }
+
+  // Items of an inner node are lower bounds of their children, so go into the
+  // last child whose first item is ordered before "key". The first item not
+  // ordered before "key" is then in that child or starts the next leaf.
+  SDArchiverBTreeNode *node = btree->root;
+  while (!node->is_leaf) {
+    const uint32_t idx =
+      simple_archiver_btree_internal_lower_bound_idx(node, key, cmp_fn, ud, 1);
+    node = node->links[idx - 1].child;
+  }
+
+  iter.node = node;
+  iter.idx =
+    simple_archiver_btree_internal_lower_bound_idx(node, key, cmp_fn, ud, 0);
+  return iter;
+}
+
+int simple_archiver_btree_internal_cmp_plain(const void *key,
+                                             const void *data,
+                                             void *ud) {
+  int (**cmp_fn)(const void *, const void *) = ud;
+  return (*cmp_fn)(key, data);
+}
+
+int simple_archiver_btree_internal_cmp_prefix(const void *key,
+                                              const void *data,
+                                              void *ud) {
+  const char *(**to_str_fn)(const void *) = ud;
+  return strcmp(key, (*to_str_fn)(data));
+}
+
+SDArchiverBTree *simple_archiver_btree_init(int (*less_fn)(void *, void *)) {
+  SDArchiverBTree *btree = malloc(sizeof(SDArchiverBTree));
+  btree->root = NULL;
+  btree->first = NULL;
+  btree->size = 0;
+  btree->less_fn = less_fn;
+  btree->less_fn_ud = NULL;
+  btree->ud = NULL;
+  return btree;
+}
+
+SDArchiverBTree *simple_archiver_btree_init_ud(
+    int (*less_fn)(void *, void *, void *), void *ud) {
+  SDArchiverBTree *btree = simple_archiver_btree_init(NULL);
+  btree->less_fn_ud = less_fn;
+  btree->ud = ud;
+  return btree;
+}
+
+void simple_archiver_btree_free_single_ptr(SDArchiverBTree *btree) {
+  if (btree) {
+    if (btree->root) {
+      simple_archiver_btree_internal_node_free(btree->root);
+    }
+    free(btree);
+  }
+}
+
+void simple_archiver_btree_free(SDArchiverBTree **btree) {
+  if (btree && *btree) {
+    simple_archiver_btree_free_single_ptr(*btree);
+    *btree = NULL;
+  }
+}
+
+void simple_archiver_btree_insert(SDArchiverBTree *btree, void *data,
+                                  void (*data_cleanup_fn)(void *)) {
+  if (!btree->root) {
+    btree->root = simple_archiver_btree_internal_node_init(1);
+    btree->first = btree->root;
+  } else if (btree->root->count == SC_SA_DS_BTREE_ORDER) {
+    SDArchiverBTreeNode *root = simple_archiver_btree_internal_node_init(0);
+    root->count = 1;
+    root->items[0] = btree->root->items[0];
+    root->links[0].child = btree->root;
+    simple_archiver_btree_internal_split(root, 0);
+    btree->root = root;
+  }
+
+  // Full nodes are split on the way down so that a parent always has room.
+  SDArchiverBTreeNode *node = btree->root;
+  while (!node->is_leaf) {
+    uint32_t idx =
+      simple_archiver_btree_internal_upper_bound(btree, node, data, 1) - 1;
+    if (node->links[idx].child->count == SC_SA_DS_BTREE_ORDER) {
+      simple_archiver_btree_internal_split(node, idx);
+      if (!simple_archiver_btree_internal_less(btree,
+                                               data,
+                                               node->items[idx + 1])) {
+        ++idx;
+      }
+    }
+    node = node->links[idx].child;
+  }
+
+  const uint32_t idx =
+    simple_archiver_btree_internal_upper_bound(btree, node, data, 0);
+  memmove(node->items + idx + 1,
+          node->items + idx,
+          sizeof(void *) * (node->count - idx));
+  memmove(node->links + idx + 1,
+          node->links + idx,
+          sizeof(SDArchiverBTreeLink) * (node->count - idx));
+  node->items[idx] = data;
+  node->links[idx].data_cleanup_fn = data_cleanup_fn;
+  ++node->count;
+  ++btree->size;
+}
+
+uint64_t simple_archiver_btree_size(const SDArchiverBTree *btree) {
+  return btree ? btree->size : 0;
+}
+
+void *simple_archiver_btree_first(const SDArchiverBTree *btree) {
+  if (!btree || btree->size == 0) {
+    return NULL;
+  }
+  return btree->first->items[0];
+}
+
+void *simple_archiver_btree_pop_first(SDArchiverBTree *btree) {
+  if (!btree || btree->size == 0) {
+    return NULL;
+  }
+
+  SDArchiverBTreeNode *leaf = btree->first;
+  void *data = leaf->items[0];
+  --leaf->count;
+  memmove(leaf->items, leaf->items + 1, sizeof(void *) * leaf->count);
+  memmove(leaf->links,
+          leaf->links + 1,
+          sizeof(SDArchiverBTreeLink) * leaf->count);
+  --btree->size;
+
+  // Nodes are not rebalanced as only the front shrinks. Empty nodes are
+  // removed and a root with one child is replaced by that child.
+  if (leaf->count == 0) {
+    btree->first = leaf->next;
+    if (simple_archiver_btree_internal_remove_empty_first(btree->root)) {
+      free(btree->root);
+      btree->root = NULL;
+      btree->first = NULL;
+    }
+    while (btree->root && !btree->root->is_leaf && btree->root->count == 1) {
+      SDArchiverBTreeNode *root = btree->root;
+      btree->root = root->links[0].child;
+      free(root);
+    }
+  }
+
+  return data;
+}
+
+SDArchiverBTreeIter simple_archiver_btree_begin(const SDArchiverBTree *btree) {
+  SDArchiverBTreeIter iter = {btree ? btree->first : NULL, 0};
+  return iter;
+}
+
+void *simple_archiver_btree_iter_next(SDArchiverBTreeIter *iter) {
+  while (iter->node && iter->idx >= iter->node->count) {
+    iter->node = iter->node->next;
+    iter->idx = 0;
+  }
+  if (!iter->node) {
+    return NULL;
+  }
+  return iter->node->items[iter->idx++];
+}
+
+SDArchiverBTreeIter simple_archiver_btree_lower_bound(
+    const SDArchiverBTree *btree,
+    const void *key,
+    int (*cmp_fn)(const void *key, const void *data)) {
+  return simple_archiver_btree_internal_lower_bound(
+    btree, key, simple_archiver_btree_internal_cmp_plain, &cmp_fn);
+}
+
+int simple_archiver_btree_prefix_iter(const SDArchiverBTree *btree,
+                                      const char *prefix,
+                                      const char *(*to_str_fn)(const void *),
+                                      int (*iter_fn)(void *data, void *ud),
+                                      void *ud) {
+  // Strings starting with "prefix" are contiguous in "strcmp" order and begin
+  // at the first string not less than "prefix".
+  SDArchiverBTreeIter iter = simple_archiver_btree_internal_lower_bound(
+    btree, prefix, simple_archiver_btree_internal_cmp_prefix, &to_str_fn);
+  const size_t prefix_size = strlen(prefix);
+  void *data;
+  while ((data = simple_archiver_btree_iter_next(&iter))) {
+    if (strncmp(to_str_fn(data), prefix, prefix_size) != 0) {
+      break;
+    }
+    const int ret = iter_fn(data, ud);
+    if (ret != 0) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+int simple_archiver_btree_iter(const SDArchiverBTree *btree,
+                               int (*iter_fn)(void *data, void *ud),
+                               void *ud) {
+  SDArchiverBTreeIter iter = simple_archiver_btree_begin(btree);
+  void *data;
+  while ((data = simple_archiver_btree_iter_next(&iter))) {
+    const int ret = iter_fn(data, ud);
+    if (ret != 0) {
+      return ret;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+// ISC License
+//
+// Copyright (c) 2024-2026 Stephen Seo
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//
+// `btree.h` is the header for an ordered B+tree implementation.
+
+#ifndef SEODISPARATE_COM_SIMPLE_ARCHIVER_DATA_STRUCTURE_BTREE_H_
+#define SEODISPARATE_COM_SIMPLE_ARCHIVER_DATA_STRUCTURE_BTREE_H_
+
+// Standard library includes.
+#include <stdint.h>
+
+/// Max number of items in a leaf or children in an inner node.
+#define SC_SA_DS_BTREE_ORDER 32
+
+struct SDArchiverBTreeNode;
+
+typedef union SDArchiverBTreeLink {
+  /// Used by leaves.
+  void (*data_cleanup_fn)(void *);
+  /// Used by inner nodes.
+  struct SDArchiverBTreeNode *child;
+} SDArchiverBTreeLink;
+
+typedef struct SDArchiverBTreeNode {
+  /// Next leaf in order, NULL for inner nodes and the last leaf.
+  struct SDArchiverBTreeNode *next;
+  uint32_t count;
+  /// Is non-zero if a leaf.
+  int is_leaf;
+  /// Data of a leaf, or the smallest data of each child of an inner node.
+  void *items[SC_SA_DS_BTREE_ORDER];
+  SDArchiverBTreeLink links[SC_SA_DS_BTREE_ORDER];
+} SDArchiverBTreeNode;
+
+/// Keeps data sorted by a "less" function on the data. Data that compares
+/// equal keeps its insertion order.
+typedef struct SDArchiverBTree {
+  SDArchiverBTreeNode *root;
+  /// First leaf, the start of ordered iteration.
+  SDArchiverBTreeNode *first;
+  uint64_t size;
+  int (*less_fn)(void *, void *);
+  int (*less_fn_ud)(void *, void *, void *);
+  void *ud;
+} SDArchiverBTree;
+
+/// Position of an item in a SDArchiverBTree. Invalidated by insert and pop.
+typedef struct SDArchiverBTreeIter {
+  SDArchiverBTreeNode *node;
+  uint32_t idx;
+} SDArchiverBTreeIter;
+
+/// "less_fn" returns non-zero if a is ordered before b.
+SDArchiverBTree *simple_archiver_btree_init(int (*less_fn)(void *, void *));
+/// Same as "simple_archiver_btree_init" but "less_fn" is also given "ud".
+SDArchiverBTree *simple_archiver_btree_init_ud(
+    int (*less_fn)(void *, void *, void *), void *ud);
+
+/// It is recommended to use the double-pointer version of btree free as that
+/// will ensure the variable holding the pointer will end up pointing to NULL
+/// after free.
+void simple_archiver_btree_free_single_ptr(SDArchiverBTree *btree);
+void simple_archiver_btree_free(SDArchiverBTree **btree);
+
+/// "data" must not be NULL.
+/// If data_cleanup_fn is NULL, then "free()" is used on data when freed.
+/// "data" is placed after every item that compares equal to it.
+void simple_archiver_btree_insert(SDArchiverBTree *btree, void *data,
+                                  void (*data_cleanup_fn)(void *));
+
+uint64_t simple_archiver_btree_size(const SDArchiverBTree *btree);
+
+/// Returns NULL if empty or if btree is NULL.
+void *simple_archiver_btree_first(const SDArchiverBTree *btree);
+
+/// Returns NULL if empty or if btree is NULL.
+/// When data is popped, the data_cleanup_fn is ignored and the user must take
+/// ownership of the returned data pointer.
+void *simple_archiver_btree_pop_first(SDArchiverBTree *btree);
+
+/// Returns an iterator at the first item.
+SDArchiverBTreeIter simple_archiver_btree_begin(const SDArchiverBTree *btree);
+
+/// Returns the data at "iter" and advances it, or NULL at the end.
+void *simple_archiver_btree_iter_next(SDArchiverBTreeIter *iter);
+
+/// Returns an iterator at the first item that "cmp_fn" does not order before
+/// "key". "cmp_fn" returns negative, zero, or positive if "key" is less than,
+/// equal to, or greater than "data", and must agree with the tree's order.
+SDArchiverBTreeIter simple_archiver_btree_lower_bound(
+    const SDArchiverBTree *btree,
+    const void *key,
+    int (*cmp_fn)(const void *key, const void *data));
+
+/// Calls "iter_fn" in order on every item whose string starts with "prefix".
+/// The tree must be ordered by "strcmp" of "to_str_fn" of its data.
+/// Stops early and returns the value of "iter_fn" if it returns non-zero.
+/// Returns zero otherwise.
+int simple_archiver_btree_prefix_iter(const SDArchiverBTree *btree,
+                                      const char *prefix,
+                                      const char *(*to_str_fn)(const void *),
+                                      int (*iter_fn)(void *data, void *ud),
+                                      void *ud);
+
+/// Calls "iter_fn" in order on every item.
+/// Stops early and returns the value of "iter_fn" if it returns non-zero.
+/// Returns zero otherwise.
+int simple_archiver_btree_iter(const SDArchiverBTree *btree,
+                               int (*iter_fn)(void *data, void *ud),
+                               void *ud);
+
+#endif
@@ -0,0 +1,199 @@
+// ISC License
+//
+// Copyright (c) 2024-2026 Stephen Seo
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//
+// `concurrent_hash_map.c` is the source for a thread-safe hash map
+// implementation.
+
+#include "concurrent_hash_map.h"
+
+#include <stdlib.h>
+
+SDArchiverCHashMapShard *simple_archiver_chash_map_internal_shard(
+    SDArchiverCHashMap *chash_map, const void *key, size_t key_size) {
+  // The inner hash maps use the low bits of the same hash for their buckets,
+  // so pick the shard with the high bits.
+  uint64_t hash = chash_map->hash_fn(key, key_size) >> 32;
+  return chash_map->shards + (hash % chash_map->shards_size);
+}
+
+SDArchiverCHashMap *simple_archiver_chash_map_init(size_t shards) {
+  return simple_archiver_chash_map_init_custom_hasher(
+      shards, simple_archiver_hash_default_fn);
+}
+
+SDArchiverCHashMap *simple_archiver_chash_map_init_custom_hasher(
+    size_t shards, uint64_t (*hash_fn)(const void *, size_t)) {
+  if (shards == 0) {
+    shards = SC_SA_DS_CHASH_MAP_DEFAULT_SHARDS;
+  }
+
+  SDArchiverCHashMap *chash_map = malloc(sizeof(SDArchiverCHashMap));
+  chash_map->shards = calloc(shards, sizeof(SDArchiverCHashMapShard));
+  chash_map->shards_size = 0;
+  chash_map->hash_fn = hash_fn;
+
+  for (size_t idx = 0; idx < shards; ++idx) {
+    SDArchiverCHashMapShard *shard = chash_map->shards + idx;
+    if (pthread_mutex_init(&shard->mutex, NULL) != 0) {
+      simple_archiver_chash_map_free_single_ptr(chash_map);
+      return NULL;
+    }
+    shard->map = simple_archiver_hash_map_init_custom_hasher(hash_fn);
+    shard->count = 0;
+    chash_map->shards_size = idx + 1;
+  }
+
+  return chash_map;
+}
+
+void simple_archiver_chash_map_free_single_ptr(SDArchiverCHashMap *chash_map) {
+  if (chash_map) {
+    for (size_t idx = 0; idx < chash_map->shards_size; ++idx) {
+      simple_archiver_hash_map_free(&chash_map->shards[idx].map);
+      pthread_mutex_destroy(&chash_map->shards[idx].mutex);
+    }
+    free(chash_map->shards);
+    free(chash_map);
+  }
+}
+
+void simple_archiver_chash_map_free(SDArchiverCHashMap **chash_map) {
+  if (chash_map && *chash_map) {
+    simple_archiver_chash_map_free_single_ptr(*chash_map);
+    *chash_map = NULL;
+  }
+}
+
+int simple_archiver_chash_map_insert(SDArchiverCHashMap *chash_map,
+                                     void *value, void *key, size_t key_size,
+                                     void (*value_cleanup_fn)(void *),
+                                     void (*key_cleanup_fn)(void *)) {
+  SDArchiverCHashMapShard *shard =
+      simple_archiver_chash_map_internal_shard(chash_map, key, key_size);
+
+  pthread_mutex_lock(&shard->mutex);
+  int ret = simple_archiver_hash_map_insert(shard->map, value, key, key_size,
+                                            value_cleanup_fn, key_cleanup_fn);
+  if (ret == 0) {
+    ++shard->count;
+  }
+  pthread_mutex_unlock(&shard->mutex);
+
+  return ret;
+}
+
+int simple_archiver_chash_map_insert_if_absent(
+    SDArchiverCHashMap *chash_map, void *value, void *key, size_t key_size,
+    void (*value_cleanup_fn)(void *), void (*key_cleanup_fn)(void *)) {
+  SDArchiverCHashMapShard *shard =
+      simple_archiver_chash_map_internal_shard(chash_map, key, key_size);
+
+  pthread_mutex_lock(&shard->mutex);
+  if (simple_archiver_hash_map_get(shard->map, key, key_size)) {
+    pthread_mutex_unlock(&shard->mutex);
+    if (value) {
+      if (value_cleanup_fn) {
+        value_cleanup_fn(value);
+      } else {
+        free(value);
+      }
+    }
+    if (key) {
+      if (key_cleanup_fn) {
+        key_cleanup_fn(key);
+      } else {
+        free(key);
+      }
+    }
+    return 1;
+  }
+  int ret = simple_archiver_hash_map_insert(shard->map, value, key, key_size,
+                                            value_cleanup_fn, key_cleanup_fn);
+  if (ret == 0) {
+    ++shard->count;
+  }
+  pthread_mutex_unlock(&shard->mutex);
+
+  return ret == 0 ? 0 : 2;
+}
+
+void *simple_archiver_chash_map_get(SDArchiverCHashMap *chash_map,
+                                    const void *key, size_t key_size) {
+  SDArchiverCHashMapShard *shard =
+      simple_archiver_chash_map_internal_shard(chash_map, key, key_size);
+
+  pthread_mutex_lock(&shard->mutex);
+  void *value = simple_archiver_hash_map_get(shard->map, key, key_size);
+  pthread_mutex_unlock(&shard->mutex);
+
+  return value;
+}
+
+int simple_archiver_chash_map_internal_count_fn(
+    __attribute__((unused)) const void *key,
+    __attribute__((unused)) size_t key_size,
+    __attribute__((unused)) const void *value, void *ud) {
+  ++*((size_t *)ud);
+  return 0;
+}
+
+int simple_archiver_chash_map_remove(SDArchiverCHashMap *chash_map, void *key,
+                                     size_t key_size) {
+  SDArchiverCHashMapShard *shard =
+      simple_archiver_chash_map_internal_shard(chash_map, key, key_size);
+
+  pthread_mutex_lock(&shard->mutex);
+  int ret = simple_archiver_hash_map_remove(shard->map, key, key_size);
+  if (ret == 0 && shard->count > 0) {
+    --shard->count;
+  } else if (ret == 1) {
+    // More than one entry was removed, so recount this shard.
+    shard->count = 0;
+    simple_archiver_hash_map_iter(
+        shard->map, simple_archiver_chash_map_internal_count_fn,
+        &shard->count);
+  }
+  pthread_mutex_unlock(&shard->mutex);
+
+  return ret;
+}
+
+size_t simple_archiver_chash_map_count(SDArchiverCHashMap *chash_map) {
+  size_t count = 0;
+  for (size_t idx = 0; idx < chash_map->shards_size; ++idx) {
+    pthread_mutex_lock(&chash_map->shards[idx].mutex);
+    count += chash_map->shards[idx].count;
+    pthread_mutex_unlock(&chash_map->shards[idx].mutex);
+  }
+  return count;
+}
+
+int simple_archiver_chash_map_iter(SDArchiverCHashMap *chash_map,
+                                   int (*iter_check_fn)(const void *, size_t,
+                                                        const void *, void *),
+                                   void *user_data) {
+  for (size_t idx = 0; idx < chash_map->shards_size; ++idx) {
+    SDArchiverCHashMapShard *shard = chash_map->shards + idx;
+    pthread_mutex_lock(&shard->mutex);
+    int ret = simple_archiver_hash_map_iter(shard->map, iter_check_fn,
+                                            user_data);
+    pthread_mutex_unlock(&shard->mutex);
+    if (ret != 0) {
+      return ret;
+    }
+  }
+  return 0;
+}
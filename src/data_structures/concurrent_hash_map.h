@@ -0,0 +1,96 @@
+// ISC License
+//
+// Copyright (c) 2024-2026 Stephen Seo
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//
+// `concurrent_hash_map.h` is the header for a thread-safe hash map
+// implementation.
+
+#ifndef SEODISPARATE_COM_SIMPLE_ARCHIVER_DATA_STRUCTURE_CONCURRENT_HASH_MAP_H_
+#define SEODISPARATE_COM_SIMPLE_ARCHIVER_DATA_STRUCTURE_CONCURRENT_HASH_MAP_H_
+
+#define SC_SA_DS_CHASH_MAP_DEFAULT_SHARDS 16
+
+// Standard library includes.
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Local includes.
+#include "hash_map.h"
+
+typedef struct SDArchiverCHashMapShard {
+  pthread_mutex_t mutex;
+  SDArchiverHashMap *map;
+  size_t count;
+} SDArchiverCHashMapShard;
+
+/// A hash map split into shards, each a SDArchiverHashMap behind its own
+/// mutex, so threads working on keys in different shards do not contend.
+/// Keys and values follow the same ownership rules as SDArchiverHashMap.
+typedef struct SDArchiverCHashMap {
+  SDArchiverCHashMapShard *shards;
+  size_t shards_size;
+  uint64_t (*hash_fn)(const void *, size_t);
+} SDArchiverCHashMap;
+
+/// If "shards" is zero, SC_SA_DS_CHASH_MAP_DEFAULT_SHARDS is used.
+/// Returns NULL on error.
+SDArchiverCHashMap *simple_archiver_chash_map_init(size_t shards);
+
+/// Same as "simple_archiver_hash_map_init_custom_hasher" but for the
+/// concurrent hash map. The high 32 bits of the hash pick the shard.
+SDArchiverCHashMap *simple_archiver_chash_map_init_custom_hasher(
+    size_t shards, uint64_t (*hash_fn)(const void *, size_t));
+
+/// Must not be called while other threads still use the hash map.
+void simple_archiver_chash_map_free_single_ptr(SDArchiverCHashMap *chash_map);
+void simple_archiver_chash_map_free(SDArchiverCHashMap **chash_map);
+
+/// Same as "simple_archiver_hash_map_insert".
+/// Returns zero on success.
+int simple_archiver_chash_map_insert(SDArchiverCHashMap *chash_map,
+                                     void *value, void *key, size_t key_size,
+                                     void (*value_cleanup_fn)(void *),
+                                     void (*key_cleanup_fn)(void *));
+
+/// Inserts only if "key" is not already in the hash map, checked and inserted
+/// while holding the shard's lock.
+/// Returns zero if inserted. Returns one if the key already existed, in which
+/// case the value and key are freed with the given functions (or "free" if
+/// NULL). Otherwise returns non-zero and non-one value on error.
+int simple_archiver_chash_map_insert_if_absent(
+    SDArchiverCHashMap *chash_map, void *value, void *key, size_t key_size,
+    void (*value_cleanup_fn)(void *), void (*key_cleanup_fn)(void *));
+
+/// Returns NULL if not found.
+/// The returned value is only valid while no other thread removes its key.
+void *simple_archiver_chash_map_get(SDArchiverCHashMap *chash_map,
+                                    const void *key, size_t key_size);
+
+/// Same as "simple_archiver_hash_map_remove".
+int simple_archiver_chash_map_remove(SDArchiverCHashMap *chash_map, void *key,
+                                     size_t key_size);
+
+/// Returns the number of entries over all shards.
+size_t simple_archiver_chash_map_count(SDArchiverCHashMap *chash_map);
+
+/// Same as "simple_archiver_hash_map_iter", locking one shard at a time.
+/// "iter_check_fn" must not call other functions on the same hash map.
+int simple_archiver_chash_map_iter(SDArchiverCHashMap *chash_map,
+                                   int (*iter_check_fn)(const void *, size_t,
+                                                        const void *, void *),
+                                   void *user_data);
+
+#endif
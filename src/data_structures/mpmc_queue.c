@@ -0,0 +1,161 @@
+// ISC License
+//
+// Copyright (c) 2024-2026 Stephen Seo
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//
+// `mpmc_queue.c` is the source for a bounded multi-producer multi-consumer
+// queue implementation.
+
+#include "mpmc_queue.h"
+
+#include <stdlib.h>
+
+SDArchiverMPMCQueue *simple_archiver_mpmc_queue_init(size_t capacity) {
+  if (capacity == 0) {
+    return NULL;
+  }
+
+  SDArchiverMPMCQueue *queue = malloc(sizeof(SDArchiverMPMCQueue));
+  if (pthread_mutex_init(&queue->mutex, NULL) != 0) {
+    free(queue);
+    return NULL;
+  } else if (pthread_cond_init(&queue->not_empty, NULL) != 0) {
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue);
+    return NULL;
+  } else if (pthread_cond_init(&queue->not_full, NULL) != 0) {
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue);
+    return NULL;
+  }
+  queue->ring = malloc(sizeof(void *) * capacity);
+  queue->capacity = capacity;
+  queue->head = 0;
+  queue->size = 0;
+  queue->closed = 0;
+
+  return queue;
+}
+
+void simple_archiver_mpmc_queue_free_single_ptr(
+    SDArchiverMPMCQueue *queue, void (*data_cleanup_fn)(void *)) {
+  if (queue) {
+    for (size_t idx = 0; idx < queue->size; ++idx) {
+      void *data = queue->ring[(queue->head + idx) % queue->capacity];
+      if (data_cleanup_fn) {
+        data_cleanup_fn(data);
+      } else {
+        free(data);
+      }
+    }
+    free(queue->ring);
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue);
+  }
+}
+
+void simple_archiver_mpmc_queue_free(SDArchiverMPMCQueue **queue,
+                                     void (*data_cleanup_fn)(void *)) {
+  if (queue && *queue) {
+    simple_archiver_mpmc_queue_free_single_ptr(*queue, data_cleanup_fn);
+    *queue = NULL;
+  }
+}
+
+/// Mutex must be held and the queue must not be full.
+void simple_archiver_mpmc_queue_internal_push(SDArchiverMPMCQueue *queue,
+                                              void *data) {
+  queue->ring[(queue->head + queue->size) % queue->capacity] = data;
+  ++queue->size;
+  pthread_cond_signal(&queue->not_empty);
+}
+
+/// Mutex must be held and the queue must not be empty.
+void *simple_archiver_mpmc_queue_internal_pop(SDArchiverMPMCQueue *queue) {
+  void *data = queue->ring[queue->head];
+  queue->head = (queue->head + 1) % queue->capacity;
+  --queue->size;
+  pthread_cond_signal(&queue->not_full);
+  return data;
+}
+
+int simple_archiver_mpmc_queue_push(SDArchiverMPMCQueue *queue, void *data) {
+  pthread_mutex_lock(&queue->mutex);
+  while (queue->size == queue->capacity && !queue->closed) {
+    pthread_cond_wait(&queue->not_full, &queue->mutex);
+  }
+  if (queue->closed) {
+    pthread_mutex_unlock(&queue->mutex);
+    return 1;
+  }
+  simple_archiver_mpmc_queue_internal_push(queue, data);
+  pthread_mutex_unlock(&queue->mutex);
+  return 0;
+}
+
+int simple_archiver_mpmc_queue_try_push(SDArchiverMPMCQueue *queue,
+                                        void *data) {
+  pthread_mutex_lock(&queue->mutex);
+  if (queue->closed) {
+    pthread_mutex_unlock(&queue->mutex);
+    return 2;
+  } else if (queue->size == queue->capacity) {
+    pthread_mutex_unlock(&queue->mutex);
+    return 1;
+  }
+  simple_archiver_mpmc_queue_internal_push(queue, data);
+  pthread_mutex_unlock(&queue->mutex);
+  return 0;
+}
+
+void *simple_archiver_mpmc_queue_pop(SDArchiverMPMCQueue *queue) {
+  pthread_mutex_lock(&queue->mutex);
+  while (queue->size == 0 && !queue->closed) {
+    pthread_cond_wait(&queue->not_empty, &queue->mutex);
+  }
+  void *data = NULL;
+  if (queue->size != 0) {
+    data = simple_archiver_mpmc_queue_internal_pop(queue);
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  return data;
+}
+
+void *simple_archiver_mpmc_queue_try_pop(SDArchiverMPMCQueue *queue) {
+  pthread_mutex_lock(&queue->mutex);
+  void *data = NULL;
+  if (queue->size != 0) {
+    data = simple_archiver_mpmc_queue_internal_pop(queue);
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  return data;
+}
+
+void simple_archiver_mpmc_queue_close(SDArchiverMPMCQueue *queue) {
+  pthread_mutex_lock(&queue->mutex);
+  queue->closed = 1;
+  pthread_cond_broadcast(&queue->not_empty);
+  pthread_cond_broadcast(&queue->not_full);
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+size_t simple_archiver_mpmc_queue_size(SDArchiverMPMCQueue *queue) {
+  pthread_mutex_lock(&queue->mutex);
+  size_t size = queue->size;
+  pthread_mutex_unlock(&queue->mutex);
+  return size;
+}
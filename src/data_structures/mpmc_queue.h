@@ -0,0 +1,75 @@
+// ISC License
+//
+// Copyright (c) 2024-2026 Stephen Seo
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//
+// `mpmc_queue.h` is the header for a bounded multi-producer multi-consumer
+// queue implementation.
+
+#ifndef SEODISPARATE_COM_SIMPLE_ARCHIVER_DATA_STRUCTURE_MPMC_QUEUE_H_
+#define SEODISPARATE_COM_SIMPLE_ARCHIVER_DATA_STRUCTURE_MPMC_QUEUE_H_
+
+// Standard library includes.
+#include <pthread.h>
+#include <stddef.h>
+
+/// A fixed-size ring of pointers guarded by one mutex. Producers block while
+/// it is full and consumers block while it is empty, until it is closed.
+typedef struct SDArchiverMPMCQueue {
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  void **ring;
+  size_t capacity;
+  size_t head;
+  size_t size;
+  /// Is non-zero once closed.
+  int closed;
+} SDArchiverMPMCQueue;
+
+/// Returns NULL on error or if "capacity" is zero.
+SDArchiverMPMCQueue *simple_archiver_mpmc_queue_init(size_t capacity);
+
+/// Must not be called while other threads still use the queue.
+/// Data still in the queue is freed with "data_cleanup_fn", or "free" if NULL.
+void simple_archiver_mpmc_queue_free_single_ptr(
+    SDArchiverMPMCQueue *queue, void (*data_cleanup_fn)(void *));
+void simple_archiver_mpmc_queue_free(SDArchiverMPMCQueue **queue,
+                                     void (*data_cleanup_fn)(void *));
+
+/// "data" must not be NULL. Blocks while the queue is full.
+/// Returns zero on success. Returns non-zero if the queue is closed, in which
+/// case the caller keeps ownership of "data".
+int simple_archiver_mpmc_queue_push(SDArchiverMPMCQueue *queue, void *data);
+
+/// Returns zero on success. Returns one if the queue is full. Returns two if
+/// the queue is closed. The caller keeps ownership of "data" on non-zero.
+int simple_archiver_mpmc_queue_try_push(SDArchiverMPMCQueue *queue,
+                                        void *data);
+
+/// Blocks while the queue is empty and not closed. The caller takes ownership
+/// of the returned data.
+/// Returns NULL only once the queue is closed and empty.
+void *simple_archiver_mpmc_queue_pop(SDArchiverMPMCQueue *queue);
+
+/// Returns NULL if the queue is empty.
+void *simple_archiver_mpmc_queue_try_pop(SDArchiverMPMCQueue *queue);
+
+/// Wakes all waiting threads. Pushes fail afterwards, but pops still drain
+/// what is left in the queue.
+void simple_archiver_mpmc_queue_close(SDArchiverMPMCQueue *queue);
+
+size_t simple_archiver_mpmc_queue_size(SDArchiverMPMCQueue *queue);
+
+#endif
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <pthread.h>
 
 // Local includes.
 #include "../algorithms/linear_congruential_gen.h"
@@ -31,10 +32,22 @@
 #include "chunked_array.h"
 #include "list_array.h"
 #include "priority_heap.h"
+#include "concurrent_hash_map.h"
+#include "mpmc_queue.h"
+#include "arena.h"
+#include "btree.h"
 #include "../helpers.h"
 
 #define SDARCHIVER_DS_TEST_HASH_MAP_ITER_SIZE 100
 
+#define SDARCHIVER_DS_TEST_THREADS 8
+#define SDARCHIVER_DS_TEST_CHASH_OWN_KEYS 2000
+#define SDARCHIVER_DS_TEST_CHASH_SHARED_KEYS 500
+#define SDARCHIVER_DS_TEST_MPMC_ITEMS 20000
+#define SDARCHIVER_DS_TEST_BENCH_KEYS 4096
+#define SDARCHIVER_DS_TEST_BENCH_OPS 400000
+#define SDARCHIVER_DS_TEST_BTREE_ITEMS 5000
+
 #define SDAR_UNUSED __attribute__((unused))
 
 static int32_t checks_checked = 0;
@@ -183,6 +196,179 @@ int internal_slist_always_return_one(
   return 1;
 }
 
+typedef struct TestBTreeItem {
+  uint32_t key;
+  uint32_t seq;
+} TestBTreeItem;
+
+int internal_btree_less(void *left, void *right) {
+  return ((TestBTreeItem *)left)->key < ((TestBTreeItem *)right)->key;
+}
+
+int internal_btree_greater_ud(void *left, void *right, void *ud) {
+  ++*((uint64_t *)ud);
+  return ((TestBTreeItem *)left)->key > ((TestBTreeItem *)right)->key;
+}
+
+int internal_btree_cmp(const void *key, const void *data) {
+  const uint32_t k = *((const uint32_t *)key);
+  const uint32_t d = ((const TestBTreeItem *)data)->key;
+  return k < d ? -1 : (k > d ? 1 : 0);
+}
+
+int internal_btree_strcmp_less(void *left, void *right) {
+  return strcmp(left, right) < 0;
+}
+
+const char *internal_btree_to_str(const void *data) {
+  return data;
+}
+
+int internal_btree_count_fn(SDAR_UNUSED void *data, void *ud) {
+  ++*((uint32_t *)ud);
+  return 0;
+}
+
+int internal_btree_stop_fn(void *data, SDAR_UNUSED void *ud) {
+  return strcmp(data, "dir/b") == 0 ? 7 : 0;
+}
+
+typedef struct TestCHashThread {
+  SDArchiverCHashMap *chash_map;
+  uint64_t id;
+  uint64_t absent_inserted;
+  uint64_t found;
+} TestCHashThread;
+
+void *test_chash_insert_thread(void *ud) {
+  TestCHashThread *t = ud;
+  for (uint64_t idx = 0; idx < SDARCHIVER_DS_TEST_CHASH_OWN_KEYS; ++idx) {
+    uint64_t *key = malloc(sizeof(uint64_t));
+    *key = (t->id + 1) * 1000000 + idx;
+    uint64_t *value = malloc(sizeof(uint64_t));
+    *value = *key;
+    simple_archiver_chash_map_insert(t->chash_map, value, key,
+                                     sizeof(uint64_t), NULL, NULL);
+
+    // Every thread races to insert the same shared keys.
+    if (idx < SDARCHIVER_DS_TEST_CHASH_SHARED_KEYS) {
+      key = malloc(sizeof(uint64_t));
+      *key = idx;
+      value = malloc(sizeof(uint64_t));
+      *value = t->id;
+      if (simple_archiver_chash_map_insert_if_absent(
+            t->chash_map, value, key, sizeof(uint64_t), NULL, NULL) == 0) {
+        ++t->absent_inserted;
+      }
+    }
+  }
+  for (uint64_t idx = 0; idx < SDARCHIVER_DS_TEST_CHASH_OWN_KEYS; ++idx) {
+    uint64_t key = (t->id + 1) * 1000000 + idx;
+    uint64_t *value =
+      simple_archiver_chash_map_get(t->chash_map, &key, sizeof(uint64_t));
+    if (value && *value == key) {
+      ++t->found;
+    }
+  }
+  return NULL;
+}
+
+void *test_chash_remove_thread(void *ud) {
+  TestCHashThread *t = ud;
+  for (uint64_t idx = 0; idx < SDARCHIVER_DS_TEST_CHASH_OWN_KEYS; ++idx) {
+    uint64_t key = (t->id + 1) * 1000000 + idx;
+    simple_archiver_chash_map_remove(t->chash_map, &key, sizeof(uint64_t));
+  }
+  return NULL;
+}
+
+typedef struct TestMPMCThread {
+  SDArchiverMPMCQueue *queue;
+  uint64_t id;
+  uint64_t count;
+  uint64_t sum;
+} TestMPMCThread;
+
+void *test_mpmc_producer_thread(void *ud) {
+  TestMPMCThread *t = ud;
+  for (uint64_t idx = 0; idx < SDARCHIVER_DS_TEST_MPMC_ITEMS; ++idx) {
+    uint64_t *data = malloc(sizeof(uint64_t));
+    *data = t->id * SDARCHIVER_DS_TEST_MPMC_ITEMS + idx + 1;
+    if (simple_archiver_mpmc_queue_push(t->queue, data) != 0) {
+      free(data);
+      break;
+    }
+    ++t->count;
+  }
+  return NULL;
+}
+
+void *test_mpmc_consumer_thread(void *ud) {
+  TestMPMCThread *t = ud;
+  uint64_t *data;
+  while ((data = simple_archiver_mpmc_queue_pop(t->queue))) {
+    ++t->count;
+    t->sum += *data;
+    free(data);
+  }
+  return NULL;
+}
+
+typedef struct TestBenchThread {
+  SDArchiverCHashMap *chash_map;
+  SDArchiverHashMap *hash_map;
+  pthread_mutex_t *hash_map_mutex;
+  uint64_t ops;
+  uint64_t seed;
+  uint64_t found;
+} TestBenchThread;
+
+void *test_bench_lookup_thread(void *ud) {
+  TestBenchThread *t = ud;
+  for (uint64_t idx = 0; idx < t->ops; ++idx) {
+    t->seed = simple_archiver_algo_lcg_defaults(t->seed);
+    uint64_t key = (t->seed >> 32) % SDARCHIVER_DS_TEST_BENCH_KEYS;
+    void *value;
+    if (t->chash_map) {
+      value = simple_archiver_chash_map_get(t->chash_map, &key,
+                                            sizeof(uint64_t));
+    } else {
+      pthread_mutex_lock(t->hash_map_mutex);
+      value = simple_archiver_hash_map_get(t->hash_map, &key,
+                                           sizeof(uint64_t));
+      pthread_mutex_unlock(t->hash_map_mutex);
+    }
+    if (value) {
+      ++t->found;
+    }
+  }
+  return NULL;
+}
+
+/// Returns elapsed nanoseconds of "threads" threads sharing
+/// SDARCHIVER_DS_TEST_BENCH_OPS lookups.
+uint64_t test_bench_lookups(SDArchiverCHashMap *chash_map,
+                            SDArchiverHashMap *hash_map,
+                            pthread_mutex_t *hash_map_mutex,
+                            uint32_t threads,
+                            uint64_t *found) {
+  pthread_t handles[SDARCHIVER_DS_TEST_THREADS];
+  TestBenchThread data[SDARCHIVER_DS_TEST_THREADS];
+  const uint64_t start = simple_archiver_helper_monotonic_ns();
+  for (uint32_t idx = 0; idx < threads; ++idx) {
+    data[idx] = (TestBenchThread){chash_map, hash_map, hash_map_mutex,
+                                  SDARCHIVER_DS_TEST_BENCH_OPS / threads,
+                                  idx + 1, 0};
+    pthread_create(handles + idx, NULL, test_bench_lookup_thread, data + idx);
+  }
+  *found = 0;
+  for (uint32_t idx = 0; idx < threads; ++idx) {
+    pthread_join(handles[idx], NULL);
+    *found += data[idx].found;
+  }
+  return simple_archiver_helper_monotonic_ns() - start;
+}
+
 int main(void) {
   puts("Begin data-structures unit test.");
   fflush(stdout);
@@ -1268,6 +1454,372 @@ int main(void) {
     simple_archiver_slist_free(&slist);
   }
 
+  // Test Arena.
+  {
+    SDArchiverArena *arena = simple_archiver_arena_init(64);
+    CHECK_TRUE(simple_archiver_arena_alloc(arena, 0) == NULL);
+    char *first = simple_archiver_arena_alloc(arena, 10);
+    char *second = simple_archiver_arena_alloc(arena, 30);
+    CHECK_TRUE(first != NULL && second != NULL);
+    CHECK_TRUE(((uintptr_t)second & 0xF) == 0);
+    CHECK_TRUE(second >= first + 10);
+    memset(first, 'a', 10);
+    memset(second, 'b', 30);
+    // Does not fit in the first block.
+    char *third = simple_archiver_arena_alloc(arena, 40);
+    memset(third, 'c', 40);
+    // Larger than a block.
+    char *large = simple_archiver_arena_alloc(arena, 1000);
+    memset(large, 'd', 1000);
+    CHECK_TRUE(first[9] == 'a' && second[29] == 'b' && third[39] == 'c');
+    CHECK_TRUE(arena->used == 1080);
+    CHECK_TRUE(arena->blocks != NULL && arena->blocks->next != NULL);
+    CHECK_TRUE(arena->large_blocks != NULL);
+
+    // Giving back the latest allocation lets the next one reuse it.
+    simple_archiver_arena_unalloc_last(arena, 1000);
+    CHECK_TRUE(arena->used == 80);
+    CHECK_TRUE(arena->large_blocks == NULL);
+    simple_archiver_arena_unalloc_last(arena, 40);
+    CHECK_TRUE(arena->used == 40);
+    CHECK_TRUE(simple_archiver_arena_alloc(arena, 20) == third);
+    CHECK_TRUE(arena->used == 60);
+
+    simple_archiver_arena_reset(arena);
+    CHECK_TRUE(arena->used == 0);
+    CHECK_TRUE(arena->large_blocks == NULL);
+    // Reuses the kept blocks.
+    CHECK_TRUE(simple_archiver_arena_alloc(arena, 64) == first);
+    CHECK_TRUE(simple_archiver_arena_alloc(arena, 8) == third);
+    simple_archiver_arena_free(&arena);
+    CHECK_TRUE(arena == NULL);
+  }
+
+  // Test ConcurrentHashMap.
+  {
+    SDArchiverCHashMap *chash_map = simple_archiver_chash_map_init(0);
+    CHECK_TRUE(chash_map->shards_size == SC_SA_DS_CHASH_MAP_DEFAULT_SHARDS);
+    simple_archiver_chash_map_free(&chash_map);
+    CHECK_TRUE(chash_map == NULL);
+
+    chash_map = simple_archiver_chash_map_init(4);
+    char *value;
+    CHECK_TRUE(simple_archiver_chash_map_insert(chash_map, strdup("one"),
+                                                strdup("key"), 4, NULL, NULL)
+               == 0);
+    value = simple_archiver_chash_map_get(chash_map, "key", 4);
+    CHECK_TRUE(value && strcmp(value, "one") == 0);
+    CHECK_TRUE(simple_archiver_chash_map_insert_if_absent(
+                 chash_map, strdup("two"), strdup("key"), 4, NULL, NULL)
+               == 1);
+    value = simple_archiver_chash_map_get(chash_map, "key", 4);
+    CHECK_TRUE(value && strcmp(value, "one") == 0);
+    CHECK_TRUE(simple_archiver_chash_map_insert_if_absent(
+                 chash_map, strdup("two"), strdup("key2"), 5, NULL, NULL)
+               == 0);
+    CHECK_TRUE(simple_archiver_chash_map_count(chash_map) == 2);
+    CHECK_TRUE(simple_archiver_chash_map_remove(chash_map, "key", 4) == 0);
+    CHECK_TRUE(simple_archiver_chash_map_get(chash_map, "key", 4) == NULL);
+    CHECK_TRUE(simple_archiver_chash_map_remove(chash_map, "key", 4) > 1);
+    CHECK_TRUE(simple_archiver_chash_map_count(chash_map) == 1);
+    simple_archiver_chash_map_free(&chash_map);
+
+    // Stress with threads inserting their own keys and racing on shared keys.
+    chash_map = simple_archiver_chash_map_init(0);
+    pthread_t handles[SDARCHIVER_DS_TEST_THREADS];
+    TestCHashThread data[SDARCHIVER_DS_TEST_THREADS];
+    for (uint64_t idx = 0; idx < SDARCHIVER_DS_TEST_THREADS; ++idx) {
+      data[idx] = (TestCHashThread){chash_map, idx, 0, 0};
+      CHECK_TRUE(pthread_create(handles + idx, NULL, test_chash_insert_thread,
+                                data + idx) == 0);
+    }
+    uint64_t absent_inserted = 0;
+    uint64_t found = 0;
+    for (uint64_t idx = 0; idx < SDARCHIVER_DS_TEST_THREADS; ++idx) {
+      pthread_join(handles[idx], NULL);
+      absent_inserted += data[idx].absent_inserted;
+      found += data[idx].found;
+    }
+    CHECK_TRUE(absent_inserted == SDARCHIVER_DS_TEST_CHASH_SHARED_KEYS);
+    CHECK_TRUE(found
+               == SDARCHIVER_DS_TEST_THREADS
+                  * SDARCHIVER_DS_TEST_CHASH_OWN_KEYS);
+    CHECK_TRUE(simple_archiver_chash_map_count(chash_map)
+               == SDARCHIVER_DS_TEST_THREADS
+                    * SDARCHIVER_DS_TEST_CHASH_OWN_KEYS
+                  + SDARCHIVER_DS_TEST_CHASH_SHARED_KEYS);
+
+    for (uint64_t idx = 0; idx < SDARCHIVER_DS_TEST_THREADS; ++idx) {
+      CHECK_TRUE(pthread_create(handles + idx, NULL, test_chash_remove_thread,
+                                data + idx) == 0);
+    }
+    for (uint64_t idx = 0; idx < SDARCHIVER_DS_TEST_THREADS; ++idx) {
+      pthread_join(handles[idx], NULL);
+    }
+    CHECK_TRUE(simple_archiver_chash_map_count(chash_map)
+               == SDARCHIVER_DS_TEST_CHASH_SHARED_KEYS);
+    for (uint64_t idx = 0; idx < SDARCHIVER_DS_TEST_CHASH_SHARED_KEYS; ++idx) {
+      CHECK_TRUE(simple_archiver_chash_map_get(chash_map, &idx,
+                                               sizeof(uint64_t)));
+    }
+    simple_archiver_chash_map_free(&chash_map);
+  }
+
+  // Test MPMCQueue.
+  {
+    CHECK_TRUE(simple_archiver_mpmc_queue_init(0) == NULL);
+
+    SDArchiverMPMCQueue *queue = simple_archiver_mpmc_queue_init(2);
+    CHECK_TRUE(simple_archiver_mpmc_queue_try_pop(queue) == NULL);
+    CHECK_TRUE(simple_archiver_mpmc_queue_try_push(queue, strdup("one")) == 0);
+    CHECK_TRUE(simple_archiver_mpmc_queue_push(queue, strdup("two")) == 0);
+    char *three = strdup("three");
+    CHECK_TRUE(simple_archiver_mpmc_queue_try_push(queue, three) == 1);
+    CHECK_TRUE(simple_archiver_mpmc_queue_size(queue) == 2);
+    char *popped = simple_archiver_mpmc_queue_try_pop(queue);
+    CHECK_TRUE(popped && strcmp(popped, "one") == 0);
+    free(popped);
+    CHECK_TRUE(simple_archiver_mpmc_queue_try_push(queue, three) == 0);
+    simple_archiver_mpmc_queue_close(queue);
+    char *four = strdup("four");
+    CHECK_TRUE(simple_archiver_mpmc_queue_try_push(queue, four) == 2);
+    CHECK_TRUE(simple_archiver_mpmc_queue_push(queue, four) != 0);
+    free(four);
+    popped = simple_archiver_mpmc_queue_pop(queue);
+    CHECK_TRUE(popped && strcmp(popped, "two") == 0);
+    free(popped);
+    // "three" is left in the queue to be freed by free.
+    simple_archiver_mpmc_queue_free(&queue, NULL);
+    CHECK_TRUE(queue == NULL);
+
+    // Stress with half the threads producing and half consuming through a
+    // small ring.
+    queue = simple_archiver_mpmc_queue_init(64);
+    pthread_t handles[SDARCHIVER_DS_TEST_THREADS];
+    TestMPMCThread data[SDARCHIVER_DS_TEST_THREADS];
+    const uint64_t producers = SDARCHIVER_DS_TEST_THREADS / 2;
+    for (uint64_t idx = 0; idx < SDARCHIVER_DS_TEST_THREADS; ++idx) {
+      data[idx] = (TestMPMCThread){queue, idx, 0, 0};
+      CHECK_TRUE(pthread_create(handles + idx, NULL,
+                                idx < producers
+                                  ? test_mpmc_producer_thread
+                                  : test_mpmc_consumer_thread,
+                                data + idx) == 0);
+    }
+    for (uint64_t idx = 0; idx < producers; ++idx) {
+      pthread_join(handles[idx], NULL);
+    }
+    simple_archiver_mpmc_queue_close(queue);
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    for (uint64_t idx = producers; idx < SDARCHIVER_DS_TEST_THREADS; ++idx) {
+      pthread_join(handles[idx], NULL);
+      count += data[idx].count;
+      sum += data[idx].sum;
+    }
+    const uint64_t total = producers * SDARCHIVER_DS_TEST_MPMC_ITEMS;
+    CHECK_TRUE(count == total);
+    CHECK_TRUE(sum == total * (total + 1) / 2);
+    CHECK_TRUE(simple_archiver_mpmc_queue_size(queue) == 0);
+    simple_archiver_mpmc_queue_free(&queue, NULL);
+  }
+
+  // Test BTree.
+  {
+    SDArchiverBTree *btree = simple_archiver_btree_init(internal_btree_less);
+    CHECK_TRUE(simple_archiver_btree_size(btree) == 0);
+    CHECK_TRUE(simple_archiver_btree_first(btree) == NULL);
+    CHECK_TRUE(simple_archiver_btree_pop_first(btree) == NULL);
+
+    // Few distinct keys so that many items compare equal.
+    uint64_t rand = 1;
+    for (uint32_t idx = 0; idx < SDARCHIVER_DS_TEST_BTREE_ITEMS; ++idx) {
+      rand = simple_archiver_algo_lcg_defaults(rand);
+      TestBTreeItem *item = malloc(sizeof(TestBTreeItem));
+      item->key = (uint32_t)((rand >> 16) % 500) * 2;
+      item->seq = idx;
+      simple_archiver_btree_insert(btree, item, NULL);
+    }
+    CHECK_TRUE(simple_archiver_btree_size(btree)
+               == SDARCHIVER_DS_TEST_BTREE_ITEMS);
+
+    // Ordered and stable.
+    SDArchiverBTreeIter iter = simple_archiver_btree_begin(btree);
+    TestBTreeItem *prev = NULL;
+    TestBTreeItem *item;
+    uint32_t count = 0;
+    uint32_t ordered = 0;
+    while ((item = simple_archiver_btree_iter_next(&iter))) {
+      if (!prev || prev->key < item->key
+          || (prev->key == item->key && prev->seq < item->seq)) {
+        ++ordered;
+      }
+      prev = item;
+      ++count;
+    }
+    CHECK_TRUE(count == SDARCHIVER_DS_TEST_BTREE_ITEMS);
+    CHECK_TRUE(ordered == SDARCHIVER_DS_TEST_BTREE_ITEMS);
+    count = 0;
+    CHECK_TRUE(simple_archiver_btree_iter(btree, internal_btree_count_fn,
+                                          &count) == 0);
+    CHECK_TRUE(count == SDARCHIVER_DS_TEST_BTREE_ITEMS);
+
+    // Lower bound of present, absent, and out of range keys.
+    uint32_t key = 500;
+    iter = simple_archiver_btree_lower_bound(btree, &key, internal_btree_cmp);
+    item = simple_archiver_btree_iter_next(&iter);
+    CHECK_TRUE(item && item->key == 500);
+    uint32_t lowest_seq = UINT32_MAX;
+    iter = simple_archiver_btree_begin(btree);
+    while ((prev = simple_archiver_btree_iter_next(&iter))) {
+      if (prev->key == 500 && prev->seq < lowest_seq) {
+        lowest_seq = prev->seq;
+      }
+    }
+    CHECK_TRUE(item && item->seq == lowest_seq);
+    key = 501;
+    iter = simple_archiver_btree_lower_bound(btree, &key, internal_btree_cmp);
+    item = simple_archiver_btree_iter_next(&iter);
+    CHECK_TRUE(item && item->key == 502);
+    key = 0;
+    iter = simple_archiver_btree_lower_bound(btree, &key, internal_btree_cmp);
+    CHECK_TRUE(simple_archiver_btree_iter_next(&iter)
+               == simple_archiver_btree_first(btree));
+    key = 1000;
+    iter = simple_archiver_btree_lower_bound(btree, &key, internal_btree_cmp);
+    CHECK_TRUE(simple_archiver_btree_iter_next(&iter) == NULL);
+
+    // Pop half, then insert more, then let free clean up the rest.
+    prev = NULL;
+    ordered = 0;
+    for (uint32_t idx = 0; idx < SDARCHIVER_DS_TEST_BTREE_ITEMS / 2; ++idx) {
+      item = simple_archiver_btree_pop_first(btree);
+      if (item && (!prev || prev->key <= item->key)) {
+        ++ordered;
+      }
+      free(prev);
+      prev = item;
+    }
+    CHECK_TRUE(ordered == SDARCHIVER_DS_TEST_BTREE_ITEMS / 2);
+    free(prev);
+    CHECK_TRUE(simple_archiver_btree_size(btree)
+               == SDARCHIVER_DS_TEST_BTREE_ITEMS / 2);
+    for (uint32_t idx = 0; idx < 100; ++idx) {
+      item = malloc(sizeof(TestBTreeItem));
+      item->key = idx;
+      item->seq = 0;
+      simple_archiver_btree_insert(btree, item, NULL);
+    }
+    item = simple_archiver_btree_first(btree);
+    CHECK_TRUE(item && item->key == 0);
+    simple_archiver_btree_free(&btree);
+    CHECK_TRUE(btree == NULL);
+
+    // Pop everything with a "less" function with userdata.
+    uint64_t calls = 0;
+    btree = simple_archiver_btree_init_ud(internal_btree_greater_ud, &calls);
+    for (uint32_t idx = 0; idx < SDARCHIVER_DS_TEST_BTREE_ITEMS; ++idx) {
+      item = malloc(sizeof(TestBTreeItem));
+      item->key = idx;
+      item->seq = 0;
+      simple_archiver_btree_insert(btree, item, NULL);
+    }
+    CHECK_TRUE(calls > 0);
+    ordered = 0;
+    for (uint32_t idx = SDARCHIVER_DS_TEST_BTREE_ITEMS; idx-- > 0;) {
+      item = simple_archiver_btree_pop_first(btree);
+      if (item && item->key == idx) {
+        ++ordered;
+      }
+      free(item);
+    }
+    CHECK_TRUE(ordered == SDARCHIVER_DS_TEST_BTREE_ITEMS);
+    CHECK_TRUE(simple_archiver_btree_size(btree) == 0);
+    CHECK_TRUE(simple_archiver_btree_pop_first(btree) == NULL);
+    // Usable again after being emptied.
+    item = malloc(sizeof(TestBTreeItem));
+    item->key = 1;
+    item->seq = 0;
+    simple_archiver_btree_insert(btree, item, NULL);
+    CHECK_TRUE(simple_archiver_btree_first(btree) == item);
+    simple_archiver_btree_free(&btree);
+
+    // Prefix range scans.
+    btree = simple_archiver_btree_init(internal_btree_strcmp_less);
+    const char *paths[] = {"dir/b", "dir", "dir/a", "dir.txt", "dir/sub/c",
+                           "dis", "a", "dir/", "di"};
+    for (size_t idx = 0; idx < sizeof(paths) / sizeof(paths[0]); ++idx) {
+      simple_archiver_btree_insert(
+        btree, (void *)paths[idx],
+        simple_archiver_helper_datastructure_cleanup_nop);
+    }
+    count = 0;
+    CHECK_TRUE(simple_archiver_btree_prefix_iter(btree, "dir/",
+                                                 internal_btree_to_str,
+                                                 internal_btree_count_fn,
+                                                 &count) == 0);
+    CHECK_TRUE(count == 4);
+    count = 0;
+    simple_archiver_btree_prefix_iter(btree, "dir", internal_btree_to_str,
+                                      internal_btree_count_fn, &count);
+    CHECK_TRUE(count == 6);
+    count = 0;
+    simple_archiver_btree_prefix_iter(btree, "", internal_btree_to_str,
+                                      internal_btree_count_fn, &count);
+    CHECK_TRUE(count == 9);
+    count = 0;
+    simple_archiver_btree_prefix_iter(btree, "e", internal_btree_to_str,
+                                      internal_btree_count_fn, &count);
+    CHECK_TRUE(count == 0);
+    CHECK_TRUE(simple_archiver_btree_prefix_iter(btree, "dir/",
+                                                 internal_btree_to_str,
+                                                 internal_btree_stop_fn,
+                                                 NULL) == 7);
+    simple_archiver_btree_free(&btree);
+  }
+
+  // Benchmark lookup scaling of ConcurrentHashMap against one HashMap behind
+  // a single mutex. Timings are informational and not checked.
+  {
+    SDArchiverCHashMap *chash_map = simple_archiver_chash_map_init(0);
+    SDArchiverHashMap *hash_map = simple_archiver_hash_map_init();
+    pthread_mutex_t hash_map_mutex;
+    pthread_mutex_init(&hash_map_mutex, NULL);
+    for (uint64_t idx = 0; idx < SDARCHIVER_DS_TEST_BENCH_KEYS; ++idx) {
+      uint64_t *key = malloc(sizeof(uint64_t));
+      *key = idx;
+      simple_archiver_chash_map_insert(chash_map, (void *)(idx + 1), key,
+                                       sizeof(uint64_t),
+                                       no_free_fn, NULL);
+      key = malloc(sizeof(uint64_t));
+      *key = idx;
+      simple_archiver_hash_map_insert(hash_map, (void *)(idx + 1), key,
+                                      sizeof(uint64_t), no_free_fn, NULL);
+    }
+
+    for (uint32_t threads = 1; threads <= SDARCHIVER_DS_TEST_THREADS;
+         threads *= 2) {
+      uint64_t found;
+      const uint64_t locked_ns = test_bench_lookups(NULL, hash_map,
+                                                    &hash_map_mutex, threads,
+                                                    &found);
+      CHECK_TRUE(found
+                 == SDARCHIVER_DS_TEST_BENCH_OPS / threads * threads);
+      const uint64_t sharded_ns = test_bench_lookups(chash_map, NULL, NULL,
+                                                     threads, &found);
+      CHECK_TRUE(found
+                 == SDARCHIVER_DS_TEST_BENCH_OPS / threads * threads);
+      printf("%" PRIu32 " thread(s), %d lookups: single lock %" PRIu64
+             " us, sharded %" PRIu64 " us\n",
+             threads, SDARCHIVER_DS_TEST_BENCH_OPS, locked_ns / 1000,
+             sharded_ns / 1000);
+    }
+
+    pthread_mutex_destroy(&hash_map_mutex);
+    simple_archiver_hash_map_free(&hash_map);
+    simple_archiver_chash_map_free(&chash_map);
+  }
+
   printf("Checks checked: %" PRId32 "\n", checks_checked);
   printf("Checks passed:  %" PRId32 "\n", checks_passed);
   return checks_passed == checks_checked ? 0 : 1;
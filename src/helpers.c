@@ -16,14 +16,20 @@
 //
 // `helpers.c` is the source for helpful/utility functions.
 
+#include "platforms.h"
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+// Needed for "O_PATH".
+#define _GNU_SOURCE
+#endif
+
 #include "helpers.h"
 
 #include <ctype.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-#include "platforms.h"
 #if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_COSMOPOLITAN || \
     SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC ||          \
     SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
@@ -36,6 +42,19 @@
 #include <signal.h>
 #endif
 
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+#include <sys/syscall.h>
+#ifdef SYS_openat2
+#include <linux/openat2.h>
+#endif
+#endif
+
+#ifdef O_PATH
+#define SDA_HELPER_DIR_FLAGS (O_PATH | O_DIRECTORY)
+#elif defined(O_DIRECTORY)
+#define SDA_HELPER_DIR_FLAGS (O_RDONLY | O_DIRECTORY)
+#endif
+
 #ifdef ENABLE_LIBCAP
 #if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC || \
     SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
@@ -891,6 +910,81 @@ uint_fast8_t simple_archiver_helper_string_allowed_lists(
   }
 }
 
+uint_fast8_t simple_archiver_helper_string_dir_blacklisted(
+    const char *dir,
+    uint_fast8_t case_i,
+    const SDArchiverParsed *parsed) {
+  if (parsed->whitelist_exact
+      || parsed->whitelist_exact_case_i
+      || parsed->whitelist_contains_any
+      || parsed->whitelist_contains_all
+      || parsed->whitelist_begins
+      || parsed->whitelist_ends) {
+    // Whitelists take precedence over blacklists.
+    return 0;
+  } else if (!parsed->blacklist_contains_any
+      && !parsed->blacklist_contains_all
+      && !parsed->blacklist_begins) {
+    // "exact" and "ends" blacklists cannot match every path in a dir.
+    return 0;
+  }
+
+  // Every path within "dir" starts with "dir/", so any "begins" or "contains"
+  // match on "dir/" also matches every path within "dir".
+  __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+  char *dir_slash = simple_archiver_helper_combine_strs(dir, "/");
+  if (!dir_slash) {
+    return 0;
+  }
+
+  if (parsed->blacklist_contains_any) {
+    for (const SDArchiverLLNode *node
+          = parsed->blacklist_contains_any->head->next;
+        node != parsed->blacklist_contains_any->tail;
+        node = node->next) {
+      if (node->data) {
+        if (simple_archiver_helper_string_contains(
+            dir_slash, node->data, case_i)) {
+          return 1;
+        }
+      }
+    }
+  }
+  if (parsed->blacklist_contains_all) {
+    int_fast8_t not_contains = 0;
+    for (const SDArchiverLLNode *node
+          = parsed->blacklist_contains_all->head->next;
+        node != parsed->blacklist_contains_all->tail;
+        node = node->next) {
+      if (node->data) {
+        if (!simple_archiver_helper_string_contains(
+            dir_slash, node->data, case_i)) {
+          not_contains = 1;
+          break;
+        }
+      }
+    }
+    if (!not_contains) {
+      return 1;
+    }
+  }
+  if (parsed->blacklist_begins) {
+    for (const SDArchiverLLNode *node = parsed->blacklist_begins->head->next;
+        node != parsed->blacklist_begins->tail;
+        node = node->next) {
+      if (node->data) {
+        if (simple_archiver_helper_string_starts(dir_slash,
+                                                 node->data,
+                                                 case_i)) {
+          return 1;
+        }
+      }
+    }
+  }
+
+  return 0;
+}
+
 FILE *simple_archiver_helper_temp_dir(const SDArchiverParsed *parsed,
                                       char **out_temp_filename) {
   if (parsed->flags & 0x40000) {
@@ -1277,3 +1371,426 @@ char *simple_archiver_helper_value_to_base10_with_newline(uint64_t value) {
 
   return buf;
 }
+
+uint64_t simple_archiver_helper_fnv1a_64(uint64_t hash,
+                                         const void *data,
+                                         size_t size) {
+  const uint8_t *bytes = data;
+  for (size_t idx = 0; idx < size; ++idx) {
+    hash ^= bytes[idx];
+    hash *= 0x100000001B3;
+  }
+  return hash;
+}
+
+uint64_t simple_archiver_helper_monotonic_ns(void) {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+    return 0;
+  }
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+int simple_archiver_helper_read_pressure(const char *path,
+                                         uint32_t *hundredths) {
+  __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    return 1;
+  }
+  char line[128];
+  while (fgets(line, sizeof(line), f)) {
+    unsigned int whole;
+    unsigned int frac;
+    if (sscanf(line, "some avg10=%u.%2u", &whole, &frac) == 2) {
+      *hundredths = (uint32_t)(whole * 100 + frac);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Returns the CPUs allowed by "quota" microseconds every "period", rounded up.
+uint32_t simple_archiver_helper_internal_quota_cpus(long long quota,
+                                                    long long period) {
+  if (quota <= 0 || period <= 0) {
+    return 0;
+  }
+  const long long cpus = (quota + period - 1) / period;
+  return cpus > 0xFFFF ? 0xFFFF : (uint32_t)cpus;
+}
+
+uint32_t simple_archiver_helper_cgroup_cpu_limit(const char *cgroup_fs,
+                                                 const char *proc_cgroup) {
+  __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
+  FILE *cgroups_f = fopen(proc_cgroup, "r");
+  if (!cgroups_f) {
+    return 0;
+  }
+
+  uint32_t limit = 0;
+  char line[1024];
+  while (fgets(line, sizeof(line), cgroups_f)) {
+    line[strcspn(line, "\n")] = 0;
+    // Lines are "<id>:<controllers>:<path>", with no controllers for v2.
+    char *controllers = strchr(line, ':');
+    char *cgroup = controllers ? strchr(controllers + 1, ':') : NULL;
+    if (!cgroup) {
+      continue;
+    }
+    ++controllers;
+    *cgroup = 0;
+    ++cgroup;
+
+    uint32_t cpus = 0;
+    if (*controllers == 0) {
+      // A parent's quota also limits the cgroup, so check up to the root.
+      size_t cgroup_len = strlen(cgroup);
+      while (1) {
+        cgroup[cgroup_len] = 0;
+        char path[1200];
+        snprintf(path, sizeof(path), "%s%s/cpu.max", cgroup_fs, cgroup);
+        __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
+        FILE *f = fopen(path, "r");
+        long long quota;
+        long long period;
+        if (f && fscanf(f, "%lld %lld", &quota, &period) == 2) {
+          const uint32_t level_cpus =
+            simple_archiver_helper_internal_quota_cpus(quota, period);
+          if (level_cpus != 0 && (cpus == 0 || level_cpus < cpus)) {
+            cpus = level_cpus;
+          }
+        }
+        if (cgroup_len == 0) {
+          break;
+        }
+        while (cgroup_len > 0 && cgroup[cgroup_len - 1] != '/') {
+          --cgroup_len;
+        }
+        if (cgroup_len > 0) {
+          --cgroup_len;
+        }
+      }
+    } else {
+      int_fast8_t has_cpu = 0;
+      char *saveptr = NULL;
+      for (char *controller = strtok_r(controllers, ",", &saveptr); controller;
+           controller = strtok_r(NULL, ",", &saveptr)) {
+        if (strcmp(controller, "cpu") == 0) {
+          has_cpu = 1;
+        }
+      }
+      if (!has_cpu) {
+        continue;
+      }
+      long long quota = 0;
+      long long period = 0;
+      char path[1200];
+      snprintf(path,
+               sizeof(path),
+               "%s/cpu%s/cpu.cfs_quota_us",
+               cgroup_fs,
+               strcmp(cgroup, "/") == 0 ? "" : cgroup);
+      __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
+      FILE *quota_f = fopen(path, "r");
+      snprintf(path,
+               sizeof(path),
+               "%s/cpu%s/cpu.cfs_period_us",
+               cgroup_fs,
+               strcmp(cgroup, "/") == 0 ? "" : cgroup);
+      __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
+      FILE *period_f = fopen(path, "r");
+      if (quota_f && period_f && fscanf(quota_f, "%lld", &quota) == 1
+          && fscanf(period_f, "%lld", &period) == 1) {
+        cpus = simple_archiver_helper_internal_quota_cpus(quota, period);
+      }
+    }
+
+    if (cpus != 0 && (limit == 0 || cpus < limit)) {
+      limit = cpus;
+    }
+  }
+
+  return limit;
+}
+
+int simple_archiver_helper_beneath_dir_fd(void) {
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX \
+    && defined(SYS_openat2)
+  int dir_fd = open(".", SDA_HELPER_DIR_FLAGS | O_CLOEXEC);
+  if (dir_fd < 0) {
+    return -1;
+  }
+  // Older kernels and some seccomp filters reject openat2, so check that it
+  // works before relying on it.
+  int fd = simple_archiver_helper_open_beneath(dir_fd,
+                                               ".",
+                                               SDA_HELPER_DIR_FLAGS,
+                                               0);
+  if (fd < 0) {
+    close(dir_fd);
+    return -1;
+  }
+  close(fd);
+  return dir_fd;
+#else
+  return -1;
+#endif
+}
+
+int simple_archiver_helper_open_beneath(int dir_fd,
+                                        const char *path,
+                                        int flags,
+                                        uint32_t mode) {
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_COSMOPOLITAN || \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC ||          \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  if (dir_fd < 0) {
+    return open(path, flags, (mode_t)mode);
+  }
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX \
+    && defined(SYS_openat2)
+  struct open_how how;
+  memset(&how, 0, sizeof(how));
+  how.flags = (__u64)(flags | O_CLOEXEC);
+  // openat2 rejects a mode without O_CREAT.
+  how.mode = (flags & O_CREAT) ? (__u64)mode : 0;
+  how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+  long fd;
+  do {
+    // EAGAIN is returned if a rename raced with the path resolution.
+    fd = syscall(SYS_openat2, dir_fd, path, &how, sizeof(how));
+  } while (fd < 0 && (errno == EAGAIN || errno == EINTR));
+  return (int)fd;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+#else
+  return -1;
+#endif
+}
+
+int simple_archiver_helper_parent_beneath(int dir_fd,
+                                          const char *path,
+                                          const char **name) {
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_COSMOPOLITAN || \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC ||          \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  if (dir_fd < 0) {
+    *name = path;
+    return AT_FDCWD;
+  }
+  const char *last_slash = strrchr(path, '/');
+  if (!last_slash) {
+    *name = path;
+    return simple_archiver_helper_open_beneath(dir_fd,
+                                               ".",
+                                               SDA_HELPER_DIR_FLAGS,
+                                               0);
+  }
+  *name = last_slash + 1;
+  __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+  char *parent = malloc((size_t)(last_slash - path) + 2);
+  if (last_slash == path) {
+    // Absolute, which the kernel will reject as not beneath "dir_fd".
+    strcpy(parent, "/");
+  } else {
+    memcpy(parent, path, (size_t)(last_slash - path));
+    parent[last_slash - path] = 0;
+  }
+  return simple_archiver_helper_open_beneath(dir_fd,
+                                             parent,
+                                             SDA_HELPER_DIR_FLAGS,
+                                             0);
+#else
+  return -1;
+#endif
+}
+
+FILE *simple_archiver_helper_fopen_beneath(int dir_fd,
+                                           const char *path,
+                                           const char *mode) {
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_COSMOPOLITAN || \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC ||          \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  if (dir_fd < 0) {
+    return fopen(path, mode);
+  }
+  const int flags = mode[0] == 'w' ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY;
+  int fd = simple_archiver_helper_open_beneath(dir_fd, path, flags, 0666);
+  if (fd < 0) {
+    return NULL;
+  }
+  FILE *f = fdopen(fd, mode);
+  if (!f) {
+    close(fd);
+  }
+  return f;
+#else
+  return fopen(path, mode);
+#endif
+}
+
+int simple_archiver_helper_make_dirs_perms_beneath(int dir_fd,
+                                                   const char *file_path,
+                                                   uint32_t perms,
+                                                   uint32_t uid,
+                                                   uint32_t gid) {
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_COSMOPOLITAN || \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC ||          \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  if (dir_fd < 0) {
+    return simple_archiver_helper_make_dirs_perms(file_path, perms, uid, gid);
+  }
+  __attribute__((
+      cleanup(simple_archiver_helper_cleanup_c_string))) char *path_dup =
+      strdup(file_path);
+  if (!path_dup) {
+    return 3;
+  }
+  const char *dir = dirname(path_dup);
+  if (strcmp(dir, "/") == 0 || strcmp(dir, ".") == 0) {
+    // At root.
+    return 0;
+  }
+
+  // Only checks if it exists, an existing dir that leads outside of "dir_fd"
+  // is caught when opening beneath it.
+  struct stat st;
+  if (fstatat(dir_fd, dir, &st, 0) == 0) {
+    if (!S_ISDIR(st.st_mode)) {
+      // Error, somehow got non-dir in path.
+      return 1;
+    }
+    // Exists.
+    return 0;
+  } else if (errno == ENOTDIR) {
+    // Error, somehow got non-dir in path.
+    return 1;
+  }
+
+  // Directory does not exist. Check parent dir first.
+  int ret = simple_archiver_helper_make_dirs_perms_beneath(dir_fd,
+                                                           dir,
+                                                           perms,
+                                                           uid,
+                                                           gid);
+  if (ret != 0) {
+    return ret;
+  }
+  // Now make dir.
+  const char *name;
+  int parent_fd = simple_archiver_helper_parent_beneath(dir_fd, dir, &name);
+  if (parent_fd < 0) {
+    // 6 if the path leads outside of "dir_fd".
+    return errno == EXDEV ? 6 : 2;
+  }
+  if (mkdirat(parent_fd, name, (mode_t)perms) != 0) {
+    ret = 2;
+  } else if (fchmodat(parent_fd, name, (mode_t)perms, 0) != 0) {
+    ret = 5;
+  } else if (simple_archiver_helper_can_chown()
+             && fchownat(parent_fd, name, uid, gid, AT_SYMLINK_NOFOLLOW) != 0) {
+    ret = 4;
+  }
+  close(parent_fd);
+  return ret;
+#else
+  return 1;
+#endif
+}
+
+int simple_archiver_helper_symlink_beneath(int dir_fd,
+                                           const char *target,
+                                           const char *link_path) {
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_COSMOPOLITAN || \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC ||          \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  const char *name;
+  int parent_fd =
+    simple_archiver_helper_parent_beneath(dir_fd, link_path, &name);
+  if (parent_fd == -1) {
+    return -1;
+  }
+  int ret = symlinkat(target, parent_fd, name);
+  if (parent_fd >= 0) {
+    const int saved_errno = errno;
+    close(parent_fd);
+    errno = saved_errno;
+  }
+  return ret;
+#else
+  return -1;
+#endif
+}
+
+int simple_archiver_helper_unlink_beneath(int dir_fd, const char *path) {
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_COSMOPOLITAN || \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC ||          \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  const char *name;
+  int parent_fd = simple_archiver_helper_parent_beneath(dir_fd, path, &name);
+  if (parent_fd == -1) {
+    return -1;
+  }
+  int ret = unlinkat(parent_fd, name, 0);
+  if (parent_fd >= 0) {
+    const int saved_errno = errno;
+    close(parent_fd);
+    errno = saved_errno;
+  }
+  return ret;
+#else
+  return -1;
+#endif
+}
+
+int simple_archiver_helper_fchmodat_beneath(int dir_fd,
+                                            const char *path,
+                                            uint32_t mode,
+                                            int flags) {
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_COSMOPOLITAN || \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC ||          \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  const char *name;
+  int parent_fd = simple_archiver_helper_parent_beneath(dir_fd, path, &name);
+  if (parent_fd == -1) {
+    return -1;
+  }
+  int ret = fchmodat(parent_fd, name, (mode_t)mode, flags);
+  if (parent_fd >= 0) {
+    const int saved_errno = errno;
+    close(parent_fd);
+    errno = saved_errno;
+  }
+  return ret;
+#else
+  return -1;
+#endif
+}
+
+int simple_archiver_helper_fchownat_beneath(int dir_fd,
+                                            const char *path,
+                                            uint32_t uid,
+                                            uint32_t gid,
+                                            int flags) {
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_COSMOPOLITAN || \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC ||          \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  const char *name;
+  int parent_fd = simple_archiver_helper_parent_beneath(dir_fd, path, &name);
+  if (parent_fd == -1) {
+    return -1;
+  }
+  int ret = fchownat(parent_fd, name, uid, gid, flags);
+  if (parent_fd >= 0) {
+    const int saved_errno = errno;
+    close(parent_fd);
+    errno = saved_errno;
+  }
+  return ret;
+#else
+  return -1;
+#endif
+}
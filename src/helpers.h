@@ -149,6 +149,14 @@ uint_fast8_t simple_archiver_helper_string_allowed_lists(
   uint_fast8_t case_i,
   const SDArchiverParsed *parsed);
 
+// Returns non-zero if every path within directory "dir" is rejected by the
+// blacklists, meaning the walker does not need to look inside "dir".
+// "case_i" stands for "case-insensitive".
+uint_fast8_t simple_archiver_helper_string_dir_blacklisted(
+  const char *dir,
+  uint_fast8_t case_i,
+  const SDArchiverParsed *parsed);
+
 // Must be free'd with `fclose(...)`.
 // "out_temp_filename" must be free'd if non-NULL.
 FILE *simple_archiver_helper_temp_dir(const SDArchiverParsed *parsed,
@@ -184,4 +192,84 @@ int simple_archiver_helper_has_null_before_size(const char *s, size_t index);
 // Must be FREE'd after use.
 char *simple_archiver_helper_value_to_base10_with_newline(uint64_t value);
 
+#define SDA_HELPER_FNV1A_64_INIT 0xCBF29CE484222325
+
+// Continues a 64-bit FNV-1a hash over "data". Start with
+// SDA_HELPER_FNV1A_64_INIT.
+uint64_t simple_archiver_helper_fnv1a_64(uint64_t hash,
+                                         const void *data,
+                                         size_t size);
+
+// Returns nanoseconds of a monotonic clock, only useful for differences.
+uint64_t simple_archiver_helper_monotonic_ns(void);
+
+// Sets "hundredths" to the "some avg10" stall percentage of a Linux pressure
+// stall information file like "/proc/pressure/cpu", in hundredths of a
+// percent. Returns non-zero if the file cannot be read or parsed.
+int simple_archiver_helper_read_pressure(const char *path,
+                                         uint32_t *hundredths);
+
+// Returns the number of CPUs the cgroup CPU quota (v2 "cpu.max" of the cgroup
+// and its parents, or v1 "cpu.cfs_quota_us") allows, rounded up, or 0 if there
+// is no quota. "cgroup_fs" is where cgroups are mounted, like
+// "/sys/fs/cgroup", and "proc_cgroup" lists the cgroups of the process, like
+// "/proc/self/cgroup".
+uint32_t simple_archiver_helper_cgroup_cpu_limit(const char *cgroup_fs,
+                                                 const char *proc_cgroup);
+
+// Returns an fd of the current working directory for the "_beneath"
+// functions, or -1 if the kernel cannot confine paths beneath it (only
+// Linux 5.6 and up with "openat2" can). Must be closed if not -1.
+int simple_archiver_helper_beneath_dir_fd(void);
+
+// The "_beneath" functions work like their libc counterparts on a path
+// relative to "dir_fd", but the kernel resolves the path with "openat2"
+// RESOLVE_BENEATH and RESOLVE_NO_MAGICLINKS, failing with EXDEV if the path
+// (including any symlink or ".." in it) leads outside of "dir_fd".
+// If "dir_fd" is -1, paths are used as-is relative to the current working
+// directory.
+
+// Returns an fd that must be closed, or -1 on error.
+int simple_archiver_helper_open_beneath(int dir_fd,
+                                        const char *path,
+                                        int flags,
+                                        uint32_t mode);
+
+// Returns an fd of the parent dir of "path" that must be closed if not
+// negative, and sets "name" to the last part of "path". Returns AT_FDCWD if
+// "dir_fd" is -1, or -1 on error.
+int simple_archiver_helper_parent_beneath(int dir_fd,
+                                          const char *path,
+                                          const char **name);
+
+// "mode" is "r", "rb", "w", or "wb".
+FILE *simple_archiver_helper_fopen_beneath(int dir_fd,
+                                           const char *path,
+                                           const char *mode);
+
+// Same return values as "simple_archiver_helper_make_dirs_perms", or 6 if the
+// dirs would be outside of "dir_fd".
+int simple_archiver_helper_make_dirs_perms_beneath(int dir_fd,
+                                                   const char *file_path,
+                                                   uint32_t perms,
+                                                   uint32_t uid,
+                                                   uint32_t gid);
+
+int simple_archiver_helper_symlink_beneath(int dir_fd,
+                                           const char *target,
+                                           const char *link_path);
+
+int simple_archiver_helper_unlink_beneath(int dir_fd, const char *path);
+
+int simple_archiver_helper_fchmodat_beneath(int dir_fd,
+                                            const char *path,
+                                            uint32_t mode,
+                                            int flags);
+
+int simple_archiver_helper_fchownat_beneath(int dir_fd,
+                                            const char *path,
+                                            uint32_t uid,
+                                            uint32_t gid,
+                                            int flags);
+
 #endif
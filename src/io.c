@@ -0,0 +1,1090 @@
+// ISC License
+//
+// Copyright (c) 2024-2026 Stephen Seo
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//
+// `io.c` is the source for pluggable archive input/output backends.
+
+#include "platforms.h"
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+// Needed for "fopencookie".
+#define _GNU_SOURCE
+#endif
+
+#include "io.h"
+
+// Local includes.
+#include "data_structures/mpmc_queue.h"
+
+// Standard library includes.
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Unix includes.
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_COSMOPOLITAN || \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC ||          \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+#include <errno.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#define SDA_IO_STREAM_BUF_SIZE 0x10000
+
+typedef struct SDArchiverIOFd {
+  int fd;
+  /// Is negative if "fd" is read and written in order (pipes and sockets).
+  int64_t offset;
+} SDArchiverIOFd;
+
+typedef struct SDArchiverIOMem {
+  char *buf;
+  const char *ro_buf;
+  uint64_t size;
+  uint64_t capacity;
+  uint64_t pos;
+} SDArchiverIOMem;
+
+typedef struct SDArchiverIODelta {
+  int fd;
+  /// Incoming data of the current block.
+  char *block;
+  /// What the file held at the current block.
+  char *disk;
+  uint64_t block_size;
+  uint64_t fill;
+  /// File offset of the current block.
+  uint64_t offset;
+  uint64_t blocks;
+  uint64_t written_blocks;
+} SDArchiverIODelta;
+
+typedef struct SDArchiverIOAsyncFrame {
+  uint64_t size;
+  char *data;
+} SDArchiverIOAsyncFrame;
+
+typedef struct SDArchiverIOAsync {
+  SDArchiverIO *out;
+  /// Filled frames waiting for the writer thread.
+  SDArchiverMPMCQueue *frames;
+  /// Written frames returned by the writer thread for reuse.
+  SDArchiverMPMCQueue *free_frames;
+  /// Frame being filled by "write".
+  SDArchiverIOAsyncFrame *frame;
+  uint64_t frame_size;
+  pthread_t thread;
+  int is_thread_running;
+  pthread_mutex_t mutex;
+  /// Is non-zero once the writer thread failed to write. Guarded by "mutex".
+  int error;
+} SDArchiverIOAsync;
+
+struct SDArchiverIOStream {
+  SDArchiverIO *io;
+  /// Stdio backend owned by the stream, if made from a FILE*.
+  SDArchiverIO *owned_io;
+  /// Flushed with the stream if non-NULL.
+  FILE *f;
+  char *buf;
+  size_t buf_size;
+  /// When reading, "buf" holds unread bytes from "pos" up to "len".
+  size_t pos;
+  /// When writing, "buf" holds "len" bytes not yet written to "io".
+  size_t len;
+  int_fast8_t is_write;
+  int_fast8_t is_eof;
+  int_fast8_t is_error;
+};
+
+int64_t simple_archiver_io_internal_stdio_read(void *ud,
+                                               char *buf,
+                                               uint64_t size) {
+  size_t read_size = fread(buf, 1, size, ud);
+  if (read_size == 0 && ferror((FILE *)ud)) {
+    return -1;
+  }
+  return (int64_t)read_size;
+}
+
+int64_t simple_archiver_io_internal_stdio_write(void *ud,
+                                                const char *buf,
+                                                uint64_t size) {
+  size_t write_size = fwrite(buf, 1, size, ud);
+  if (write_size != size) {
+    return -1;
+  }
+  return (int64_t)write_size;
+}
+
+int simple_archiver_io_internal_stdio_seek(void *ud,
+                                           int64_t *offset,
+                                           int whence) {
+  if (fseek(ud, (long)*offset, whence) != 0) {
+    return 1;
+  }
+  long pos = ftell(ud);
+  if (pos < 0) {
+    return 1;
+  }
+  *offset = pos;
+  return 0;
+}
+
+FILE *simple_archiver_io_internal_stdio_get_FILE(void *ud,
+                                                 const char *mode,
+                                                 int_fast8_t *needs_fclose) {
+  (void)mode;
+  *needs_fclose = 0;
+  return ud;
+}
+
+SDArchiverIO *simple_archiver_io_init_stdio(FILE *f) {
+  if (!f) {
+    return NULL;
+  }
+  SDArchiverIO *io = malloc(sizeof(SDArchiverIO));
+  memset(io, 0, sizeof(SDArchiverIO));
+  io->ud = f;
+  io->read = simple_archiver_io_internal_stdio_read;
+  io->write = simple_archiver_io_internal_stdio_write;
+  io->seek = simple_archiver_io_internal_stdio_seek;
+  io->get_FILE = simple_archiver_io_internal_stdio_get_FILE;
+  return io;
+}
+
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_COSMOPOLITAN || \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC ||          \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+int64_t simple_archiver_io_internal_fd_read(void *ud,
+                                            char *buf,
+                                            uint64_t size) {
+  SDArchiverIOFd *io_fd = ud;
+  while (1) {
+    ssize_t ret = io_fd->offset < 0
+      ? read(io_fd->fd, buf, size)
+      : pread(io_fd->fd, buf, size, (off_t)io_fd->offset);
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    } else if (ret > 0 && io_fd->offset >= 0) {
+      io_fd->offset += ret;
+    }
+    return ret;
+  }
+}
+
+int64_t simple_archiver_io_internal_fd_write(void *ud,
+                                             const char *buf,
+                                             uint64_t size) {
+  SDArchiverIOFd *io_fd = ud;
+  uint64_t written = 0;
+  while (written < size) {
+    ssize_t ret = io_fd->offset < 0
+      ? write(io_fd->fd, buf + written, size - written)
+      : pwrite(io_fd->fd,
+               buf + written,
+               size - written,
+               (off_t)io_fd->offset);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    written += (uint64_t)ret;
+    if (io_fd->offset >= 0) {
+      io_fd->offset += ret;
+    }
+  }
+  return (int64_t)written;
+}
+
+int64_t simple_archiver_io_internal_fd_size(void *ud) {
+  struct stat st;
+  if (fstat(((SDArchiverIOFd *)ud)->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    return -1;
+  }
+  return st.st_size;
+}
+
+int simple_archiver_io_internal_fd_seek(void *ud,
+                                        int64_t *offset,
+                                        int whence) {
+  SDArchiverIOFd *io_fd = ud;
+  int64_t base;
+  if (io_fd->offset < 0) {
+    return 1;
+  }
+  switch (whence) {
+    case SEEK_SET:
+      base = 0;
+      break;
+    case SEEK_CUR:
+      base = io_fd->offset;
+      break;
+    case SEEK_END:
+      base = simple_archiver_io_internal_fd_size(ud);
+      if (base < 0) {
+        return 1;
+      }
+      break;
+    default:
+      return 1;
+  }
+  if (base + *offset < 0) {
+    return 1;
+  }
+  io_fd->offset = base + *offset;
+  *offset = io_fd->offset;
+  return 0;
+}
+#endif
+
+SDArchiverIO *simple_archiver_io_init_fd(int fd) {
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_COSMOPOLITAN || \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC ||          \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  if (fd < 0) {
+    return NULL;
+  }
+  SDArchiverIO *io = malloc(sizeof(SDArchiverIO));
+  memset(io, 0, sizeof(SDArchiverIO));
+  SDArchiverIOFd *io_fd = malloc(sizeof(SDArchiverIOFd));
+  io_fd->fd = fd;
+  // Fails with ESPIPE on pipes and sockets.
+  const off_t offset = lseek(fd, 0, SEEK_CUR);
+  io_fd->offset = offset < 0 ? -1 : (int64_t)offset;
+  io->ud = io_fd;
+  io->read = simple_archiver_io_internal_fd_read;
+  io->write = simple_archiver_io_internal_fd_write;
+  io->seek = simple_archiver_io_internal_fd_seek;
+  io->size = simple_archiver_io_internal_fd_size;
+  io->cleanup = free;
+  return io;
+#else
+  (void)fd;
+  return NULL;
+#endif
+}
+
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_COSMOPOLITAN || \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC ||          \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+/// Compares the current block with the file and writes it if it differs.
+/// Returns zero on success.
+int simple_archiver_io_internal_delta_flush(SDArchiverIODelta *delta) {
+  if (delta->fill == 0) {
+    return 0;
+  }
+
+  // Bytes past the end of the file count as different.
+  uint64_t have = 0;
+  while (have < delta->fill) {
+    ssize_t ret = pread(delta->fd,
+                        delta->disk + have,
+                        delta->fill - have,
+                        (off_t)(delta->offset + have));
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return 1;
+    } else if (ret == 0) {
+      break;
+    }
+    have += (uint64_t)ret;
+  }
+
+  ++delta->blocks;
+  if (have != delta->fill || memcmp(delta->block, delta->disk, have) != 0) {
+    uint64_t written = 0;
+    while (written < delta->fill) {
+      ssize_t ret = pwrite(delta->fd,
+                           delta->block + written,
+                           delta->fill - written,
+                           (off_t)(delta->offset + written));
+      if (ret < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return 1;
+      }
+      written += (uint64_t)ret;
+    }
+    ++delta->written_blocks;
+  }
+
+  delta->offset += delta->fill;
+  delta->fill = 0;
+  return 0;
+}
+
+int64_t simple_archiver_io_internal_delta_write(void *ud,
+                                                const char *buf,
+                                                uint64_t size) {
+  SDArchiverIODelta *delta = ud;
+  uint64_t done = 0;
+  while (done < size) {
+    uint64_t amount = delta->block_size - delta->fill;
+    if (amount > size - done) {
+      amount = size - done;
+    }
+    memcpy(delta->block + delta->fill, buf + done, amount);
+    delta->fill += amount;
+    done += amount;
+    if (delta->fill == delta->block_size
+        && simple_archiver_io_internal_delta_flush(delta) != 0) {
+      return -1;
+    }
+  }
+  return (int64_t)size;
+}
+
+void simple_archiver_io_internal_delta_cleanup(void *ud) {
+  SDArchiverIODelta *delta = ud;
+  free(delta->block);
+  free(delta->disk);
+  free(delta);
+}
+#endif
+
+SDArchiverIO *simple_archiver_io_init_delta_fd(int fd, uint64_t block_size) {
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_COSMOPOLITAN || \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC ||          \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  if (fd < 0 || block_size == 0) {
+    return NULL;
+  }
+  SDArchiverIODelta *delta = malloc(sizeof(SDArchiverIODelta));
+  memset(delta, 0, sizeof(SDArchiverIODelta));
+  delta->fd = fd;
+  delta->block_size = block_size;
+  delta->block = malloc(block_size);
+  delta->disk = malloc(block_size);
+  if (!delta->block || !delta->disk) {
+    simple_archiver_io_internal_delta_cleanup(delta);
+    return NULL;
+  }
+  SDArchiverIO *io = malloc(sizeof(SDArchiverIO));
+  memset(io, 0, sizeof(SDArchiverIO));
+  io->ud = delta;
+  io->write = simple_archiver_io_internal_delta_write;
+  io->cleanup = simple_archiver_io_internal_delta_cleanup;
+  return io;
+#else
+  (void)fd;
+  (void)block_size;
+  return NULL;
+#endif
+}
+
+int simple_archiver_io_delta_finish(SDArchiverIO *io,
+                                    uint64_t *written_blocks_out,
+                                    uint64_t *blocks_out) {
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_COSMOPOLITAN || \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC ||          \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  if (!io || io->write != simple_archiver_io_internal_delta_write) {
+    return 1;
+  }
+  SDArchiverIODelta *delta = io->ud;
+  if (simple_archiver_io_internal_delta_flush(delta) != 0) {
+    return 1;
+  }
+  struct stat st;
+  if (fstat(delta->fd, &st) != 0) {
+    return 1;
+  } else if ((uint64_t)st.st_size > delta->offset
+             && ftruncate(delta->fd, (off_t)delta->offset) != 0) {
+    return 1;
+  }
+  if (written_blocks_out) {
+    *written_blocks_out = delta->written_blocks;
+  }
+  if (blocks_out) {
+    *blocks_out = delta->blocks;
+  }
+  return 0;
+#else
+  (void)io;
+  (void)written_blocks_out;
+  (void)blocks_out;
+  return 1;
+#endif
+}
+
+void simple_archiver_io_internal_async_frame_free(void *data) {
+  SDArchiverIOAsyncFrame *frame = data;
+  if (frame) {
+    free(frame->data);
+    free(frame);
+  }
+}
+
+void *simple_archiver_io_internal_async_thread(void *ud) {
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_COSMOPOLITAN || \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC ||          \
+    SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  // Signals like SIGINT are handled by the archiver's thread.
+  sigset_t all_set;
+  sigfillset(&all_set);
+  pthread_sigmask(SIG_BLOCK, &all_set, NULL);
+#endif
+  SDArchiverIOAsync *async = ud;
+  SDArchiverIOAsyncFrame *frame;
+  int failed = 0;
+  while ((frame = simple_archiver_mpmc_queue_pop(async->frames))) {
+    if (failed) {
+      simple_archiver_io_internal_async_frame_free(frame);
+      continue;
+    } else if (async->out->write(async->out->ud, frame->data, frame->size)
+               != (int64_t)frame->size) {
+      failed = 1;
+      pthread_mutex_lock(&async->mutex);
+      async->error = 1;
+      pthread_mutex_unlock(&async->mutex);
+      // Fails the pushes of "write" so the error reaches the archiver.
+      simple_archiver_mpmc_queue_close(async->frames);
+      simple_archiver_io_internal_async_frame_free(frame);
+      continue;
+    }
+    frame->size = 0;
+    if (simple_archiver_mpmc_queue_try_push(async->free_frames, frame) != 0) {
+      simple_archiver_io_internal_async_frame_free(frame);
+    }
+  }
+  return NULL;
+}
+
+/// Hands the current frame to the writer thread. Returns zero on success.
+int simple_archiver_io_internal_async_push(SDArchiverIOAsync *async) {
+  if (!async->frame || async->frame->size == 0) {
+    return 0;
+  } else if (simple_archiver_mpmc_queue_push(async->frames, async->frame)
+             != 0) {
+    return 1;
+  }
+  async->frame = NULL;
+  return 0;
+}
+
+int64_t simple_archiver_io_internal_async_write(void *ud,
+                                                const char *buf,
+                                                uint64_t size) {
+  SDArchiverIOAsync *async = ud;
+  uint64_t done = 0;
+  while (done < size) {
+    if (!async->frame) {
+      async->frame = simple_archiver_mpmc_queue_try_pop(async->free_frames);
+      if (!async->frame) {
+        async->frame = malloc(sizeof(SDArchiverIOAsyncFrame));
+        async->frame->size = 0;
+        async->frame->data = malloc(async->frame_size);
+      }
+    }
+    uint64_t amount = async->frame_size - async->frame->size;
+    if (amount > size - done) {
+      amount = size - done;
+    }
+    memcpy(async->frame->data + async->frame->size, buf + done, amount);
+    async->frame->size += amount;
+    done += amount;
+    if (async->frame->size == async->frame_size
+        && simple_archiver_io_internal_async_push(async) != 0) {
+      return -1;
+    }
+  }
+  return (int64_t)done;
+}
+
+/// Stops the writer thread after it writes the queued frames.
+/// Returns zero if every frame was written.
+int simple_archiver_io_internal_async_join(SDArchiverIOAsync *async) {
+  if (async->is_thread_running) {
+    simple_archiver_mpmc_queue_close(async->frames);
+    pthread_join(async->thread, NULL);
+    async->is_thread_running = 0;
+  }
+  pthread_mutex_lock(&async->mutex);
+  int error = async->error;
+  pthread_mutex_unlock(&async->mutex);
+  return error;
+}
+
+void simple_archiver_io_internal_async_cleanup(void *ud) {
+  SDArchiverIOAsync *async = ud;
+  simple_archiver_io_internal_async_join(async);
+  simple_archiver_mpmc_queue_free(
+    &async->frames, simple_archiver_io_internal_async_frame_free);
+  simple_archiver_mpmc_queue_free(
+    &async->free_frames, simple_archiver_io_internal_async_frame_free);
+  simple_archiver_io_internal_async_frame_free(async->frame);
+  pthread_mutex_destroy(&async->mutex);
+  free(async);
+}
+
+SDArchiverIO *simple_archiver_io_init_async(SDArchiverIO *out,
+                                            uint64_t buffer_size,
+                                            uint64_t frame_size) {
+  if (!out || !out->write || frame_size == 0) {
+    return NULL;
+  }
+  const uint64_t capacity =
+    buffer_size / frame_size > 0 ? buffer_size / frame_size : 1;
+
+  SDArchiverIOAsync *async = malloc(sizeof(SDArchiverIOAsync));
+  memset(async, 0, sizeof(SDArchiverIOAsync));
+  async->out = out;
+  async->frame_size = frame_size;
+  if (pthread_mutex_init(&async->mutex, NULL) != 0) {
+    free(async);
+    return NULL;
+  }
+  async->frames = simple_archiver_mpmc_queue_init((size_t)capacity);
+  async->free_frames = simple_archiver_mpmc_queue_init((size_t)capacity);
+  if (!async->frames || !async->free_frames
+      || pthread_create(&async->thread,
+                        NULL,
+                        simple_archiver_io_internal_async_thread,
+                        async) != 0) {
+    simple_archiver_io_internal_async_cleanup(async);
+    return NULL;
+  }
+  async->is_thread_running = 1;
+
+  SDArchiverIO *io = malloc(sizeof(SDArchiverIO));
+  memset(io, 0, sizeof(SDArchiverIO));
+  io->ud = async;
+  io->write = simple_archiver_io_internal_async_write;
+  io->cleanup = simple_archiver_io_internal_async_cleanup;
+  return io;
+}
+
+int simple_archiver_io_async_finish(SDArchiverIO *io) {
+  if (!io || io->write != simple_archiver_io_internal_async_write) {
+    return 1;
+  }
+  SDArchiverIOAsync *async = io->ud;
+  const int push_ret = simple_archiver_io_internal_async_push(async);
+  return simple_archiver_io_internal_async_join(async) || push_ret ? 1 : 0;
+}
+
+int64_t simple_archiver_io_internal_mem_read(void *ud,
+                                             char *buf,
+                                             uint64_t size) {
+  SDArchiverIOMem *mem = ud;
+  const char *src = mem->ro_buf ? mem->ro_buf : mem->buf;
+  if (mem->pos >= mem->size) {
+    return 0;
+  } else if (size > mem->size - mem->pos) {
+    size = mem->size - mem->pos;
+  }
+  memcpy(buf, src + mem->pos, size);
+  mem->pos += size;
+  return (int64_t)size;
+}
+
+int64_t simple_archiver_io_internal_mem_write(void *ud,
+                                              const char *buf,
+                                              uint64_t size) {
+  SDArchiverIOMem *mem = ud;
+  if (mem->ro_buf) {
+    return -1;
+  }
+  if (mem->pos + size > mem->capacity) {
+    uint64_t new_capacity = mem->capacity ? mem->capacity : 4096;
+    while (new_capacity < mem->pos + size) {
+      new_capacity *= 2;
+    }
+    char *new_buf = realloc(mem->buf, new_capacity);
+    if (!new_buf) {
+      return -1;
+    }
+    mem->buf = new_buf;
+    mem->capacity = new_capacity;
+  }
+  if (mem->pos > mem->size) {
+    // Seeked past the end, fill the gap with zeroes.
+    memset(mem->buf + mem->size, 0, mem->pos - mem->size);
+  }
+  memcpy(mem->buf + mem->pos, buf, size);
+  mem->pos += size;
+  if (mem->pos > mem->size) {
+    mem->size = mem->pos;
+  }
+  return (int64_t)size;
+}
+
+int simple_archiver_io_internal_mem_seek(void *ud,
+                                         int64_t *offset,
+                                         int whence) {
+  SDArchiverIOMem *mem = ud;
+  int64_t base;
+  switch (whence) {
+    case SEEK_SET:
+      base = 0;
+      break;
+    case SEEK_CUR:
+      base = (int64_t)mem->pos;
+      break;
+    case SEEK_END:
+      base = (int64_t)mem->size;
+      break;
+    default:
+      return 1;
+  }
+  if (base + *offset < 0) {
+    return 1;
+  }
+  mem->pos = (uint64_t)(base + *offset);
+  *offset = (int64_t)mem->pos;
+  return 0;
+}
+
+int64_t simple_archiver_io_internal_mem_size(void *ud) {
+  return (int64_t)((SDArchiverIOMem *)ud)->size;
+}
+
+FILE *simple_archiver_io_internal_mem_get_FILE(void *ud,
+                                               const char *mode,
+                                               int_fast8_t *needs_fclose) {
+  SDArchiverIOMem *mem = ud;
+  // Reading a read-only buffer can be done directly on the buffer.
+  if (!mem->ro_buf || mem->size == 0 || mode[0] != 'r') {
+    return NULL;
+  }
+  *needs_fclose = 1;
+  return fmemopen((void *)mem->ro_buf, mem->size, "rb");
+}
+
+void simple_archiver_io_internal_mem_cleanup(void *ud) {
+  SDArchiverIOMem *mem = ud;
+  if (mem->buf) {
+    free(mem->buf);
+  }
+  free(mem);
+}
+
+SDArchiverIO *simple_archiver_io_init_mem(const char *buf, uint64_t size) {
+  SDArchiverIO *io = malloc(sizeof(SDArchiverIO));
+  memset(io, 0, sizeof(SDArchiverIO));
+  SDArchiverIOMem *mem = malloc(sizeof(SDArchiverIOMem));
+  memset(mem, 0, sizeof(SDArchiverIOMem));
+  if (buf) {
+    mem->ro_buf = buf;
+    mem->size = size;
+  }
+  io->ud = mem;
+  io->read = simple_archiver_io_internal_mem_read;
+  io->write = buf ? NULL : simple_archiver_io_internal_mem_write;
+  io->seek = simple_archiver_io_internal_mem_seek;
+  io->size = simple_archiver_io_internal_mem_size;
+  io->get_FILE = simple_archiver_io_internal_mem_get_FILE;
+  io->cleanup = simple_archiver_io_internal_mem_cleanup;
+  return io;
+}
+
+const char *simple_archiver_io_mem_buf(const SDArchiverIO *io,
+                                       uint64_t *size_out) {
+  if (!io || io->read != simple_archiver_io_internal_mem_read) {
+    return NULL;
+  }
+  const SDArchiverIOMem *mem = io->ud;
+  if (size_out) {
+    *size_out = mem->size;
+  }
+  return mem->ro_buf ? mem->ro_buf : mem->buf;
+}
+
+void simple_archiver_io_free(SDArchiverIO **io) {
+  if (io && *io) {
+    if ((*io)->cleanup) {
+      (*io)->cleanup((*io)->ud);
+    }
+    free(*io);
+    *io = NULL;
+  }
+}
+
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+ssize_t simple_archiver_io_internal_cookie_read(void *cookie,
+                                                char *buf,
+                                                size_t size) {
+  SDArchiverIO *io = cookie;
+  return io->read(io->ud, buf, size);
+}
+
+ssize_t simple_archiver_io_internal_cookie_write(void *cookie,
+                                                 const char *buf,
+                                                 size_t size) {
+  SDArchiverIO *io = cookie;
+  int64_t ret = io->write(io->ud, buf, size);
+  // "fopencookie" expects zero on error.
+  return ret < 0 ? 0 : ret;
+}
+
+int simple_archiver_io_internal_cookie_seek(void *cookie,
+                                            off64_t *offset,
+                                            int whence) {
+  SDArchiverIO *io = cookie;
+  int64_t pos = *offset;
+  if (io->seek(io->ud, &pos, whence) != 0) {
+    return -1;
+  }
+  *offset = pos;
+  return 0;
+}
+#elif SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC
+int simple_archiver_io_internal_cookie_read(void *cookie, char *buf, int size) {
+  SDArchiverIO *io = cookie;
+  return (int)io->read(io->ud, buf, (uint64_t)size);
+}
+
+int simple_archiver_io_internal_cookie_write(void *cookie,
+                                             const char *buf,
+                                             int size) {
+  SDArchiverIO *io = cookie;
+  return (int)io->write(io->ud, buf, (uint64_t)size);
+}
+
+fpos_t simple_archiver_io_internal_cookie_seek(void *cookie,
+                                               fpos_t offset,
+                                               int whence) {
+  SDArchiverIO *io = cookie;
+  int64_t pos = offset;
+  if (io->seek(io->ud, &pos, whence) != 0) {
+    return -1;
+  }
+  return pos;
+}
+#endif
+
+FILE *simple_archiver_io_open_FILE(SDArchiverIO *io,
+                                   const char *mode,
+                                   int_fast8_t *needs_fclose) {
+  if (!io || !mode || !needs_fclose) {
+    return NULL;
+  }
+  const int_fast8_t is_read = mode[0] == 'r' ? 1 : 0;
+  if ((is_read && !io->read) || (!is_read && !io->write)) {
+    return NULL;
+  }
+
+  if (io->get_FILE) {
+    FILE *f = io->get_FILE(io->ud, mode, needs_fclose);
+    if (f) {
+      return f;
+    }
+  }
+
+  *needs_fclose = 1;
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  cookie_io_functions_t funcs = {
+    .read = is_read ? simple_archiver_io_internal_cookie_read : NULL,
+    .write = is_read ? NULL : simple_archiver_io_internal_cookie_write,
+    .seek = io->seek ? simple_archiver_io_internal_cookie_seek : NULL,
+    .close = NULL
+  };
+  return fopencookie(io, mode, funcs);
+#elif SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_MAC
+  return funopen(io,
+                 is_read ? simple_archiver_io_internal_cookie_read : NULL,
+                 is_read ? NULL : simple_archiver_io_internal_cookie_write,
+                 io->seek ? simple_archiver_io_internal_cookie_seek : NULL,
+                 NULL);
+#else
+  return NULL;
+#endif
+}
+
+int simple_archiver_io_close_FILE(FILE **f, int_fast8_t needs_fclose) {
+  int ret = 0;
+  if (f && *f) {
+    if (needs_fclose) {
+      ret = fclose(*f);
+    } else {
+      ret = fflush(*f);
+    }
+    *f = NULL;
+  }
+  return ret;
+}
+
+SDArchiverIOStream *simple_archiver_io_stream_init(SDArchiverIO *io,
+                                                   int_fast8_t is_write) {
+  if (!io || (is_write && !io->write) || (!is_write && !io->read)) {
+    return NULL;
+  }
+  SDArchiverIOStream *stream = malloc(sizeof(SDArchiverIOStream));
+  memset(stream, 0, sizeof(SDArchiverIOStream));
+  stream->io = io;
+  stream->buf_size = SDA_IO_STREAM_BUF_SIZE;
+  stream->buf = malloc(stream->buf_size);
+  stream->is_write = is_write;
+  return stream;
+}
+
+SDArchiverIOStream *simple_archiver_io_stream_init_FILE(FILE *f,
+                                                        int_fast8_t is_write) {
+  SDArchiverIO *io = simple_archiver_io_init_stdio(f);
+  SDArchiverIOStream *stream = simple_archiver_io_stream_init(io, is_write);
+  if (!stream) {
+    simple_archiver_io_free(&io);
+    return NULL;
+  }
+  stream->owned_io = io;
+  if (is_write) {
+    stream->f = f;
+  }
+  return stream;
+}
+
+SDArchiverIO *simple_archiver_io_stream_io(SDArchiverIOStream *stream) {
+  return stream ? stream->io : NULL;
+}
+
+int simple_archiver_io_stream_close(SDArchiverIOStream **stream) {
+  int ret = 0;
+  if (stream && *stream) {
+    ret = simple_archiver_io_flush(*stream) == 0 ? 0 : 1;
+    simple_archiver_io_free(&(*stream)->owned_io);
+    free((*stream)->buf);
+    free(*stream);
+    *stream = NULL;
+  }
+  return ret;
+}
+
+void simple_archiver_io_stream_free(SDArchiverIOStream **stream) {
+  simple_archiver_io_stream_close(stream);
+}
+
+/// Returns zero on success.
+int simple_archiver_io_internal_stream_write_buf(SDArchiverIOStream *stream,
+                                                 const char *buf,
+                                                 size_t size) {
+  if (size > 0 && stream->io->write(stream->io->ud, buf, size)
+                  != (int64_t)size) {
+    stream->is_error = 1;
+    return 1;
+  }
+  return 0;
+}
+
+size_t simple_archiver_io_read(void *buf,
+                               size_t size,
+                               size_t count,
+                               SDArchiverIOStream *stream) {
+  if (size == 0 || count == 0 || stream->is_write) {
+    return 0;
+  } else if (count > SIZE_MAX / size) {
+    stream->is_error = 1;
+    return 0;
+  }
+  const size_t total = size * count;
+  char *out = buf;
+  size_t done = 0;
+  while (done < total) {
+    if (stream->pos < stream->len) {
+      size_t amount = stream->len - stream->pos;
+      if (amount > total - done) {
+        amount = total - done;
+      }
+      memcpy(out + done, stream->buf + stream->pos, amount);
+      stream->pos += amount;
+      done += amount;
+      continue;
+    } else if (stream->is_eof || stream->is_error) {
+      break;
+    }
+
+    // Reads of at least a buffer's size skip the buffer.
+    const int_fast8_t is_direct = total - done >= stream->buf_size;
+    int64_t ret = stream->io->read(stream->io->ud,
+                                   is_direct ? out + done : stream->buf,
+                                   is_direct ? total - done : stream->buf_size);
+    if (ret < 0) {
+      stream->is_error = 1;
+    } else if (ret == 0) {
+      stream->is_eof = 1;
+    } else if (is_direct) {
+      done += (size_t)ret;
+    } else {
+      stream->pos = 0;
+      stream->len = (size_t)ret;
+    }
+  }
+  return done / size;
+}
+
+size_t simple_archiver_io_write(const void *buf,
+                                size_t size,
+                                size_t count,
+                                SDArchiverIOStream *stream) {
+  if (size == 0 || count == 0 || !stream->is_write) {
+    return 0;
+  } else if (count > SIZE_MAX / size) {
+    stream->is_error = 1;
+    return 0;
+  }
+  const size_t total = size * count;
+  if (total <= stream->buf_size - stream->len) {
+    memcpy(stream->buf + stream->len, buf, total);
+    stream->len += total;
+    if (stream->len == stream->buf_size) {
+      const size_t len = stream->len;
+      stream->len = 0;
+      if (simple_archiver_io_internal_stream_write_buf(stream,
+                                                       stream->buf,
+                                                       len) != 0) {
+        return 0;
+      }
+    }
+    return count;
+  }
+
+  const size_t len = stream->len;
+  stream->len = 0;
+  if (simple_archiver_io_internal_stream_write_buf(stream, stream->buf, len)
+      != 0) {
+    return 0;
+  } else if (total >= stream->buf_size) {
+    // Writes of at least a buffer's size skip the buffer.
+    if (simple_archiver_io_internal_stream_write_buf(stream, buf, total)
+        != 0) {
+      return 0;
+    }
+  } else {
+    memcpy(stream->buf, buf, total);
+    stream->len = total;
+  }
+  return count;
+}
+
+int simple_archiver_io_getc(SDArchiverIOStream *stream) {
+  unsigned char c;
+  if (stream->pos < stream->len) {
+    return (unsigned char)stream->buf[stream->pos++];
+  } else if (simple_archiver_io_read(&c, 1, 1, stream) != 1) {
+    return EOF;
+  }
+  return c;
+}
+
+const char *simple_archiver_io_peek(SDArchiverIOStream *stream,
+                                    size_t *size_out) {
+  if (stream->is_write) {
+    *size_out = 0;
+    return NULL;
+  } else if (stream->pos == stream->len && !stream->is_eof
+             && !stream->is_error) {
+    int64_t ret = stream->io->read(stream->io->ud,
+                                   stream->buf,
+                                   stream->buf_size);
+    if (ret < 0) {
+      stream->is_error = 1;
+    } else if (ret == 0) {
+      stream->is_eof = 1;
+    } else {
+      stream->pos = 0;
+      stream->len = (size_t)ret;
+    }
+  }
+  *size_out = stream->len - stream->pos;
+  return stream->buf + stream->pos;
+}
+
+void simple_archiver_io_consume(SDArchiverIOStream *stream, size_t size) {
+  if (size > stream->len - stream->pos) {
+    size = stream->len - stream->pos;
+  }
+  stream->pos += size;
+}
+
+char *simple_archiver_io_reserve(SDArchiverIOStream *stream, size_t size) {
+  if (!stream->is_write || size > stream->buf_size) {
+    return NULL;
+  } else if (size > stream->buf_size - stream->len) {
+    const size_t len = stream->len;
+    stream->len = 0;
+    if (simple_archiver_io_internal_stream_write_buf(stream, stream->buf, len)
+        != 0) {
+      return NULL;
+    }
+  }
+  return stream->buf + stream->len;
+}
+
+void simple_archiver_io_commit(SDArchiverIOStream *stream, size_t size) {
+  stream->len += size;
+}
+
+int simple_archiver_io_seek(SDArchiverIOStream *stream,
+                            int64_t offset,
+                            int whence) {
+  if (stream->is_write || !stream->io->seek) {
+    return -1;
+  } else if (whence == SEEK_CUR) {
+    if (offset >= 0 && (uint64_t)offset <= stream->len - stream->pos) {
+      // Stays within the buffer.
+      stream->pos += (size_t)offset;
+      return 0;
+    }
+    // The backend is ahead by the unread bytes of the buffer.
+    offset -= (int64_t)(stream->len - stream->pos);
+  }
+  if (stream->io->seek(stream->io->ud, &offset, whence) != 0) {
+    return -1;
+  }
+  stream->pos = 0;
+  stream->len = 0;
+  stream->is_eof = 0;
+  return 0;
+}
+
+int64_t simple_archiver_io_tell(SDArchiverIOStream *stream) {
+  int64_t offset = 0;
+  if (stream->is_write || !stream->io->seek
+      || stream->io->seek(stream->io->ud, &offset, SEEK_CUR) != 0) {
+    return -1;
+  }
+  return offset - (int64_t)(stream->len - stream->pos);
+}
+
+int simple_archiver_io_flush(SDArchiverIOStream *stream) {
+  if (!stream->is_write) {
+    return 0;
+  }
+  const size_t len = stream->len;
+  stream->len = 0;
+  if (simple_archiver_io_internal_stream_write_buf(stream, stream->buf, len)
+      != 0) {
+    return EOF;
+  } else if (stream->f && fflush(stream->f) != 0) {
+    stream->is_error = 1;
+    return EOF;
+  }
+  return 0;
+}
+
+int simple_archiver_io_eof(const SDArchiverIOStream *stream) {
+  return stream->is_eof && stream->pos == stream->len;
+}
+
+int simple_archiver_io_error(const SDArchiverIOStream *stream) {
+  return stream->is_error;
+}
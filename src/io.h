@@ -0,0 +1,191 @@
+// ISC License
+//
+// Copyright (c) 2024-2026 Stephen Seo
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//
+// `io.h` is the header for pluggable archive input/output backends.
+
+#ifndef SEODISPARATE_COM_SIMPLE_ARCHIVER_IO_H_
+#define SEODISPARATE_COM_SIMPLE_ARCHIVER_IO_H_
+
+// Standard library includes.
+#include <stdint.h>
+#include <stdio.h>
+
+/// Set of callbacks the archiver reads from or writes to.
+/// Every callback gets "ud" as its first argument.
+typedef struct SDArchiverIO {
+  void *ud;
+  /// Returns bytes read, zero on EOF, negative on error.
+  /// NULL if not readable.
+  int64_t (*read)(void *ud, char *buf, uint64_t size);
+  /// Returns bytes written, negative on error.
+  /// NULL if not writable.
+  int64_t (*write)(void *ud, const char *buf, uint64_t size);
+  /// Sets "*offset" to the resulting position. Returns zero on success.
+  /// NULL if not seekable.
+  int (*seek)(void *ud, int64_t *offset, int whence);
+  /// Returns the total size, or negative if unknown.
+  /// May be NULL.
+  int64_t (*size)(void *ud);
+  /// Returns a plain FILE* on the backing storage, so stdio does not go
+  /// through "read"/"write". "*needs_fclose" must be set to non-zero if the
+  /// returned FILE* is owned by the caller.
+  /// May be NULL or return NULL.
+  FILE *(*get_FILE)(void *ud, const char *mode, int_fast8_t *needs_fclose);
+  /// Frees "ud". May be NULL.
+  void (*cleanup)(void *ud);
+} SDArchiverIO;
+
+/// Does not take ownership of "f".
+SDArchiverIO *simple_archiver_io_init_stdio(FILE *f);
+
+/// Does not take ownership of "fd". Reads and writes at an offset of its own
+/// with pread/pwrite, starting at the offset of "fd", so the offset of "fd"
+/// is left as is. Pipes and sockets are read and written in order instead.
+SDArchiverIO *simple_archiver_io_init_fd(int fd);
+
+/// If "buf" is non-NULL, it is read-only and is not copied, so it must outlive
+/// the returned SDArchiverIO.
+/// If "buf" is NULL, a growable buffer is written to that is accessible with
+/// "simple_archiver_io_mem_buf(...)".
+SDArchiverIO *simple_archiver_io_init_mem(const char *buf, uint64_t size);
+
+/// Writes over the existing file "fd" from its start, comparing each block of
+/// "block_size" bytes with what the file already holds and only writing the
+/// blocks that differ. "fd" must be open for reading and writing, and is not
+/// owned by the returned SDArchiverIO. Not readable or seekable.
+/// Call "simple_archiver_io_delta_finish(...)" after the last write.
+/// Returns NULL on error or if unsupported on this platform.
+SDArchiverIO *simple_archiver_io_init_delta_fd(int fd, uint64_t block_size);
+
+/// Writes the last partial block if it differs and truncates the file to what
+/// was written. If non-NULL, "written_blocks_out" and "blocks_out" are set to
+/// the number of written and compared blocks.
+/// Returns zero on success.
+int simple_archiver_io_delta_finish(SDArchiverIO *io,
+                                    uint64_t *written_blocks_out,
+                                    uint64_t *blocks_out);
+
+/// Writes to "out" from a writer thread, so the caller does not wait on slow
+/// output until "buffer_size" bytes are queued. Data is handed to the thread
+/// in frames of "frame_size" bytes. Does not take ownership of "out", which
+/// must not be used until "simple_archiver_io_async_finish(...)".
+/// A failed write by the thread fails the following writes. Not readable or
+/// seekable. Returns NULL on error.
+SDArchiverIO *simple_archiver_io_init_async(SDArchiverIO *out,
+                                            uint64_t buffer_size,
+                                            uint64_t frame_size);
+
+/// Waits for the writer thread to write all queued data, and stops it.
+/// Returns zero if all data was written.
+int simple_archiver_io_async_finish(SDArchiverIO *io);
+
+/// Returns the memory backend's buffer, or NULL if "io" is not a memory
+/// backend. The returned buffer is owned by "io".
+const char *simple_archiver_io_mem_buf(const SDArchiverIO *io,
+                                       uint64_t *size_out);
+
+/// Calls "cleanup" and frees "io".
+void simple_archiver_io_free(SDArchiverIO **io);
+
+/// For code that needs stdio, like extracting a file in place. Returns the
+/// FILE* of "get_FILE" if it gives one, otherwise a FILE* that calls
+/// "read"/"write" through fopencookie (Linux) or funopen (macOS), where
+/// stdio's buffer adds a copy. Returns NULL on error, or if "get_FILE" gives
+/// none on other platforms.
+/// Must be closed with "simple_archiver_io_close_FILE(...)".
+FILE *simple_archiver_io_open_FILE(SDArchiverIO *io,
+                                   const char *mode,
+                                   int_fast8_t *needs_fclose);
+
+/// Returns zero on success.
+int simple_archiver_io_close_FILE(FILE **f, int_fast8_t needs_fclose);
+
+/// Buffered stream the archiver reads and writes archives with. Calls "read"
+/// or "write" of a SDArchiverIO with whole buffers, and hands reads and writes
+/// of at least a buffer's size to it directly. Not thread-safe.
+typedef struct SDArchiverIOStream SDArchiverIOStream;
+
+/// Does not take ownership of "io". Returns NULL if "io" cannot read or write
+/// as asked by "is_write".
+SDArchiverIOStream *simple_archiver_io_stream_init(SDArchiverIO *io,
+                                                   int_fast8_t is_write);
+
+/// Does not take ownership of "f". Flushing the stream also flushes "f".
+SDArchiverIOStream *simple_archiver_io_stream_init_FILE(FILE *f,
+                                                        int_fast8_t is_write);
+
+/// Returns the SDArchiverIO the stream reads from or writes to.
+SDArchiverIO *simple_archiver_io_stream_io(SDArchiverIOStream *stream);
+
+/// Flushes and frees the stream. Returns zero on success.
+int simple_archiver_io_stream_close(SDArchiverIOStream **stream);
+
+/// Same as "simple_archiver_io_stream_close" without the result, to be used
+/// with "__attribute__((cleanup(...)))".
+void simple_archiver_io_stream_free(SDArchiverIOStream **stream);
+
+/// Same as "fread".
+size_t simple_archiver_io_read(void *buf,
+                               size_t size,
+                               size_t count,
+                               SDArchiverIOStream *stream);
+
+/// Same as "fwrite".
+size_t simple_archiver_io_write(const void *buf,
+                                size_t size,
+                                size_t count,
+                                SDArchiverIOStream *stream);
+
+/// Same as "getc".
+int simple_archiver_io_getc(SDArchiverIOStream *stream);
+
+/// Returns the unread bytes a stream that reads holds, reading more first if
+/// it holds none, without consuming them. "*size_out" is set to their count,
+/// which is zero on EOF or error. Valid until the next call on "stream".
+const char *simple_archiver_io_peek(SDArchiverIOStream *stream,
+                                    size_t *size_out);
+
+/// Consumes "size" of the bytes given by "simple_archiver_io_peek(...)".
+void simple_archiver_io_consume(SDArchiverIOStream *stream, size_t size);
+
+/// Returns room for "size" bytes in the buffer of a stream that writes, so
+/// data can be put there directly. Writes out what the stream holds first if
+/// there is not enough room. Returns NULL on error or if "size" is larger than
+/// the buffer. Nothing is written until "simple_archiver_io_commit(...)".
+char *simple_archiver_io_reserve(SDArchiverIOStream *stream, size_t size);
+
+/// Adds the first "size" bytes of the room given by
+/// "simple_archiver_io_reserve(...)" to what the stream writes.
+void simple_archiver_io_commit(SDArchiverIOStream *stream, size_t size);
+
+/// Same as "fseek". Only for streams that read from a seekable SDArchiverIO.
+int simple_archiver_io_seek(SDArchiverIOStream *stream,
+                            int64_t offset,
+                            int whence);
+
+/// Same as "ftell". Only for streams that read from a seekable SDArchiverIO.
+int64_t simple_archiver_io_tell(SDArchiverIOStream *stream);
+
+/// Same as "fflush".
+int simple_archiver_io_flush(SDArchiverIOStream *stream);
+
+/// Same as "feof".
+int simple_archiver_io_eof(const SDArchiverIOStream *stream);
+
+/// Same as "ferror".
+int simple_archiver_io_error(const SDArchiverIOStream *stream);
+
+#endif
@@ -28,6 +28,7 @@
 #include "archiver.h"
 #include "parser.h"
 #include "helpers.h"
+#include "watch.h"
 
 int print_map_fn(
     SDAR_ATTR_UNUSED const void *key,
@@ -73,6 +74,26 @@ int main(int argc, const char **argv) {
     return 9;
   }
 
+  if (parsed.delta_from && (parsed.flags & 0x3) == 0) {
+    if (parsed.write_version < 8) {
+      fprintf(stderr,
+              "ERROR: \"--delta-from\" requires \"--write-version 8\"!\n");
+      simple_archiver_print_usage();
+      return 11;
+    } else if (!parsed.compressor || !parsed.decompressor) {
+      fprintf(stderr,
+              "ERROR: \"--delta-from\" requires \"--compressor\" and "
+              "\"--decompressor\"!\n");
+      simple_archiver_print_usage();
+      return 11;
+    } else if (parsed.rsyncable) {
+      fprintf(stderr,
+              "ERROR: \"--rsyncable\" cannot be used with \"--delta-from\"!\n");
+      simple_archiver_print_usage();
+      return 11;
+    }
+  }
+
   if ((parsed.flags & 0x3) == 0 && (parsed.flags & 0x2000) != 0) {
     fprintf(stderr,
             "WARNING: --force-dir-permissions specified, but has no effect "
@@ -99,6 +120,14 @@ int main(int argc, const char **argv) {
     }
   }
 
+  if ((parsed.flags & 0x20000000)
+      && ((parsed.flags & 0x3) != 0 || (parsed.flags & 0x10) != 0)) {
+    fprintf(stderr,
+            "ERROR: \"--watch\" requires creating an archive to a file!\n");
+    simple_archiver_print_usage();
+    return 12;
+  }
+
 #ifndef NDEBUG
   if (parsed.working_files->count > 0) {
     fprintf(stderr, "Filenames:\n");
@@ -124,6 +153,17 @@ int main(int argc, const char **argv) {
     __attribute__((cleanup(simple_archiver_free_state)))
     SDArchiverState *state = simple_archiver_init_state(&parsed);
     if ((parsed.flags & 0x10) == 0) {
+      // Watching starts before the initial archive so that changes made while
+      // it is written end up in the first segment.
+      __attribute__((cleanup(simple_archiver_watch_free)))
+      SDArchiverWatch *watch = NULL;
+      if (parsed.flags & 0x20000000) {
+        watch = simple_archiver_watch_begin(state);
+        if (!watch) {
+          return 12;
+        }
+      }
+
       FILE *file = fopen(parsed.filename, "wb");
       if (!file) {
         fprintf(stderr, "ERROR: Failed to open \"%s\" for writing!\n",
@@ -150,6 +190,10 @@ int main(int argc, const char **argv) {
         return 3;
       }
 #endif
+
+      if (watch && simple_archiver_watch_run(watch)) {
+        return 13;
+      }
     } else {
       SDArchiverStateRetStruct ret =
         simple_archiver_write_all(stdout, state);
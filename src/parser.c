@@ -16,6 +16,12 @@
 //
 // `parser.c` is the source file for parsing args.
 
+#include "platforms.h"
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+// Needed for "statx".
+#define _GNU_SOURCE
+#endif
+
 #include "parser.h"
 
 #define PARSER_PROGRESS_INTERVAL 5
@@ -151,6 +157,95 @@ void simple_archiver_parser_internal_remove_end_slash(char *filename) {
   }
 }
 
+/// Reads the opened regular file "file" of "size" bytes into the small-files
+/// arena if it is small enough and fits in the budget. "file_info->filename"
+/// must already be normalized, as files the white/black lists remove later on
+/// are not read.
+void simple_archiver_parser_internal_read_small_file(
+    SDArchiverParsed *out,
+    SDArchiverFileInfo *file_info,
+    FILE *file,
+    uint64_t size) {
+  const uint64_t used =
+    out->small_files_arena ? out->small_files_arena->used : 0;
+  if (size == 0 || size > out->small_files_size || out->write_version < 4
+      || used + size > out->small_files_budget
+      || !simple_archiver_helper_string_allowed_lists(
+           file_info->filename,
+           out->flags & 0x20000 ? 1 : 0,
+           out)) {
+    return;
+  }
+
+  if (!out->small_files_arena) {
+    out->small_files_arena = simple_archiver_arena_init(0);
+  }
+  char *data = simple_archiver_arena_alloc(out->small_files_arena,
+                                           (size_t)size);
+  if (!data) {
+    return;
+  }
+  // A file that changed size since it was stat'ed is left to be read later,
+  // and does not use up the budget.
+  if (fread(data, 1, (size_t)size, file) == size && fgetc(file) == EOF) {
+    file_info->data = data;
+    file_info->data_size = size;
+  } else {
+    simple_archiver_arena_unalloc_last(out->small_files_arena, (size_t)size);
+  }
+}
+
+/// Fills the type and size of "st" for "name" in the walked dir "dir_fd" (or
+/// the cwd if AT_FDCWD), also found at "path" from the cwd. "d_type" is the
+/// entry's type from "readdir", or DT_UNKNOWN. "st" is zeroed first, so it is
+/// neither a file, symlink, nor dir if the stat fails.
+void simple_archiver_parser_internal_walk_stat(const SDArchiverParsed *out,
+                                               int dir_fd,
+                                               const char *name,
+                                               const char *path,
+                                               unsigned char d_type,
+                                               struct stat *st) {
+  memset(st, 0, sizeof(struct stat));
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  // The walk only needs the size of regular files to read small files.
+  if (d_type == DT_DIR) {
+    st->st_mode = S_IFDIR;
+    return;
+  } else if (d_type == DT_LNK) {
+    st->st_mode = S_IFLNK;
+    return;
+  } else if (d_type == DT_REG
+             && (out->small_files_size == 0 || out->write_version < 4)) {
+    st->st_mode = S_IFREG;
+    return;
+  }
+#else
+  (void)d_type;
+#endif
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX \
+    && defined(STATX_TYPE)
+  // Relative to the dir being walked, so the path is not resolved again.
+  (void)path;
+  struct statx stx;
+  if (statx(dir_fd,
+            name,
+            AT_SYMLINK_NOFOLLOW
+              | (out->stat_dont_sync ? AT_STATX_DONT_SYNC : 0),
+            STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_UID | STATX_GID,
+            &stx) == 0) {
+    st->st_mode = stx.stx_mode;
+    st->st_size = (off_t)stx.stx_size;
+    st->st_uid = stx.stx_uid;
+    st->st_gid = stx.stx_gid;
+  }
+#else
+  (void)out;
+  (void)dir_fd;
+  (void)name;
+  fstatat(AT_FDCWD, path, st, AT_SYMLINK_NOFOLLOW);
+#endif
+}
+
 void simple_archiver_internal_free_file_info_fn(void *data) {
   SDArchiverFileInfo *file_info = data;
   if (file_info) {
@@ -179,6 +274,75 @@ int list_remove_same_str_fn(void *data, void *ud) {
   return 0;
 }
 
+/// Returns non-zero if the walker may skip the contents of "dir" because every
+/// path within it would be removed by the blacklists later on.
+int simple_archiver_parser_internal_is_dir_pruned(const SDArchiverParsed *out,
+                                                  const char *dir) {
+  // Paths with "." components are normalized after the walk, so the
+  // blacklists would be checked against a different string.
+  for (size_t idx = 0; dir[idx] != 0; ++idx) {
+    if (dir[idx] == '.'
+        && (idx == 0 || dir[idx - 1] == '/')
+        && (dir[idx + 1] == 0 || dir[idx + 1] == '/')) {
+      return 0;
+    }
+  }
+
+  return simple_archiver_helper_string_dir_blacklisted(
+    dir,
+    out->flags & 0x20000 ? 1 : 0,
+    out);
+}
+
+/// Parses a byte count with an optional "KB, KiB, MB, MiB, GB, or GiB" suffix.
+/// Returns zero on success.
+int simple_archiver_parser_internal_parse_bytes(const char *str,
+                                                const char *arg_name,
+                                                uint64_t *out) {
+  *out = 0;
+  char suffix_buf[4];
+  size_t sb_idx = 0;
+  int_fast8_t digits_passed = 0;
+
+  for (const char *c = str; *c != 0; ++c) {
+    if (!digits_passed && *c >= '0' && *c <= '9') {
+      *out = *out * 10 + (uint64_t)(*c - '0');
+    } else {
+      digits_passed = 1;
+      suffix_buf[sb_idx++] = *c;
+      if (sb_idx > 3) {
+        fprintf(stderr, "ERROR: Invalid arg to %s!\n", arg_name);
+        return 1;
+      }
+    }
+  }
+  suffix_buf[sb_idx] = 0;
+
+  if (sb_idx > 0) {
+    if (strcmp(suffix_buf, "KB") == 0) {
+      *out *= 1000;
+    } else if (strcmp(suffix_buf, "KiB") == 0) {
+      *out *= 1024;
+    } else if (strcmp(suffix_buf, "MB") == 0) {
+      *out *= 1000 * 1000;
+    } else if (strcmp(suffix_buf, "MiB") == 0) {
+      *out *= 1024 * 1024;
+    } else if (strcmp(suffix_buf, "GB") == 0) {
+      *out *= 1000 * 1000 * 1000;
+    } else if (strcmp(suffix_buf, "GiB") == 0) {
+      *out *= 1024 * 1024 * 1024;
+    } else {
+      fprintf(stderr,
+              "ERROR: Invalid suffix \"%s\"! Expected KB, KiB, MB, MiB, "
+              "GB, or GiB!\n",
+              suffix_buf);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
 char *simple_archiver_parsed_status_to_str(SDArchiverParsedStatus status) {
   switch (status) {
     case SDAPS_SUCCESS:
@@ -195,6 +359,11 @@ void simple_archiver_print_usage(void) {
   fprintf(stderr, "-c : create archive file\n");
   fprintf(stderr, "-x : extract archive file\n");
   fprintf(stderr, "-t : examine archive file\n");
+  fprintf(stderr,
+          "--du : examine only the directory summaries of the archive "
+          "(file format 11), printing \"<bytes> <files> <largest file bytes> "
+          "<dir>\" (tab separated) to stdout for every dir, or for the dirs "
+          "given as arguments and the dirs within them\n");
   fprintf(stderr, "-f <filename> : filename to work on\n");
   fprintf(stderr,
           "  Use \"-f -\" to work on stdout when creating archive or stdin "
@@ -218,6 +387,11 @@ void simple_archiver_print_usage(void) {
           "file's stored decompressor cmd\n");
   fprintf(stderr, "--overwrite-create : allows overwriting an archive file\n");
   fprintf(stderr, "--overwrite-extract : allows overwriting when extracting\n");
+  fprintf(stderr,
+          "--extract-in-place-delta : implies \"--overwrite-extract\", "
+          "existing files of the same size (without other hard links) are "
+          "rewritten in place, only writing blocks that differ (file formats "
+          "4 and up)\n");
   fprintf(stderr,
           "--no-abs-symlink : do not store absolute paths for symlinks\n");
   fprintf(
@@ -241,11 +415,103 @@ void simple_archiver_print_usage(void) {
   fprintf(stderr,
           "--write-version <version> | --write-version=<version> : Force write "
           "version file format (default 6)\n");
+  fprintf(stderr,
+          "--delta-from <archive> | --delta-from=<archive> : compress chunks "
+          "against the matching chunks of a previous archive (requires "
+          "\"--write-version 8\" or above and a de/compressor that supports "
+          "\"--patch-from=<file>\" like zstd)\n  When extracting, specifies "
+          "the same previous archive to reconstruct delta chunks\n");
   fprintf(stderr,
           "--chunk-min-size <bytes> | --chunk-min-size=<bytes> : minimum chunk "
           "size (default 268435456 or 256MiB) when using chunks (file formats "
           "v. 1 and up)\n  Note suffixes \"KB, KiB, MB, MiB, GB, and GiB\" are "
           "supported\n  Use like \"32MiB\" without spaces.\n");
+  fprintf(stderr,
+          "--compress-jobs <count> | --compress-jobs=<count> : compress each "
+          "chunk with up to <count> compressor processes working on separate "
+          "slices of the chunk (default 1, file formats v. 4 and up)\n  The "
+          "decompressor must accept concatenated compressed streams (gzip, "
+          "zstd, xz, and bzip2 do)\n");
+  fprintf(stderr,
+          "--compress-slice-size <bytes> | --compress-slice-size=<bytes> : "
+          "size of the slices used with \"--compress-jobs\" (default "
+          "16777216 or 16MiB)\n  Note suffixes \"KB, KiB, MB, MiB, GB, and "
+          "GiB\" are supported\n");
+  fprintf(stderr,
+          "--rsyncable : end the compressed slices of a chunk where a rolling "
+          "hash of the uncompressed data matches, so similar archives share "
+          "most of their compressed bytes (file formats v. 4 and up)\n  "
+          "Slices are 128KiB to 4MiB (about 640KiB on average) regardless of "
+          "\"--compress-slice-size\", and the compressor must give the same "
+          "output for the same input (e.g. \"gzip -n\")\n  Cannot be used "
+          "with \"--delta-from\"\n");
+  fprintf(stderr,
+          "--make-jobserver : each compressor of \"--compress-jobs\" after "
+          "the first takes a token from the GNU make jobserver in MAKEFLAGS, "
+          "so it does not oversubscribe a parallel make build\n  The make "
+          "recipe may need a \"+\" prefix for make to pass the jobserver\n");
+  fprintf(stderr,
+          "--pressure-limit <percent> | --pressure-limit=<percent> : halve the "
+          "compressors of \"--compress-jobs\" while the Linux pressure stall "
+          "(avg10 of cpu, io, or memory) is above <percent>, and add them back "
+          "one at a time while it is below half of it\n  Also runs no more "
+          "compressors than the cgroup CPU quota allows\n");
+  fprintf(stderr,
+          "--write-buffer-size <bytes> | --write-buffer-size=<bytes> : queue "
+          "up to <bytes> of output for a writer thread, so compressing does "
+          "not wait on a slow archive output (default 0 to write directly, "
+          "file formats v. 4 and up)\n  Note suffixes \"KB, "
+          "KiB, MB, MiB, GB, and GiB\" are supported\n");
+  fprintf(stderr,
+          "--stats=<text|json> : print the archive sizes and the slow-file "
+          "report as text to stderr (default) or as one JSON object to stdout "
+          "(to stderr when the archive is written to stdout)\n");
+  fprintf(stderr,
+          "--slow-files <count> | --slow-files=<count> : report the <count> "
+          "files that took the longest to open, read/write, and wait on the "
+          "de/compressor, and time spent per top-level directory (default 0, "
+          "which disables timing files, file formats v. 4 and up)\n");
+  fprintf(stderr,
+          "--read-small-files <bytes> | --read-small-files=<bytes> : read "
+          "files of up to <bytes> while walking dirs instead of opening them "
+          "again when compressing (default 0 or disabled, file formats v. 4 "
+          "and up)\n  Note suffixes \"KB, KiB, MB, MiB, GB, and GiB\" are "
+          "supported\n");
+  fprintf(stderr,
+          "--read-small-files-budget <bytes> | "
+          "--read-small-files-budget=<bytes> : maximum total size of files "
+          "read by \"--read-small-files\" (default 67108864 or 64MiB)\n");
+  fprintf(stderr,
+          "--stat-dont-sync : when walking dirs (Linux only), use possibly "
+          "stale cached file attributes instead of syncing them with the "
+          "server of a network filesystem\n");
+  fprintf(stderr,
+          "--watch : after creating the archive, keep watching the given "
+          "directories (Linux only) and write the changed entries as archive "
+          "segments \"<archive>.1\", \"<archive>.2\", ... and the deleted "
+          "paths as \"<archive>.1.deleted\", ... until SIGINT, SIGHUP, or "
+          "SIGTERM\n");
+  fprintf(stderr,
+          "--watch-interval <seconds> | --watch-interval=<seconds> : write a "
+          "segment with the changes every <seconds> (default 60)\n");
+  fprintf(stderr,
+          "--watch-max-changes <bytes> | --watch-max-changes=<bytes> : also "
+          "write a segment once the changed files reach <bytes> (default "
+          "67108864 or 64MiB)\n  Note suffixes \"KB, KiB, MB, MiB, GB, and "
+          "GiB\" are supported\n");
+  fprintf(stderr,
+          "--filter-min-size <bytes> | --filter-min-size=<bytes> : only list "
+          "or extract files of at least <bytes> (file formats v. 4 and up)\n");
+  fprintf(stderr,
+          "--filter-max-size <bytes> | --filter-max-size=<bytes> : only list "
+          "or extract files of at most <bytes> (file formats v. 4 and up)\n"
+          "  Note suffixes \"KB, KiB, MB, MiB, GB, and GiB\" are supported\n");
+  fprintf(stderr,
+          "--filter-uid <uid> | --filter-uid=<uid> : only list or extract "
+          "files stored with UID <uid> (file formats v. 4 and up)\n");
+  fprintf(stderr,
+          "--filter-gid <gid> | --filter-gid=<gid> : only list or extract "
+          "files stored with GID <gid> (file formats v. 4 and up)\n");
   fprintf(stderr,
           "--no-pre-sort-files : do NOT pre-sort files by size (by default "
           "enabled so that the first file is the largest; mutually exclusive "
@@ -253,6 +519,11 @@ void simple_archiver_print_usage(void) {
   fprintf(stderr,
           "--sort-files-by-name : pre-sort files by name (mutually exclusive "
           "with \"--no-pre-sort-files\").\n");
+  fprintf(stderr,
+          "--sort-files-by-similarity : pre-sort files by extension and then "
+          "by sampled content so that similar files share chunks (file "
+          "formats v. 4 and up; mutually exclusive with "
+          "\"--no-pre-sort-files\" and \"--sort-files-by-name\").\n");
   fprintf(stderr,
           "--no-preserve-empty-dirs : do NOT preserve empty dirs (only for file"
           " format 2 and onwards)\n");
@@ -415,6 +686,24 @@ SDArchiverParsed simple_archiver_create_parsed(void) {
   parsed.user_cwd = NULL;
   parsed.write_version = 6;
   parsed.minimum_chunk_size = 268435456;
+  parsed.compress_jobs = 1;
+  parsed.compress_slice_size = 16777216;
+  parsed.rsyncable = 0;
+  parsed.make_jobserver = 0;
+  parsed.pressure_limit = 0;
+  parsed.write_buffer_size = 0;
+  parsed.slow_files = 0;
+  parsed.small_files_size = 0;
+  parsed.small_files_budget = 67108864;
+  parsed.stat_dont_sync = 0;
+  parsed.du = 0;
+  parsed.watch_interval = 60;
+  parsed.watch_max_changes = 67108864;
+  parsed.small_files_arena = NULL;
+  parsed.filter_min_size = 0;
+  parsed.filter_max_size = UINT64_MAX;
+  parsed.filter_uid = NULL;
+  parsed.filter_gid = NULL;
   parsed.uid = 0;
   parsed.gid = 0;
   parsed.file_permissions = 0;
@@ -444,6 +733,7 @@ SDArchiverParsed simple_archiver_create_parsed(void) {
   parsed.blacklist_begins = NULL;
   parsed.blacklist_ends = NULL;
   parsed.not_to_compress_file_extensions = simple_archiver_hash_map_init();
+  parsed.delta_from = NULL;
 
   return parsed;
 }
@@ -495,6 +785,11 @@ int simple_archiver_parse_args(int argc, const char **argv,
         out->flags &= 0xFFFFFFFC;
         // set second bit.
         out->flags |= 0x2;
+      } else if (strcmp(argv[0], "--du") == 0) {
+        // Same mode as "-t".
+        out->flags &= 0xFFFFFFFC;
+        out->flags |= 0x2;
+        out->du = 1;
       } else if (strcmp(argv[0], "-f") == 0) {
         if (argc < 2) {
           fprintf(stderr, "ERROR: -f specified but missing argument!\n");
@@ -626,6 +921,8 @@ int simple_archiver_parse_args(int argc, const char **argv,
         out->flags |= 0x4;
       } else if (strcmp(argv[0], "--overwrite-extract") == 0) {
         out->flags |= 0x8;
+      } else if (strcmp(argv[0], "--extract-in-place-delta") == 0) {
+        out->flags |= 0x40000008;
       } else if (strcmp(argv[0], "--no-abs-symlink") == 0) {
         out->flags |= 0x20;
       } else if (strcmp(argv[0], "--preserve-symlinks") == 0) {
@@ -690,10 +987,10 @@ int simple_archiver_parse_args(int argc, const char **argv,
           fprintf(stderr, "ERROR: --write-version cannot be negative!\n");
           simple_archiver_print_usage();
           return 1;
-        } else if (version > 7) {
+        } else if (version > 11) {
           fprintf(stderr,
-                  "ERROR: --write-version must be 0, 1, 2, 3, 4, 5, 6, or 7!"
-                  "\n");
+                  "ERROR: --write-version must be 0, 1, 2, 3, 4, 5, 6, 7, 8, "
+                  "9, 10, or 11!\n");
           simple_archiver_print_usage();
           return 1;
         }
@@ -702,6 +999,39 @@ int simple_archiver_parse_args(int argc, const char **argv,
           --argc;
           ++argv;
         }
+      } else if (strcmp(argv[0], "--delta-from") == 0
+                 || strncmp(argv[0], "--delta-from=", 13) == 0) {
+        int_fast8_t is_separate =
+          strcmp(argv[0], "--delta-from") == 0 ? 1 : 0;
+        const char *str;
+        if (is_separate && argc < 2) {
+          fprintf(stderr, "ERROR: --delta-from is missing an argument!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (is_separate) {
+          str = argv[1];
+        } else {
+          str = argv[0] + 13;
+        }
+        if (strlen(str) == 0) {
+          fprintf(stderr,
+                  "ERROR: Argument to \"--delta-from\" is an empty string!\n");
+          simple_archiver_print_usage();
+          return 1;
+        }
+        if (out->delta_from) {
+          free(out->delta_from);
+        }
+        out->delta_from = simple_archiver_helper_real_path_to_name(str);
+        if (!out->delta_from) {
+          fprintf(stderr,
+                  "ERROR: Failed to get path of \"--delta-from\" archive!\n");
+          return 1;
+        }
+        if (is_separate) {
+          --argc;
+          ++argv;
+        }
       } else if (strcmp(argv[0], "--chunk-min-size") == 0
                  || strncmp(argv[0], "--chunk-min-size=", 17) == 0) {
         int_fast8_t is_separate =
@@ -725,52 +1055,16 @@ int simple_archiver_parse_args(int argc, const char **argv,
           return 1;
         }
 
-        out->minimum_chunk_size = 0;
-        char suffix_buf[4];
-        size_t sb_idx = 0;
-        int_fast8_t digits_passed = 0;
-
-        for (const char *c = str; *c != 0; ++c) {
-          if (!digits_passed && *c >= '0' && *c <= '9') {
-            out->minimum_chunk_size =
-              out->minimum_chunk_size * 10 + (uint64_t)(*c - '0');
-          } else {
-            digits_passed = 1;
-            suffix_buf[sb_idx++] = *c;
-            if (sb_idx > 3) {
-              fprintf(stderr, "ERROR: Invalid arg to --chunk-min-size!\n");
-              return 1;
-            }
-          }
+        if (simple_archiver_parser_internal_parse_bytes(
+              str, "--chunk-min-size", &out->minimum_chunk_size)) {
+          return 1;
         }
-        suffix_buf[sb_idx] = 0;
-
-        if (sb_idx > 0) {
-          uint64_t temp = out->minimum_chunk_size;
-          if (strcmp(suffix_buf, "KB") == 0) {
-            out->minimum_chunk_size *= 1000;
-          } else if (strcmp(suffix_buf, "KiB") == 0) {
-            out->minimum_chunk_size *= 1024;
-          } else if (strcmp(suffix_buf, "MB") == 0) {
-            out->minimum_chunk_size *= 1000 * 1000;
-          } else if (strcmp(suffix_buf, "MiB") == 0) {
-            out->minimum_chunk_size *= 1024 * 1024;
-          } else if (strcmp(suffix_buf, "GB") == 0) {
-            out->minimum_chunk_size *= 1000 * 1000 * 1000;
-          } else if (strcmp(suffix_buf, "GiB") == 0) {
-            out->minimum_chunk_size *= 1024 * 1024 * 1024;
-          } else {
-            fprintf(stderr,
-                    "ERROR: Invalid suffix \"%s\"! Expected KB, KiB, MB, MiB, "
-                    "GB, or GiB!\n",
-                    suffix_buf);
-            return 1;
-          }
 
+        if (out->minimum_chunk_size != 0 && (str[strlen(str) - 1] < '0'
+                                             || str[strlen(str) - 1] > '9')) {
           fprintf(stderr,
-                  "Using chunk size %" PRIu64 "%s (%" PRIu64 " Bytes)...\n",
-                  temp,
-                  suffix_buf,
+                  "Using chunk size %s (%" PRIu64 " Bytes)...\n",
+                  str,
                   out->minimum_chunk_size);
         } else if (out->minimum_chunk_size != 0) {
           fprintf(stderr,
@@ -782,6 +1076,438 @@ int simple_archiver_parse_args(int argc, const char **argv,
           return 1;
         }
 
+        if (is_separate) {
+          --argc;
+          ++argv;
+        }
+      } else if (strcmp(argv[0], "--compress-jobs") == 0
+                 || strncmp(argv[0], "--compress-jobs=", 16) == 0) {
+        int_fast8_t is_separate =
+          strcmp(argv[0], "--compress-jobs") == 0 ? 1 : 0;
+        const char *str;
+        if (is_separate && argc < 2) {
+          fprintf(stderr,
+                  "ERROR: --compress-jobs expects an integer argument!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (is_separate) {
+          str = argv[1];
+        } else {
+          str = argv[0] + 16;
+        }
+        int jobs = atoi(str);
+        if (jobs < 1 || jobs > 1024) {
+          fprintf(stderr,
+                  "ERROR: --compress-jobs must be between 1 and 1024!\n");
+          simple_archiver_print_usage();
+          return 1;
+        }
+        out->compress_jobs = (uint32_t)jobs;
+        if (is_separate) {
+          --argc;
+          ++argv;
+        }
+      } else if (strcmp(argv[0], "--compress-slice-size") == 0
+                 || strncmp(argv[0], "--compress-slice-size=", 22) == 0) {
+        int_fast8_t is_separate =
+          strcmp(argv[0], "--compress-slice-size") == 0 ? 1 : 0;
+        const char *str;
+        if (is_separate && argc < 2) {
+          fprintf(stderr,
+                  "ERROR: --compress-slice-size expects an integer "
+                  "argument!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (is_separate) {
+          str = argv[1];
+        } else {
+          str = argv[0] + 22;
+        }
+        if (strlen(str) == 0) {
+          fprintf(stderr,
+                  "ERROR: Argument to \"--compress-slice-size\" is an empty "
+                  "string!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (simple_archiver_parser_internal_parse_bytes(
+                     str,
+                     "--compress-slice-size",
+                     &out->compress_slice_size)) {
+          return 1;
+        } else if (out->compress_slice_size == 0) {
+          fprintf(stderr, "ERROR: --compress-slice-size cannot be zero!\n");
+          simple_archiver_print_usage();
+          return 1;
+        }
+        if (is_separate) {
+          --argc;
+          ++argv;
+        }
+      } else if (strcmp(argv[0], "--rsyncable") == 0) {
+        out->rsyncable = 1;
+      } else if (strcmp(argv[0], "--make-jobserver") == 0) {
+        out->make_jobserver = 1;
+      } else if (strcmp(argv[0], "--pressure-limit") == 0
+                 || strncmp(argv[0], "--pressure-limit=", 17) == 0) {
+        int_fast8_t is_separate =
+          strcmp(argv[0], "--pressure-limit") == 0 ? 1 : 0;
+        const char *str;
+        if (is_separate && argc < 2) {
+          fprintf(stderr,
+                  "ERROR: --pressure-limit expects an integer argument!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (is_separate) {
+          str = argv[1];
+        } else {
+          str = argv[0] + 17;
+        }
+        int percent = atoi(str);
+        if (percent < 1 || percent > 100) {
+          fprintf(stderr,
+                  "ERROR: --pressure-limit must be between 1 and 100!\n");
+          simple_archiver_print_usage();
+          return 1;
+        }
+        out->pressure_limit = (uint32_t)percent;
+        if (is_separate) {
+          --argc;
+          ++argv;
+        }
+      } else if (strcmp(argv[0], "--write-buffer-size") == 0
+                 || strncmp(argv[0], "--write-buffer-size=", 20) == 0) {
+        int_fast8_t is_separate =
+          strcmp(argv[0], "--write-buffer-size") == 0 ? 1 : 0;
+        const char *str;
+        if (is_separate && argc < 2) {
+          fprintf(stderr,
+                  "ERROR: --write-buffer-size expects an integer argument!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (is_separate) {
+          str = argv[1];
+        } else {
+          str = argv[0] + 20;
+        }
+        if (strlen(str) == 0) {
+          fprintf(stderr,
+                  "ERROR: Argument to \"--write-buffer-size\" is an empty "
+                  "string!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (simple_archiver_parser_internal_parse_bytes(
+                     str,
+                     "--write-buffer-size",
+                     &out->write_buffer_size)) {
+          return 1;
+        }
+        if (is_separate) {
+          --argc;
+          ++argv;
+        }
+      } else if (strncmp(argv[0], "--stats=", 8) == 0) {
+        if (strcmp(argv[0] + 8, "text") == 0) {
+          out->flags &= 0xEFFFFFFF;
+        } else if (strcmp(argv[0] + 8, "json") == 0) {
+          out->flags |= 0x10000000;
+        } else {
+          fprintf(stderr,
+                  "ERROR: --stats expects \"text\" or \"json\"!\n");
+          simple_archiver_print_usage();
+          return 1;
+        }
+      } else if (strcmp(argv[0], "--slow-files") == 0
+                 || strncmp(argv[0], "--slow-files=", 13) == 0) {
+        int_fast8_t is_separate =
+          strcmp(argv[0], "--slow-files") == 0 ? 1 : 0;
+        const char *str;
+        if (is_separate && argc < 2) {
+          fprintf(stderr,
+                  "ERROR: --slow-files expects an integer argument!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (is_separate) {
+          str = argv[1];
+        } else {
+          str = argv[0] + 13;
+        }
+        int count = atoi(str);
+        if (count < 0 || (count == 0 && strcmp(str, "0") != 0)) {
+          fprintf(stderr,
+                  "ERROR: --slow-files expects a non-negative integer!\n");
+          simple_archiver_print_usage();
+          return 1;
+        }
+        out->slow_files = (uint32_t)count;
+        if (is_separate) {
+          --argc;
+          ++argv;
+        }
+      } else if (strcmp(argv[0], "--read-small-files") == 0
+                 || strncmp(argv[0], "--read-small-files=", 19) == 0) {
+        int_fast8_t is_separate =
+          strcmp(argv[0], "--read-small-files") == 0 ? 1 : 0;
+        const char *str;
+        if (is_separate && argc < 2) {
+          fprintf(stderr,
+                  "ERROR: --read-small-files expects an integer argument!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (is_separate) {
+          str = argv[1];
+        } else {
+          str = argv[0] + 19;
+        }
+        if (strlen(str) == 0) {
+          fprintf(stderr,
+                  "ERROR: Argument to \"--read-small-files\" is an empty "
+                  "string!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (simple_archiver_parser_internal_parse_bytes(
+                     str,
+                     "--read-small-files",
+                     &out->small_files_size)) {
+          return 1;
+        }
+        if (is_separate) {
+          --argc;
+          ++argv;
+        }
+      } else if (strcmp(argv[0], "--read-small-files-budget") == 0
+                 || strncmp(argv[0], "--read-small-files-budget=", 26) == 0) {
+        int_fast8_t is_separate =
+          strcmp(argv[0], "--read-small-files-budget") == 0 ? 1 : 0;
+        const char *str;
+        if (is_separate && argc < 2) {
+          fprintf(stderr,
+                  "ERROR: --read-small-files-budget expects an integer "
+                  "argument!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (is_separate) {
+          str = argv[1];
+        } else {
+          str = argv[0] + 26;
+        }
+        if (strlen(str) == 0) {
+          fprintf(stderr,
+                  "ERROR: Argument to \"--read-small-files-budget\" is an "
+                  "empty string!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (simple_archiver_parser_internal_parse_bytes(
+                     str,
+                     "--read-small-files-budget",
+                     &out->small_files_budget)) {
+          return 1;
+        }
+        if (is_separate) {
+          --argc;
+          ++argv;
+        }
+      } else if (strcmp(argv[0], "--stat-dont-sync") == 0) {
+        out->stat_dont_sync = 1;
+      } else if (strcmp(argv[0], "--watch") == 0) {
+        out->flags |= 0x20000000;
+      } else if (strcmp(argv[0], "--watch-interval") == 0
+                 || strncmp(argv[0], "--watch-interval=", 17) == 0) {
+        int_fast8_t is_separate =
+          strcmp(argv[0], "--watch-interval") == 0 ? 1 : 0;
+        const char *str;
+        if (is_separate && argc < 2) {
+          fprintf(stderr,
+                  "ERROR: --watch-interval expects an integer argument!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (is_separate) {
+          str = argv[1];
+        } else {
+          str = argv[0] + 17;
+        }
+        int seconds = atoi(str);
+        if (seconds <= 0) {
+          fprintf(stderr,
+                  "ERROR: --watch-interval expects a positive integer!\n");
+          simple_archiver_print_usage();
+          return 1;
+        }
+        out->watch_interval = (uint32_t)seconds;
+        if (is_separate) {
+          --argc;
+          ++argv;
+        }
+      } else if (strcmp(argv[0], "--watch-max-changes") == 0
+                 || strncmp(argv[0], "--watch-max-changes=", 20) == 0) {
+        int_fast8_t is_separate =
+          strcmp(argv[0], "--watch-max-changes") == 0 ? 1 : 0;
+        const char *str;
+        if (is_separate && argc < 2) {
+          fprintf(stderr,
+                  "ERROR: --watch-max-changes expects an integer argument!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (is_separate) {
+          str = argv[1];
+        } else {
+          str = argv[0] + 20;
+        }
+        if (strlen(str) == 0) {
+          fprintf(stderr,
+                  "ERROR: Argument to \"--watch-max-changes\" is an empty "
+                  "string!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (simple_archiver_parser_internal_parse_bytes(
+                     str,
+                     "--watch-max-changes",
+                     &out->watch_max_changes)) {
+          return 1;
+        } else if (out->watch_max_changes == 0) {
+          fprintf(stderr, "ERROR: --watch-max-changes cannot be zero!\n");
+          simple_archiver_print_usage();
+          return 1;
+        }
+        if (is_separate) {
+          --argc;
+          ++argv;
+        }
+      } else if (strcmp(argv[0], "--filter-min-size") == 0
+                 || strncmp(argv[0], "--filter-min-size=", 18) == 0) {
+        int_fast8_t is_separate =
+          strcmp(argv[0], "--filter-min-size") == 0 ? 1 : 0;
+        const char *str;
+        if (is_separate && argc < 2) {
+          fprintf(stderr,
+                  "ERROR: --filter-min-size expects an integer argument!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (is_separate) {
+          str = argv[1];
+        } else {
+          str = argv[0] + 18;
+        }
+        if (strlen(str) == 0) {
+          fprintf(stderr,
+                  "ERROR: Argument to \"--filter-min-size\" is an empty "
+                  "string!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (simple_archiver_parser_internal_parse_bytes(
+                     str,
+                     "--filter-min-size",
+                     &out->filter_min_size)) {
+          return 1;
+        }
+        if (is_separate) {
+          --argc;
+          ++argv;
+        }
+      } else if (strcmp(argv[0], "--filter-max-size") == 0
+                 || strncmp(argv[0], "--filter-max-size=", 18) == 0) {
+        int_fast8_t is_separate =
+          strcmp(argv[0], "--filter-max-size") == 0 ? 1 : 0;
+        const char *str;
+        if (is_separate && argc < 2) {
+          fprintf(stderr,
+                  "ERROR: --filter-max-size expects an integer argument!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (is_separate) {
+          str = argv[1];
+        } else {
+          str = argv[0] + 18;
+        }
+        if (strlen(str) == 0) {
+          fprintf(stderr,
+                  "ERROR: Argument to \"--filter-max-size\" is an empty "
+                  "string!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (simple_archiver_parser_internal_parse_bytes(
+                     str,
+                     "--filter-max-size",
+                     &out->filter_max_size)) {
+          return 1;
+        }
+        if (is_separate) {
+          --argc;
+          ++argv;
+        }
+      } else if (strcmp(argv[0], "--filter-uid") == 0
+                 || strncmp(argv[0], "--filter-uid=", 13) == 0) {
+        int_fast8_t is_separate = strcmp(argv[0], "--filter-uid") == 0 ? 1 : 0;
+        const char *str;
+        if (is_separate && argc < 2) {
+          fprintf(stderr, "ERROR: --filter-uid expects an integer argument!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (is_separate) {
+          str = argv[1];
+        } else {
+          str = argv[0] + 13;
+        }
+        if (strlen(str) == 0) {
+          fprintf(stderr,
+                  "ERROR: Argument to \"--filter-uid\" is an empty string!\n");
+          simple_archiver_print_usage();
+          return 1;
+        }
+        unsigned long long id = strtoull(str, NULL, 10);
+        if (id == 0 && strcmp(str, "0") != 0) {
+          fprintf(stderr, "ERROR: Failed to parse --filter-uid <UID>!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (id > 0xFFFFFFFF) {
+          fprintf(stderr,
+                  "ERROR: UID Is too large (expecting unsigned 32-bit "
+                  "value)!\n");
+          simple_archiver_print_usage();
+          return 1;
+        }
+        if (!out->filter_uid) {
+          out->filter_uid = malloc(sizeof(uint32_t));
+        }
+        *out->filter_uid = (uint32_t)id;
+        if (is_separate) {
+          --argc;
+          ++argv;
+        }
+      } else if (strcmp(argv[0], "--filter-gid") == 0
+                 || strncmp(argv[0], "--filter-gid=", 13) == 0) {
+        int_fast8_t is_separate = strcmp(argv[0], "--filter-gid") == 0 ? 1 : 0;
+        const char *str;
+        if (is_separate && argc < 2) {
+          fprintf(stderr, "ERROR: --filter-gid expects an integer argument!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (is_separate) {
+          str = argv[1];
+        } else {
+          str = argv[0] + 13;
+        }
+        if (strlen(str) == 0) {
+          fprintf(stderr,
+                  "ERROR: Argument to \"--filter-gid\" is an empty string!\n");
+          simple_archiver_print_usage();
+          return 1;
+        }
+        unsigned long long id = strtoull(str, NULL, 10);
+        if (id == 0 && strcmp(str, "0") != 0) {
+          fprintf(stderr, "ERROR: Failed to parse --filter-gid <GID>!\n");
+          simple_archiver_print_usage();
+          return 1;
+        } else if (id > 0xFFFFFFFF) {
+          fprintf(stderr,
+                  "ERROR: GID Is too large (expecting unsigned 32-bit "
+                  "value)!\n");
+          simple_archiver_print_usage();
+          return 1;
+        }
+        if (!out->filter_gid) {
+          out->filter_gid = malloc(sizeof(uint32_t));
+        }
+        *out->filter_gid = (uint32_t)id;
         if (is_separate) {
           --argc;
           ++argv;
@@ -791,6 +1517,10 @@ int simple_archiver_parse_args(int argc, const char **argv,
           fprintf(stderr, "ERROR: \"--no-pre-sort-files\" is mutually "
               "exclusive with \"--sort-files-by-name\"!\n");
           return 1;
+        } else if (out->flags & 0x100000) {
+          fprintf(stderr, "ERROR: \"--no-pre-sort-files\" is mutually "
+              "exclusive with \"--sort-files-by-similarity\"!\n");
+          return 1;
         }
         out->flags &= 0xFFFFFFBF;
       } else if (strcmp(argv[0], "--sort-files-by-name") == 0) {
@@ -798,8 +1528,23 @@ int simple_archiver_parse_args(int argc, const char **argv,
           fprintf(stderr, "ERROR: \"--sort-files-by-name\" is mutually "
               "exclusive with \"--no-pre-sort-files\"!\n");
           return 1;
+        } else if (out->flags & 0x100000) {
+          fprintf(stderr, "ERROR: \"--sort-files-by-name\" is mutually "
+              "exclusive with \"--sort-files-by-similarity\"!\n");
+          return 1;
         }
         out->flags |= 0x80000;
+      } else if (strcmp(argv[0], "--sort-files-by-similarity") == 0) {
+        if ((out->flags & 0x40) == 0) {
+          fprintf(stderr, "ERROR: \"--sort-files-by-similarity\" is mutually "
+              "exclusive with \"--no-pre-sort-files\"!\n");
+          return 1;
+        } else if (out->flags & 0x80000) {
+          fprintf(stderr, "ERROR: \"--sort-files-by-similarity\" is mutually "
+              "exclusive with \"--sort-files-by-name\"!\n");
+          return 1;
+        }
+        out->flags |= 0x100000;
       } else if (strcmp(argv[0], "--no-preserve-empty-dirs") == 0) {
         out->flags |= 0x200;
       } else if (strcmp(argv[0], "--force-uid") == 0
@@ -2004,13 +2749,31 @@ int simple_archiver_parse_args(int argc, const char **argv,
         return 1;
       }
 
-      simple_archiver_hash_map_insert(
-        out->just_w_files,
-        (void*)arg_ptr,
-        (void*)arg_ptr,
-        arg_length,
-        simple_archiver_helper_datastructure_cleanup_nop,
-        simple_archiver_helper_datastructure_cleanup_nop);
+      // Stored paths never end with '/', so "dir/" is looked up as "dir".
+      size_t key_length = arg_length;
+      while (key_length > 2 && arg_ptr[key_length - 2] == '/') {
+        --key_length;
+      }
+      if (key_length != arg_length) {
+        char *key = malloc(key_length);
+        memcpy(key, arg_ptr, key_length - 1);
+        key[key_length - 1] = 0;
+        simple_archiver_hash_map_insert(
+          out->just_w_files,
+          (void*)arg_ptr,
+          key,
+          key_length,
+          simple_archiver_helper_datastructure_cleanup_nop,
+          NULL);
+      } else {
+        simple_archiver_hash_map_insert(
+          out->just_w_files,
+          (void*)arg_ptr,
+          (void*)arg_ptr,
+          arg_length,
+          simple_archiver_helper_datastructure_cleanup_nop,
+          simple_archiver_helper_datastructure_cleanup_nop);
+      }
       simple_archiver_list_add(
         working_files_list,
         (void*)arg_ptr,
@@ -2043,6 +2806,9 @@ int simple_archiver_parse_args(int argc, const char **argv,
     // Setup data structures.
     __attribute__((cleanup(simple_archiver_hash_map_free)))
     SDArchiverHashMap *hash_map = simple_archiver_hash_map_init();
+    // Dirs whose contents are entirely excluded by the blacklists.
+    __attribute__((cleanup(simple_archiver_hash_map_free)))
+    SDArchiverHashMap *pruned_dirs = simple_archiver_hash_map_init();
     int hash_map_sentinel = 1;
     // Work with each file.
     for (SDArchiverLLNode *node = working_files_list->head->next;
@@ -2057,9 +2823,9 @@ int simple_archiver_parse_args(int argc, const char **argv,
       }
 
       struct stat st;
-      memset(&st, 0, sizeof(struct stat));
       char *file_path = node->data;
-      fstatat(AT_FDCWD, file_path, &st, AT_SYMLINK_NOFOLLOW);
+      simple_archiver_parser_internal_walk_stat(
+        out, AT_FDCWD, file_path, file_path, DT_UNKNOWN, &st);
       if ((st.st_mode & S_IFMT) == S_IFREG
           || (st.st_mode & S_IFMT) == S_IFLNK) {
         // Is a regular file or a symbolic link.
@@ -2071,6 +2837,11 @@ int simple_archiver_parse_args(int argc, const char **argv,
           file_info->filename = filename;
           file_info->link_dest = NULL;
           file_info->flags = 0;
+          file_info->data = NULL;
+          file_info->data_size = 0;
+          // Kept open to read a small file once its filename is normalized.
+          __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
+          FILE *readable_file = NULL;
           if ((st.st_mode & S_IFMT) == S_IFLNK) {
             // Is a symlink.
             file_info->link_dest = malloc(MAX_SYMBOLIC_LINK_SIZE);
@@ -2096,7 +2867,7 @@ int simple_archiver_parse_args(int argc, const char **argv,
             // Check that the file is readable by opening it. Easier than to
             // check permissions because that would also require checking if the
             // current USER can open the file.
-            FILE *readable_file = fopen(file_info->filename, "rb");
+            readable_file = fopen(file_info->filename, "rb");
             if (!readable_file) {
               // Cannot open file, so it must be unreadable (at least by the
               // current USER).
@@ -2106,11 +2877,9 @@ int simple_archiver_parse_args(int argc, const char **argv,
               free(file_info);
               free(filename);
               continue;
-            } else {
-              fclose(readable_file);
-              // fprintf(stderr, "DEBUG: \"%s\" is readable.\n",
-              // file_info->filename);
             }
+            // fprintf(stderr, "DEBUG: \"%s\" is readable.\n",
+            // file_info->filename);
           }
           // Store unprocessed filename in map to avoid duplicates.
           simple_archiver_hash_map_insert(
@@ -2149,6 +2918,10 @@ int simple_archiver_parse_args(int argc, const char **argv,
             slash_found = 0;
             dot_found = 0;
           }
+          if (readable_file) {
+            simple_archiver_parser_internal_read_small_file(
+              out, file_info, readable_file, (uint64_t)st.st_size);
+          }
           // Store the processed file_info against the arg.
           if(simple_archiver_hash_map_insert(
               out->working_files,
@@ -2196,6 +2969,14 @@ int simple_archiver_parse_args(int argc, const char **argv,
           }
         }
 
+        if (simple_archiver_parser_internal_is_dir_pruned(out, file_path)) {
+          simple_archiver_hash_map_insert(
+            pruned_dirs, &hash_map_sentinel, strdup(file_path),
+            strlen(file_path),
+            simple_archiver_helper_datastructure_cleanup_nop,
+            NULL);
+        }
+
         __attribute__((cleanup(simple_archiver_list_free)))
         SDArchiverLinkedList *dir_list = simple_archiver_list_init();
         simple_archiver_list_add(
@@ -2223,6 +3004,9 @@ int simple_archiver_parse_args(int argc, const char **argv,
             }
             continue;
           }
+          const uint_fast8_t is_pruned =
+            simple_archiver_hash_map_get(pruned_dirs, next, strlen(next))
+              ? 1 : 0;
           struct dirent *dir_entry;
           uint_fast8_t is_dir_empty = 1;
           do {
@@ -2260,8 +3044,35 @@ int simple_archiver_parse_args(int argc, const char **argv,
                 combined_path = new_path;
                 combined_size -= valid_idx;
               }
-              memset(&st, 0, sizeof(struct stat));
-              fstatat(AT_FDCWD, combined_path, &st, AT_SYMLINK_NOFOLLOW);
+              if (is_pruned && out->write_version < 6) {
+                // Only need to know if this dir is empty.
+                free(combined_path);
+                break;
+              }
+              simple_archiver_parser_internal_walk_stat(out,
+                                                        dirfd(dir),
+                                                        dir_entry->d_name,
+                                                        combined_path,
+                                                        dir_entry->d_type,
+                                                        &st);
+              if (is_pruned) {
+                // Version 6 and above store every dir, so keep walking the
+                // dirs but skip everything else.
+                if ((st.st_mode & S_IFMT) == S_IFDIR) {
+                  simple_archiver_list_add(out->working_dirs,
+                                           strdup(combined_path),
+                                           NULL);
+                  simple_archiver_hash_map_insert(
+                    pruned_dirs, &hash_map_sentinel, strdup(combined_path),
+                    combined_size - 1,
+                    simple_archiver_helper_datastructure_cleanup_nop,
+                    NULL);
+                  simple_archiver_list_add_front(dir_list, combined_path, NULL);
+                } else {
+                  free(combined_path);
+                }
+                continue;
+              }
               if ((st.st_mode & S_IFMT) == S_IFREG ||
                   (st.st_mode & S_IFMT) == S_IFLNK) {
                 // Is a file or a symbolic link.
@@ -2272,6 +3083,12 @@ int simple_archiver_parse_args(int argc, const char **argv,
                   file_info->filename = combined_path;
                   file_info->link_dest = NULL;
                   file_info->flags = 0;
+                  file_info->data = NULL;
+                  file_info->data_size = 0;
+                  // Kept open to read a small file once its filename is
+                  // normalized.
+                  __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
+                  FILE *readable_file = NULL;
                   if ((st.st_mode & S_IFMT) == S_IFLNK) {
                     // Is a symlink.
                     file_info->link_dest = malloc(MAX_SYMBOLIC_LINK_SIZE);
@@ -2297,7 +3114,7 @@ int simple_archiver_parse_args(int argc, const char **argv,
                     // Check that the file is readable by opening it. Easier
                     // than to check permissions because that would also require
                     // checking if the current USER can open the file.
-                    FILE *readable_file = fopen(file_info->filename, "rb");
+                    readable_file = fopen(file_info->filename, "rb");
                     if (!readable_file) {
                       // Cannot open file, so it must be unreadable (at least by
                       // the current USER).
@@ -2308,11 +3125,9 @@ int simple_archiver_parse_args(int argc, const char **argv,
                       free(file_info);
                       free(combined_path);
                       continue;
-                    } else {
-                      fclose(readable_file);
-                      // fprintf(stderr, "DEBUG: \"%s\" is readable.\n",
-                      // file_info->filename);
                     }
+                    // fprintf(stderr, "DEBUG: \"%s\" is readable.\n",
+                    // file_info->filename);
                   }
 
                   // Store unprocessed filename in map to avoid duplicates.
@@ -2354,6 +3169,10 @@ int simple_archiver_parse_args(int argc, const char **argv,
                     slash_found = 0;
                     dot_found = 0;
                   }
+                  if (readable_file) {
+                    simple_archiver_parser_internal_read_small_file(
+                      out, file_info, readable_file, (uint64_t)st.st_size);
+                  }
                   // Store the processed file_info against the arg.
                   if(simple_archiver_hash_map_insert(
                       out->working_files,
@@ -2375,6 +3194,14 @@ int simple_archiver_parse_args(int argc, const char **argv,
                 }
               } else if ((st.st_mode & S_IFMT) == S_IFDIR) {
                 // Is a directory.
+                if (simple_archiver_parser_internal_is_dir_pruned(
+                    out, combined_path)) {
+                  simple_archiver_hash_map_insert(
+                    pruned_dirs, &hash_map_sentinel, strdup(combined_path),
+                    combined_size - 1,
+                    simple_archiver_helper_datastructure_cleanup_nop,
+                    NULL);
+                }
                 simple_archiver_list_add(out->working_dirs,
                                          strdup(combined_path),
                                          NULL);
@@ -2397,6 +3224,8 @@ int simple_archiver_parse_args(int argc, const char **argv,
             f_info->filename = strdup(next);
             f_info->link_dest = NULL;
             f_info->flags = 1;
+            f_info->data = NULL;
+            f_info->data_size = 0;
 
             // Remove leading "./" entries from files_list.
             size_t idx =
@@ -2497,6 +3326,21 @@ void simple_archiver_free_parsed(SDArchiverParsed *parsed) {
     free(parsed->temp_dir);
     parsed->temp_dir = NULL;
   }
+  if (parsed->delta_from) {
+    free(parsed->delta_from);
+    parsed->delta_from = NULL;
+  }
+  if (parsed->small_files_arena) {
+    simple_archiver_arena_free(&parsed->small_files_arena);
+  }
+  if (parsed->filter_uid) {
+    free(parsed->filter_uid);
+    parsed->filter_uid = NULL;
+  }
+  if (parsed->filter_gid) {
+    free(parsed->filter_gid);
+    parsed->filter_gid = NULL;
+  }
 
   simple_archiver_users_free_users_infos(&parsed->users_infos);
 
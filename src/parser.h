@@ -23,6 +23,7 @@
 #include <stdint.h>
 
 // Local includes.
+#include "data_structures/arena.h"
 #include "data_structures/linked_list.h"
 #include "data_structures/hash_map.h"
 #include "users.h"
@@ -65,7 +66,8 @@ typedef struct SDArchiverParsed {
   ///   case-insensitive.
   /// 0b xxxx x1xx xxxx xxxx xxxx xxxx - Force use tmpfile.
   /// 0b xxxx 1xxx xxxx xxxx xxxx xxxx - Sort files by name before archiving.
-  /// 0b xxx1 xxxx xxxx xxxx xxxx xxxx - UNUSED
+  /// 0b xxx1 xxxx xxxx xxxx xxxx xxxx - Sort files by similarity before
+  ///   archiving.
   /// 0b xx1x xxxx xxxx xxxx xxxx xxxx - v6-extract remove empty dirs that are
   ///   not supposed to be empty
   /// 0b x1xx xxxx xxxx xxxx xxxx xxxx - also remove leaf dirs
@@ -74,6 +76,11 @@ typedef struct SDArchiverParsed {
   /// 0b xx1x xxxx xxxx xxxx xxxx xxxx xxxx - prefix user username set
   /// 0b x1xx xxxx xxxx xxxx xxxx xxxx xxxx - prefix user gid set
   /// 0b 1xxx xxxx xxxx xxxx xxxx xxxx xxxx - prefix user groupname set
+  /// 0b xxx1 xxxx xxxx xxxx xxxx xxxx xxxx xxxx - print stats as JSON
+  /// 0b xx1x xxxx xxxx xxxx xxxx xxxx xxxx xxxx - watch for changes after
+  ///   creating
+  /// 0b x1xx xxxx xxxx xxxx xxxx xxxx xxxx xxxx - extract over existing files
+  ///   of the same size in place
   uint32_t flags;
   /// Null-terminated string.
   char *filename;
@@ -95,10 +102,54 @@ typedef struct SDArchiverParsed {
   char *temp_dir;
   /// Dir specified by "-C".
   const char *user_cwd;
-  /// Currently only 0, 1, 2, 3, 4, and 5 is supported.
+  /// Currently only 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, and 11 is supported.
   uint32_t write_version;
   /// The minimum size of a chunk in bytes (the last chunk may be less).
   uint64_t minimum_chunk_size;
+  /// Number of compressor processes per chunk, each compressing a slice.
+  uint32_t compress_jobs;
+  /// Size in bytes of a slice compressed by one of "compress_jobs".
+  uint64_t compress_slice_size;
+  /// Is non-zero if slices end at content-defined boundaries ("--rsyncable").
+  uint_fast8_t rsyncable;
+  /// Is non-zero if compressors after the first of a chunk each take a token
+  /// from the GNU make jobserver in "MAKEFLAGS" ("--make-jobserver").
+  uint_fast8_t make_jobserver;
+  /// Percent of "some" stall time (avg10 of Linux "/proc/pressure/cpu", "io",
+  /// and "memory") above which fewer slice compressors run (0 to disable).
+  uint32_t pressure_limit;
+  /// Bytes of output queued for the archive's writer thread (0 to write
+  /// directly).
+  uint64_t write_buffer_size;
+  /// Number of slowest files to report after creating/extracting (0 to
+  /// disable).
+  uint32_t slow_files;
+  /// Regular files up to this size in bytes are read into
+  /// "small_files_arena" during the walk (0 to disable).
+  uint64_t small_files_size;
+  /// Maximum total bytes of files read during the walk.
+  uint64_t small_files_budget;
+  /// Is non-zero if the walk may use stale cached file attributes
+  /// ("--stat-dont-sync").
+  uint_fast8_t stat_dont_sync;
+  /// Is non-zero if examining prints only the directory summaries ("--du").
+  uint_fast8_t du;
+  /// Holds the data of files read during the walk. Is NULL if none were read.
+  SDArchiverArena *small_files_arena;
+  /// Seconds between segments written by "--watch".
+  uint32_t watch_interval;
+  /// Bytes of changed files that trigger a segment before "watch_interval".
+  uint64_t watch_max_changes;
+  /// Regular files smaller than this are not listed/extracted.
+  uint64_t filter_min_size;
+  /// Regular files larger than this are not listed/extracted.
+  uint64_t filter_max_size;
+  /// If non-NULL, only regular files stored with this UID are
+  /// listed/extracted.
+  uint32_t *filter_uid;
+  /// If non-NULL, only regular files stored with this GID are
+  /// listed/extracted.
+  uint32_t *filter_gid;
   uint32_t uid;
   uint32_t gid;
   /// 0b xxxx xxxx xxx1 - user read
@@ -142,6 +193,9 @@ typedef struct SDArchiverParsed {
   SDArchiverLinkedList *blacklist_begins;
   SDArchiverLinkedList *blacklist_ends;
   SDArchiverHashMap *not_to_compress_file_extensions;
+  /// Null-terminated string. Archive whose chunks are used as references for
+  /// delta compression (file format 8).
+  char *delta_from;
 } SDArchiverParsed;
 
 typedef struct SDArchiverFileInfo {
@@ -150,6 +204,10 @@ typedef struct SDArchiverFileInfo {
   char *link_dest;
   // xxxx xxx1 - is a directory.
   uint32_t flags;
+  /// The file's data if it was read during the walk, otherwise NULL.
+  /// Points into "small_files_arena" of SDArchiverParsed.
+  const char *data;
+  uint64_t data_size;
 } SDArchiverFileInfo;
 
 typedef enum SDArchiverParsedStatus {
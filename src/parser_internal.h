@@ -24,4 +24,10 @@
 size_t simple_archiver_parser_internal_get_first_non_current_idx(
     const char *filename);
 
+int simple_archiver_parser_internal_is_dir_pruned(const SDArchiverParsed *out,
+                                                  const char *dir);
+
+/// Frees a SDArchiverFileInfo, used as the value cleanup of "working_files".
+void simple_archiver_internal_free_file_info_fn(void *data);
+
 #endif
@@ -25,14 +25,29 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+
+#include "platforms.h"
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+
+#ifdef SDA_TEST_BUDGETS
+#include <sys/ptrace.h>
+#endif
 
 // Local includes.
 #include "archiver.h"
 #include "data_structures/hash_map.h"
 #include "data_structures/linked_list.h"
 #include "helpers.h"
+#include "io.h"
 #include "parser.h"
 #include "parser_internal.h"
+#include "watch.h"
 
 static int32_t checks_checked = 0;
 static int32_t checks_passed = 0;
@@ -65,6 +80,591 @@ static int32_t checks_passed = 0;
     }                                                                        \
   } while (0);
 
+typedef struct TestWriterReadState {
+  uint64_t remaining;
+  char fill;
+} TestWriterReadState;
+
+int64_t test_writer_read_fn(void *ud, char *buf, uint64_t buf_size) {
+  TestWriterReadState *read_state = ud;
+  if (buf_size > read_state->remaining) {
+    buf_size = read_state->remaining;
+  }
+  memset(buf, read_state->fill, buf_size);
+  read_state->remaining -= buf_size;
+  return (int64_t)buf_size;
+}
+
+/// Temporary dirs of a test that archives "tree_dir" to "archive" and extracts
+/// it to "out_dir", all within "dir".
+typedef struct TestArchiveDirs {
+  char dir[64];
+  char archive[96];
+  char tree_dir[96];
+  char out_dir[96];
+  /// Creating and extracting change the cwd, which is changed back to this.
+  char *original_cwd;
+} TestArchiveDirs;
+
+/// Makes "/tmp/sda_test_<name>_XXXXXX" with empty "tree" and "out" dirs.
+/// Returns zero on success.
+int test_archive_dirs_init(TestArchiveDirs *dirs, const char *name) {
+  memset(dirs, 0, sizeof(TestArchiveDirs));
+  snprintf(dirs->dir, sizeof(dirs->dir), "/tmp/sda_test_%s_XXXXXX", name);
+  if (!mkdtemp(dirs->dir)) {
+    dirs->dir[0] = 0;
+    return 1;
+  }
+  snprintf(dirs->archive, sizeof(dirs->archive), "%s/archive", dirs->dir);
+  snprintf(dirs->tree_dir, sizeof(dirs->tree_dir), "%s/tree", dirs->dir);
+  snprintf(dirs->out_dir, sizeof(dirs->out_dir), "%s/out", dirs->dir);
+  dirs->original_cwd = realpath(".", NULL);
+  if (!dirs->original_cwd || mkdir(dirs->tree_dir, 0755) != 0
+      || mkdir(dirs->out_dir, 0755) != 0) {
+    return 1;
+  }
+  return 0;
+}
+
+/// Removes "path" and everything in it without following symlinks.
+/// Returns zero on success.
+int test_remove_recursive(const char *path) {
+  struct stat stat_buf;
+  if (lstat(path, &stat_buf) != 0) {
+    return 1;
+  } else if (!S_ISDIR(stat_buf.st_mode)) {
+    return unlink(path) == 0 ? 0 : 1;
+  }
+  DIR *dir = opendir(path);
+  if (!dir) {
+    return 1;
+  }
+  int ret = 0;
+  const size_t path_len = strlen(path);
+  for (struct dirent *entry = readdir(dir); entry; entry = readdir(dir)) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    char *entry_path = malloc(path_len + strlen(entry->d_name) + 2);
+    sprintf(entry_path, "%s/%s", path, entry->d_name);
+    ret |= test_remove_recursive(entry_path);
+    free(entry_path);
+  }
+  closedir(dir);
+  return rmdir(path) == 0 ? ret : 1;
+}
+
+/// Changes back to the original cwd and removes "dir" with everything in it.
+/// Returns zero on success.
+int test_archive_dirs_cleanup(TestArchiveDirs *dirs) {
+  int ret = 0;
+  if (dirs->original_cwd) {
+    ret |= chdir(dirs->original_cwd) == 0 ? 0 : 1;
+    free(dirs->original_cwd);
+    dirs->original_cwd = NULL;
+  }
+  if (dirs->dir[0] != 0) {
+    ret |= test_remove_recursive(dirs->dir);
+    dirs->dir[0] = 0;
+  }
+  return ret;
+}
+
+/// Parses "args" (the program name, then options, then NULL) and creates,
+/// extracts, or lists the archive they name, then changes back to the
+/// original cwd. Returns the resulting status.
+SDArchiverStateReturns test_archive_run(const TestArchiveDirs *dirs,
+                                        const char **args) {
+  int argc = 0;
+  while (args[argc]) {
+    ++argc;
+  }
+  SDArchiverParsed parsed = simple_archiver_create_parsed();
+  if (simple_archiver_parse_args(argc, args, &parsed) != 0
+      || !parsed.filename) {
+    simple_archiver_free_parsed(&parsed);
+    return SDAS_INVALID_PARSED_STATE;
+  }
+  SDArchiverState *state = simple_archiver_init_state(&parsed);
+  const uint32_t mode = parsed.flags & 0x3;
+  SDArchiverStateReturns ret = SDAS_INVALID_FILE;
+  FILE *f = fopen(parsed.filename, mode == 0 ? "wb" : "rb");
+  if (f) {
+    const SDArchiverStateRetStruct ret_struct =
+      mode == 0 ? simple_archiver_write_all(f, state)
+                : simple_archiver_parse_archive_info(f, mode == 1, state);
+    ret = ret_struct.ret & SDAS_STATUS_RET_MASK;
+    fclose(f);
+  }
+  simple_archiver_free_state(&state);
+  simple_archiver_free_parsed(&parsed);
+  if (chdir(dirs->original_cwd) != 0) {
+    return SDAS_FAILED_TO_CHANGE_CWD;
+  }
+  return ret;
+}
+
+/// Returns the contents of "path" that must be free'd, or NULL on error.
+/// "size" is set to the number of bytes read.
+char *test_read_file(const char *path, long *size) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  *size = ftell(f);
+  rewind(f);
+  char *contents = malloc((size_t)*size + 1);
+  if (fread(contents, 1, (size_t)*size, f) != (size_t)*size) {
+    free(contents);
+    contents = NULL;
+  } else {
+    contents[*size] = 0;
+  }
+  fclose(f);
+  return contents;
+}
+
+/// Runs "args" like "test_archive_run" with "fd" (stdout or stderr) written to
+/// "path". Returns what was written to "fd" that must be free'd, or NULL on
+/// error. "ret" is set to the result of the run.
+char *test_archive_run_capture(const TestArchiveDirs *dirs,
+                               const char **args,
+                               int fd,
+                               const char *path,
+                               SDArchiverStateReturns *ret) {
+  fflush(stdout);
+  fflush(stderr);
+  const int saved_fd = dup(fd);
+  const int path_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (saved_fd < 0 || path_fd < 0) {
+    if (saved_fd >= 0) {
+      close(saved_fd);
+    }
+    if (path_fd >= 0) {
+      close(path_fd);
+    }
+    return NULL;
+  }
+  dup2(path_fd, fd);
+  close(path_fd);
+  *ret = test_archive_run(dirs, args);
+  fflush(stdout);
+  fflush(stderr);
+  dup2(saved_fd, fd);
+  close(saved_fd);
+  long size = 0;
+  char *contents = test_read_file(path, &size);
+  unlink(path);
+  return contents;
+}
+
+/// Writes "size" bytes of "data" to "path". Returns zero on success.
+int test_write_file(const char *path, const char *data, size_t size) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    return 1;
+  }
+  const int ret = fwrite(data, 1, size, f) == size ? 0 : 1;
+  return fclose(f) == 0 ? ret : 1;
+}
+
+/// Returns the offset of the first "needle" in "data" at or after "start", or
+/// -1 if it is not found.
+long test_find_bytes(const char *data,
+                     long size,
+                     const char *needle,
+                     size_t needle_size,
+                     long start) {
+  for (long idx = start; idx + (long)needle_size <= size; ++idx) {
+    if (memcmp(data + idx, needle, needle_size) == 0) {
+      return idx;
+    }
+  }
+  return -1;
+}
+
+/// Returns the number of member "key" of the JSON object at "obj" (without
+/// nested objects), or -1 if it has no such member.
+double test_json_number(const char *obj, const char *key) {
+  char needle[64];
+  snprintf(needle, sizeof(needle), "\"%s\":", key);
+  const char *obj_end = strchr(obj, '}');
+  const char *member = strstr(obj, needle);
+  if (!member || (obj_end && member > obj_end)) {
+    return -1.0;
+  }
+  return strtod(member + strlen(needle), NULL);
+}
+
+/// Counts the files read by "--read-small-files" during the walk in "ud[0]",
+/// and how many of them end with ".log" in "ud[1]".
+int test_count_small_files_fn(__attribute__((unused)) const void *key,
+                              __attribute__((unused)) size_t key_size,
+                              const void *value,
+                              void *ud) {
+  const SDArchiverFileInfo *file_info = value;
+  uint32_t *counts = ud;
+  if (file_info->data) {
+    const size_t len = strlen(file_info->filename);
+    ++counts[0];
+    if (len >= 4 && strcmp(file_info->filename + len - 4, ".log") == 0) {
+      ++counts[1];
+    }
+  }
+  return 0;
+}
+
+/// Archives "tree_dir/data" containing "data" to "archive" of "dirs",
+/// compressed in 16KiB slices (or the slices of "--rsyncable") by a compressor
+/// that prefixes each slice with '@'. Returns the archive's contents, or NULL
+/// on error.
+char *test_rsyncable_write(const TestArchiveDirs *dirs,
+                           const char *data,
+                           uint64_t size,
+                           uint_fast8_t rsyncable,
+                           long *archive_size) {
+  char path[128];
+  snprintf(path, sizeof(path), "%s/data", dirs->tree_dir);
+  if (test_write_file(path, data, size) != 0) {
+    return NULL;
+  }
+
+  const char *args[13] = {"test", "-c", "-f", dirs->archive,
+                          "--compressor=sed 1s/^/@/", "--decompressor=cat",
+                          "--compress-jobs=2", "--compress-slice-size=16KiB"};
+  size_t argc = 8;
+  if (rsyncable) {
+    args[argc++] = "--rsyncable";
+  }
+  args[argc++] = "-C";
+  args[argc++] = dirs->tree_dir;
+  args[argc++] = "data";
+  args[argc] = NULL;
+  if (test_archive_run(dirs, args) != SDAS_SUCCESS) {
+    return NULL;
+  }
+  return test_read_file(dirs->archive, archive_size);
+}
+
+/// Returns how many of the slices of archive "a" are also slices of archive
+/// "b". "a_slices" is set to the number of slices of "a".
+uint32_t test_rsyncable_shared(const char *a,
+                               long a_size,
+                               const char *b,
+                               long b_size,
+                               uint32_t *a_slices) {
+  uint32_t shared = 0;
+  *a_slices = 0;
+  const char *a_end = a + a_size;
+  const char *b_end = b + b_size;
+  const char *a_slice = memchr(a, '@', (size_t)a_size);
+  while (a_slice) {
+    const char *a_next =
+      memchr(a_slice + 1, '@', (size_t)(a_end - a_slice - 1));
+    if (!a_next) {
+      // The last slice is followed by the rest of the archive.
+      break;
+    }
+    ++*a_slices;
+    const size_t len = (size_t)(a_next - a_slice);
+    const char *b_slice = memchr(b, '@', (size_t)b_size);
+    while (b_slice) {
+      const char *b_next =
+        memchr(b_slice + 1, '@', (size_t)(b_end - b_slice - 1));
+      if (b_next && (size_t)(b_next - b_slice) == len
+          && memcmp(a_slice, b_slice, len) == 0) {
+        ++shared;
+        break;
+      }
+      b_slice = b_next;
+    }
+    a_slice = a_next;
+  }
+  return shared;
+}
+
+#ifdef SDA_TEST_BUDGETS
+// The test target is linked with "-Wl,--wrap=<fn>" for these, so every
+// allocation made by simplearchiver code is counted.
+static uint64_t test_alloc_count = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *s);
+
+void *__wrap_malloc(size_t size) {
+  ++test_alloc_count;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+  ++test_alloc_count;
+  return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  ++test_alloc_count;
+  return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *s) {
+  ++test_alloc_count;
+  return __real_strdup(s);
+}
+
+#define TEST_BUDGET_DIRS 4
+
+typedef enum TestBudgetOp {
+  TEST_BUDGET_CREATE = 0,
+  TEST_BUDGET_LIST,
+  TEST_BUDGET_EXTRACT,
+  /// Create with "--read-small-files".
+  TEST_BUDGET_CREATE_READ_SMALL
+} TestBudgetOp;
+
+typedef struct TestBudgetCounts {
+  uint64_t syscalls;
+  uint64_t allocs;
+  /// Zero if syscalls could not be counted (ptrace not permitted).
+  int traced;
+} TestBudgetCounts;
+
+/// Creates "dir/d<n>/f<n>" for "count" files spread over TEST_BUDGET_DIRS
+/// directories. Returns zero on success.
+int test_budget_make_tree(const char *dir, uint32_t count) {
+  char path[256];
+  for (uint32_t idx = 0; idx < TEST_BUDGET_DIRS; ++idx) {
+    snprintf(path, sizeof(path), "%s/d%" PRIu32, dir, idx);
+    if (mkdir(path, 0700) != 0) {
+      return 1;
+    }
+  }
+  for (uint32_t idx = 0; idx < count; ++idx) {
+    snprintf(path,
+             sizeof(path),
+             "%s/d%" PRIu32 "/f%" PRIu32,
+             dir,
+             idx % TEST_BUDGET_DIRS,
+             idx);
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+      return 1;
+    }
+    fprintf(f, "Contents of budget test file number %" PRIu32 ".\n", idx);
+    fclose(f);
+  }
+  return 0;
+}
+
+/// Runs "op" in a child process, counting its syscalls with ptrace and its
+/// allocations. Returns zero on success.
+int test_budget_run(TestBudgetOp op,
+                    const char *tree_dir,
+                    const char *archive,
+                    const char *out_dir,
+                    TestBudgetCounts *counts) {
+  int pipe_fd[2];
+  if (pipe(pipe_fd) != 0) {
+    return 1;
+  }
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(pipe_fd[0]);
+    close(pipe_fd[1]);
+    return 1;
+  } else if (pid == 0) {
+    close(pipe_fd[0]);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) {
+      dup2(null_fd, STDERR_FILENO);
+      close(null_fd);
+    }
+    TestBudgetCounts child_counts = {0, 0, 0};
+    if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) == 0) {
+      child_counts.traced = 1;
+      raise(SIGSTOP);
+    }
+    test_alloc_count = 0;
+
+    const char *create_args[] = {"test", "-c", "-f", archive,
+                                 "--overwrite-create",
+                                 "-C", tree_dir, ".", NULL};
+    const char *create_read_small_args[] = {"test", "-c", "-f", archive,
+                                            "--overwrite-create",
+                                            "--read-small-files=4KiB",
+                                            "-C", tree_dir, ".", NULL};
+    const char *list_args[] = {"test", "-t", "-f", archive, NULL};
+    const char *extract_args[] = {"test", "-x", "-f", archive,
+                                  "-C", out_dir, NULL};
+    SDArchiverParsed parsed = simple_archiver_create_parsed();
+    int ret = 1;
+    const int is_create =
+      op == TEST_BUDGET_CREATE || op == TEST_BUDGET_CREATE_READ_SMALL;
+    int argc;
+    const char **argv;
+    if (op == TEST_BUDGET_CREATE) {
+      argc = 8;
+      argv = create_args;
+    } else if (op == TEST_BUDGET_CREATE_READ_SMALL) {
+      argc = 9;
+      argv = create_read_small_args;
+    } else if (op == TEST_BUDGET_LIST) {
+      argc = 4;
+      argv = list_args;
+    } else {
+      argc = 6;
+      argv = extract_args;
+    }
+    if (simple_archiver_parse_args(argc, argv, &parsed) == 0) {
+      SDArchiverState *state = simple_archiver_init_state(&parsed);
+      FILE *f = fopen(archive, is_create ? "wb" : "rb");
+      if (f) {
+        SDArchiverStateRetStruct run_ret =
+          is_create
+          ? simple_archiver_write_all(f, state)
+          : simple_archiver_parse_archive_info(
+              f, op == TEST_BUDGET_EXTRACT ? 1 : 0, state);
+        ret = (run_ret.ret & SDAS_STATUS_RET_MASK) == SDAS_SUCCESS ? 0 : 1;
+        fclose(f);
+      }
+      simple_archiver_free_state(&state);
+    }
+    simple_archiver_free_parsed(&parsed);
+
+    child_counts.allocs = test_alloc_count;
+    if (write(pipe_fd[1], &child_counts, sizeof(child_counts))
+        != (ssize_t)sizeof(child_counts)) {
+      ret = 1;
+    }
+    _exit(ret);
+  }
+
+  close(pipe_fd[1]);
+  uint64_t syscall_stops = 0;
+  int status = 0;
+  if (waitpid(pid, &status, 0) == pid && WIFSTOPPED(status)) {
+    ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)PTRACE_O_TRACESYSGOOD);
+    int sig = 0;
+    while (ptrace(PTRACE_SYSCALL, pid, NULL, (void *)(intptr_t)sig) == 0
+           && waitpid(pid, &status, 0) == pid
+           && WIFSTOPPED(status)) {
+      if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+        ++syscall_stops;
+        sig = 0;
+      } else {
+        sig = WSTOPSIG(status);
+      }
+    }
+  }
+  if (!WIFEXITED(status) && !WIFSIGNALED(status)) {
+    waitpid(pid, &status, 0);
+  }
+
+  TestBudgetCounts child_counts = {0, 0, 0};
+  ssize_t read_ret = read(pipe_fd[0], &child_counts, sizeof(child_counts));
+  close(pipe_fd[0]);
+  if (read_ret != (ssize_t)sizeof(child_counts)
+      || !WIFEXITED(status)
+      || WEXITSTATUS(status) != 0) {
+    return 1;
+  }
+  // Each syscall stops on entry and on exit.
+  counts->syscalls = syscall_stops / 2;
+  counts->allocs = child_counts.allocs;
+  counts->traced = child_counts.traced;
+  return 0;
+}
+
+/// Sets "per_entry" to the extra syscalls/allocations per file of "op" going
+/// from "small" to "large" files. Returns zero on success.
+int test_budget_per_entry(TestBudgetOp op,
+                          uint32_t small,
+                          uint32_t large,
+                          TestBudgetCounts *per_entry) {
+  TestBudgetCounts counts[2];
+  const uint32_t sizes[2] = {small, large};
+  int ret = 0;
+  for (int idx = 0; ret == 0 && idx < 2; ++idx) {
+    TestArchiveDirs dirs;
+    ret = test_archive_dirs_init(&dirs, "budget");
+    if (ret == 0) {
+      ret = test_budget_make_tree(dirs.tree_dir, sizes[idx]);
+    }
+    if (ret == 0 && (op == TEST_BUDGET_LIST || op == TEST_BUDGET_EXTRACT)) {
+      // Only the measured run is counted, the archive is made beforehand.
+      ret = test_budget_run(TEST_BUDGET_CREATE,
+                            dirs.tree_dir,
+                            dirs.archive,
+                            dirs.out_dir,
+                            &counts[idx]);
+    }
+    if (ret == 0) {
+      ret = test_budget_run(op,
+                            dirs.tree_dir,
+                            dirs.archive,
+                            dirs.out_dir,
+                            &counts[idx]);
+    }
+
+    test_archive_dirs_cleanup(&dirs);
+  }
+  if (ret != 0) {
+    return ret;
+  }
+  const uint32_t diff = large - small;
+  per_entry->syscalls =
+    counts[1].syscalls > counts[0].syscalls
+    ? (counts[1].syscalls - counts[0].syscalls + diff - 1) / diff
+    : 0;
+  per_entry->allocs =
+    counts[1].allocs > counts[0].allocs
+    ? (counts[1].allocs - counts[0].allocs + diff - 1) / diff
+    : 0;
+  per_entry->traced = counts[0].traced && counts[1].traced;
+  return 0;
+}
+#endif
+
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+/// Creates the archive of "tree_dir" with "--watch" in a child process whose
+/// stderr is "stderr_fd". Returns the child's pid, or negative on error.
+pid_t test_watch_start(const char *tree_dir,
+                       const char *archive,
+                       int stderr_fd[2]) {
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid != 0) {
+    return pid;
+  }
+
+  close(stderr_fd[0]);
+  dup2(stderr_fd[1], STDERR_FILENO);
+  close(stderr_fd[1]);
+
+  const char *args[] = {"test", "-c", "-f", archive, "--watch",
+                        "--watch-interval=3600", "--write-version=11",
+                        "-C", tree_dir, ".", NULL};
+  SDArchiverParsed parsed = simple_archiver_create_parsed();
+  if (simple_archiver_parse_args(10, args, &parsed)) {
+    _exit(1);
+  }
+  SDArchiverState *state = simple_archiver_init_state(&parsed);
+  SDArchiverWatch *watch = simple_archiver_watch_begin(state);
+  FILE *out_f = fopen(archive, "wb");
+  if (!watch || !out_f
+      || simple_archiver_write_all(out_f, state).ret != SDAS_SUCCESS) {
+    _exit(2);
+  }
+  fclose(out_f);
+  _exit(simple_archiver_watch_run(watch) == 0 ? 0 : 3);
+}
+#endif
+
 int main(void) {
   puts("Begin unit test.");
   fflush(stdout);
@@ -127,6 +727,164 @@ int main(void) {
 
     simple_archiver_free_parsed(&parsed);
 
+    parsed = simple_archiver_create_parsed();
+    args = (const char *[]){"parser",
+                            "--write-version=8",
+                            "--delta-from",
+                            "/previous.simplearchive",
+                            NULL};
+    CHECK_TRUE(simple_archiver_parse_args(4, args, &parsed) == 0);
+    CHECK_TRUE(parsed.write_version == 8);
+    CHECK_STREQ(parsed.delta_from, "/previous.simplearchive");
+    simple_archiver_free_parsed(&parsed);
+
+    parsed = simple_archiver_create_parsed();
+    CHECK_TRUE(parsed.filter_min_size == 0);
+    CHECK_TRUE(parsed.filter_max_size == UINT64_MAX);
+    CHECK_TRUE(parsed.filter_uid == NULL);
+    CHECK_TRUE(parsed.filter_gid == NULL);
+    args = (const char *[]){"parser",
+                            "--write-version=9",
+                            "--filter-min-size",
+                            "1KiB",
+                            "--filter-max-size=2MiB",
+                            "--filter-uid",
+                            "1000",
+                            "--filter-gid=100",
+                            NULL};
+    CHECK_TRUE(simple_archiver_parse_args(8, args, &parsed) == 0);
+    CHECK_TRUE(parsed.write_version == 9);
+    CHECK_TRUE(parsed.filter_min_size == 1024);
+    CHECK_TRUE(parsed.filter_max_size == 2 * 1024 * 1024);
+    CHECK_TRUE(parsed.filter_uid && *parsed.filter_uid == 1000);
+    CHECK_TRUE(parsed.filter_gid && *parsed.filter_gid == 100);
+    simple_archiver_free_parsed(&parsed);
+
+    parsed = simple_archiver_create_parsed();
+    args = (const char *[]){"parser", "--write-version=12", NULL};
+    printf("Expecting ERROR output on next line:\n");
+    CHECK_FALSE(simple_archiver_parse_args(2, args, &parsed) == 0);
+    simple_archiver_free_parsed(&parsed);
+
+    parsed = simple_archiver_create_parsed();
+    CHECK_TRUE(parsed.compress_jobs == 1);
+    CHECK_FALSE(parsed.rsyncable);
+    CHECK_FALSE(parsed.stat_dont_sync);
+    CHECK_TRUE(parsed.write_buffer_size == 0);
+    args = (const char *[]){"parser",
+                            "--compress-jobs",
+                            "4",
+                            "--compress-slice-size=2MiB",
+                            "--rsyncable",
+                            "--stat-dont-sync",
+                            "--write-buffer-size",
+                            "1MiB",
+                            NULL};
+    CHECK_TRUE(simple_archiver_parse_args(8, args, &parsed) == 0);
+    CHECK_TRUE(parsed.write_buffer_size == 1024 * 1024);
+    CHECK_TRUE(parsed.compress_jobs == 4);
+    CHECK_TRUE(parsed.compress_slice_size == 2 * 1024 * 1024);
+    CHECK_TRUE(parsed.rsyncable);
+    CHECK_TRUE(parsed.stat_dont_sync);
+    simple_archiver_free_parsed(&parsed);
+
+    parsed = simple_archiver_create_parsed();
+    CHECK_FALSE(parsed.make_jobserver);
+    args = (const char *[]){"parser", "--make-jobserver", NULL};
+    CHECK_TRUE(simple_archiver_parse_args(2, args, &parsed) == 0);
+    CHECK_TRUE(parsed.make_jobserver);
+    simple_archiver_free_parsed(&parsed);
+
+    parsed = simple_archiver_create_parsed();
+    CHECK_TRUE(parsed.pressure_limit == 0);
+    args = (const char *[]){"parser", "--pressure-limit", "25", NULL};
+    CHECK_TRUE(simple_archiver_parse_args(3, args, &parsed) == 0);
+    CHECK_TRUE(parsed.pressure_limit == 25);
+    simple_archiver_free_parsed(&parsed);
+
+    parsed = simple_archiver_create_parsed();
+    args = (const char *[]){"parser", "--pressure-limit=101", NULL};
+    fprintf(stderr, "Expecting ERROR output on next line:\n");
+    CHECK_TRUE(simple_archiver_parse_args(2, args, &parsed) != 0);
+    simple_archiver_free_parsed(&parsed);
+
+    parsed = simple_archiver_create_parsed();
+    args = (const char *[]){"parser", "--compress-jobs=0", NULL};
+    fprintf(stderr, "Expecting ERROR output on next line:\n");
+    CHECK_TRUE(simple_archiver_parse_args(2, args, &parsed) != 0);
+    simple_archiver_free_parsed(&parsed);
+
+    parsed = simple_archiver_create_parsed();
+    args = (const char *[]){"parser", "--sort-files-by-similarity", NULL};
+    CHECK_TRUE(simple_archiver_parse_args(2, args, &parsed) == 0);
+    CHECK_TRUE(parsed.flags & 0x100000);
+    simple_archiver_free_parsed(&parsed);
+
+    parsed = simple_archiver_create_parsed();
+    args = (const char *[]){"parser",
+                            "--sort-files-by-name",
+                            "--sort-files-by-similarity",
+                            NULL};
+    fprintf(stderr, "Expecting ERROR output on next line:\n");
+    CHECK_TRUE(simple_archiver_parse_args(3, args, &parsed) != 0);
+    simple_archiver_free_parsed(&parsed);
+
+    parsed = simple_archiver_create_parsed();
+    CHECK_TRUE(parsed.slow_files == 0);
+    CHECK_TRUE((parsed.flags & 0x10000000) == 0);
+    args = (const char *[]){"parser", "--stats=json", "--slow-files", "5", NULL};
+    CHECK_TRUE(simple_archiver_parse_args(4, args, &parsed) == 0);
+    CHECK_TRUE(parsed.slow_files == 5);
+    CHECK_TRUE(parsed.flags & 0x10000000);
+    simple_archiver_free_parsed(&parsed);
+
+    parsed = simple_archiver_create_parsed();
+    args = (const char *[]){"parser", "--stats=xml", NULL};
+    fprintf(stderr, "Expecting ERROR output on next line:\n");
+    CHECK_TRUE(simple_archiver_parse_args(2, args, &parsed) != 0);
+    simple_archiver_free_parsed(&parsed);
+
+    parsed = simple_archiver_create_parsed();
+    CHECK_TRUE(parsed.small_files_size == 0);
+    CHECK_TRUE(parsed.small_files_budget == 67108864);
+    args = (const char *[]){"parser",
+                            "--read-small-files=4KiB",
+                            "--read-small-files-budget",
+                            "1MB",
+                            NULL};
+    CHECK_TRUE(simple_archiver_parse_args(4, args, &parsed) == 0);
+    CHECK_TRUE(parsed.small_files_size == 4096);
+    CHECK_TRUE(parsed.small_files_budget == 1000000);
+    CHECK_TRUE(parsed.small_files_arena == NULL);
+    simple_archiver_free_parsed(&parsed);
+
+    parsed = simple_archiver_create_parsed();
+    args = (const char *[]){"parser", "--read-small-files=4XB", NULL};
+    fprintf(stderr, "Expecting ERROR output on next line:\n");
+    CHECK_TRUE(simple_archiver_parse_args(2, args, &parsed) != 0);
+    simple_archiver_free_parsed(&parsed);
+
+    parsed = simple_archiver_create_parsed();
+    CHECK_TRUE(parsed.watch_interval == 60);
+    CHECK_TRUE(parsed.watch_max_changes == 67108864);
+    args = (const char *[]){"parser",
+                            "--watch",
+                            "--watch-interval",
+                            "5",
+                            "--watch-max-changes=2MiB",
+                            NULL};
+    CHECK_TRUE(simple_archiver_parse_args(5, args, &parsed) == 0);
+    CHECK_TRUE(parsed.flags & 0x20000000);
+    CHECK_TRUE(parsed.watch_interval == 5);
+    CHECK_TRUE(parsed.watch_max_changes == 2 * 1024 * 1024);
+    simple_archiver_free_parsed(&parsed);
+
+    parsed = simple_archiver_create_parsed();
+    args = (const char *[]){"parser", "--watch-interval=0", NULL};
+    fprintf(stderr, "Expecting ERROR output on next line:\n");
+    CHECK_TRUE(simple_archiver_parse_args(2, args, &parsed) != 0);
+    simple_archiver_free_parsed(&parsed);
+
     // Test mappings.
     parsed = simple_archiver_create_parsed();
     CHECK_TRUE(simple_archiver_handle_map_user_or_group(
@@ -1450,6 +2208,1817 @@ TEST_HELPERS_PREFIX_END:
     simple_archiver_list_free(&parsed.blacklist_ends);
   }
 
+  // Test reading pressure stall information and cgroup CPU quotas.
+  {
+    TestArchiveDirs dirs;
+    CHECK_TRUE(test_archive_dirs_init(&dirs, "pressure") == 0);
+    const char *dir = dirs.dir;
+    char path[96];
+    char proc_cgroup[96];
+    snprintf(path, sizeof(path), "%s/cpu", dir);
+    FILE *f = fopen(path, "w");
+    fputs("some avg10=12.34 avg60=4.30 avg300=4.96 total=384923228\n"
+          "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n",
+          f);
+    fclose(f);
+    uint32_t stall = 0;
+    CHECK_TRUE(simple_archiver_helper_read_pressure(path, &stall) == 0);
+    CHECK_TRUE(stall == 1234);
+    unlink(path);
+    CHECK_TRUE(simple_archiver_helper_read_pressure(path, &stall) != 0);
+
+    // cgroup v2 where a parent has the lower quota.
+    snprintf(proc_cgroup, sizeof(proc_cgroup), "%s/cgroup", dir);
+    f = fopen(proc_cgroup, "w");
+    fputs("0::/a/b\n", f);
+    fclose(f);
+    CHECK_TRUE(simple_archiver_helper_cgroup_cpu_limit(dir, proc_cgroup) == 0);
+    snprintf(path, sizeof(path), "%s/a", dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/a/b", dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/a/b/cpu.max", dir);
+    f = fopen(path, "w");
+    fputs("max 100000\n", f);
+    fclose(f);
+    CHECK_TRUE(simple_archiver_helper_cgroup_cpu_limit(dir, proc_cgroup) == 0);
+    snprintf(path, sizeof(path), "%s/a/cpu.max", dir);
+    f = fopen(path, "w");
+    fputs("250000 100000\n", f);
+    fclose(f);
+    CHECK_TRUE(simple_archiver_helper_cgroup_cpu_limit(dir, proc_cgroup) == 3);
+
+    // cgroup v1.
+    f = fopen(proc_cgroup, "w");
+    fputs("3:cpuset:/\n2:cpu,cpuacct:/c\n1:memory:/c\n", f);
+    fclose(f);
+    snprintf(path, sizeof(path), "%s/cpu", dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/cpu/c", dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/cpu/c/cpu.cfs_quota_us", dir);
+    f = fopen(path, "w");
+    fputs("200000\n", f);
+    fclose(f);
+    snprintf(path, sizeof(path), "%s/cpu/c/cpu.cfs_period_us", dir);
+    f = fopen(path, "w");
+    fputs("100000\n", f);
+    fclose(f);
+    CHECK_TRUE(simple_archiver_helper_cgroup_cpu_limit(dir, proc_cgroup) == 2);
+
+    CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+  }
+
+  // Test simple_archiver_helper_string_dir_blacklisted
+  {
+    SDArchiverParsed parsed;
+    memset(&parsed, 0, sizeof(SDArchiverParsed));
+
+    // no white/black lists.
+    CHECK_FALSE(simple_archiver_helper_string_dir_blacklisted("node_modules",
+                                                              0,
+                                                              &parsed));
+
+    // blacklist begins.
+    parsed.blacklist_begins = simple_archiver_list_init();
+    simple_archiver_list_add(parsed.blacklist_begins,
+                             "node_modules/",
+                             simple_archiver_helper_datastructure_cleanup_nop);
+
+    CHECK_TRUE(simple_archiver_helper_string_dir_blacklisted("node_modules",
+                                                             0,
+                                                             &parsed));
+    CHECK_TRUE(simple_archiver_helper_string_dir_blacklisted(
+      "node_modules/inner",
+      0,
+      &parsed));
+    CHECK_FALSE(simple_archiver_helper_string_dir_blacklisted("node",
+                                                              0,
+                                                              &parsed));
+    CHECK_FALSE(simple_archiver_helper_string_dir_blacklisted(
+      "src/node_modules",
+      0,
+      &parsed));
+    CHECK_FALSE(simple_archiver_helper_string_dir_blacklisted("NODE_MODULES",
+                                                              0,
+                                                              &parsed));
+    CHECK_TRUE(simple_archiver_helper_string_dir_blacklisted("NODE_MODULES",
+                                                             1,
+                                                             &parsed));
+    simple_archiver_list_free(&parsed.blacklist_begins);
+
+    // blacklist contains any.
+    parsed.blacklist_contains_any = simple_archiver_list_init();
+    simple_archiver_list_add(parsed.blacklist_contains_any,
+                             "/.git/",
+                             simple_archiver_helper_datastructure_cleanup_nop);
+
+    CHECK_TRUE(simple_archiver_helper_string_dir_blacklisted("a/b/.git",
+                                                             0,
+                                                             &parsed));
+    CHECK_TRUE(simple_archiver_helper_string_dir_blacklisted("a/.git/objects",
+                                                             0,
+                                                             &parsed));
+    CHECK_FALSE(simple_archiver_helper_string_dir_blacklisted("a/.github",
+                                                              0,
+                                                              &parsed));
+    CHECK_FALSE(simple_archiver_helper_string_dir_blacklisted("a/b",
+                                                              0,
+                                                              &parsed));
+
+    // blacklist contains all.
+    parsed.blacklist_contains_all = simple_archiver_list_init();
+    simple_archiver_list_add(parsed.blacklist_contains_all,
+                             "build",
+                             simple_archiver_helper_datastructure_cleanup_nop);
+    simple_archiver_list_add(parsed.blacklist_contains_all,
+                             "cache",
+                             simple_archiver_helper_datastructure_cleanup_nop);
+
+    CHECK_TRUE(simple_archiver_helper_string_dir_blacklisted("build/cache",
+                                                             0,
+                                                             &parsed));
+    CHECK_FALSE(simple_archiver_helper_string_dir_blacklisted("build",
+                                                              0,
+                                                              &parsed));
+
+    // Pruning must agree with checking each path within the dir.
+    CHECK_FALSE(simple_archiver_helper_string_allowed_lists(
+      "a/b/.git/HEAD",
+      0,
+      &parsed));
+    CHECK_FALSE(simple_archiver_helper_string_allowed_lists(
+      "build/cache/x",
+      0,
+      &parsed));
+
+    // "ends" and "exact" blacklists never prune.
+    simple_archiver_list_free(&parsed.blacklist_contains_any);
+    simple_archiver_list_free(&parsed.blacklist_contains_all);
+    parsed.blacklist_ends = simple_archiver_list_init();
+    simple_archiver_list_add(parsed.blacklist_ends,
+                             "node_modules",
+                             simple_archiver_helper_datastructure_cleanup_nop);
+    CHECK_FALSE(simple_archiver_helper_string_dir_blacklisted("node_modules",
+                                                              0,
+                                                              &parsed));
+    simple_archiver_list_free(&parsed.blacklist_ends);
+
+    // "." components are normalized later, so they are never pruned.
+    parsed.blacklist_begins = simple_archiver_list_init();
+    simple_archiver_list_add(parsed.blacklist_begins,
+                             "a/",
+                             simple_archiver_helper_datastructure_cleanup_nop);
+    CHECK_TRUE(simple_archiver_parser_internal_is_dir_pruned(&parsed, "a/b"));
+    CHECK_TRUE(simple_archiver_parser_internal_is_dir_pruned(&parsed, "a/.b"));
+    CHECK_FALSE(simple_archiver_parser_internal_is_dir_pruned(&parsed,
+                                                              "a/./b"));
+    CHECK_FALSE(simple_archiver_parser_internal_is_dir_pruned(&parsed, "a/."));
+
+    // whitelists take precedence.
+    parsed.whitelist_ends = simple_archiver_list_init();
+    simple_archiver_list_add(parsed.whitelist_ends,
+                             ".c",
+                             simple_archiver_helper_datastructure_cleanup_nop);
+    CHECK_FALSE(simple_archiver_helper_string_dir_blacklisted("a/b",
+                                                              0,
+                                                              &parsed));
+
+    simple_archiver_list_free(&parsed.whitelist_ends);
+    simple_archiver_list_free(&parsed.blacklist_begins);
+  }
+
+  // Test archive writer.
+  {
+    SDArchiverParsed parsed = simple_archiver_create_parsed();
+    for (int idx = 0; idx < 2; ++idx) {
+      if (idx == 1) {
+        parsed.compressor = strdup("cat");
+        parsed.decompressor = strdup("cat");
+        parsed.minimum_chunk_size = 4;
+      }
+      TestArchiveDirs dirs;
+      CHECK_TRUE(test_archive_dirs_init(&dirs, "writer") == 0);
+      SDArchiverState *state = simple_archiver_init_state(&parsed);
+      __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
+      FILE *f = fopen(dirs.archive, "w+b");
+      CHECK_TRUE(f != NULL);
+      SDArchiverWriter *writer = simple_archiver_writer_begin(f, state);
+      CHECK_TRUE(writer != NULL);
+
+      SDArchiverWriterMeta meta = {
+        .permissions = 0x16F,
+        .uid = 1000,
+        .gid = 1000,
+        .username = "user",
+        .groupname = NULL
+      };
+      CHECK_TRUE(simple_archiver_writer_add_dir(writer, "dir/sub", &meta).ret
+                 == SDAS_SUCCESS);
+      CHECK_TRUE(simple_archiver_writer_add_dir(writer, "dir", &meta).ret
+                 == SDAS_SUCCESS);
+      meta.permissions = 0x4B;
+      CHECK_TRUE(simple_archiver_writer_add_file_buf(writer,
+                                                     "dir/hello.txt",
+                                                     "Hello\n",
+                                                     6,
+                                                     &meta).ret
+                 == SDAS_SUCCESS);
+      CHECK_TRUE(simple_archiver_writer_add_file_buf(writer,
+                                                     "empty",
+                                                     NULL,
+                                                     0,
+                                                     &meta).ret
+                 == SDAS_SUCCESS);
+      TestWriterReadState read_state = {.remaining = 70000, .fill = 'x'};
+      CHECK_TRUE(simple_archiver_writer_add_file_fn(writer,
+                                                    "dir/sub/big",
+                                                    70000,
+                                                    test_writer_read_fn,
+                                                    &read_state,
+                                                    &meta).ret
+                 == SDAS_SUCCESS);
+      CHECK_TRUE(simple_archiver_writer_add_symlink(writer,
+                                                    "dir/link",
+                                                    "hello.txt",
+                                                    &meta).ret
+                 == SDAS_SUCCESS);
+
+      printf("Expecting ERROR output on next line:\n");
+      CHECK_TRUE(simple_archiver_writer_add_dir(writer, "dir", &meta).ret
+                 == SDAS_INVALID_WRITER_ENTRY);
+      printf("Expecting ERROR output on next line:\n");
+      CHECK_TRUE(simple_archiver_writer_add_file_buf(writer,
+                                                     "../x",
+                                                     "x",
+                                                     1,
+                                                     &meta).ret
+                 == SDAS_INVALID_WRITER_ENTRY);
+      printf("Expecting ERROR output on next line:\n");
+      CHECK_TRUE(simple_archiver_writer_add_dir(writer, "/abs", &meta).ret
+                 == SDAS_INVALID_WRITER_ENTRY);
+
+      CHECK_TRUE(simple_archiver_writer_finish(writer).ret == SDAS_SUCCESS);
+      CHECK_TRUE(read_state.remaining == 0);
+      CHECK_TRUE(simple_archiver_writer_finish(writer).ret
+                 == SDAS_HEADER_ALREADY_WRITTEN);
+      simple_archiver_writer_free(&writer);
+      CHECK_TRUE(writer == NULL);
+
+      char header[20];
+      rewind(f);
+      CHECK_TRUE(fread(header, 1, 20, f) == 20);
+      CHECK_TRUE(memcmp(header, "SIMPLE_ARCHIVE_VER\0\x07", 20) == 0);
+      rewind(f);
+      CHECK_TRUE(simple_archiver_parse_archive_info(f, 0, state).ret
+                 == SDAS_SUCCESS);
+      simple_archiver_free_state(&state);
+      fclose(f);
+      f = NULL;
+
+      // Extract what the writer wrote and check the entries.
+      const char *args[] = {"test", "-x", "-f", dirs.archive,
+                            "-C", dirs.out_dir, NULL};
+      CHECK_TRUE(test_archive_run(&dirs, args) == SDAS_SUCCESS);
+      char path[160];
+      struct stat st;
+      long size = 0;
+      snprintf(path, sizeof(path), "%s/dir/hello.txt", dirs.out_dir);
+      char *contents = test_read_file(path, &size);
+      CHECK_TRUE(contents != NULL);
+      if (contents) {
+        CHECK_TRUE(size == 6);
+        CHECK_STREQ(contents, "Hello\n");
+      }
+      free(contents);
+      CHECK_TRUE(stat(path, &st) == 0);
+      CHECK_TRUE((st.st_mode & 0777) == 0644);
+
+      snprintf(path, sizeof(path), "%s/empty", dirs.out_dir);
+      contents = test_read_file(path, &size);
+      CHECK_TRUE(contents != NULL);
+      CHECK_TRUE(size == 0);
+      free(contents);
+
+      snprintf(path, sizeof(path), "%s/dir/sub/big", dirs.out_dir);
+      contents = test_read_file(path, &size);
+      CHECK_TRUE(contents != NULL);
+      if (contents) {
+        CHECK_TRUE(size == 70000);
+        CHECK_TRUE(contents[0] == 'x' && contents[69999] == 'x');
+      }
+      free(contents);
+
+      snprintf(path, sizeof(path), "%s/dir/sub", dirs.out_dir);
+      CHECK_TRUE(stat(path, &st) == 0);
+      CHECK_TRUE(S_ISDIR(st.st_mode));
+      CHECK_TRUE((st.st_mode & 0777) == 0755);
+
+      snprintf(path, sizeof(path), "%s/dir/link", dirs.out_dir);
+      char link_buf[32];
+      const ssize_t link_len = readlink(path, link_buf, sizeof(link_buf) - 1);
+      CHECK_TRUE(link_len == 9);
+      if (link_len > 0) {
+        link_buf[link_len] = 0;
+        CHECK_STREQ(link_buf, "hello.txt");
+      }
+      CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+    }
+    simple_archiver_free_parsed(&parsed);
+  }
+
+  // Test I/O backends.
+  {
+    SDArchiverParsed parsed = simple_archiver_create_parsed();
+    SDArchiverState *state = simple_archiver_init_state(&parsed);
+    SDArchiverWriterMeta meta = {
+      .permissions = 0x4B,
+      .uid = 0,
+      .gid = 0,
+      .username = NULL,
+      .groupname = NULL
+    };
+
+    // Write to a growable memory buffer.
+    SDArchiverIO *mem_io = simple_archiver_io_init_mem(NULL, 0);
+    SDArchiverWriter *writer = simple_archiver_writer_begin_io(mem_io, state);
+    CHECK_TRUE(writer != NULL);
+    CHECK_TRUE(simple_archiver_writer_add_file_buf(writer,
+                                                   "file",
+                                                   "data",
+                                                   4,
+                                                   &meta).ret
+               == SDAS_SUCCESS);
+    CHECK_TRUE(simple_archiver_writer_finish(writer).ret == SDAS_SUCCESS);
+    simple_archiver_writer_free(&writer);
+    CHECK_TRUE(writer == NULL);
+
+    uint64_t archive_size = 0;
+    const char *archive = simple_archiver_io_mem_buf(mem_io, &archive_size);
+    CHECK_TRUE(archive != NULL);
+    CHECK_TRUE(archive_size > 20);
+    CHECK_TRUE(mem_io->size(mem_io->ud) == (int64_t)archive_size);
+    CHECK_TRUE(memcmp(archive, "SIMPLE_ARCHIVE_VER\0\x07", 20) == 0);
+
+    // Read-only memory buffer is not writable.
+    SDArchiverIO *ro_io = simple_archiver_io_init_mem(archive, archive_size);
+    int_fast8_t needs_fclose = 0;
+    CHECK_TRUE(simple_archiver_io_open_FILE(ro_io, "wb", &needs_fclose)
+               == NULL);
+    CHECK_TRUE(simple_archiver_io_stream_init(ro_io, 1) == NULL);
+    CHECK_TRUE(simple_archiver_parse_archive_info_io(ro_io, 0, state).ret
+               == SDAS_SUCCESS);
+    simple_archiver_io_free(&ro_io);
+    CHECK_TRUE(ro_io == NULL);
+
+    // Memory seeking.
+    int64_t offset = 18;
+    char buf[2];
+    CHECK_TRUE(mem_io->seek(mem_io->ud, &offset, SEEK_SET) == 0);
+    CHECK_TRUE(mem_io->read(mem_io->ud, buf, 2) == 2);
+    CHECK_TRUE(buf[0] == 0 && buf[1] == 7);
+    offset = -1;
+    CHECK_TRUE(mem_io->seek(mem_io->ud, &offset, SEEK_END) == 0);
+    CHECK_TRUE(offset == (int64_t)archive_size - 1);
+    offset = -1;
+    CHECK_TRUE(mem_io->seek(mem_io->ud, &offset, SEEK_SET) != 0);
+
+    // Writing after the writer was freed appends to what it wrote.
+    offset = 0;
+    CHECK_TRUE(mem_io->seek(mem_io->ud, &offset, SEEK_END) == 0);
+    CHECK_TRUE(mem_io->write(mem_io->ud, "x", 1) == 1);
+    CHECK_TRUE(mem_io->size(mem_io->ud) == (int64_t)archive_size + 1);
+    archive = simple_archiver_io_mem_buf(mem_io, &archive_size);
+    CHECK_TRUE(archive[archive_size - 1] == 'x');
+    --archive_size;
+
+    // Round-trip through a raw fd.
+    __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
+    FILE *tmp_f = tmpfile();
+    SDArchiverIO *fd_io = simple_archiver_io_init_fd(fileno(tmp_f));
+    CHECK_TRUE(fd_io != NULL);
+    CHECK_TRUE(fd_io->write(fd_io->ud, archive, archive_size)
+               == (int64_t)archive_size);
+    CHECK_TRUE(fd_io->size(fd_io->ud) == (int64_t)archive_size);
+    offset = 0;
+    CHECK_TRUE(fd_io->seek(fd_io->ud, &offset, SEEK_SET) == 0);
+    CHECK_TRUE(simple_archiver_parse_archive_info_io(fd_io, 0, state).ret
+               == SDAS_SUCCESS);
+    // The fd backend keeps an offset of its own.
+    CHECK_TRUE(lseek(fileno(tmp_f), 0, SEEK_CUR) == 0);
+    offset = 0;
+    CHECK_TRUE(fd_io->seek(fd_io->ud, &offset, SEEK_CUR) == 0);
+    CHECK_TRUE(offset == (int64_t)archive_size);
+    simple_archiver_io_free(&fd_io);
+
+    // Round-trip through a pipe, which is read and written in order.
+    int pipe_fds[2];
+    CHECK_TRUE(pipe(pipe_fds) == 0);
+    SDArchiverIO *pipe_io = simple_archiver_io_init_fd(pipe_fds[1]);
+    CHECK_TRUE(pipe_io->seek(pipe_io->ud, &offset, SEEK_CUR) != 0);
+    CHECK_TRUE(pipe_io->write(pipe_io->ud, archive, archive_size)
+               == (int64_t)archive_size);
+    simple_archiver_io_free(&pipe_io);
+    close(pipe_fds[1]);
+    pipe_io = simple_archiver_io_init_fd(pipe_fds[0]);
+    CHECK_TRUE(simple_archiver_parse_archive_info_io(pipe_io, 0, state).ret
+               == SDAS_SUCCESS);
+    simple_archiver_io_free(&pipe_io);
+    close(pipe_fds[0]);
+
+    // The stream hands reads and writes of at least its buffer's size to the
+    // backend, and buffers the rest.
+    {
+      const uint64_t big_size = 0x10000 * 3 + 5;
+      char *big = malloc(big_size);
+      for (uint64_t idx = 0; idx < big_size; ++idx) {
+        big[idx] = (char)(idx % 251);
+      }
+      SDArchiverIO *big_io = simple_archiver_io_init_mem(NULL, 0);
+      SDArchiverIOStream *stream = simple_archiver_io_stream_init(big_io, 1);
+      CHECK_TRUE(simple_archiver_io_write(big, 1, 3, stream) == 3);
+      CHECK_TRUE(big_io->size(big_io->ud) == 0);
+      CHECK_TRUE(simple_archiver_io_write(big + 3, 1, big_size - 3, stream)
+                 == big_size - 3);
+      CHECK_TRUE(big_io->size(big_io->ud) == (int64_t)big_size);
+      CHECK_TRUE(simple_archiver_io_read(big, 1, 1, stream) == 0);
+      CHECK_TRUE(simple_archiver_io_stream_close(&stream) == 0);
+      CHECK_TRUE(stream == NULL);
+
+      uint64_t big_io_size = 0;
+      const char *big_buf = simple_archiver_io_mem_buf(big_io, &big_io_size);
+      SDArchiverIO *big_ro_io = simple_archiver_io_init_mem(big_buf,
+                                                            big_io_size);
+      stream = simple_archiver_io_stream_init(big_ro_io, 0);
+      CHECK_TRUE(simple_archiver_io_getc(stream) == 0);
+      CHECK_TRUE(simple_archiver_io_getc(stream) == 1);
+      CHECK_TRUE(simple_archiver_io_tell(stream) == 2);
+      CHECK_TRUE(simple_archiver_io_seek(stream, 248, SEEK_CUR) == 0);
+      CHECK_TRUE(simple_archiver_io_getc(stream) == 250);
+      CHECK_TRUE(simple_archiver_io_seek(stream, 0x10000, SEEK_CUR) == 0);
+      CHECK_TRUE(simple_archiver_io_tell(stream) == 0x10000 + 251);
+      CHECK_TRUE(simple_archiver_io_getc(stream) == (0x10000 + 251) % 251);
+      CHECK_TRUE(simple_archiver_io_seek(stream, 1, SEEK_SET) == 0);
+      char *big_read = malloc(big_size);
+      CHECK_TRUE(simple_archiver_io_read(big_read, 1, big_size, stream)
+                 == big_size - 1);
+      CHECK_TRUE(memcmp(big_read, big + 1, big_size - 1) == 0);
+      CHECK_TRUE(simple_archiver_io_eof(stream));
+      CHECK_FALSE(simple_archiver_io_error(stream));
+      CHECK_TRUE(simple_archiver_io_getc(stream) == EOF);
+      simple_archiver_io_stream_free(&stream);
+      free(big_read);
+      simple_archiver_io_free(&big_ro_io);
+      simple_archiver_io_free(&big_io);
+      free(big);
+    }
+
+    // stdio hands out its own FILE*.
+    SDArchiverIO *stdio_io = simple_archiver_io_init_stdio(tmp_f);
+    rewind(tmp_f);
+    FILE *f = simple_archiver_io_open_FILE(stdio_io, "rb", &needs_fclose);
+    CHECK_TRUE(f == tmp_f);
+    CHECK_FALSE(needs_fclose);
+    CHECK_TRUE(simple_archiver_io_close_FILE(&f, needs_fclose) == 0);
+    rewind(tmp_f);
+    CHECK_TRUE(simple_archiver_parse_archive_info_io(stdio_io, 0, state).ret
+               == SDAS_SUCCESS);
+    simple_archiver_io_free(&stdio_io);
+
+    // The writer thread writes every queued frame in order.
+    __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
+    FILE *async_f = tmpfile();
+    SDArchiverIO *async_out = simple_archiver_io_init_stdio(async_f);
+    SDArchiverIO *async_io = simple_archiver_io_init_async(async_out, 64, 16);
+    CHECK_TRUE(async_io != NULL);
+    CHECK_TRUE(async_io->read == NULL);
+    CHECK_TRUE(async_io->seek == NULL);
+    for (uint64_t idx = 0; idx < archive_size; idx += 7) {
+      const uint64_t amount = archive_size - idx < 7 ? archive_size - idx : 7;
+      CHECK_TRUE(async_io->write(async_io->ud, archive + idx, amount)
+                 == (int64_t)amount);
+    }
+    CHECK_TRUE(simple_archiver_io_async_finish(async_io) == 0);
+    simple_archiver_io_free(&async_io);
+    simple_archiver_io_free(&async_out);
+    rewind(async_f);
+    char *async_buf = malloc(archive_size + 1);
+    CHECK_TRUE(fread(async_buf, 1, archive_size + 1, async_f) == archive_size);
+    CHECK_TRUE(memcmp(async_buf, archive, archive_size) == 0);
+    free(async_buf);
+
+    // A failed write by the writer thread fails the following writes.
+    __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
+    FILE *ro_f = fopen("/dev/null", "rb");
+    async_out = simple_archiver_io_init_stdio(ro_f);
+    async_io = simple_archiver_io_init_async(async_out, 64, 16);
+    CHECK_TRUE(async_io != NULL);
+    int_fast8_t write_failed = 0;
+    for (uint32_t idx = 0; idx < 100000 && !write_failed; ++idx) {
+      if (async_io->write(async_io->ud, archive, 16) < 0) {
+        write_failed = 1;
+      }
+    }
+    CHECK_TRUE(write_failed);
+    CHECK_TRUE(simple_archiver_io_async_finish(async_io) != 0);
+    simple_archiver_io_free(&async_io);
+    simple_archiver_io_free(&async_out);
+
+    simple_archiver_io_free(&mem_io);
+    simple_archiver_free_state(&state);
+    simple_archiver_free_parsed(&parsed);
+  }
+
+  // Test file formats 9, 10, and 11, the size/owner filters, extracting paths
+  // given as arguments, and "--du".
+  for (uint32_t version = 9; version <= 11; ++version) {
+    TestArchiveDirs dirs;
+    CHECK_TRUE(test_archive_dirs_init(&dirs, "v9") == 0);
+    const char *tree_dir = dirs.tree_dir;
+    const char *archive = dirs.archive;
+    const char *out_dir = dirs.out_dir;
+    char path[128];
+    char uid_str[16];
+    char other_uid_str[16];
+    char version_str[24];
+    snprintf(uid_str, sizeof(uid_str), "%" PRIu32, (uint32_t)getuid());
+    snprintf(other_uid_str, sizeof(other_uid_str), "%" PRIu32,
+             (uint32_t)getuid() + 1);
+    snprintf(version_str, sizeof(version_str), "--write-version=%" PRIu32,
+             version);
+    snprintf(path, sizeof(path), "%s/a", tree_dir);
+    FILE *f = fopen(path, "wb");
+    fputs("a", f);
+    fclose(f);
+    snprintf(path, sizeof(path), "%s/sub", tree_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/sub/b", tree_dir);
+    f = fopen(path, "wb");
+    for (uint32_t idx = 0; idx < 5000; ++idx) {
+      fputc('b', f);
+    }
+    fclose(f);
+
+    // Each file is in its own chunk.
+    const char *create_args[] = {"test", "-c", "-f", archive, version_str,
+                                 "--chunk-min-size=1", "-C", tree_dir, ".",
+                                 NULL};
+    CHECK_TRUE(test_archive_run(&dirs, create_args) == SDAS_SUCCESS);
+
+    char header[20];
+    f = fopen(archive, "rb");
+    CHECK_TRUE(f != NULL);
+    if (f) {
+      CHECK_TRUE(fread(header, 1, 20, f) == 20);
+      CHECK_TRUE(memcmp(header, "SIMPLE_ARCHIVE_VER\0", 19) == 0);
+      CHECK_TRUE((uint32_t)header[19] == version);
+      fclose(f);
+    }
+
+    // The summary of "sub" (file count, total size, largest size) precedes
+    // the dir entry of "sub", which starts with the same path.
+    if (version >= 11) {
+      long archive_size = 0;
+      char *contents = test_read_file(archive, &archive_size);
+      CHECK_TRUE(contents != NULL);
+      if (contents) {
+        const long sub_pos =
+          test_find_bytes(contents, archive_size, "\0\0\0\3sub", 8, 0);
+        CHECK_TRUE(sub_pos >= 0
+                   && sub_pos + 32 <= archive_size
+                   && memcmp(contents + sub_pos + 8,
+                             "\0\0\0\0\0\0\0\1"
+                             "\0\0\0\0\0\0\x13\x88"
+                             "\0\0\0\0\0\0\x13\x88",
+                             24) == 0);
+        free(contents);
+      }
+    }
+
+    // "--du" prints the directory summaries of file format 11 to stdout, for
+    // the dirs given as arguments it also prints the dirs within them.
+    for (int with_arg = 0; with_arg < 3; ++with_arg) {
+      snprintf(path, sizeof(path), "%s/du", dirs.dir);
+      SDArchiverParsed parsed = simple_archiver_create_parsed();
+      const char *du_args[] = {"test", "-f", archive, "--du",
+                               with_arg == 2 ? "." : "sub/", NULL};
+      CHECK_TRUE(simple_archiver_parse_args(with_arg ? 5 : 4, du_args, &parsed)
+                 == 0);
+      CHECK_TRUE((parsed.flags & 0x3) == 0x2);
+      SDArchiverState *state = simple_archiver_init_state(&parsed);
+      fflush(stdout);
+      int stdout_fd = dup(STDOUT_FILENO);
+      int du_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      CHECK_TRUE(stdout_fd >= 0 && du_fd >= 0);
+      dup2(du_fd, STDOUT_FILENO);
+      close(du_fd);
+      SDArchiverStateReturns du_ret = SDAS_INVALID_FILE;
+      f = fopen(archive, "rb");
+      if (f) {
+        du_ret = simple_archiver_parse_archive_info(f, 0, state).ret
+                 & SDAS_STATUS_RET_MASK;
+        fclose(f);
+      }
+      fflush(stdout);
+      dup2(stdout_fd, STDOUT_FILENO);
+      close(stdout_fd);
+      simple_archiver_free_state(&state);
+      simple_archiver_free_parsed(&parsed);
+
+      char du_out[128];
+      memset(du_out, 0, sizeof(du_out));
+      f = fopen(path, "rb");
+      CHECK_TRUE(f != NULL);
+      if (f) {
+        CHECK_TRUE(fread(du_out, 1, sizeof(du_out) - 1, f) < sizeof(du_out));
+        fclose(f);
+      }
+      unlink(path);
+      if (version >= 11) {
+        CHECK_TRUE(du_ret == SDAS_SUCCESS);
+        CHECK_STREQ(du_out,
+                    with_arg == 1
+                      ? "5000\t1\t5000\tsub\n"
+                      : "5001\t2\t5000\t.\n5000\t1\t5000\tsub\n");
+      } else {
+        CHECK_TRUE(du_ret != SDAS_SUCCESS);
+        CHECK_STREQ(du_out, "");
+      }
+    }
+
+    // Each run extracts with filters or paths, "a" is 1 byte and "sub/b" is
+    // 5000 bytes.
+    const char *extra_args[7][2] = {
+      {NULL, NULL},
+      {"--filter-min-size", "100"},
+      {"--filter-max-size", "100"},
+      {"--filter-uid", uid_str},
+      {"--filter-uid", other_uid_str},
+      {"sub", NULL},
+      {"sub/b", NULL}
+    };
+    const int_fast8_t expect_a[7] = {1, 0, 1, 1, 0, 0, 0};
+    const int_fast8_t expect_b[7] = {1, 1, 0, 1, 0, 1, 1};
+    for (uint32_t idx = 0; idx < 7; ++idx) {
+      mkdir(out_dir, 0755);
+      const char *extract_args[] = {"test", "-x", "-f", archive,
+                                    "-C", out_dir,
+                                    extra_args[idx][0], extra_args[idx][1],
+                                    NULL};
+      CHECK_TRUE(test_archive_run(&dirs, extract_args) == SDAS_SUCCESS);
+
+      snprintf(path, sizeof(path), "%s/a", out_dir);
+      CHECK_TRUE((access(path, F_OK) == 0) == expect_a[idx]);
+      unlink(path);
+      snprintf(path, sizeof(path), "%s/sub/b", out_dir);
+      struct stat stat_buf;
+      CHECK_TRUE((stat(path, &stat_buf) == 0) == expect_b[idx]);
+      if (expect_b[idx]) {
+        CHECK_TRUE(stat_buf.st_size == 5000);
+      }
+      unlink(path);
+      snprintf(path, sizeof(path), "%s/sub", out_dir);
+      rmdir(path);
+      CHECK_TRUE(rmdir(out_dir) == 0);
+    }
+
+    CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+  }
+
+  // Test --extract-in-place-delta with uncompressed and compressed chunks.
+  for (int compressed = 0; compressed < 2; ++compressed) {
+    TestArchiveDirs dirs;
+    CHECK_TRUE(test_archive_dirs_init(&dirs, "in_place") == 0);
+    const char *archive = dirs.archive;
+    const char *out_dir = dirs.out_dir;
+    char path[128];
+    char link_path[128];
+
+    const uint32_t big_size = 200000;
+    char *big = malloc(big_size);
+    for (uint32_t idx = 0; idx < big_size; ++idx) {
+      big[idx] = (char)(idx * 7);
+    }
+
+    SDArchiverParsed parsed = simple_archiver_create_parsed();
+    if (compressed) {
+      parsed.compressor = strdup("cat");
+      parsed.decompressor = strdup("cat");
+    }
+    SDArchiverState *state = simple_archiver_init_state(&parsed);
+    FILE *f = fopen(archive, "wb");
+    CHECK_TRUE(f != NULL);
+    SDArchiverWriter *writer = simple_archiver_writer_begin(f, state);
+    SDArchiverWriterMeta meta = {
+      .permissions = 0x1A4, .uid = getuid(), .gid = getgid(),
+      .username = NULL, .groupname = NULL
+    };
+    CHECK_TRUE(simple_archiver_writer_add_file_buf(writer, "big", big,
+                                                   big_size, &meta).ret
+               == SDAS_SUCCESS);
+    CHECK_TRUE(simple_archiver_writer_add_file_buf(writer, "linked", big,
+                                                   big_size, &meta).ret
+               == SDAS_SUCCESS);
+    CHECK_TRUE(simple_archiver_writer_add_file_buf(writer, "small", "small",
+                                                   5, &meta).ret
+               == SDAS_SUCCESS);
+    CHECK_TRUE(simple_archiver_writer_finish(writer).ret == SDAS_SUCCESS);
+    simple_archiver_writer_free(&writer);
+    fclose(f);
+    simple_archiver_free_state(&state);
+    simple_archiver_free_parsed(&parsed);
+
+    // "big" and "linked" have the same size with one changed byte. "linked"
+    // also has a hard link outside of the extraction dir, which must keep its
+    // contents. "small" has a different size.
+    big[150000] ^= 1;
+    snprintf(path, sizeof(path), "%s/big", out_dir);
+    f = fopen(path, "wb");
+    fwrite(big, 1, big_size, f);
+    fclose(f);
+    struct stat before;
+    CHECK_TRUE(stat(path, &before) == 0);
+    snprintf(path, sizeof(path), "%s/linked", out_dir);
+    f = fopen(path, "wb");
+    fwrite(big, 1, big_size, f);
+    fclose(f);
+    big[150000] ^= 1;
+    snprintf(link_path, sizeof(link_path), "%s/linked_outside", dirs.dir);
+    CHECK_TRUE(link(path, link_path) == 0);
+    struct stat linked_before;
+    CHECK_TRUE(stat(path, &linked_before) == 0);
+    snprintf(path, sizeof(path), "%s/small", out_dir);
+    f = fopen(path, "wb");
+    fputs("old", f);
+    fclose(f);
+
+    parsed = simple_archiver_create_parsed();
+    const char *args[] = {"test", "-x", "-f", archive, "-C", out_dir,
+                          "--extract-in-place-delta", NULL};
+    CHECK_TRUE(simple_archiver_parse_args(7, args, &parsed) == 0);
+    CHECK_TRUE(parsed.flags & 0x8);
+    simple_archiver_free_parsed(&parsed);
+    CHECK_TRUE(test_archive_run(&dirs, args) == SDAS_SUCCESS);
+
+    struct stat after;
+    snprintf(path, sizeof(path), "%s/big", out_dir);
+    CHECK_TRUE(stat(path, &after) == 0);
+    CHECK_TRUE(after.st_ino == before.st_ino);
+    CHECK_TRUE(after.st_size == big_size);
+    snprintf(path, sizeof(path), "%s/linked", out_dir);
+    CHECK_TRUE(stat(path, &after) == 0);
+    CHECK_TRUE(after.st_ino != linked_before.st_ino);
+    CHECK_TRUE(after.st_nlink == 1);
+    const char *const read_paths[3] = {"big", "linked", NULL};
+    char *read_back = malloc(big_size);
+    for (size_t idx = 0; idx < 3; ++idx) {
+      if (read_paths[idx]) {
+        snprintf(path, sizeof(path), "%s/%s", out_dir, read_paths[idx]);
+      }
+      f = fopen(read_paths[idx] ? path : link_path, "rb");
+      CHECK_TRUE(f != NULL);
+      if (f) {
+        CHECK_TRUE(fread(read_back, 1, big_size, f) == big_size);
+        CHECK_TRUE((read_back[150000] != big[150000]) == !read_paths[idx]);
+        CHECK_TRUE(memcmp(read_back, big, 150000) == 0);
+        fclose(f);
+      }
+    }
+    free(read_back);
+    snprintf(path, sizeof(path), "%s/small", out_dir);
+    char small[8] = {0};
+    f = fopen(path, "rb");
+    CHECK_TRUE(f != NULL);
+    if (f) {
+      CHECK_TRUE(fread(small, 1, sizeof(small), f) == 5);
+      CHECK_TRUE(memcmp(small, "small", 5) == 0);
+      fclose(f);
+    }
+    free(big);
+    CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+  }
+
+  // Test that extracting does not write through a symlink leading outside of
+  // the extraction dir, with uncompressed and compressed chunks.
+  for (int compressed = 0; compressed < 2; ++compressed) {
+    TestArchiveDirs dirs;
+    CHECK_TRUE(test_archive_dirs_init(&dirs, "beneath") == 0);
+    const char *archive = dirs.archive;
+    const char *out_dir = dirs.out_dir;
+    char outside_dir[96];
+    char path[128];
+    snprintf(outside_dir, sizeof(outside_dir), "%s/outside", dirs.dir);
+    mkdir(outside_dir, 0755);
+
+    SDArchiverParsed parsed = simple_archiver_create_parsed();
+    if (compressed) {
+      parsed.compressor = strdup("cat");
+      parsed.decompressor = strdup("cat");
+    }
+    SDArchiverState *state = simple_archiver_init_state(&parsed);
+    FILE *f = fopen(archive, "wb");
+    CHECK_TRUE(f != NULL);
+    SDArchiverWriter *writer = simple_archiver_writer_begin(f, state);
+    SDArchiverWriterMeta meta = {
+      .permissions = 0x1A4, .uid = getuid(), .gid = getgid(),
+      .username = NULL, .groupname = NULL
+    };
+    CHECK_TRUE(simple_archiver_writer_add_file_buf(writer, "a/x", "x", 1,
+                                                   &meta).ret
+               == SDAS_SUCCESS);
+    CHECK_TRUE(simple_archiver_writer_finish(writer).ret == SDAS_SUCCESS);
+    simple_archiver_writer_free(&writer);
+    fclose(f);
+    simple_archiver_free_state(&state);
+    simple_archiver_free_parsed(&parsed);
+
+    // Planted after the archive was checked, which string checks of the
+    // archived paths cannot see.
+    snprintf(path, sizeof(path), "%s/a", out_dir);
+    CHECK_TRUE(symlink(outside_dir, path) == 0);
+
+    CHECK_TRUE(chdir(out_dir) == 0);
+    const int dir_fd = simple_archiver_helper_beneath_dir_fd();
+    if (dir_fd >= 0) {
+      CHECK_TRUE(simple_archiver_helper_open_beneath(dir_fd,
+                                                     "../outside",
+                                                     O_RDONLY,
+                                                     0) == -1);
+      CHECK_TRUE(errno == EXDEV);
+      CHECK_TRUE(simple_archiver_helper_open_beneath(dir_fd,
+                                                     "a/x",
+                                                     O_WRONLY | O_CREAT,
+                                                     0644) == -1);
+      CHECK_TRUE(errno == EXDEV);
+      close(dir_fd);
+    } else {
+      printf("NOTICE: openat2 is not available, confinement is not "
+             "checked!\n");
+    }
+    CHECK_TRUE(chdir(dirs.original_cwd) == 0);
+
+    const char *args[] = {"test", "-x", "-f", archive, "-C", out_dir, NULL};
+    const SDArchiverStateReturns ret = test_archive_run(&dirs, args);
+    if (dir_fd >= 0) {
+      CHECK_TRUE(ret == SDAS_FILE_CREATE_FAIL);
+    }
+
+    snprintf(path, sizeof(path), "%s/x", outside_dir);
+    if (dir_fd >= 0) {
+      CHECK_FALSE(access(path, F_OK) == 0);
+    }
+    CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+  }
+
+  // Test extracting only some of the files of a file format 0 archive, which
+  // must skip over the data of the files before them.
+  {
+    TestArchiveDirs dirs;
+    CHECK_TRUE(test_archive_dirs_init(&dirs, "v0_some") == 0);
+    char path[160];
+    const uint32_t big_size = 40000;
+    char *big = malloc(big_size);
+    for (uint32_t idx = 0; idx < big_size; ++idx) {
+      big[idx] = (char)(idx % 253);
+    }
+    snprintf(path, sizeof(path), "%s/a", dirs.tree_dir);
+    CHECK_TRUE(test_write_file(path, "aaa", 3) == 0);
+    snprintf(path, sizeof(path), "%s/b", dirs.tree_dir);
+    CHECK_TRUE(test_write_file(path, big, big_size) == 0);
+    snprintf(path, sizeof(path), "%s/c", dirs.tree_dir);
+    CHECK_TRUE(test_write_file(path, "ccccc", 5) == 0);
+
+    const char *create_args[] = {"test", "-c", "-f", dirs.archive,
+                                 "--write-version=0", "-C", dirs.tree_dir,
+                                 "a", "b", "c", NULL};
+    CHECK_TRUE(test_archive_run(&dirs, create_args) == SDAS_SUCCESS);
+    const char *args[] = {"test", "-x", "-f", dirs.archive,
+                          "-C", dirs.out_dir, "c", NULL};
+    CHECK_TRUE(test_archive_run(&dirs, args) == SDAS_SUCCESS);
+
+    snprintf(path, sizeof(path), "%s/c", dirs.out_dir);
+    long size = 0;
+    char *contents = test_read_file(path, &size);
+    CHECK_TRUE(contents != NULL && size == 5);
+    if (contents) {
+      CHECK_STREQ(contents, "ccccc");
+      free(contents);
+    }
+    snprintf(path, sizeof(path), "%s/a", dirs.out_dir);
+    CHECK_FALSE(access(path, F_OK) == 0);
+    snprintf(path, sizeof(path), "%s/b", dirs.out_dir);
+    CHECK_FALSE(access(path, F_OK) == 0);
+    free(big);
+    CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+  }
+
+  // Test that a dir given to extract selects its entries in every file
+  // format, with or without a trailing "/".
+  {
+    const char *versions[] = {"0", "1", "2", "3", "5", "7", "11"};
+    for (size_t idx = 0; idx < sizeof(versions) / sizeof(versions[0]);
+         ++idx) {
+      TestArchiveDirs dirs;
+      CHECK_TRUE(test_archive_dirs_init(&dirs, "arg_dir") == 0);
+      char path[160];
+      snprintf(path, sizeof(path), "%s/src", dirs.tree_dir);
+      mkdir(path, 0755);
+      snprintf(path, sizeof(path), "%s/src/c", dirs.tree_dir);
+      mkdir(path, 0755);
+      snprintf(path, sizeof(path), "%s/src/c/a", dirs.tree_dir);
+      CHECK_TRUE(test_write_file(path, "a", 1) == 0);
+      snprintf(path, sizeof(path), "%s/src/cc", dirs.tree_dir);
+      CHECK_TRUE(test_write_file(path, "cc", 2) == 0);
+      snprintf(path, sizeof(path), "%s/src/b", dirs.tree_dir);
+      CHECK_TRUE(test_write_file(path, "b", 1) == 0);
+
+      char version_arg[32];
+      snprintf(version_arg, sizeof(version_arg), "--write-version=%s",
+               versions[idx]);
+      const char *create_args[] = {"test", "-c", "-f", dirs.archive,
+                                   version_arg, "-C", dirs.tree_dir, "src",
+                                   NULL};
+      CHECK_TRUE(test_archive_run(&dirs, create_args) == SDAS_SUCCESS);
+      const char *args[] = {"test", "-x", "-f", dirs.archive,
+                            "-C", dirs.out_dir, "src/c/", NULL};
+      CHECK_TRUE(test_archive_run(&dirs, args) == SDAS_SUCCESS);
+
+      snprintf(path, sizeof(path), "%s/src/c/a", dirs.out_dir);
+      CHECK_TRUE(access(path, F_OK) == 0);
+      snprintf(path, sizeof(path), "%s/src/cc", dirs.out_dir);
+      CHECK_FALSE(access(path, F_OK) == 0);
+      snprintf(path, sizeof(path), "%s/src/b", dirs.out_dir);
+      CHECK_FALSE(access(path, F_OK) == 0);
+      CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+    }
+  }
+
+  // Test that --rsyncable slices of data with an inserted byte are mostly the
+  // same, unlike fixed size slices.
+  {
+    TestArchiveDirs dirs;
+    CHECK_TRUE(test_archive_dirs_init(&dirs, "rsyncable") == 0);
+    char path[128];
+
+    // Large enough for several slices of "--rsyncable"'s own slice size.
+    const uint64_t size = 8 * 1024 * 1024;
+    char *data = malloc(size + 1);
+    uint32_t lcg = 1;
+    for (uint64_t idx = 0; idx < size; ++idx) {
+      lcg = lcg * 1103515245 + 12345;
+      data[idx] = idx % 61 == 60 ? '\n' : (char)('a' + (lcg >> 16) % 26);
+    }
+    char *inserted = malloc(size + 1);
+    memcpy(inserted, data, 100);
+    inserted[100] = 'z';
+    memcpy(inserted + 101, data + 100, size - 100);
+
+    for (uint_fast8_t rsyncable = 0; rsyncable < 2; ++rsyncable) {
+      long a_size = 0;
+      long b_size = 0;
+      char *a = test_rsyncable_write(&dirs, data, size, rsyncable, &a_size);
+      char *b =
+        test_rsyncable_write(&dirs, inserted, size + 1, rsyncable, &b_size);
+      CHECK_TRUE(a != NULL);
+      CHECK_TRUE(b != NULL);
+      if (a && b) {
+        uint32_t a_slices = 0;
+        const uint32_t shared =
+          test_rsyncable_shared(a, a_size, b, b_size, &a_slices);
+        if (rsyncable) {
+          CHECK_TRUE(a_slices > 6);
+          CHECK_TRUE(a_slices < size / 16384);
+          CHECK_TRUE(shared + 2 >= a_slices);
+        } else {
+          CHECK_TRUE(a_slices >= size / 16384);
+          CHECK_TRUE(shared == 0);
+        }
+      }
+      free(a);
+      free(b);
+    }
+
+    // The concatenated slices extract as the original data.
+    snprintf(path, sizeof(path), "%s/data", dirs.tree_dir);
+    CHECK_TRUE(test_write_file(path, data, size) == 0);
+    const char *create_args[] = {"test", "-c", "-f", dirs.archive,
+                                 "--compressor=cat", "--decompressor=cat",
+                                 "--compress-slice-size=16KiB", "--rsyncable",
+                                 "-C", dirs.tree_dir, "data", NULL};
+    CHECK_TRUE(test_archive_run(&dirs, create_args) == SDAS_SUCCESS);
+
+    const char *args[] = {"test", "-x", "-f", dirs.archive,
+                          "-C", dirs.out_dir, NULL};
+    CHECK_TRUE(test_archive_run(&dirs, args) == SDAS_SUCCESS);
+
+    snprintf(path, sizeof(path), "%s/data", dirs.out_dir);
+    long read_size = 0;
+    char *read_back = test_read_file(path, &read_size);
+    CHECK_TRUE(read_back != NULL);
+    if (read_back) {
+      CHECK_TRUE(read_size == (long)size);
+      CHECK_TRUE(memcmp(read_back, data, size) == 0);
+    }
+    free(read_back);
+    free(data);
+    free(inserted);
+
+    // Delta compressed chunks cannot be sliced.
+    char delta_archive[128];
+    snprintf(delta_archive, sizeof(delta_archive), "%s/delta", dirs.dir);
+    const char *delta_args[] = {"test", "-c", "-f", delta_archive,
+                                "--compressor=cat", "--decompressor=cat",
+                                "--write-version=8", "--rsyncable",
+                                "--delta-from", dirs.archive,
+                                "-C", dirs.tree_dir, "data", NULL};
+    printf("Expecting ERROR output on next line:\n");
+    CHECK_TRUE(test_archive_run(&dirs, delta_args)
+               == SDAS_INVALID_PARSED_STATE);
+    CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+  }
+
+  // Test creating an archive with "--delta-from" and zstd, which needs the
+  // stream size to compress with "--patch-from", then extracting it.
+  if (system("zstd --version > /dev/null 2>&1") == 0) {
+    TestArchiveDirs dirs;
+    CHECK_TRUE(test_archive_dirs_init(&dirs, "delta_zstd") == 0);
+    char base_archive[128];
+    char path[128];
+    snprintf(base_archive, sizeof(base_archive), "%s/base", dirs.dir);
+    snprintf(path, sizeof(path), "%s/data", dirs.tree_dir);
+
+    const uint32_t size = 200000;
+    char *data = malloc(size);
+    uint32_t lcg = 7;
+    for (uint32_t idx = 0; idx < size; ++idx) {
+      lcg = lcg * 1103515245 + 12345;
+      data[idx] = (char)(lcg >> 16);
+    }
+    CHECK_TRUE(test_write_file(path, data, size) == 0);
+    const char *base_args[] = {"test", "-c", "-f", base_archive,
+                               "--write-version=8",
+                               "--compressor=zstd", "--decompressor=zstd -d",
+                               "-C", dirs.tree_dir, "data", NULL};
+    CHECK_TRUE(test_archive_run(&dirs, base_args) == SDAS_SUCCESS);
+
+    data[100000] ^= 1;
+    CHECK_TRUE(test_write_file(path, data, size) == 0);
+    const char *args[] = {"test", "-c", "-f", dirs.archive,
+                          "--write-version=8",
+                          "--compressor=zstd", "--decompressor=zstd -d",
+                          "--delta-from", base_archive,
+                          "-C", dirs.tree_dir, "data", NULL};
+    CHECK_TRUE(test_archive_run(&dirs, args) == SDAS_SUCCESS);
+    long base_size = 0;
+    long delta_size = 0;
+    char *base = test_read_file(base_archive, &base_size);
+    char *delta = test_read_file(dirs.archive, &delta_size);
+    CHECK_TRUE(base_size > size);
+    CHECK_TRUE(delta_size > 0 && delta_size < 4096);
+    free(base);
+    free(delta);
+
+    const char *extract_args[] = {"test", "-x", "-f", dirs.archive,
+                                  "--delta-from", base_archive,
+                                  "-C", dirs.out_dir, NULL};
+    CHECK_TRUE(test_archive_run(&dirs, extract_args) == SDAS_SUCCESS);
+    snprintf(path, sizeof(path), "%s/data", dirs.out_dir);
+    long read_size = 0;
+    char *read_back = test_read_file(path, &read_size);
+    CHECK_TRUE(read_back != NULL);
+    if (read_back) {
+      CHECK_TRUE(read_size == size);
+      CHECK_TRUE(memcmp(read_back, data, size) == 0);
+    }
+    free(read_back);
+    free(data);
+    CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+  } else {
+    printf("NOTICE: zstd is not available, \"--delta-from\" is not "
+           "checked!\n");
+  }
+
+  // Test that writing through the writer thread gives the same archive as
+  // writing directly.
+  {
+    TestArchiveDirs dirs;
+    CHECK_TRUE(test_archive_dirs_init(&dirs, "write_buffer") == 0);
+    char path[128];
+    snprintf(path, sizeof(path), "%s/data", dirs.tree_dir);
+    FILE *f = fopen(path, "wb");
+    for (uint32_t idx = 0; idx < 300000; ++idx) {
+      fputc((char)(idx % 251), f);
+    }
+    fclose(f);
+
+    char *archives[2] = {NULL, NULL};
+    long archive_sizes[2] = {0, 0};
+    for (uint32_t direct = 0; direct < 2; ++direct) {
+      const char *args[] = {"test", "-c", "-f", dirs.archive,
+                            "--write-version=7",
+                            "--compressor=cat", "--decompressor=cat",
+                            direct ? "--write-buffer-size=0"
+                                   : "--write-buffer-size=64KiB",
+                            "-C", dirs.tree_dir, "data", NULL};
+      CHECK_TRUE(test_archive_run(&dirs, args) == SDAS_SUCCESS);
+      archives[direct] = test_read_file(dirs.archive, &archive_sizes[direct]);
+    }
+    CHECK_TRUE(archive_sizes[0] > 300000);
+    CHECK_TRUE(archive_sizes[0] == archive_sizes[1]);
+    if (archives[0] && archives[1] && archive_sizes[0] == archive_sizes[1]) {
+      CHECK_TRUE(memcmp(archives[0], archives[1], (size_t)archive_sizes[0])
+                 == 0);
+    }
+    free(archives[0]);
+    free(archives[1]);
+    CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+  }
+
+  // Test that "--compress-jobs" compresses a chunk as separate gzip members
+  // that extract back to the same files as compressing with one job.
+  if (system("gzip --version > /dev/null 2>&1") == 0) {
+    TestArchiveDirs dirs;
+    CHECK_TRUE(test_archive_dirs_init(&dirs, "compress_jobs") == 0);
+    char path[128];
+    const uint32_t size = 300000;
+    char *data = malloc(size);
+    uint32_t lcg = 11;
+    for (uint32_t idx = 0; idx < size; ++idx) {
+      lcg = lcg * 1103515245 + 12345;
+      data[idx] = (char)('a' + (lcg >> 16) % 8);
+    }
+    snprintf(path, sizeof(path), "%s/data", dirs.tree_dir);
+    CHECK_TRUE(test_write_file(path, data, size) == 0);
+    snprintf(path, sizeof(path), "%s/sub", dirs.tree_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/sub/small", dirs.tree_dir);
+    CHECK_TRUE(test_write_file(path, "small\n", 6) == 0);
+
+    for (uint32_t jobs = 1; jobs <= 4; jobs += 3) {
+      char jobs_arg[32];
+      snprintf(jobs_arg, sizeof(jobs_arg), "--compress-jobs=%" PRIu32, jobs);
+      const char *args[] = {"test", "-c", "-f", dirs.archive,
+                            "--compressor=gzip -n", "--decompressor=gzip -d",
+                            jobs_arg, "--compress-slice-size=16KiB",
+                            "-C", dirs.tree_dir, ".", NULL};
+      CHECK_TRUE(test_archive_run(&dirs, args) == SDAS_SUCCESS);
+
+      // "gzip -n" starts every member with the same 8 bytes.
+      long archive_size = 0;
+      char *archive = test_read_file(dirs.archive, &archive_size);
+      CHECK_TRUE(archive != NULL);
+      uint32_t members = 0;
+      for (long idx = 0; archive && idx + 8 <= archive_size; ++idx) {
+        if (memcmp(archive + idx, "\x1f\x8b\x08\0\0\0\0\0", 8) == 0) {
+          ++members;
+        }
+      }
+      free(archive);
+      if (jobs == 1) {
+        CHECK_TRUE(members == 1);
+      } else {
+        CHECK_TRUE(members >= size / 16384);
+      }
+
+      const char *extract_args[] = {"test", "-x", "-f", dirs.archive,
+                                    "--overwrite-extract",
+                                    "-C", dirs.out_dir, NULL};
+      CHECK_TRUE(test_archive_run(&dirs, extract_args) == SDAS_SUCCESS);
+      snprintf(path, sizeof(path), "%s/data", dirs.out_dir);
+      long read_size = 0;
+      char *read_back = test_read_file(path, &read_size);
+      CHECK_TRUE(read_back != NULL);
+      if (read_back) {
+        CHECK_TRUE(read_size == size);
+        CHECK_TRUE(memcmp(read_back, data, size) == 0);
+      }
+      free(read_back);
+      snprintf(path, sizeof(path), "%s/sub/small", dirs.out_dir);
+      read_back = test_read_file(path, &read_size);
+      CHECK_TRUE(read_back != NULL);
+      if (read_back) {
+        CHECK_STREQ(read_back, "small\n");
+      }
+      free(read_back);
+    }
+    free(data);
+    CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+  } else {
+    printf("NOTICE: gzip is not available, \"--compress-jobs\" is not "
+           "checked!\n");
+  }
+
+  // Test that "--sort-files-by-similarity" stores the files grouped by
+  // extension with the files of the same content next to each other, and that
+  // they extract unchanged.
+  {
+    TestArchiveDirs dirs;
+    CHECK_TRUE(test_archive_dirs_init(&dirs, "similarity") == 0);
+    char path[128];
+    // "one.txt" and "two.txt" are the same, "three.txt" (between them by
+    // name) and "x.bin" differ.
+    const char *names[4] = {"one.txt", "two.txt", "three.txt", "x.bin"};
+    const uint32_t seeds[4] = {3, 3, 5, 7};
+    const uint32_t size = 20000;
+    char *contents[4];
+    for (uint32_t file = 0; file < 4; ++file) {
+      contents[file] = malloc(size);
+      uint32_t lcg = seeds[file];
+      for (uint32_t idx = 0; idx < size; ++idx) {
+        lcg = lcg * 1103515245 + 12345;
+        contents[file][idx] = (char)('a' + (lcg >> 16) % 26);
+      }
+      snprintf(path, sizeof(path), "%s/%s", dirs.tree_dir, names[file]);
+      CHECK_TRUE(test_write_file(path, contents[file], size) == 0);
+    }
+
+    const char *args[] = {"test", "-c", "-f", dirs.archive,
+                          "--sort-files-by-similarity",
+                          "-C", dirs.tree_dir, ".", NULL};
+    CHECK_TRUE(test_archive_run(&dirs, args) == SDAS_SUCCESS);
+
+    // Without a compressor the files are stored as is, in order.
+    long archive_size = 0;
+    char *archive = test_read_file(dirs.archive, &archive_size);
+    CHECK_TRUE(archive != NULL);
+    if (archive) {
+      const long bin_pos =
+        test_find_bytes(archive, archive_size, contents[3], 64, 0);
+      const long same_pos =
+        test_find_bytes(archive, archive_size, contents[0], 64, 0);
+      const long same_next_pos =
+        test_find_bytes(archive, archive_size, contents[0], 64, same_pos + 1);
+      const long three_pos =
+        test_find_bytes(archive, archive_size, contents[2], 64, 0);
+      CHECK_TRUE(bin_pos >= 0 && same_pos >= 0 && three_pos >= 0);
+      CHECK_TRUE(same_next_pos == same_pos + (long)size);
+      CHECK_TRUE(bin_pos < same_pos && bin_pos < three_pos);
+    }
+    free(archive);
+
+    const char *extract_args[] = {"test", "-x", "-f", dirs.archive,
+                                  "-C", dirs.out_dir, NULL};
+    CHECK_TRUE(test_archive_run(&dirs, extract_args) == SDAS_SUCCESS);
+    for (uint32_t file = 0; file < 4; ++file) {
+      snprintf(path, sizeof(path), "%s/%s", dirs.out_dir, names[file]);
+      long read_size = 0;
+      char *read_back = test_read_file(path, &read_size);
+      CHECK_TRUE(read_back != NULL);
+      if (read_back) {
+        CHECK_TRUE(read_size == size);
+        CHECK_TRUE(memcmp(read_back, contents[file], size) == 0);
+      }
+      free(read_back);
+      free(contents[file]);
+    }
+    CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+  }
+
+  // Test that file format 7 is written byte for byte as before its
+  // chunked-encoding was rewritten, and that the fixture written before (and
+  // the same data in smaller "mini-chunks") extracts.
+  {
+    TestArchiveDirs dirs;
+    CHECK_TRUE(test_archive_dirs_init(&dirs, "v7_fixture") == 0);
+    // Written by the old writer from "data" (16 times "0123456789abcdef") and
+    // "sub/hello.txt" ("Hello v7\n") with the arguments below. This is up to
+    // the newline of the only "mini-chunk" (267 bytes).
+    const char fixture_header[] =
+      "\x53\x49\x4d\x50\x4c\x45\x5f\x41\x52\x43\x48\x49\x56\x45\x5f\x56"
+      "\x45\x52\x00\x07\x01\x00\x00\x00\x00\x03\x63\x61\x74\x00\x00\x03"
+      "\x63\x61\x74\x00\x00\x00\x00\x00\x00\x00\x00\x01\x00\x00\x00\x03"
+      "\x73\x75\x62\x00\x6f\x03\x00\x3d\x09\x00\x00\x3d\x09\x00\x00\x00"
+      "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+      "\x00\x01\x00\x00\x00\x00\x00\x00\x00\x02\x00\x04\x64\x61\x74\x61"
+      "\x00\x4b\x00\x00\x00\x00\x3d\x09\x00\x00\x3d\x09\x00\x00\x00\x00"
+      "\x00\x00\x00\x00\x00\x00\x00\x01\x00\x00\x0d\x73\x75\x62\x2f\x68"
+      "\x65\x6c\x6c\x6f\x2e\x74\x78\x74\x00\x4b\x00\x00\x00\x00\x3d\x09"
+      "\x00\x00\x3d\x09\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+      "\x09\x01\x00\x32\x36\x37\x0a";
+    const size_t fixture_header_size = sizeof(fixture_header) - 1;
+    char chunk[267];
+    memcpy(chunk, "SA", 2);
+    for (size_t idx = 0; idx < 16; ++idx) {
+      memcpy(chunk + 2 + idx * 16, "0123456789abcdef", 16);
+    }
+    memcpy(chunk + 258, "Hello v7\n", 9);
+    char fixture[512];
+    memcpy(fixture, fixture_header, fixture_header_size);
+    memcpy(fixture + fixture_header_size, chunk, sizeof(chunk));
+    memcpy(fixture + fixture_header_size + sizeof(chunk), "0\n", 2);
+    const size_t fixture_size = fixture_header_size + sizeof(chunk) + 2;
+
+    char path[128];
+    snprintf(path, sizeof(path), "%s/data", dirs.tree_dir);
+    CHECK_TRUE(test_write_file(path, chunk + 2, 256) == 0);
+    snprintf(path, sizeof(path), "%s/sub", dirs.tree_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/sub/hello.txt", dirs.tree_dir);
+    CHECK_TRUE(test_write_file(path, "Hello v7\n", 9) == 0);
+    const char *args[] = {"test", "-c", "-f", dirs.archive,
+                          "--write-version=7",
+                          "--compressor=cat", "--decompressor=cat",
+                          "--force-uid=4000000", "--force-gid=4000000",
+                          "--force-file-permissions=644",
+                          "--force-dir-permissions=755",
+                          "-C", dirs.tree_dir, ".", NULL};
+    CHECK_TRUE(test_archive_run(&dirs, args) == SDAS_SUCCESS);
+    long archive_size = 0;
+    char *archive = test_read_file(dirs.archive, &archive_size);
+    CHECK_TRUE(archive != NULL);
+    CHECK_TRUE(archive_size == (long)fixture_size);
+    if (archive && archive_size == (long)fixture_size) {
+      CHECK_TRUE(memcmp(archive, fixture, fixture_size) == 0);
+    }
+    free(archive);
+
+    // The fixture as is, then split into "mini-chunks" of 100, 100, and 67
+    // bytes, then cut short within the "mini-chunk".
+    for (uint32_t variant = 0; variant < 3; ++variant) {
+      char variant_archive[512];
+      size_t variant_size = fixture_header_size - 4;
+      memcpy(variant_archive, fixture, variant_size);
+      if (variant == 1) {
+        for (size_t offset = 0; offset < sizeof(chunk); offset += 100) {
+          const size_t size =
+            sizeof(chunk) - offset < 100 ? sizeof(chunk) - offset : 100;
+          variant_size += (size_t)sprintf(variant_archive + variant_size,
+                                          "%zu\n",
+                                          size);
+          memcpy(variant_archive + variant_size, chunk + offset, size);
+          variant_size += size;
+        }
+        memcpy(variant_archive + variant_size, "0\n", 2);
+        variant_size += 2;
+      } else {
+        memcpy(variant_archive, fixture, fixture_size);
+        variant_size = variant == 0 ? fixture_size : fixture_size - 100;
+      }
+      CHECK_TRUE(test_write_file(dirs.archive, variant_archive, variant_size)
+                 == 0);
+
+      const char *extract_args[] = {"test", "-x", "-f", dirs.archive,
+                                    "--overwrite-extract",
+                                    "-C", dirs.out_dir, NULL};
+      if (variant == 2) {
+        printf("Expecting ERROR output on next line:\n");
+        CHECK_TRUE(test_archive_run(&dirs, extract_args) != SDAS_SUCCESS);
+        continue;
+      }
+      CHECK_TRUE(test_archive_run(&dirs, extract_args) == SDAS_SUCCESS);
+      snprintf(path, sizeof(path), "%s/data", dirs.out_dir);
+      long read_size = 0;
+      char *read_back = test_read_file(path, &read_size);
+      CHECK_TRUE(read_back != NULL);
+      if (read_back) {
+        CHECK_TRUE(read_size == 256);
+        CHECK_TRUE(memcmp(read_back, chunk + 2, 256) == 0);
+      }
+      free(read_back);
+      snprintf(path, sizeof(path), "%s/sub/hello.txt", dirs.out_dir);
+      read_back = test_read_file(path, &read_size);
+      CHECK_TRUE(read_back != NULL);
+      if (read_back) {
+        CHECK_STREQ(read_back, "Hello v7\n");
+      }
+      free(read_back);
+      snprintf(path, sizeof(path), "%s/data", dirs.out_dir);
+      unlink(path);
+      snprintf(path, sizeof(path), "%s/sub/hello.txt", dirs.out_dir);
+      unlink(path);
+    }
+    CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+  }
+
+  // Test that compressing slices with "--make-jobserver" works with and
+  // without free tokens, and gives back every token it took, with a named fifo
+  // and with inherited (blocking) pipe fds.
+  for (int use_pipe = 0; use_pipe < 2; ++use_pipe) {
+    TestArchiveDirs dirs;
+    CHECK_TRUE(test_archive_dirs_init(&dirs, "jobserver") == 0);
+    char fifo_path[96];
+    char path[128];
+    snprintf(fifo_path, sizeof(fifo_path), "%s/fifo", dirs.dir);
+    snprintf(path, sizeof(path), "%s/data", dirs.tree_dir);
+    FILE *f = fopen(path, "wb");
+    for (uint32_t idx = 0; idx < 300000; ++idx) {
+      fputc((char)(idx % 251), f);
+    }
+    fclose(f);
+    // The read end is "fds[0]" and the write end is "fds[1]".
+    int fds[2] = {-1, -1};
+    char makeflags_test[128];
+    if (use_pipe) {
+      CHECK_TRUE(pipe(fds) == 0);
+      snprintf(makeflags_test,
+               sizeof(makeflags_test),
+               "-j3 --jobserver-auth=%d,%d",
+               fds[0],
+               fds[1]);
+    } else {
+      CHECK_TRUE(mkfifo(fifo_path, 0600) == 0);
+      fds[0] = open(fifo_path, O_RDWR | O_NONBLOCK);
+      fds[1] = fds[0];
+      snprintf(makeflags_test,
+               sizeof(makeflags_test),
+               "-j3 --jobserver-auth=fifo:%s",
+               fifo_path);
+    }
+    CHECK_TRUE(fds[0] >= 0 && fds[1] >= 0);
+
+    __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+    char *makeflags = getenv("MAKEFLAGS") ? strdup(getenv("MAKEFLAGS")) : NULL;
+    setenv("MAKEFLAGS", makeflags_test, 1);
+
+    for (uint32_t tokens = 0; tokens < 3; tokens += 2) {
+      for (uint32_t idx = 0; idx < tokens; ++idx) {
+        CHECK_TRUE(write(fds[1], "+", 1) == 1);
+      }
+      const char *args[] = {"test", "-c", "-f", dirs.archive,
+                            "--compressor=cat", "--decompressor=cat",
+                            "--compress-jobs=4", "--compress-slice-size=16KiB",
+                            "--make-jobserver",
+                            "-C", dirs.tree_dir, "data", NULL};
+      CHECK_TRUE(test_archive_run(&dirs, args) == SDAS_SUCCESS);
+
+      // The pipe's read end is blocking, so only read what is there.
+      char returned[4];
+      struct pollfd pfd = {fds[0], POLLIN, 0};
+      if (tokens == 0) {
+        CHECK_TRUE(poll(&pfd, 1, 0) == 0);
+      } else {
+        CHECK_TRUE(poll(&pfd, 1, 0) == 1);
+        CHECK_TRUE(read(fds[0], returned, tokens) == (ssize_t)tokens);
+        CHECK_TRUE(memcmp(returned, "++", 2) == 0);
+        CHECK_TRUE(poll(&pfd, 1, 0) == 0);
+      }
+    }
+
+    if (makeflags) {
+      setenv("MAKEFLAGS", makeflags, 1);
+    } else {
+      unsetenv("MAKEFLAGS");
+    }
+    close(fds[0]);
+    if (use_pipe) {
+      close(fds[1]);
+    }
+    CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+  }
+
+  // Test that compressing slices with "--pressure-limit" gives the same
+  // archive, however many compressors it allows.
+  {
+    TestArchiveDirs dirs;
+    CHECK_TRUE(test_archive_dirs_init(&dirs, "pressure_limit") == 0);
+    char path[128];
+    snprintf(path, sizeof(path), "%s/data", dirs.tree_dir);
+    FILE *f = fopen(path, "wb");
+    for (uint32_t idx = 0; idx < 300000; ++idx) {
+      fputc((char)(idx % 251), f);
+    }
+    fclose(f);
+
+    char *archives[2] = {NULL, NULL};
+    long archive_sizes[2] = {0, 0};
+    for (uint32_t limited = 0; limited < 2; ++limited) {
+      const char *args[13] = {"test", "-c", "-f", dirs.archive,
+                              "--compressor=cat", "--decompressor=cat",
+                              "--compress-jobs=4",
+                              "--compress-slice-size=16KiB"};
+      size_t argc = 8;
+      if (limited) {
+        args[argc++] = "--pressure-limit=1";
+      }
+      args[argc++] = "-C";
+      args[argc++] = dirs.tree_dir;
+      args[argc++] = "data";
+      args[argc] = NULL;
+      CHECK_TRUE(test_archive_run(&dirs, args) == SDAS_SUCCESS);
+      archives[limited] =
+        test_read_file(dirs.archive, &archive_sizes[limited]);
+    }
+    CHECK_TRUE(archive_sizes[0] > 300000);
+    CHECK_TRUE(archive_sizes[0] == archive_sizes[1]);
+    if (archives[0] && archives[1] && archive_sizes[0] == archive_sizes[1]) {
+      CHECK_TRUE(memcmp(archives[0], archives[1], (size_t)archive_sizes[0])
+                 == 0);
+    }
+    free(archives[0]);
+    free(archives[1]);
+    CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+  }
+
+  // Test the report of "--slow-files" as text and as JSON after creating an
+  // archive.
+  {
+    TestArchiveDirs dirs;
+    CHECK_TRUE(test_archive_dirs_init(&dirs, "slow_files") == 0);
+    char path[128];
+    const char *const names[3] = {"sub/a", "sub/b", "top"};
+    const uint32_t sizes[3] = {20000, 10000, 5};
+    snprintf(path, sizeof(path), "%s/sub", dirs.tree_dir);
+    mkdir(path, 0755);
+    for (size_t idx = 0; idx < 3; ++idx) {
+      snprintf(path, sizeof(path), "%s/%s", dirs.tree_dir, names[idx]);
+      FILE *f = fopen(path, "wb");
+      for (uint32_t byte = 0; byte < sizes[idx]; ++byte) {
+        fputc('x', f);
+      }
+      fclose(f);
+    }
+    snprintf(path, sizeof(path), "%s/report", dirs.dir);
+
+    char *reports[2] = {NULL, NULL};
+    for (int json = 0; json < 2; ++json) {
+      const char *args[] = {"test", "-c", "-f", dirs.archive,
+                            "--overwrite-create", "--slow-files=3",
+                            json ? "--stats=json" : "--stats=text",
+                            "-C", dirs.tree_dir, "sub", "top", NULL};
+      SDArchiverStateReturns ret = SDAS_INVALID_FILE;
+      reports[json] = test_archive_run_capture(
+        &dirs, args, json ? STDOUT_FILENO : STDERR_FILENO, path, &ret);
+      CHECK_TRUE(ret == SDAS_SUCCESS);
+      CHECK_TRUE(reports[json] != NULL);
+    }
+
+    // Every file and top-level dir has a line of text and a JSON object with
+    // its size, time, and throughput.
+    const char *const report_paths[5] = {"sub/a", "sub/b", "top", "sub", "."};
+    const uint32_t report_sizes[5] = {20000, 10000, 5, 30000, 5};
+    for (size_t idx = 0; idx < 5 && reports[0] && reports[1]; ++idx) {
+      char needle[64];
+      snprintf(needle, sizeof(needle), " MiB/s: %s\n", report_paths[idx]);
+      const char *line_end = strstr(reports[0], needle);
+      CHECK_TRUE(line_end != NULL);
+      if (line_end) {
+        const char *line = line_end;
+        while (line != reports[0] && line[-1] != '\n') {
+          --line;
+        }
+        snprintf(needle, sizeof(needle), " %" PRIu32 " bytes, ",
+                 report_sizes[idx]);
+        const char *size_text = strstr(line, needle);
+        CHECK_TRUE(size_text != NULL && size_text < line_end);
+        const char *time_text = strstr(line, " ms (");
+        CHECK_TRUE(time_text != NULL && time_text < line_end);
+      }
+
+      snprintf(needle, sizeof(needle), "{\"path\":\"%s\",",
+               report_paths[idx]);
+      const char *obj = strstr(reports[1], needle);
+      CHECK_TRUE(obj != NULL);
+      if (obj) {
+        const double size = test_json_number(obj, "size");
+        const double total_ns = test_json_number(obj, "total_ns");
+        const double mib_per_s = test_json_number(obj, "mib_per_s");
+        CHECK_TRUE(size == (double)report_sizes[idx]);
+        CHECK_TRUE(total_ns > 0.0);
+        CHECK_TRUE(total_ns == test_json_number(obj, "open_ns")
+                               + test_json_number(obj, "io_ns")
+                               + test_json_number(obj, "wait_ns"));
+        const double expected_mib_per_s =
+          size / (1024.0 * 1024.0) / (total_ns / 1000000000.0);
+        CHECK_TRUE(mib_per_s >= expected_mib_per_s - 0.01
+                   && mib_per_s <= expected_mib_per_s + 0.01);
+      }
+    }
+    if (reports[0]) {
+      CHECK_TRUE(strstr(reports[0], "Slowest 3 file(s)") != NULL);
+      CHECK_TRUE(strstr(reports[0], "Time per top-level directory:\n")
+                 != NULL);
+    }
+    if (reports[1]) {
+      CHECK_TRUE(strncmp(reports[1], "{\"compressed_size\":", 19) == 0);
+      CHECK_TRUE(strstr(reports[1], "]}\n") != NULL);
+    }
+    free(reports[0]);
+    free(reports[1]);
+    CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+  }
+
+  // Test walking dirs of files, symlinks, and dirs with "--stat-dont-sync",
+  // with and without needing the size of regular files.
+  for (uint32_t small = 0; small < 2; ++small) {
+    TestArchiveDirs dirs;
+    CHECK_TRUE(test_archive_dirs_init(&dirs, "walk_stat") == 0);
+    char path[128];
+    snprintf(path, sizeof(path), "%s/sub", dirs.tree_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/sub/a", dirs.tree_dir);
+    CHECK_TRUE(test_write_file(path, "walked", 6) == 0);
+    snprintf(path, sizeof(path), "%s/sub/a_link", dirs.tree_dir);
+    CHECK_TRUE(symlink("a", path) == 0);
+
+    SDArchiverParsed parsed = simple_archiver_create_parsed();
+    const char *create_args[] = {"test", "-c", "-f", dirs.archive,
+                                 "--stat-dont-sync",
+                                 small ? "--read-small-files=4KiB"
+                                       : "--stat-dont-sync",
+                                 "-C", dirs.tree_dir, ".", NULL};
+    CHECK_TRUE(simple_archiver_parse_args(9, create_args, &parsed) == 0);
+    CHECK_TRUE(small ? parsed.small_files_arena != NULL
+                     : parsed.small_files_arena == NULL);
+    simple_archiver_free_parsed(&parsed);
+    CHECK_TRUE(test_archive_run(&dirs, create_args) == SDAS_SUCCESS);
+
+    const char *args[] = {"test", "-x", "-f", dirs.archive,
+                          "-C", dirs.out_dir, NULL};
+    CHECK_TRUE(test_archive_run(&dirs, args) == SDAS_SUCCESS);
+
+    snprintf(path, sizeof(path), "%s/sub/a", dirs.out_dir);
+    long read_size = 0;
+    char *read_back = test_read_file(path, &read_size);
+    CHECK_TRUE(read_back != NULL);
+    if (read_back) {
+      CHECK_STREQ(read_back, "walked");
+    }
+    free(read_back);
+    char buf[16] = {0};
+    snprintf(path, sizeof(path), "%s/sub/a_link", dirs.out_dir);
+    CHECK_TRUE(readlink(path, buf, sizeof(buf) - 1) == 1);
+    CHECK_STREQ(buf, "a");
+    CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+  }
+
+  // Test that "--read-small-files" only reads and uses its budget for files
+  // that are archived, not for blacklisted files.
+  {
+    TestArchiveDirs dirs;
+    CHECK_TRUE(test_archive_dirs_init(&dirs, "small_budget") == 0);
+    char path[128];
+    char data[3000];
+    memset(data, 'x', sizeof(data));
+    const char *names[4] = {"a.log", "b.log", "c.log", "keep.txt"};
+    for (uint32_t idx = 0; idx < 4; ++idx) {
+      snprintf(path, sizeof(path), "%s/%s", dirs.tree_dir, names[idx]);
+      CHECK_TRUE(test_write_file(path, data, sizeof(data)) == 0);
+    }
+
+    SDArchiverParsed parsed = simple_archiver_create_parsed();
+    const char *create_args[] = {"test", "-c", "-f", dirs.archive,
+                                 "--read-small-files=4KiB",
+                                 "--read-small-files-budget=20000",
+                                 "--blacklist-ends-with=.log",
+                                 "-C", dirs.tree_dir, ".", NULL};
+    CHECK_TRUE(simple_archiver_parse_args(10, create_args, &parsed) == 0);
+    uint32_t counts[2] = {0, 0};
+    simple_archiver_hash_map_iter(parsed.working_files,
+                                  test_count_small_files_fn,
+                                  counts);
+    CHECK_TRUE(counts[0] == 1);
+    CHECK_TRUE(counts[1] == 0);
+    CHECK_TRUE(parsed.small_files_arena != NULL);
+    if (parsed.small_files_arena) {
+      CHECK_TRUE(parsed.small_files_arena->used == sizeof(data));
+    }
+    simple_archiver_free_parsed(&parsed);
+    CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+  }
+
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  // Test --watch segments.
+  {
+    TestArchiveDirs dirs;
+    CHECK_TRUE(test_archive_dirs_init(&dirs, "watch") == 0);
+    const char *tree_dir = dirs.tree_dir;
+    const char *out_dir = dirs.out_dir;
+    char segment[128];
+    char path[160];
+    snprintf(segment, sizeof(segment), "%s.1", dirs.archive);
+    snprintf(path, sizeof(path), "%s/sub", tree_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/sub/b", tree_dir);
+    FILE *f = fopen(path, "wb");
+    fputs("b", f);
+    fclose(f);
+    snprintf(path, sizeof(path), "%s/a", tree_dir);
+    f = fopen(path, "wb");
+    fputs("a", f);
+    fclose(f);
+
+    int stderr_fd[2];
+    CHECK_TRUE(pipe(stderr_fd) == 0);
+    pid_t pid = test_watch_start(tree_dir, dirs.archive, stderr_fd);
+    CHECK_TRUE(pid > 0);
+    close(stderr_fd[1]);
+
+    // The message is printed once the stop signals are handled.
+    const char *ready = "Watching for changes...\n";
+    char buf[8192];
+    size_t buf_size = 0;
+    while (buf_size < sizeof(buf) - 1) {
+      ssize_t read_ret =
+        read(stderr_fd[0], buf + buf_size, sizeof(buf) - 1 - buf_size);
+      if (read_ret <= 0) {
+        break;
+      }
+      buf_size += (size_t)read_ret;
+      buf[buf_size] = 0;
+      if (strstr(buf, ready)) {
+        break;
+      }
+    }
+    buf[buf_size] = 0;
+    CHECK_TRUE(strstr(buf, ready) != NULL);
+
+    f = fopen(path, "ab");
+    fputs("a", f);
+    fclose(f);
+    snprintf(path, sizeof(path), "%s/sub/b", tree_dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/new", tree_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/new/c", tree_dir);
+    f = fopen(path, "wb");
+    fputs("c", f);
+    fclose(f);
+
+    int status = 1;
+    kill(pid, SIGINT);
+    // Drain stderr so the child never blocks on it.
+    while (read(stderr_fd[0], buf, sizeof(buf)) > 0) {
+    }
+    close(stderr_fd[0]);
+    CHECK_TRUE(waitpid(pid, &status, 0) == pid);
+    CHECK_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // Segments use the archive's "--write-version".
+    long size = 0;
+    char *contents = test_read_file(segment, &size);
+    CHECK_TRUE(contents != NULL);
+    if (contents) {
+      CHECK_TRUE(size > 20);
+      CHECK_TRUE(memcmp(contents, "SIMPLE_ARCHIVE_VER\0\x0B", 20) == 0);
+    }
+    free(contents);
+
+    const char *args[] = {"test", "-x", "-f", segment, "-C", out_dir, NULL};
+    CHECK_TRUE(test_archive_run(&dirs, args) == SDAS_SUCCESS);
+
+    snprintf(path, sizeof(path), "%s/a", out_dir);
+    f = fopen(path, "rb");
+    CHECK_TRUE(f != NULL);
+    if (f) {
+      CHECK_TRUE(fread(buf, 1, sizeof(buf), f) == 2);
+      CHECK_TRUE(memcmp(buf, "aa", 2) == 0);
+      fclose(f);
+      unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/new/c", out_dir);
+    CHECK_TRUE(unlink(path) == 0);
+    snprintf(path, sizeof(path), "%s/new", out_dir);
+    CHECK_TRUE(rmdir(path) == 0);
+    snprintf(path, sizeof(path), "%s/sub", out_dir);
+    CHECK_FALSE(access(path, F_OK) == 0);
+
+    // Deleted paths are listed next to the segment, not inside it.
+    snprintf(path, sizeof(path), "%s.deleted", segment);
+    contents = test_read_file(path, &size);
+    CHECK_TRUE(contents != NULL);
+    if (contents) {
+      CHECK_TRUE(size == 6);
+      CHECK_TRUE(memcmp(contents, "sub/b\0", 6) == 0);
+    }
+    free(contents);
+    CHECK_TRUE(test_archive_dirs_cleanup(&dirs) == 0);
+  }
+#endif
+
+#ifdef SDA_TEST_BUDGETS
+  // Per-entry syscall and allocation budgets of creating, listing, and
+  // extracting (measured as the difference between two tree sizes).
+  {
+    const char *op_names[4] = {"create", "list", "extract",
+                               "create --read-small-files"};
+    // Raise these only when an extra per-entry cost is intended. Syscalls have
+    // some slack since they depend on the libc.
+    const uint64_t syscall_budgets[4] = {28, 18, 14, 20};
+    const uint64_t alloc_budgets[4] = {57, 17, 18, 57};
+    for (int op = 0; op < 4; ++op) {
+      TestBudgetCounts per_entry = {0, 0, 0};
+      CHECK_TRUE(test_budget_per_entry((TestBudgetOp)op,
+                                       16,
+                                       80,
+                                       &per_entry) == 0);
+      printf("Per-entry budget of %s: %" PRIu64 " syscalls (max %" PRIu64
+             "), %" PRIu64 " allocations (max %" PRIu64 ")\n",
+             op_names[op],
+             per_entry.syscalls,
+             syscall_budgets[op],
+             per_entry.allocs,
+             alloc_budgets[op]);
+      if (per_entry.traced) {
+        CHECK_TRUE(per_entry.syscalls <= syscall_budgets[op]);
+      } else {
+        printf("NOTICE: ptrace not permitted, syscalls are not checked!\n");
+      }
+      CHECK_TRUE(per_entry.allocs > 0);
+      CHECK_TRUE(per_entry.allocs <= alloc_budgets[op]);
+    }
+  }
+#endif
+
   printf("Checks checked: %" PRId32 "\n", checks_checked);
   printf("Checks passed:  %" PRId32 "\n", checks_passed);
   return checks_passed == checks_checked ? 0 : 1;
@@ -0,0 +1,747 @@
+// ISC License
+//
+// Copyright (c) 2024-2026 Stephen Seo
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//
+// `watch.c` is the source for continuously archiving changed files.
+
+#include "watch.h"
+
+#include "platforms.h"
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "helpers.h"
+#include "parser_internal.h"
+
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+
+#define SDA_WATCH_EVENTS                                                   \
+  (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+   IN_ATTRIB)
+
+volatile int is_watch_stop_requested = 0;
+
+/// Non-NULL value of entries in "deleted" of SDArchiverWatch.
+static int simple_archiver_watch_internal_sentinel = 1;
+
+typedef struct SDArchiverWatchInternalDir {
+  /// Relative to the cwd, "." for the cwd itself.
+  char *path;
+  /// May be NULL.
+  char *abs_path;
+} SDArchiverWatchInternalDir;
+
+struct SDArchiverWatch {
+  const SDArchiverState *state;
+  int fd;
+  /// Paths of the watched positional arguments.
+  SDArchiverLinkedList *roots;
+  /// Key is a watch descriptor, value is a SDArchiverWatchInternalDir.
+  SDArchiverHashMap *dirs;
+  /// Keys are paths changed since the last segment, values are their last
+  /// known sizes (uint64_t).
+  SDArchiverHashMap *changed;
+  /// Keys are paths deleted since the last segment.
+  SDArchiverHashMap *deleted;
+  /// Sum of the values of "changed".
+  uint64_t changed_bytes;
+  uint64_t segment_count;
+};
+
+void simple_archiver_watch_internal_handle_sig(int sig) {
+  if (sig == SIGINT || sig == SIGHUP || sig == SIGTERM) {
+    is_watch_stop_requested = 1;
+  }
+}
+
+void simple_archiver_watch_internal_free_dir(void *data) {
+  SDArchiverWatchInternalDir *dir = data;
+  if (dir) {
+    free(dir->path);
+    free(dir->abs_path);
+    free(dir);
+  }
+}
+
+/// Returns "dir/name", or "name" if "dir" is ".". Must be free'd.
+char *simple_archiver_watch_internal_join(const char *dir, const char *name) {
+  if (strcmp(dir, ".") == 0) {
+    return strdup(name);
+  }
+  const size_t dir_len = strlen(dir);
+  const size_t name_len = strlen(name);
+  char *path = malloc(dir_len + name_len + 2);
+  memcpy(path, dir, dir_len);
+  path[dir_len] = '/';
+  memcpy(path + dir_len + 1, name, name_len + 1);
+  return path;
+}
+
+/// Returns non-zero if changes of file "name" in directory "dir" are not
+/// archived.
+int simple_archiver_watch_internal_is_ignored(
+    const SDArchiverWatch *watch,
+    const SDArchiverWatchInternalDir *dir,
+    const char *name,
+    const char *path) {
+  const SDArchiverParsed *parsed = watch->state->parsed;
+
+  // The archive, its segments, and temporary files of the compressor.
+  if (dir->abs_path && parsed->filename_full_abs_path) {
+    __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+    char *abs_path = simple_archiver_watch_internal_join(dir->abs_path, name);
+    const size_t archive_len = strlen(parsed->filename_full_abs_path);
+    if (strncmp(abs_path, parsed->filename_full_abs_path, archive_len) == 0
+        && (abs_path[archive_len] == 0 || abs_path[archive_len] == '.')) {
+      return 1;
+    }
+  }
+  if (simple_archiver_helper_string_starts(name,
+                                           "simple_archiver_compressed_",
+                                           0)) {
+    return 1;
+  }
+
+  return simple_archiver_helper_string_allowed_lists(
+           path,
+           parsed->flags & 0x20000 ? 1 : 0,
+           parsed) ? 0 : 1;
+}
+
+void simple_archiver_watch_internal_mark_changed(SDArchiverWatch *watch,
+                                                 const char *path,
+                                                 uint64_t size) {
+  const size_t key_size = strlen(path) + 1;
+  if (simple_archiver_hash_map_get(watch->deleted, path, key_size)) {
+    simple_archiver_hash_map_remove(watch->deleted, (void *)path, key_size);
+  }
+  // A path written many times is only in the segment once, so only its
+  // latest size counts.
+  uint64_t *prev_size =
+    simple_archiver_hash_map_get(watch->changed, path, key_size);
+  if (prev_size) {
+    watch->changed_bytes -= *prev_size;
+    *prev_size = size;
+  } else {
+    uint64_t *value = malloc(sizeof(uint64_t));
+    *value = size;
+    simple_archiver_hash_map_insert(
+      watch->changed, value, strdup(path), key_size, NULL, NULL);
+  }
+  watch->changed_bytes += size;
+}
+
+void simple_archiver_watch_internal_mark_deleted(SDArchiverWatch *watch,
+                                                 const char *path) {
+  const size_t key_size = strlen(path) + 1;
+  const uint64_t *prev_size =
+    simple_archiver_hash_map_get(watch->changed, path, key_size);
+  if (prev_size) {
+    watch->changed_bytes -= *prev_size;
+    simple_archiver_hash_map_remove(watch->changed, (void *)path, key_size);
+  }
+  if (!simple_archiver_hash_map_get(watch->deleted, path, key_size)) {
+    simple_archiver_hash_map_insert(
+      watch->deleted,
+      &simple_archiver_watch_internal_sentinel,
+      strdup(path),
+      key_size,
+      simple_archiver_helper_datastructure_cleanup_nop,
+      NULL);
+  }
+}
+
+/// Watches directory "path" and the directories in it. If "mark" is non-zero,
+/// everything in them is marked as changed.
+void simple_archiver_watch_internal_add_tree(SDArchiverWatch *watch,
+                                             const char *path,
+                                             int_fast8_t mark) {
+  const SDArchiverParsed *parsed = watch->state->parsed;
+  if (strcmp(path, ".") != 0
+      && simple_archiver_helper_string_dir_blacklisted(
+           path, parsed->flags & 0x20000 ? 1 : 0, parsed)) {
+    return;
+  }
+
+  int wd = inotify_add_watch(watch->fd,
+                             path,
+                             SDA_WATCH_EVENTS | IN_ONLYDIR | IN_DONT_FOLLOW);
+  if (wd < 0) {
+    fprintf(stderr,
+            "WARNING: Failed to watch \"%s\" (errno %d)!\n",
+            path,
+            errno);
+    return;
+  }
+
+  // A directory moved within the watched tree keeps its watch descriptor.
+  SDArchiverWatchInternalDir *dir =
+    simple_archiver_hash_map_get(watch->dirs, &wd, sizeof(int));
+  if (dir) {
+    free(dir->path);
+    free(dir->abs_path);
+  } else {
+    dir = malloc(sizeof(SDArchiverWatchInternalDir));
+    int *key = malloc(sizeof(int));
+    *key = wd;
+    simple_archiver_hash_map_insert(watch->dirs,
+                                    dir,
+                                    key,
+                                    sizeof(int),
+                                    simple_archiver_watch_internal_free_dir,
+                                    NULL);
+  }
+  dir->path = strdup(path);
+  dir->abs_path = realpath(path, NULL);
+
+  if (mark && strcmp(path, ".") != 0) {
+    simple_archiver_watch_internal_mark_changed(watch, path, 0);
+  }
+
+  DIR *d = opendir(path);
+  if (!d) {
+    return;
+  }
+  for (struct dirent *entry = readdir(d); entry; entry = readdir(d)) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+    char *child = simple_archiver_watch_internal_join(path, entry->d_name);
+    struct stat st;
+    if (lstat(child, &st) != 0) {
+      continue;
+    }
+    if (S_ISDIR(st.st_mode)) {
+      simple_archiver_watch_internal_add_tree(watch, child, mark);
+    } else if (mark
+               && (S_ISREG(st.st_mode) || S_ISLNK(st.st_mode))) {
+      // "dir" may have been replaced by the recursive calls.
+      SDArchiverWatchInternalDir *cur =
+        simple_archiver_hash_map_get(watch->dirs, &wd, sizeof(int));
+      if (cur && !simple_archiver_watch_internal_is_ignored(
+            watch, cur, entry->d_name, child)) {
+        simple_archiver_watch_internal_mark_changed(
+          watch,
+          child,
+          S_ISREG(st.st_mode) ? (uint64_t)st.st_size : 0);
+      }
+    }
+  }
+  closedir(d);
+}
+
+void simple_archiver_watch_internal_handle_event(
+    SDArchiverWatch *watch, const struct inotify_event *event) {
+  if (event->mask & IN_Q_OVERFLOW) {
+    fprintf(stderr, "WARNING: Watch events were lost, rescanning...\n");
+    for (SDArchiverLLNode *node = watch->roots->head->next;
+         node != watch->roots->tail;
+         node = node->next) {
+      simple_archiver_watch_internal_add_tree(watch, node->data, 1);
+    }
+    return;
+  }
+
+  SDArchiverWatchInternalDir *dir =
+    simple_archiver_hash_map_get(watch->dirs, &event->wd, sizeof(int));
+  if (!dir) {
+    return;
+  } else if (event->mask & IN_IGNORED) {
+    simple_archiver_hash_map_remove(watch->dirs,
+                                    (void *)&event->wd,
+                                    sizeof(int));
+    return;
+  } else if (event->len == 0) {
+    return;
+  }
+
+  __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+  char *path = simple_archiver_watch_internal_join(dir->path, event->name);
+
+  if (event->mask & IN_ISDIR) {
+    if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+      simple_archiver_watch_internal_add_tree(watch, path, 1);
+    } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+      simple_archiver_watch_internal_mark_deleted(watch, path);
+    } else if (event->mask & IN_ATTRIB) {
+      simple_archiver_watch_internal_mark_changed(watch, path, 0);
+    }
+  } else if (!simple_archiver_watch_internal_is_ignored(watch,
+                                                        dir,
+                                                        event->name,
+                                                        path)) {
+    if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+      simple_archiver_watch_internal_mark_deleted(watch, path);
+    } else {
+      struct stat st;
+      if (lstat(path, &st) == 0
+          && (S_ISREG(st.st_mode) || S_ISLNK(st.st_mode))) {
+        simple_archiver_watch_internal_mark_changed(
+          watch,
+          path,
+          S_ISREG(st.st_mode) ? (uint64_t)st.st_size : 0);
+      }
+    }
+  }
+}
+
+/// Handles all pending events without blocking. Returns zero on success.
+int simple_archiver_watch_internal_read_events(SDArchiverWatch *watch) {
+  char buf[4096]
+    __attribute__((aligned(__alignof__(struct inotify_event))));
+  while (1) {
+    const ssize_t len = read(watch->fd, buf, sizeof(buf));
+    if (len < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        return 0;
+      }
+      fprintf(stderr, "ERROR: Failed to read watch events!\n");
+      return 1;
+    } else if (len == 0) {
+      return 0;
+    }
+    for (const char *ptr = buf; ptr < buf + len;) {
+      const struct inotify_event *event = (const struct inotify_event *)ptr;
+      ptr += sizeof(struct inotify_event) + event->len;
+      simple_archiver_watch_internal_handle_event(watch, event);
+    }
+  }
+}
+
+int simple_archiver_watch_internal_collect_fn(const void *key,
+                                              SDAR_ATTR_UNUSED size_t size,
+                                              SDAR_ATTR_UNUSED
+                                              const void *value,
+                                              void *ud) {
+  simple_archiver_list_add(ud,
+                           (void *)key,
+                           simple_archiver_helper_datastructure_cleanup_nop);
+  return 0;
+}
+
+/// Adds "path" to "working_files" the way the parser does for a path given to
+/// archive. Returns zero on success.
+int simple_archiver_watch_internal_add_file_info(SDArchiverHashMap *files,
+                                                 const char *path,
+                                                 const struct stat *st) {
+  SDArchiverFileInfo *file_info = malloc(sizeof(SDArchiverFileInfo));
+  file_info->filename = strdup(path);
+  file_info->link_dest = NULL;
+  file_info->flags = S_ISDIR(st->st_mode) ? 1 : 0;
+  file_info->data = NULL;
+  file_info->data_size = 0;
+  if (S_ISLNK(st->st_mode)) {
+    file_info->link_dest = malloc(MAX_SYMBOLIC_LINK_SIZE);
+    const ssize_t len =
+      readlink(path, file_info->link_dest, MAX_SYMBOLIC_LINK_SIZE - 1);
+    if (len <= 0) {
+      simple_archiver_internal_free_file_info_fn(file_info);
+      return 1;
+    }
+    file_info->link_dest[len] = 0;
+  }
+  simple_archiver_hash_map_insert(files,
+                                  file_info,
+                                  strdup(path),
+                                  strlen(path) + 1,
+                                  simple_archiver_internal_free_file_info_fn,
+                                  NULL);
+  return 0;
+}
+
+/// Returns non-zero if directory "path" has no entries.
+int simple_archiver_watch_internal_is_dir_empty(const char *path) {
+  DIR *d = opendir(path);
+  if (!d) {
+    return 0;
+  }
+  int is_empty = 1;
+  for (struct dirent *entry = readdir(d); entry; entry = readdir(d)) {
+    if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+      is_empty = 0;
+      break;
+    }
+  }
+  closedir(d);
+  return is_empty;
+}
+
+/// Writes "lists" of paths, each followed by a NULL, to "name".
+/// Returns zero on success.
+int simple_archiver_watch_internal_write_deleted(
+    const char *name, SDArchiverLinkedList *const lists[2]) {
+  __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
+  FILE *out_f = fopen(name, "wb");
+  if (!out_f) {
+    fprintf(stderr, "ERROR: Failed to open \"%s\" for writing!\n", name);
+    return 1;
+  }
+  for (size_t idx = 0; idx < 2; ++idx) {
+    for (SDArchiverLLNode *node = lists[idx]->head->next;
+         node != lists[idx]->tail;
+         node = node->next) {
+      const size_t len = strlen(node->data) + 1;
+      if (fwrite(node->data, 1, len, out_f) != len) {
+        fprintf(stderr, "ERROR: Failed to write \"%s\"!\n", name);
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/// Writes the next segment if there are changes. On error, the changes are
+/// kept for the next segment. Returns zero on success.
+int simple_archiver_watch_internal_write_segment(SDArchiverWatch *watch) {
+  const SDArchiverParsed *parsed = watch->state->parsed;
+
+  __attribute__((cleanup(simple_archiver_list_free)))
+  SDArchiverLinkedList *changed = simple_archiver_list_init();
+  __attribute__((cleanup(simple_archiver_list_free)))
+  SDArchiverLinkedList *deleted = simple_archiver_list_init();
+  simple_archiver_hash_map_iter(watch->changed,
+                                simple_archiver_watch_internal_collect_fn,
+                                changed);
+  simple_archiver_hash_map_iter(watch->deleted,
+                                simple_archiver_watch_internal_collect_fn,
+                                deleted);
+  if (changed->count == 0 && deleted->count == 0) {
+    return 0;
+  }
+
+  const size_t name_size = strlen(parsed->filename_full_abs_path) + 30;
+  __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+  char *segment_name = malloc(name_size);
+  snprintf(segment_name,
+           name_size,
+           "%s.%" PRIu64,
+           parsed->filename_full_abs_path,
+           watch->segment_count + 1);
+  __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+  char *deleted_name = malloc(name_size);
+  snprintf(deleted_name, name_size, "%s.deleted", segment_name);
+
+  if ((parsed->flags & 0x4) == 0) {
+    FILE *exists = fopen(segment_name, "rb");
+    if (exists) {
+      fclose(exists);
+      fprintf(stderr,
+              "ERROR: Segment \"%s\" exists but --overwrite-create not "
+              "specified!\n",
+              segment_name);
+      return 1;
+    }
+  }
+
+  // The segment is written like the initial archive (with the same options
+  // and "--write-version") but only from the changed paths.
+  SDArchiverParsed segment_parsed = *parsed;
+  __attribute__((cleanup(simple_archiver_hash_map_free)))
+  SDArchiverHashMap *working_files = simple_archiver_hash_map_init();
+  __attribute__((cleanup(simple_archiver_list_free)))
+  SDArchiverLinkedList *working_dirs = simple_archiver_list_init();
+  segment_parsed.working_files = working_files;
+  segment_parsed.working_dirs = working_dirs;
+  // The cwd was already changed to "user_cwd".
+  segment_parsed.user_cwd = NULL;
+
+  // Paths deleted during the segment.
+  __attribute__((cleanup(simple_archiver_list_free)))
+  SDArchiverLinkedList *gone = simple_archiver_list_init();
+
+  for (SDArchiverLLNode *node = changed->head->next;
+       node != changed->tail;
+       node = node->next) {
+    const char *path = node->data;
+    struct stat st;
+    if (lstat(path, &st) != 0) {
+      simple_archiver_list_add(
+        gone, (void *)path, simple_archiver_helper_datastructure_cleanup_nop);
+    } else if (S_ISDIR(st.st_mode)) {
+      simple_archiver_list_add(working_dirs, strdup(path), NULL);
+      if ((parsed->flags & 0x200) == 0
+          && parsed->write_version >= 2
+          && simple_archiver_watch_internal_is_dir_empty(path)) {
+        simple_archiver_watch_internal_add_file_info(working_files,
+                                                     path,
+                                                     &st);
+      }
+    } else if (S_ISREG(st.st_mode) || S_ISLNK(st.st_mode)) {
+      simple_archiver_watch_internal_add_file_info(working_files, path, &st);
+    }
+  }
+
+  __attribute__((cleanup(simple_archiver_helper_cleanup_FILE)))
+  FILE *out_f = fopen(segment_name, "wb");
+  if (!out_f) {
+    fprintf(stderr,
+            "ERROR: Failed to open \"%s\" for writing!\n",
+            segment_name);
+    return 1;
+  }
+
+  // A stop requested while the segment is written is handled after it.
+  sigset_t stop_set;
+  sigset_t prev_set;
+  sigemptyset(&stop_set);
+  sigaddset(&stop_set, SIGINT);
+  sigaddset(&stop_set, SIGHUP);
+  sigaddset(&stop_set, SIGTERM);
+  sigprocmask(SIG_BLOCK, &stop_set, &prev_set);
+
+  SDArchiverState *state = simple_archiver_init_state(&segment_parsed);
+  SDArchiverStateRetStruct ret = simple_archiver_write_all(out_f, state);
+  simple_archiver_free_state(&state);
+
+  // "simple_archiver_write_all" sets its own signal handlers.
+  simple_archiver_helper_set_signal_action(
+    SIGINT, simple_archiver_watch_internal_handle_sig);
+  simple_archiver_helper_set_signal_action(
+    SIGHUP, simple_archiver_watch_internal_handle_sig);
+  simple_archiver_helper_set_signal_action(
+    SIGTERM, simple_archiver_watch_internal_handle_sig);
+  sigprocmask(SIG_SETMASK, &prev_set, NULL);
+
+  const int close_ret = fclose(out_f);
+  out_f = NULL;
+  if (ret.ret != SDAS_SUCCESS || close_ret != 0) {
+    fprintf(stderr,
+            "ERROR: Failed to write segment \"%s\": %s\n",
+            segment_name,
+            simple_archiver_error_to_string(
+              ret.ret != SDAS_SUCCESS ? ret.ret : SDAS_FAILED_TO_WRITE));
+    unlink(segment_name);
+    return 1;
+  }
+
+  if (deleted->count + gone->count > 0) {
+    SDArchiverLinkedList *const lists[2] = {deleted, gone};
+    if (simple_archiver_watch_internal_write_deleted(deleted_name, lists)) {
+      unlink(segment_name);
+      unlink(deleted_name);
+      return 1;
+    }
+  } else {
+    // Left over from a previous run with "--overwrite-create".
+    unlink(deleted_name);
+  }
+
+  fprintf(stderr,
+          "Wrote segment \"%s\": %zu changed, %zu deleted.\n",
+          segment_name,
+          changed->count - gone->count,
+          deleted->count + gone->count);
+
+  // "changed" and "deleted" point to keys of the maps, so free them first.
+  simple_archiver_list_free(&changed);
+  simple_archiver_list_free(&deleted);
+  simple_archiver_list_free(&gone);
+  simple_archiver_hash_map_free(&watch->changed);
+  simple_archiver_hash_map_free(&watch->deleted);
+  watch->changed = simple_archiver_hash_map_init();
+  watch->deleted = simple_archiver_hash_map_init();
+  watch->changed_bytes = 0;
+  ++watch->segment_count;
+
+  return 0;
+}
+
+int simple_archiver_watch_internal_add_root_fn(SDAR_ATTR_UNUSED
+                                               const void *key,
+                                               SDAR_ATTR_UNUSED size_t size,
+                                               const void *value,
+                                               void *ud) {
+  SDArchiverWatch *watch = ud;
+
+  // Strip "./" and trailing '/', so paths match the initial archive.
+  __attribute__((cleanup(simple_archiver_helper_cleanup_c_string)))
+  char *path = simple_archiver_helper_remove_single_dot_path(value);
+  size_t len = path ? strlen(path) : 0;
+  while (len > 1 && path[len - 1] == '/') {
+    path[--len] = 0;
+  }
+  if (len == 0) {
+    free(path);
+    path = strdup(".");
+  }
+
+  struct stat st;
+  if (lstat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+    fprintf(stderr,
+            "NOTICE: \"%s\" is not a directory and will not be watched.\n",
+            path);
+    return 0;
+  }
+
+  simple_archiver_watch_internal_add_tree(watch, path, 0);
+  simple_archiver_list_add(watch->roots, path, NULL);
+  path = NULL;
+  return 0;
+}
+
+#endif
+
+SDArchiverWatch *simple_archiver_watch_begin(const SDArchiverState *state) {
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  const SDArchiverParsed *parsed = state->parsed;
+  if ((parsed->flags & 0x10) || !parsed->filename_full_abs_path) {
+    fprintf(stderr, "ERROR: --watch requires an archive filename!\n");
+    return NULL;
+  }
+
+  __attribute__((cleanup(simple_archiver_helper_cleanup_chdir_back)))
+  char *original_cwd = NULL;
+  if (parsed->user_cwd) {
+    original_cwd = realpath(".", NULL);
+    if (chdir(parsed->user_cwd)) {
+      fprintf(stderr,
+              "ERROR: Failed to change cwd to \"%s\"!\n",
+              parsed->user_cwd);
+      return NULL;
+    }
+  }
+
+  const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "ERROR: Failed to initialize inotify!\n");
+    return NULL;
+  }
+
+  SDArchiverWatch *watch = malloc(sizeof(SDArchiverWatch));
+  watch->state = state;
+  watch->fd = fd;
+  watch->roots = simple_archiver_list_init();
+  watch->dirs = simple_archiver_hash_map_init();
+  watch->changed = simple_archiver_hash_map_init();
+  watch->deleted = simple_archiver_hash_map_init();
+  watch->changed_bytes = 0;
+  watch->segment_count = 0;
+
+  simple_archiver_hash_map_iter(parsed->just_w_files,
+                                simple_archiver_watch_internal_add_root_fn,
+                                watch);
+
+  if (watch->roots->count == 0) {
+    fprintf(stderr,
+            "ERROR: --watch requires at least one directory to archive!\n");
+    simple_archiver_watch_free(&watch);
+    return NULL;
+  }
+
+  return watch;
+#else
+  (void)state;
+  fprintf(stderr, "ERROR: --watch is only supported on Linux!\n");
+  return NULL;
+#endif
+}
+
+void simple_archiver_watch_free(SDArchiverWatch **watch) {
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  if (watch && *watch) {
+    close((*watch)->fd);
+    simple_archiver_list_free(&(*watch)->roots);
+    simple_archiver_hash_map_free(&(*watch)->dirs);
+    simple_archiver_hash_map_free(&(*watch)->changed);
+    simple_archiver_hash_map_free(&(*watch)->deleted);
+    free(*watch);
+    *watch = NULL;
+  }
+#else
+  (void)watch;
+#endif
+}
+
+int simple_archiver_watch_run(SDArchiverWatch *watch) {
+#if SIMPLE_ARCHIVER_PLATFORM == SIMPLE_ARCHIVER_PLATFORM_LINUX
+  const SDArchiverParsed *parsed = watch->state->parsed;
+
+  __attribute__((cleanup(simple_archiver_helper_cleanup_chdir_back)))
+  char *original_cwd = NULL;
+  if (parsed->user_cwd) {
+    original_cwd = realpath(".", NULL);
+    if (chdir(parsed->user_cwd)) {
+      fprintf(stderr,
+              "ERROR: Failed to change cwd to \"%s\"!\n",
+              parsed->user_cwd);
+      return 1;
+    }
+  }
+
+  is_watch_stop_requested = 0;
+  simple_archiver_helper_set_signal_action(
+    SIGINT, simple_archiver_watch_internal_handle_sig);
+  simple_archiver_helper_set_signal_action(
+    SIGHUP, simple_archiver_watch_internal_handle_sig);
+  simple_archiver_helper_set_signal_action(
+    SIGTERM, simple_archiver_watch_internal_handle_sig);
+
+  const uint64_t interval_ns = (uint64_t)parsed->watch_interval * 1000000000;
+  uint64_t next_segment = simple_archiver_helper_monotonic_ns() + interval_ns;
+  fprintf(stderr, "Watching for changes...\n");
+
+  while (!is_watch_stop_requested) {
+    uint64_t now = simple_archiver_helper_monotonic_ns();
+    int timeout_ms = 0;
+    if (next_segment > now) {
+      const uint64_t wait_ms = (next_segment - now) / 1000000 + 1;
+      timeout_ms = wait_ms > INT_MAX ? INT_MAX : (int)wait_ms;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = watch->fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    const int poll_ret = poll(&pfd, 1, timeout_ms);
+    if (poll_ret < 0 && errno != EINTR) {
+      fprintf(stderr, "ERROR: Failed to wait for watch events!\n");
+      return 1;
+    } else if (poll_ret > 0
+               && simple_archiver_watch_internal_read_events(watch)) {
+      return 1;
+    }
+
+    now = simple_archiver_helper_monotonic_ns();
+    if (now >= next_segment
+        || watch->changed_bytes >= parsed->watch_max_changes) {
+      // Errors are printed and the changes are kept for the next segment.
+      simple_archiver_watch_internal_write_segment(watch);
+      next_segment = now + interval_ns;
+    }
+  }
+
+  // Picks up changes made right before the stop was requested.
+  if (simple_archiver_watch_internal_read_events(watch)) {
+    return 1;
+  }
+  return simple_archiver_watch_internal_write_segment(watch);
+#else
+  (void)watch;
+  return 1;
+#endif
+}
@@ -0,0 +1,46 @@
+// ISC License
+//
+// Copyright (c) 2024-2026 Stephen Seo
+//
+// Permission to use, copy, modify, and/or distribute this software for any
+// purpose with or without fee is hereby granted, provided that the above
+// copyright notice and this permission notice appear in all copies.
+//
+// THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+// REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+// AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+// INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+// LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+// OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+// PERFORMANCE OF THIS SOFTWARE.
+//
+// `watch.h` is the header for continuously archiving changed files.
+
+#ifndef SEODISPARATE_COM_SIMPLE_ARCHIVER_WATCH_H_
+#define SEODISPARATE_COM_SIMPLE_ARCHIVER_WATCH_H_
+
+// Local includes.
+#include "archiver.h"
+
+typedef struct SDArchiverWatch SDArchiverWatch;
+
+/// Starts watching the directories given as positional arguments of
+/// "state->parsed", so it should be called before the initial archive is
+/// written. Only supported on Linux.
+/// Returns NULL on error. Returned pointer must be free'd with
+/// "simple_archiver_watch_free".
+SDArchiverWatch *simple_archiver_watch_begin(const SDArchiverState *state);
+
+void simple_archiver_watch_free(SDArchiverWatch **watch);
+
+/// Writes the entries changed since "simple_archiver_watch_begin" as archive
+/// segments named "<archive>.<n>" every "watch_interval" seconds or every
+/// "watch_max_changes" bytes of changed files, until SIGINT, SIGHUP, or
+/// SIGTERM, which writes the last segment. Segments are written with the same
+/// options (and "write_version") as the initial archive. Paths deleted during
+/// a segment are listed in "<archive>.<n>.deleted", each followed by a NULL;
+/// extracting a segment does not remove them.
+/// Returns zero on success.
+int simple_archiver_watch_run(SDArchiverWatch *watch);
+
+#endif